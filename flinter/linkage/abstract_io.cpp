@@ -0,0 +1,51 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "flinter/linkage/abstract_io.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+namespace flinter {
+
+AbstractIo::Status AbstractIo::SendFile(int fd,
+                                        int64_t offset,
+                                        size_t length,
+                                        size_t *retlen)
+{
+    // One TLS record, which is where this is mostly used.
+    unsigned char buffer[16384];
+
+    if (fd < 0 || offset < 0 || !length) {
+        return kStatusBug;
+    } else if (length > sizeof(buffer)) {
+        length = sizeof(buffer);
+    }
+
+    ssize_t ret;
+    do {
+        ret = pread(fd, buffer, length, static_cast<off_t>(offset));
+    } while (ret < 0 && errno == EINTR);
+
+    // Truncated since queued.
+    if (ret <= 0) {
+        return kStatusError;
+    }
+
+    return Write(buffer, static_cast<size_t>(ret), retlen);
+}
+
+} // namespace flinter
@@ -16,10 +16,15 @@
 #ifndef FLINTER_LINKAGE_ABSTRACT_IO_H
 #define FLINTER_LINKAGE_ABSTRACT_IO_H
 
+#include <sys/uio.h>
 #include <stddef.h>
+#include <stdint.h>
 
 namespace flinter {
 
+class LinkageBase;
+class LinkageWorker;
+
 class AbstractIo {
 public:
     enum Status {
@@ -30,6 +35,7 @@ public:
         kStatusClosed       = -4, // Action completed with failures.
         kStatusWannaRead    = -5, // Action incomplete, should call again.
         kStatusWannaWrite   = -6, // Action incomplete, should call again.
+        kStatusPending      = -7, // Action incomplete, will be resumed.
     }; // enum Status
 
     enum Action {
@@ -55,10 +61,41 @@ public:
     /// @param more set to false before calling.
     virtual Status Read(void *buffer, size_t length, size_t *retlen, bool *more) = 0;
     virtual Status Write(const void *buffer, size_t length, size_t *retlen) = 0;
+
+    // Scatter/gather version of Write(), pieces are written in order and
+    //     retlen counts bytes across all of them. If it's incomplete, call
+    //     again with exactly the same bytes.
+    // By default only the first piece is written, which is a valid partial
+    //     write, override it to do better.
+    virtual Status Writev(const struct iovec *iov, size_t count, size_t *retlen)
+    {
+        if (!iov || !count) {
+            return kStatusBug;
+        }
+
+        return Write(iov[0].iov_base, iov[0].iov_len, retlen);
+    }
+
+    // Write bytes of a file, in order with what's written before. Plain
+    //     sockets and kTLS have the kernel send them without copying. By
+    //     default bytes are read into a buffer and then Write() them, so if
+    //     it's incomplete, call again with exactly the same range.
+    /// @param fd a regular file.
+    virtual Status SendFile(int fd, int64_t offset, size_t length, size_t *retlen);
+
     virtual Status Shutdown() = 0;
     virtual Status Connect() = 0;
     virtual Status Accept() = 0;
 
+    // Some underlying I/O carry out actions in other threads, they return
+    //     kStatusPending and then LinkageWorker::Resume() the linkage within
+    //     the worker thread, where the same action is called again for the
+    //     result. Nothing else is called in between.
+    /// @param worker life span NOT taken, NULL when detached.
+    /// @param linkage life span NOT taken.
+    virtual void SetOwner(LinkageWorker * /*worker*/,
+                          LinkageBase * /*linkage*/) {}
+
 }; // class AbstractIo
 
 } // namespace flinter
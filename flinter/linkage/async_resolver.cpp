@@ -0,0 +1,1075 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flinter/linkage/async_resolver.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#include "flinter/linkage/interface.h"
+#include "flinter/linkage/linkage_base.h"
+#include "flinter/linkage/linkage_worker.h"
+#include "flinter/logger.h"
+#include "flinter/safeio.h"
+#include "flinter/utility.h"
+
+namespace flinter {
+
+static const uint16_t kTypeA        = 1;
+static const uint16_t kTypeCname    = 5;
+static const uint16_t kTypeSoa      = 6;
+static const uint16_t kTypeAaaa     = 28;
+static const uint16_t kClassIn      = 1;
+
+static const uint16_t kFlagResponse  = 0x8000;
+static const uint16_t kFlagTruncated = 0x0200;
+static const uint16_t kFlagRecursion = 0x0100;
+static const uint16_t kRcodeMask     = 0x000f;
+static const uint16_t kRcodeNoError  = 0;
+static const uint16_t kRcodeNxDomain = 3;
+
+static const size_t kHeaderSize = 12;
+static const size_t kMaximumName = 253;
+static const size_t kMaximumLabel = 63;
+static const size_t kMaximumPacket = 4096;
+static const size_t kMaximumNameservers = 3;
+static const int kMaximumReceive = 64;
+
+static const int64_t kSecond = 1000000000LL;
+static const int64_t kAgingInterval = 60000000000LL; ///< 1min
+
+struct AsyncResolver::query_t {
+    key_t key;                          ///< Domain and hostname as asked.
+    std::vector<std::string> names;     ///< Search list applied.
+    std::list<Callback *> callbacks;    ///< Coalesced lookups.
+    size_t name;                        ///< Which name is being asked.
+    size_t server;                      ///< Which nameserver is asked.
+    int tries;                          ///< For the current name.
+    bool failed;                        ///< Any name failed to resolve.
+    Socket *socket;                     ///< For the current try.
+    uint16_t id;
+    int64_t deadline;
+    int64_t ttl;                        ///< Negative TTL so far, <0 unknown.
+}; // struct AsyncResolver::query_t
+
+struct record_t {
+    std::string name;
+    std::string target;                 ///< CNAME or SOA MNAME.
+    uint16_t type;
+    uint16_t klass;
+    uint32_t ttl;
+    size_t rdata;
+    size_t rdlength;
+}; // struct record_t
+
+struct AsyncResolver::cache_t {
+    int64_t expire;
+    Result result;
+    std::vector<address_t> addresses;
+}; // struct AsyncResolver::cache_t
+
+/// One for each try, released by the worker once retired.
+class AsyncResolver::Socket : public LinkageBase {
+public:
+    Socket(AsyncResolver *resolver, struct query_t *query)
+            : _resolver(resolver), _query(query) {}
+
+    virtual ~Socket() {}
+
+    bool Connect(const struct nameserver_t &nameserver);
+    bool Send(const std::string &packet);
+    void Schedule(LinkageWorker *worker, int64_t when);
+
+    /// Answers are no longer wanted, released as soon as the worker calls it.
+    void Retire()
+    {
+        _query = NULL;
+    }
+
+    virtual ssize_t GetMessageLength(const void *buffer, size_t length);
+    virtual int OnReceived(const void *buffer, size_t length);
+    virtual void OnError(bool reading_or_writing, int errnum);
+    virtual int OnMessage(const void *buffer, size_t length);
+    virtual void OnDisconnected();
+    virtual bool OnConnected();
+
+    virtual int Disconnect(bool finish_write = true);
+    virtual bool Attach(LinkageWorker *worker);
+    virtual bool Detach(LinkageWorker *worker);
+    virtual bool Cleanup(int64_t now);
+
+protected:
+    virtual int OnReadable(LinkageWorker *worker);
+    virtual int OnWritable(LinkageWorker *worker);
+
+private:
+    AsyncResolver *const _resolver;
+    struct query_t *_query;
+    Interface _interface;
+
+}; // class AsyncResolver::Socket
+
+bool AsyncResolver::Socket::Connect(const struct nameserver_t &nameserver)
+{
+    Interface::Socket s;
+    s.domain = nameserver.domain;
+    s.type = SOCK_DGRAM;
+    s.socket_hostname = nameserver.host.c_str();
+    s.socket_port = nameserver.port;
+
+    Interface::Option o;
+    o.socket_close_on_exec = true;
+    o.socket_non_blocking = true;
+
+    // Numeric, won't block. Connected so that the kernel drops datagrams from
+    // anywhere else and reports ICMP errors. Not bound, the kernel picks a
+    // random ephemeral port.
+    return _interface.Connect(s, o) >= 0;
+}
+
+bool AsyncResolver::Socket::Send(const std::string &packet)
+{
+    ssize_t ret = safe_write(_interface.fd(), packet.data(), packet.length());
+    if (ret != static_cast<ssize_t>(packet.length())) {
+        CLOG.Verbose("AsyncResolver: failed to send to nameserver: %d: %s",
+                     errno, strerror(errno));
+
+        return false;
+    }
+
+    return true;
+}
+
+void AsyncResolver::Socket::Schedule(LinkageWorker *worker, int64_t when)
+{
+    DoSetCleanup(worker, when);
+}
+
+bool AsyncResolver::Socket::Attach(LinkageWorker *worker)
+{
+    return DoAttach(worker, _interface.fd(), true, false, true);
+}
+
+bool AsyncResolver::Socket::Detach(LinkageWorker *worker)
+{
+    return DoDetach(worker);
+}
+
+// Retired sockets are released by returning false or 0, never detached
+// within callbacks.
+bool AsyncResolver::Socket::Cleanup(int64_t now)
+{
+    if (_query) {
+        _resolver->Expire(_query, now, false);
+    }
+
+    return _query != NULL;
+}
+
+int AsyncResolver::Socket::OnReadable(LinkageWorker * /*worker*/)
+{
+    unsigned char buffer[kMaximumPacket];
+    for (int i = 0; i < kMaximumReceive && _query; ++i) {
+        ssize_t ret = safe_read(_interface.fd(), buffer, sizeof(buffer));
+        if (ret >= 0) {
+            _resolver->OnPacket(_query, buffer, static_cast<size_t>(ret));
+            continue;
+
+        } else if (errno == ECONNREFUSED) {
+            // Nobody's listening, don't wait for timeouts.
+            _resolver->Expire(_query, get_monotonic_timestamp(), true);
+            continue;
+        }
+
+        break;
+    }
+
+    return _query ? 1 : 0;
+}
+
+int AsyncResolver::Socket::OnWritable(LinkageWorker * /*worker*/)
+{
+    return 1;
+}
+
+ssize_t AsyncResolver::Socket::GetMessageLength(const void * /*buffer*/,
+                                                size_t /*length*/)
+{
+    return -1; // The hell?
+}
+
+int AsyncResolver::Socket::OnMessage(const void * /*buffer*/, size_t /*length*/)
+{
+    return -1; // The hell?
+}
+
+int AsyncResolver::Socket::OnReceived(const void * /*buffer*/, size_t /*length*/)
+{
+    return -1; // The hell?
+}
+
+void AsyncResolver::Socket::OnError(bool /*reading_or_writing*/, int /*errnum*/)
+{
+    // Intended left blank.
+}
+
+void AsyncResolver::Socket::OnDisconnected()
+{
+    // The worker is quitting.
+    if (_query) {
+        _query->socket = NULL;
+    }
+}
+
+bool AsyncResolver::Socket::OnConnected()
+{
+    return true;
+}
+
+int AsyncResolver::Socket::Disconnect(bool /*finish_write*/)
+{
+    return 0;
+}
+
+static inline uint16_t Read16(const unsigned char *p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t Read32(const unsigned char *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) |
+           (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) <<  8) |
+            static_cast<uint32_t>(p[3]);
+}
+
+static inline void Write16(std::string *s, uint16_t value)
+{
+    s->push_back(static_cast<char>(value >> 8));
+    s->push_back(static_cast<char>(value & 0xff));
+}
+
+static void ToLower(std::string *s)
+{
+    std::transform(s->begin(), s->end(), s->begin(), ::tolower);
+}
+
+/// Read a possibly compressed name in lower case.
+static bool ReadName(const unsigned char *packet, size_t length,
+                     size_t *offset, std::string *name)
+{
+    size_t o = *offset;
+    size_t end = 0;
+    int jumps = 0;
+
+    name->clear();
+    while (true) {
+        if (o >= length) {
+            return false;
+        }
+
+        size_t l = packet[o];
+        if ((l & 0xc0) == 0xc0) {
+            if (o + 1 >= length || ++jumps > 16) {
+                return false;
+            } else if (!end) {
+                end = o + 2;
+            }
+
+            o = ((l & 0x3f) << 8) | packet[o + 1];
+            continue;
+
+        } else if (l & 0xc0) {
+            return false;
+
+        } else if (!l) {
+            break;
+        }
+
+        if (o + 1 + l > length) {
+            return false;
+        }
+
+        if (!name->empty()) {
+            name->push_back('.');
+        }
+
+        name->append(reinterpret_cast<const char *>(packet + o + 1), l);
+        if (name->length() > kMaximumName) {
+            return false;
+        }
+
+        o += 1 + l;
+    }
+
+    *offset = end ? end : o + 1;
+    ToLower(name);
+    return true;
+}
+
+static bool IsValidName(const std::string &name)
+{
+    if (name.empty() || name.length() > kMaximumName) {
+        return false;
+    }
+
+    size_t label = 0;
+    for (std::string::const_iterator p = name.begin(); p != name.end(); ++p) {
+        if (*p != '.') {
+            if (++label > kMaximumLabel) {
+                return false;
+            }
+
+        } else if (!label) {
+            return false;
+
+        } else {
+            label = 0;
+        }
+    }
+
+    return label > 0;
+}
+
+AsyncResolver::Option::Option()
+        : ndots(1)
+        , attempts(2)
+        , timeout(5000000000LL)
+        , minimum_ttl(0)
+        , maximum_ttl(3600000000000LL)
+        , negative_ttl(0)
+        , maximum_entries(65536)
+{
+    // Intended left blank.
+}
+
+bool AsyncResolver::Option::Load(const std::string &resolv_conf)
+{
+    nameservers.clear();
+    search.clear();
+    hosts = "/etc/hosts";
+
+    std::ifstream file(resolv_conf.c_str());
+    std::string line;
+    while (std::getline(file, line)) {
+        std::string::size_type p = line.find_first_of("#;");
+        if (p != std::string::npos) {
+            line.erase(p);
+        }
+
+        std::istringstream s(line);
+        std::string keyword;
+        std::string value;
+        if (!(s >> keyword)) {
+            continue;
+        }
+
+        if (keyword == "nameserver") {
+            if (s >> value && nameservers.size() < kMaximumNameservers) {
+                nameservers.push_back(value);
+            }
+
+        } else if (keyword == "domain" || keyword == "search") {
+            search.clear();
+            while (s >> value) {
+                if (value.length() > 1 && value[value.length() - 1] == '.') {
+                    value.erase(value.length() - 1);
+                }
+
+                search.push_back(value);
+            }
+
+        } else if (keyword == "options") {
+            while (s >> value) {
+                if (value.compare(0, 6, "ndots:") == 0) {
+                    ndots = std::min(atoi(value.c_str() + 6), 15);
+                } else if (value.compare(0, 8, "timeout:") == 0) {
+                    timeout = std::max(atoi(value.c_str() + 8), 1) * kSecond;
+                } else if (value.compare(0, 9, "attempts:") == 0) {
+                    attempts = std::max(atoi(value.c_str() + 9), 1);
+                }
+            }
+        }
+    }
+
+    // Same as glibc.
+    if (nameservers.empty()) {
+        nameservers.push_back("127.0.0.1");
+    }
+
+    return !file.bad() && file.eof();
+}
+
+AsyncResolver::AsyncResolver()
+        : _worker(NULL)
+        , _last_aging(get_monotonic_timestamp())
+        , _seed(randomize_r())
+        , _random(-1)
+        , _remaining(0)
+        , _calling(NULL)
+{
+    // Intended left blank.
+}
+
+AsyncResolver::~AsyncResolver()
+{
+    // Sockets belong to the worker, which has released them if it has quit.
+    for (query_map_t::iterator p = _queries.begin(); p != _queries.end(); ++p) {
+        if (p->second->socket) {
+            p->second->socket->Retire();
+        }
+
+        delete p->second;
+    }
+
+    if (_random >= 0) {
+        safe_close(_random);
+    }
+}
+
+bool AsyncResolver::ParseNameserver(const std::string &nameserver,
+                                    struct nameserver_t *parsed)
+{
+    // "1.2.3.4", "1.2.3.4:53", "::1" or "[::1]:53".
+    std::string host = nameserver;
+    std::string port;
+    int domain = AF_INET;
+    if (!host.empty() && host[0] == '[') {
+        std::string::size_type p = host.find(']');
+        if (p == std::string::npos) {
+            return false;
+        } else if (p + 1 < host.length()) {
+            if (host[p + 1] != ':') {
+                return false;
+            }
+
+            port = host.substr(p + 2);
+        }
+
+        host = host.substr(1, p - 1);
+        domain = AF_INET6;
+
+    } else if (std::count(host.begin(), host.end(), ':') > 1) {
+        domain = AF_INET6;
+
+    } else {
+        std::string::size_type p = host.find(':');
+        if (p != std::string::npos) {
+            port = host.substr(p + 1);
+            host.erase(p);
+        }
+    }
+
+    int n = port.empty() ? 53 : atoi(port.c_str());
+    if (n <= 0 || n > 65535) {
+        return false;
+    }
+
+    parsed->domain = domain;
+    parsed->host = host;
+    parsed->port = static_cast<uint16_t>(n);
+    return true;
+}
+
+bool AsyncResolver::Initialize(LinkageWorker *worker, const Option &option)
+{
+    if (!worker || _worker) {
+        return false;
+    }
+
+    _option = option;
+    if (_option.attempts <= 0) {
+        _option.attempts = 1;
+    }
+
+    if (!_option.hosts.empty() && !LoadHosts(_option.hosts)) {
+        CLOG.Warn("AsyncResolver: failed to load hosts from [%s]",
+                  _option.hosts.c_str());
+    }
+
+    // Connect once to tell bad addresses early.
+    for (std::vector<std::string>::const_iterator p = _option.nameservers.begin();
+         p != _option.nameservers.end(); ++p) {
+
+        struct nameserver_t nameserver;
+        Socket socket(this, NULL);
+        if (!ParseNameserver(*p, &nameserver) || !socket.Connect(nameserver)) {
+            CLOG.Warn("AsyncResolver: invalid nameserver [%s]", p->c_str());
+            continue;
+        }
+
+        _nameservers.push_back(nameserver);
+    }
+
+    _random = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (_random < 0) {
+        CLOG.Warn("AsyncResolver: failed to open /dev/urandom: %d: %s",
+                  errno, strerror(errno));
+    }
+
+    _worker = worker;
+    return true;
+}
+
+uint16_t AsyncResolver::GetRandomId()
+{
+    if (!_remaining && _random >= 0) {
+        if (safe_read(_random, _randoms, sizeof(_randoms)) ==
+            static_cast<ssize_t>(sizeof(_randoms))) {
+
+            _remaining = sizeof(_randoms) / sizeof(*_randoms);
+        }
+    }
+
+    if (_remaining) {
+        return _randoms[--_remaining];
+    }
+
+    // Not good, but better than nothing.
+    return static_cast<uint16_t>(rand_r(&_seed));
+}
+
+bool AsyncResolver::LoadHosts(const std::string &filename)
+{
+    std::ifstream file(filename.c_str());
+    if (!file) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        std::string::size_type p = line.find('#');
+        if (p != std::string::npos) {
+            line.erase(p);
+        }
+
+        std::istringstream s(line);
+        std::string ip;
+        std::string name;
+        if (!(s >> ip)) {
+            continue;
+        }
+
+        address_t address;
+        memset(&address, 0, sizeof(address));
+        if (inet_pton(AF_INET, ip.c_str(), &address.in) == 1) {
+            address.domain = AF_INET;
+        } else if (inet_pton(AF_INET6, ip.c_str(), &address.in6) == 1) {
+            address.domain = AF_INET6;
+        } else {
+            continue;
+        }
+
+        while (s >> name) {
+            ToLower(&name);
+            _hosts[key_t(address.domain, name)].push_back(address);
+        }
+    }
+
+    return true;
+}
+
+AsyncResolver::Result AsyncResolver::Resolve(const std::string &hostname,
+                                             int domain,
+                                             std::vector<address_t> *addresses,
+                                             Callback *callback)
+{
+    if (!addresses || (domain != AF_INET && domain != AF_INET6)) {
+        return kResultFailed;
+    }
+
+    address_t address;
+    memset(&address, 0, sizeof(address));
+    address.domain = domain;
+    if (inet_pton(domain, hostname.c_str(), &address.in6) == 1) {
+        addresses->assign(1, address);
+        return kResultOk;
+    }
+
+    // Keep the trailing dot, search domains are not applied to it.
+    key_t key(domain, hostname);
+    ToLower(&key.second);
+    std::string name = key.second;
+    if (name.length() > 1 && name[name.length() - 1] == '.') {
+        name.erase(name.length() - 1);
+    }
+
+    if (!IsValidName(name)) {
+        return kResultNotFound;
+    }
+
+    hosts_t::const_iterator h = _hosts.find(key_t(domain, name));
+    if (h != _hosts.end()) {
+        *addresses = h->second;
+        return kResultOk;
+    }
+
+    Result result;
+    const int64_t now = get_monotonic_timestamp();
+    if (Lookup(key, now, &result, addresses)) {
+        return result;
+    }
+
+    if (_nameservers.empty() || !callback) {
+        return kResultFailed;
+    }
+
+    query_map_t::iterator p = _queries.find(key);
+    if (p != _queries.end()) {
+        p->second->callbacks.push_back(callback);
+        return kResultPending;
+    }
+
+    struct query_t *query = new struct query_t;
+    query->key = key;
+    query->callbacks.push_back(callback);
+    _queries.insert(std::make_pair(key, query));
+
+    if (!Start(query, now)) {
+        _queries.erase(key);
+        delete query;
+        return kResultFailed;
+    }
+
+    return kResultPending;
+}
+
+void AsyncResolver::Cancel(Callback *callback)
+{
+    for (query_map_t::iterator p = _queries.begin(); p != _queries.end(); ++p) {
+        p->second->callbacks.remove(callback);
+    }
+
+    if (_calling) {
+        _calling->remove(callback);
+    }
+}
+
+bool AsyncResolver::Start(struct query_t *query, int64_t now)
+{
+    // Like res_search(3), names with enough dots are tried as is first.
+    const std::string &hostname = query->key.second;
+    size_t dots = static_cast<size_t>(std::count(hostname.begin(), hostname.end(), '.'));
+    bool as_is_first = dots >= static_cast<size_t>(_option.ndots);
+
+    if (hostname[hostname.length() - 1] == '.') {
+        query->names.push_back(hostname.substr(0, hostname.length() - 1));
+
+    } else {
+        if (as_is_first) {
+            query->names.push_back(hostname);
+        }
+
+        for (std::vector<std::string>::const_iterator p = _option.search.begin();
+             p != _option.search.end(); ++p) {
+
+            std::string name = hostname + "." + *p;
+            ToLower(&name);
+            if (IsValidName(name)) {
+                query->names.push_back(name);
+            }
+        }
+
+        if (!as_is_first) {
+            query->names.push_back(hostname);
+        }
+    }
+
+    query->name = 0;
+    query->server = 0;
+    query->tries = 0;
+    query->failed = false;
+    query->socket = NULL;
+    query->id = 0;
+    query->deadline = 0;
+    query->ttl = -1;
+    return Send(query, now);
+}
+
+bool AsyncResolver::Send(struct query_t *query, int64_t now)
+{
+    if (query->socket) {
+        query->socket->Retire();
+        query->socket = NULL;
+    }
+
+    // A new socket and id for every try, answers to earlier tries are simply
+    // dropped along with their sockets.
+    query->id = GetRandomId();
+    query->server = static_cast<size_t>(query->tries) % _nameservers.size();
+    query->deadline = now + _option.timeout;
+
+    Socket *socket = new Socket(this, query);
+    if (!socket->Connect(_nameservers[query->server])) {
+        CLOG.Warn("AsyncResolver: failed to open socket: %d: %s",
+                  errno, strerror(errno));
+
+        delete socket;
+        return false;
+
+    } else if (!socket->Attach(_worker)) {
+        delete socket;
+        return false;
+    }
+
+    query->socket = socket;
+
+    std::string packet;
+    const int domain = query->key.first;
+    if (!BuildQuery(query->names[query->name], domain, query->id, &packet) ||
+        !socket->Send(packet)) {
+
+        // Try the next one shortly.
+        query->deadline = now;
+    }
+
+    socket->Schedule(_worker, query->deadline);
+    return true;
+}
+
+void AsyncResolver::Dispatch(struct query_t *query, int64_t now)
+{
+    // Running out of sockets, other nameservers won't help.
+    if (!Send(query, now)) {
+        std::vector<address_t> empty;
+        Finish(query, kResultFailed, 0, empty);
+    }
+}
+
+void AsyncResolver::Retry(struct query_t *query, int64_t now)
+{
+    int total = _option.attempts * static_cast<int>(_nameservers.size());
+    if (++query->tries >= total) {
+        Next(query, true, now);
+        return;
+    }
+
+    Dispatch(query, now);
+}
+
+void AsyncResolver::Next(struct query_t *query, bool failed, int64_t now)
+{
+    query->failed = query->failed || failed;
+    query->tries = 0;
+    if (++query->name < query->names.size()) {
+        Dispatch(query, now);
+        return;
+    }
+
+    // Don't remember the name doesn't exist if any nameserver failed.
+    std::vector<address_t> empty;
+    if (query->failed) {
+        Finish(query, kResultFailed, 0, empty);
+    } else {
+        Finish(query, kResultNotFound, query->ttl, empty);
+    }
+}
+
+void AsyncResolver::Finish(struct query_t *query, Result result, int64_t ttl,
+                           const std::vector<address_t> &addresses)
+{
+    if (query->socket) {
+        query->socket->Retire();
+    }
+
+    const key_t key = query->key;
+    _queries.erase(key);
+
+    std::list<Callback *> callbacks;
+    callbacks.swap(query->callbacks);
+    delete query;
+
+    if (result == kResultNotFound && ttl < 0) {
+        ttl = _option.negative_ttl;
+    }
+
+    if (result != kResultFailed) {
+        Store(key, result, ttl, get_monotonic_timestamp(), addresses);
+    }
+
+    CLOG.Verbose("AsyncResolver: resolved [%s] to %lu result(s).",
+                 key.second.c_str(), addresses.size());
+
+    // Callbacks might cancel each other.
+    std::list<Callback *> *calling = _calling;
+    _calling = &callbacks;
+    while (!callbacks.empty()) {
+        Callback *callback = callbacks.front();
+        callbacks.pop_front();
+        callback->OnResolved(key.second, key.first, result, addresses);
+    }
+
+    _calling = calling;
+}
+
+bool AsyncResolver::BuildQuery(const std::string &name, int domain,
+                               uint16_t id, std::string *packet) const
+{
+    if (!IsValidName(name)) {
+        return false;
+    }
+
+    packet->clear();
+    Write16(packet, id);
+    Write16(packet, kFlagRecursion);
+    Write16(packet, 1); // QDCOUNT
+    Write16(packet, 0); // ANCOUNT
+    Write16(packet, 0); // NSCOUNT
+    Write16(packet, 0); // ARCOUNT
+
+    std::string::size_type begin = 0;
+    while (begin < name.length()) {
+        std::string::size_type end = name.find('.', begin);
+        if (end == std::string::npos) {
+            end = name.length();
+        }
+
+        packet->push_back(static_cast<char>(end - begin));
+        packet->append(name, begin, end - begin);
+        begin = end + 1;
+    }
+
+    packet->push_back('\0');
+    Write16(packet, domain == AF_INET6 ? kTypeAaaa : kTypeA);
+    Write16(packet, kClassIn);
+    return true;
+}
+
+void AsyncResolver::OnPacket(struct query_t *query,
+                             const unsigned char *packet,
+                             size_t length)
+{
+    if (length < kHeaderSize) {
+        return;
+    }
+
+    const uint16_t id      = Read16(packet);
+    const uint16_t flags   = Read16(packet + 2);
+    const uint16_t qdcount = Read16(packet + 4);
+    const uint16_t ancount = Read16(packet + 6);
+    const uint16_t nscount = Read16(packet + 8);
+    if (!(flags & kFlagResponse) || qdcount != 1) {
+        return;
+    }
+
+    if (id != query->id) {
+        return;
+    }
+
+    const int domain = query->key.first;
+    const uint16_t type = domain == AF_INET6 ? kTypeAaaa : kTypeA;
+    const size_t size = domain == AF_INET6 ? sizeof(struct in6_addr)
+                                           : sizeof(struct in_addr);
+
+    // The question must be exactly what's asked.
+    std::string qname;
+    size_t offset = kHeaderSize;
+    if (!ReadName(packet, length, &offset, &qname) || offset + 4 > length ||
+        Read16(packet + offset) != type || Read16(packet + offset + 2) != kClassIn ||
+        qname != query->names[query->name]) {
+
+        return;
+    }
+
+    offset += 4;
+    const int64_t now = get_monotonic_timestamp();
+    const uint16_t rcode = flags & kRcodeMask;
+    if (rcode != kRcodeNoError && rcode != kRcodeNxDomain) {
+        Retry(query, now);
+        return;
+    }
+
+    std::vector<record_t> records;
+    for (size_t i = 0; i < static_cast<size_t>(ancount) + nscount; ++i) {
+        record_t r;
+        if (!ReadName(packet, length, &offset, &r.name) || offset + 10 > length) {
+            return;
+        }
+
+        r.type     = Read16(packet + offset);
+        r.klass    = Read16(packet + offset + 2);
+        r.ttl      = Read32(packet + offset + 4);
+        r.rdlength = Read16(packet + offset + 8);
+        r.rdata    = offset + 10;
+        offset = r.rdata + r.rdlength;
+        if (offset > length) {
+            return;
+        }
+
+        // TTL with the highest bit set means zero, see RFC 2181.
+        if (r.ttl > 0x7fffffffu) {
+            r.ttl = 0;
+        }
+
+        if (r.type == kTypeCname || r.type == kTypeSoa) {
+            size_t o = r.rdata;
+            if (!ReadName(packet, length, &o, &r.target)) {
+                return;
+            }
+
+            // SOA MINIMUM is the last field of the RDATA.
+            if (r.type == kTypeSoa && r.rdlength >= 4) {
+                uint32_t minimum = Read32(packet + r.rdata + r.rdlength - 4);
+                r.ttl = std::min(r.ttl, minimum);
+            }
+        }
+
+        records.push_back(r);
+    }
+
+    // Follow CNAME chains in the answer section.
+    std::set<std::string> chain;
+    chain.insert(qname);
+    uint32_t ttl = 0xffffffffu;
+    for (size_t pass = 0; pass < ancount; ++pass) {
+        bool grown = false;
+        for (size_t i = 0; i < ancount; ++i) {
+            const record_t &r = records[i];
+            if (r.type == kTypeCname && chain.count(r.name) && !chain.count(r.target)) {
+                chain.insert(r.target);
+                ttl = std::min(ttl, r.ttl);
+                grown = true;
+            }
+        }
+
+        if (!grown) {
+            break;
+        }
+    }
+
+    std::vector<address_t> addresses;
+    for (size_t i = 0; i < ancount; ++i) {
+        const record_t &r = records[i];
+        if (r.type != type || r.klass != kClassIn || r.rdlength != size ||
+            !chain.count(r.name)) {
+
+            continue;
+        }
+
+        address_t address;
+        memset(&address, 0, sizeof(address));
+        address.domain = domain;
+        memcpy(&address.in6, packet + r.rdata, size);
+        addresses.push_back(address);
+        ttl = std::min(ttl, r.ttl);
+    }
+
+    if (!addresses.empty()) {
+        Finish(query, kResultOk, static_cast<int64_t>(ttl) * kSecond, addresses);
+        return;
+    }
+
+    // Answers didn't fit and there's no TCP fallback, try another nameserver.
+    if (flags & kFlagTruncated) {
+        Retry(query, now);
+        return;
+    }
+
+    // NXDOMAIN or NODATA, the SOA tells how long to remember it.
+    for (size_t i = ancount; i < records.size(); ++i) {
+        const record_t &r = records[i];
+        if (r.type == kTypeSoa) {
+            int64_t negative = static_cast<int64_t>(r.ttl) * kSecond;
+            if (query->ttl < 0 || negative < query->ttl) {
+                query->ttl = negative;
+            }
+        }
+    }
+
+    Next(query, false, now);
+}
+
+void AsyncResolver::Expire(struct query_t *query, int64_t now, bool everything)
+{
+    Aging(now);
+
+    if (everything || query->deadline <= now) {
+        Retry(query, now);
+        return;
+    }
+
+    query->socket->Schedule(_worker, query->deadline);
+}
+
+bool AsyncResolver::Lookup(const key_t &key, int64_t now, Result *result,
+                           std::vector<address_t> *addresses)
+{
+    cache_map_t::iterator p = _cache.find(key);
+    if (p == _cache.end()) {
+        return false;
+    } else if (p->second.expire <= now) {
+        _cache.erase(p);
+        return false;
+    }
+
+    *result = p->second.result;
+    *addresses = p->second.addresses;
+    return true;
+}
+
+void AsyncResolver::Store(const key_t &key, Result result, int64_t ttl,
+                          int64_t now, const std::vector<address_t> &addresses)
+{
+    ttl = std::min(std::max(ttl, _option.minimum_ttl), _option.maximum_ttl);
+    if (ttl <= 0) {
+        return;
+    }
+
+    if (_cache.size() >= _option.maximum_entries) {
+        _last_aging = 0;
+        Aging(now);
+        if (_cache.size() >= _option.maximum_entries) {
+            return;
+        }
+    }
+
+    struct cache_t &cache = _cache[key];
+    cache.expire = now + ttl;
+    cache.result = result;
+    cache.addresses = addresses;
+}
+
+void AsyncResolver::Aging(int64_t now)
+{
+    if (now - _last_aging < kAgingInterval) {
+        return;
+    }
+
+    _last_aging = now;
+    for (cache_map_t::iterator p = _cache.begin(); p != _cache.end();) {
+        cache_map_t::iterator q = p++;
+        if (q->second.expire <= now) {
+            _cache.erase(q);
+        }
+    }
+}
+
+void AsyncResolver::Clear()
+{
+    _cache.clear();
+}
+
+} // namespace flinter
@@ -0,0 +1,199 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLINTER_LINKAGE_ASYNC_RESOLVER_H
+#define FLINTER_LINKAGE_ASYNC_RESOLVER_H
+
+#include <netinet/in.h>
+#include <sys/types.h>
+#include <stdint.h>
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <flinter/common.h>
+
+namespace flinter {
+
+class LinkageWorker;
+
+/// AsyncResolver looks up A/AAAA records without blocking a LinkageWorker.
+///
+/// Names are looked up in the hosts file first, then sent to nameservers over
+/// UDP, following search domains like resolv.conf(5) says. Answers are cached
+/// as long as their TTL, and so are names that don't exist (RFC 2308).
+/// Concurrent lookups for the same name share the same query.
+///
+/// Every try is sent from a new socket, so it comes from a port the kernel
+/// picks at random, with an id read from /dev/urandom. Guessing both makes
+/// spoofing answers a lot harder than guessing the id alone.
+///
+/// Everything must be called within the worker thread, except that it can be
+/// initialized before the worker runs. Like Listener, it's not released by
+/// the worker, release it only after the worker quits.
+class AsyncResolver {
+public:
+    enum Result {
+        kResultOk       = 0, ///< Resolved to at least one address.
+        kResultPending  = 1, ///< Callback will be called later.
+        kResultNotFound = 2, ///< The name or the record type doesn't exist.
+        kResultFailed   = 3, ///< Nameservers didn't answer, try again later.
+    }; // enum Result
+
+    /// IPv4 or IPv6 depending on what's asked for.
+    struct address_t {
+        int domain;
+        union {
+            struct in_addr in;
+            struct in6_addr in6;
+        };
+    }; // struct address_t
+
+    class Callback {
+    public:
+        virtual ~Callback() {}
+
+        /// Called within the worker thread, it's fine to resolve again.
+        /// @param result never kResultPending.
+        virtual void OnResolved(const std::string &hostname,
+                                int domain,
+                                Result result,
+                                const std::vector<address_t> &addresses) = 0;
+
+    }; // class Callback
+
+    struct Option {
+        /// "1.2.3.4", "1.2.3.4:53", "::1" or "[::1]:53".
+        std::vector<std::string> nameservers;
+        std::vector<std::string> search;
+        std::string hosts;      ///< Path to hosts(5), empty for none.
+        int ndots;
+        int attempts;           ///< Rounds of all nameservers.
+        int64_t timeout;        ///< For each attempt, in nanoseconds.
+        int64_t minimum_ttl;    ///< In nanoseconds.
+        int64_t maximum_ttl;    ///< In nanoseconds.
+        int64_t negative_ttl;   ///< If the nameserver doesn't tell.
+        size_t maximum_entries; ///< Cached names.
+
+        Option();
+
+        /// Read nameservers, search domains and options from resolv.conf(5),
+        /// hosts is set to /etc/hosts.
+        bool Load(const std::string &resolv_conf = "/etc/resolv.conf");
+
+    }; // struct Option
+
+    AsyncResolver();
+    ~AsyncResolver();
+
+    /// Check nameservers, sockets are opened later for each query.
+    /// @param worker life span NOT taken.
+    bool Initialize(LinkageWorker *worker, const Option &option);
+
+    /// Numeric addresses, hosts and cached answers are returned right away.
+    /// @param domain AF_INET or AF_INET6.
+    /// @param addresses filled if kResultOk is returned.
+    /// @param callback life span NOT taken, only kept if kResultPending is
+    ///                 returned, Cancel() it before it's gone.
+    Result Resolve(const std::string &hostname,
+                   int domain,
+                   std::vector<address_t> *addresses,
+                   Callback *callback);
+
+    /// The callback won't be called for any pending lookups.
+    void Cancel(Callback *callback);
+
+    /// Invalidate all cache immediately.
+    void Clear();
+
+    size_t pending() const
+    {
+        return _queries.size();
+    }
+
+private:
+    NON_COPYABLE(AsyncResolver);
+
+    class Socket;
+    struct query_t;
+    struct nameserver_t {
+        int domain;
+        std::string host;
+        uint16_t port;
+    }; // struct nameserver_t
+
+    struct cache_t;
+    typedef std::pair<int, std::string> key_t;
+    typedef std::map<key_t, std::vector<address_t> > hosts_t;
+    typedef std::map<key_t, struct cache_t> cache_map_t;
+    typedef std::map<key_t, struct query_t *> query_map_t;
+
+    friend class Socket;
+
+    static bool ParseNameserver(const std::string &nameserver,
+                                struct nameserver_t *parsed);
+
+    bool LoadHosts(const std::string &filename);
+    uint16_t GetRandomId();
+
+    bool Start(struct query_t *query, int64_t now);
+    bool Send(struct query_t *query, int64_t now);
+    void Dispatch(struct query_t *query, int64_t now);
+    void Retry(struct query_t *query, int64_t now);
+    void Next(struct query_t *query, bool failed, int64_t now);
+    void Finish(struct query_t *query, Result result, int64_t ttl,
+                const std::vector<address_t> &addresses);
+
+    bool BuildQuery(const std::string &name, int domain, uint16_t id,
+                    std::string *packet) const;
+
+    void OnPacket(struct query_t *query,
+                  const unsigned char *packet,
+                  size_t length);
+
+    void Expire(struct query_t *query, int64_t now, bool everything);
+
+    bool Lookup(const key_t &key, int64_t now, Result *result,
+                std::vector<address_t> *addresses);
+
+    void Store(const key_t &key, Result result, int64_t ttl, int64_t now,
+               const std::vector<address_t> &addresses);
+
+    void Aging(int64_t now);
+
+    LinkageWorker *_worker;
+    Option _option;
+    std::vector<struct nameserver_t> _nameservers;
+    hosts_t _hosts;
+    cache_map_t _cache;
+    query_map_t _queries;
+    int64_t _last_aging;
+    unsigned int _seed;
+
+    // Ids read from /dev/urandom in batches.
+    int _random;
+    uint16_t _randoms[128];
+    size_t _remaining;
+
+    // Callbacks being called, Cancel() clears them.
+    std::list<Callback *> *_calling;
+
+}; // class AsyncResolver
+
+} // namespace flinter
+
+#endif // FLINTER_LINKAGE_ASYNC_RESOLVER_H
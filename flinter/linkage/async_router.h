@@ -17,16 +17,31 @@
 #define FLINTER_LINKAGE_ASYNC_ROUTER_H
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#include <list>
 #include <string>
+#include <vector>
 
 #include <flinter/linkage/route_handler.h>
-#include <flinter/object_map.h>
-#include <flinter/timeout_pool.h>
+#include <flinter/linkage/timer_wheel.h>
+#include <flinter/thread/mutex.h>
+#include <flinter/thread/mutex_locker.h>
+#include <flinter/thread/spinlock.h>
+#include <flinter/types/atomic.h>
+#include <flinter/types/unordered_map.h>
+#include <flinter/utility.h>
 
 namespace flinter {
 
+/// AsyncRouter picks an outgoing channel for every call and tracks calls in
+/// flight until they're answered or timed out.
+///
+/// Calls are tracked in shards by sequence, each with its own spinlock and
+/// timing wheel, so Get() and Put() from different threads rarely contend and
+/// Cleanup() only costs as much as what has expired. Hosts are read without
+/// locking, each thread takes them in turns on its own.
 template <class key_t,
           class task_t,
           class seq_t = uint64_t,
@@ -62,85 +77,88 @@ public:
     /// @param task if not null, return pointer set in Get(), caller to release.
     bool Put(const seq_t &seq, int rc, task_t **task);
 
+    /// Time out all calls and remove all hosts.
     void Shutdown();
+
+    /// Time out expired calls and reclaim removed hosts, call it periodically.
     void Cleanup();
 
+    /// Drop everything without calling back.
     /// @warning not thread safe.
     void Clear();
 
+    /// Calls in flight.
+    size_t pending() const;
+
 private:
+    static const size_t kShards = 64;
+    static const size_t kWheelSlots = 1024;
+    static const int64_t kWheelResolution = 10000000LL; // 10ms
+
+    // Reference counted by the table listing it and by calls in flight, the
+    // channel is destroyed once it drops to zero. Memory is kept until lock
+    // free readers can't be looking at it.
     struct context_t {
         key_t key;
-        size_t pendings;
         channel_t channel;
-        int64_t last_active;
-
+        atomic_t refs;
+        uint64_t retired; // Epoch flips when removed.
     }; // struct context_t
 
-    class Map : public ObjectMap<key_t, context_t> {
-    public:
-        explicit Map(AsyncRouter *router) : _router(router) {}
-        virtual ~Map() {}
-
-        virtual context_t *Create(const key_t &key)
-        {
-            return _router->CreateConnection(key);
-        }
-
-        virtual void Destroy(context_t *value)
-        {
-            _router->DestroyConnection(value);
-        }
-
-    private:
-        AsyncRouter *const _router;
-
-    }; // class Map
-
-    class Track {
-    public:
-        Track(AsyncRouter *router,
-              const seq_t &seq,
-              task_t *task,
-              context_t *context) : _seq(seq)
-                                  , _task(task)
-                                  , _context(context)
-                                  , _router(router)
-                                  , _done(false) {}
-
-        ~Track()
-        {
-            if (!_done) {
-                _router->OnTimeout(this);
-            }
-        }
-
-        void Done()
-        {
-            _done = true;
-        }
-
-        const seq_t _seq;
-        task_t *const _task;
-        context_t *const _context;
-        AsyncRouter *const _router;
-
-    private:
-        bool _done;
-
-    }; // class Track
-
-    // Called by Map.
-    context_t *CreateConnection(const key_t &key);
-    void DestroyConnection(context_t *context);
-
-    // Called by Track.
-    void OnTimeout(Track *track);
+    // Immutable once published.
+    struct table_t {
+        table_t() : retired(0) {}
+        std::vector<context_t *> contexts;
+        uint64_t retired; // Epoch flips when retired.
+    }; // struct table_t
+
+    // node must be the first member.
+    struct track_t {
+        TimerWheel::node_t node;
+        seq_t seq;
+        task_t *task;
+        context_t *context;
+    }; // struct track_t
+
+    typedef std::unordered_map<seq_t, track_t *> track_map_t;
+
+    struct shard_t {
+        shard_t() : wheel(kWheelResolution, kWheelSlots,
+                          get_monotonic_timestamp()) {}
+
+        Spinlock spinlock;
+        track_map_t tracks;
+        TimerWheel wheel;
+
+    }; // struct shard_t
+
+    shard_t *GetShard(const seq_t &seq);
+    context_t *Acquire();
+    context_t *Pick(const table_t *table);
+    void Release(context_t *context);
+    void Publish(table_t *table);
+    void Retire(context_t *context);
+    void Reclaim();
+    void Expire(track_t *track);
+    void DropAll(bool expire);
 
     RouteHandler<key_t, task_t, seq_t, channel_t> *const _route_handler;
-    TimeoutPool<seq_t, Track *> _timeout;
-    Map *const _map;
-    bool _clearing;
+    const int64_t _default_timeout;
+    typename track_map_t::hasher _hasher;
+    shard_t *const _shards;
+    Atomic<table_t *> _table;
+    atomic_t _cursor;
+
+    // Lock free readers of _table enter either epoch, nobody reads a table
+    // retired before the epoch is flipped twice.
+    atomic_t _epoch;
+    atomic_t _readers[2];
+
+    // Hosts are changed with the mutex held.
+    Mutex _mutex;
+    std::list<context_t *> _contexts;
+    std::list<table_t *> _retired;
+    uint64_t _flips;
 
     AsyncRouter &operator = (const AsyncRouter &);
     explicit AsyncRouter(const AsyncRouter &);
@@ -152,9 +170,12 @@ inline AsyncRouter<K, T, S, C>::AsyncRouter(
         RouteHandler<K, T, S, C> *route_handler,
         int64_t default_timeout)
         : _route_handler(route_handler)
-        , _timeout(default_timeout > 0 ? default_timeout : 5000000000LL)
-        , _map(new Map(this))
-        , _clearing(false)
+        , _default_timeout(default_timeout > 0 ? default_timeout : 5000000000LL)
+        , _shards(new shard_t[kShards])
+        , _table(new table_t)
+        , _cursor(0)
+        , _epoch(0)
+        , _flips(0)
 {
     // Intended left blank.
 }
@@ -163,7 +184,114 @@ template <class K, class T, class S, class C>
 inline AsyncRouter<K, T, S, C>::~AsyncRouter()
 {
     Clear();
-    delete _map;
+    delete _table.Get();
+    delete [] _shards;
+}
+
+template <class K, class T, class S, class C>
+inline typename AsyncRouter<K, T, S, C>::shard_t *
+AsyncRouter<K, T, S, C>::GetShard(const S &seq)
+{
+    // Sequences are often consecutive integers, spread them.
+    uint64_t h = static_cast<uint64_t>(_hasher(seq)) * 0x9e3779b97f4a7c15ull;
+    return &_shards[(h >> 32) % kShards];
+}
+
+template <class K, class T, class S, class C>
+inline typename AsyncRouter<K, T, S, C>::context_t *
+AsyncRouter<K, T, S, C>::Acquire()
+{
+    atomic_t *readers = &_readers[_epoch.Get()];
+    readers->AddAndFetch(1);
+    context_t *c = Pick(_table.BarrierGet());
+    readers->SubAndFetch(1);
+    return c;
+}
+
+template <class K, class T, class S, class C>
+inline typename AsyncRouter<K, T, S, C>::context_t *
+AsyncRouter<K, T, S, C>::Pick(const table_t *table)
+{
+    // Each thread goes round robin on its own.
+    static __thread size_t cursor = 0;
+    if (!cursor) {
+        cursor = static_cast<size_t>(_cursor.AddAndFetch(1)) * 7919;
+    }
+
+    size_t size = table->contexts.size();
+    for (size_t i = 0; i < size; ++i) {
+        context_t *c = table->contexts[++cursor % size];
+
+        // Removed and destroyed, zero is final.
+        int refs = c->refs.Get();
+        while (refs > 0) {
+            int old = c->refs.CompareAndSwap(refs, refs + 1);
+            if (old == refs) {
+                return c;
+            }
+
+            refs = old;
+        }
+    }
+
+    return NULL;
+}
+
+template <class K, class T, class S, class C>
+inline void AsyncRouter<K, T, S, C>::Release(context_t *context)
+{
+    if (context->refs.SubAndFetch(1) == 0) {
+        _route_handler->Destroy(context->channel);
+    }
+}
+
+template <class K, class T, class S, class C>
+inline void AsyncRouter<K, T, S, C>::Publish(table_t *table)
+{
+    table_t *old = _table.BarrierSet(table);
+    old->retired = _flips;
+    _retired.push_back(old);
+}
+
+template <class K, class T, class S, class C>
+inline void AsyncRouter<K, T, S, C>::Retire(context_t *context)
+{
+    context->retired = _flips;
+    Release(context);
+}
+
+template <class K, class T, class S, class C>
+inline void AsyncRouter<K, T, S, C>::Reclaim()
+{
+    // Flip to the other epoch once it's drained, readers still in the current
+    // one must leave before flipping back. Those entering from now on only see
+    // the current table.
+    for (int i = 0; i < 2; ++i) {
+        int epoch = _epoch.Get();
+        if (_readers[epoch ^ 1].BarrierGet()) {
+            break;
+        }
+
+        _epoch.Set(epoch ^ 1);
+        ++_flips;
+    }
+
+    while (!_retired.empty() && _retired.front()->retired + 2 <= _flips) {
+        delete _retired.front();
+        _retired.pop_front();
+    }
+
+    // Removed hosts have been released by the last call in flight.
+    typename std::list<context_t *>::iterator p = _contexts.begin();
+    while (p != _contexts.end()) {
+        if ((*p)->refs.Get() || (*p)->retired + 2 > _flips) {
+            ++p;
+            continue;
+        }
+
+        delete *p;
+        p = _contexts.erase(p);
+    }
 }
 
 template <class K, class T, class S, class C>
@@ -172,12 +300,40 @@ inline bool AsyncRouter<K, T, S, C>::Get(const S &seq,
                                          C *channel,
                                          int64_t timeout)
 {
-    context_t *c = _map->GetNext();
+    context_t *c = Acquire();
     if (!c) {
         return false;
     }
 
-    _timeout.Insert(seq, new Track(this, seq, task, c), timeout);
+    track_t *track = new track_t;
+    TimerWheel::Initialize(&track->node);
+    track->seq = seq;
+    track->task = task;
+    track->context = c;
+
+    int64_t now = get_monotonic_timestamp();
+    int64_t deadline = now + (timeout > 0 ? timeout : _default_timeout);
+    track_t *replaced = NULL;
+
+    shard_t *shard = GetShard(seq);
+    Spinlock::Locker locker(&shard->spinlock, true);
+    std::pair<typename track_map_t::iterator, bool> ret =
+            shard->tracks.insert(std::make_pair(seq, track));
+
+    if (!ret.second) {
+        replaced = ret.first->second;
+        TimerWheel::Cancel(&replaced->node);
+        ret.first->second = track;
+    }
+
+    shard->wheel.Schedule(&track->node, deadline);
+    locker.Unlock();
+
+    // Reusing a sequence times out the previous call.
+    if (replaced) {
+        Expire(replaced);
+    }
+
     *channel = c->channel;
     return true;
 }
@@ -185,108 +341,270 @@ inline bool AsyncRouter<K, T, S, C>::Get(const S &seq,
 template <class K, class T, class S, class C>
 inline bool AsyncRouter<K, T, S, C>::Put(const S &seq, int rc, T **task)
 {
-    Track *track = _timeout.Erase(seq);
-    if (!track) {
+    shard_t *shard = GetShard(seq);
+    Spinlock::Locker locker(&shard->spinlock, true);
+    typename track_map_t::iterator p = shard->tracks.find(seq);
+    if (p == shard->tracks.end()) {
         return false;
     }
 
+    track_t *track = p->second;
+    TimerWheel::Cancel(&track->node);
+    shard->tracks.erase(p);
+    locker.Unlock();
+
     if (rc) {
         // TODO(yiyuanzhong): report call result.
     }
 
     if (task) {
-        *task = track->_task;
+        *task = track->task;
     }
 
-    _map->Release(track->_context->key, track->_context);
-    track->Done();
-
     // Don't delete task, give it back.
+    Release(track->context);
     delete track;
     return true;
 }
 
 template <class K, class T, class S, class C>
-inline void AsyncRouter<K, T, S, C>::Clear()
+inline void AsyncRouter<K, T, S, C>::Expire(track_t *track)
 {
-    _clearing = true;
-    _timeout.Clear();
-    _map->Clear();
-    _clearing = false;
+    _route_handler->OnTimeout(track->seq, track->task);
+    Release(track->context);
+    delete track->task;
+    delete track;
 }
 
 template <class K, class T, class S, class C>
-inline void AsyncRouter<K, T, S, C>::Shutdown()
+inline void AsyncRouter<K, T, S, C>::Cleanup()
 {
-    _timeout.Clear();
-    _map->EraseAll(true);
+    int64_t now = get_monotonic_timestamp();
+    for (size_t i = 0; i < kShards; ++i) {
+        shard_t *shard = &_shards[i];
+        std::vector<track_t *> expired;
+
+        Spinlock::Locker locker(&shard->spinlock, true);
+        shard->wheel.Advance(now);
+        TimerWheel::node_t *node;
+        while ((node = shard->wheel.PopExpired())) {
+            track_t *track = reinterpret_cast<track_t *>(node);
+            shard->tracks.erase(track->seq);
+            expired.push_back(track);
+        }
+
+        locker.Unlock();
+
+        // Call back without locking.
+        for (typename std::vector<track_t *>::iterator p = expired.begin();
+             p != expired.end(); ++p) {
+
+            Expire(*p);
+        }
+    }
+
+    // Don't wait for hosts being changed.
+    if (_mutex.TryLock()) {
+        Reclaim();
+        _mutex.Unlock();
+    }
 }
 
 template <class K, class T, class S, class C>
-inline void AsyncRouter<K, T, S, C>::Cleanup()
+inline void AsyncRouter<K, T, S, C>::DropAll(bool expire)
 {
-    _timeout.Check();
+    for (size_t i = 0; i < kShards; ++i) {
+        shard_t *shard = &_shards[i];
+        track_map_t tracks;
+
+        Spinlock::Locker locker(&shard->spinlock, true);
+        tracks.swap(shard->tracks);
+        for (typename track_map_t::iterator p = tracks.begin();
+             p != tracks.end(); ++p) {
+
+            TimerWheel::Cancel(&p->second->node);
+        }
+
+        locker.Unlock();
+
+        for (typename track_map_t::iterator p = tracks.begin();
+             p != tracks.end(); ++p) {
+
+            if (expire) {
+                Expire(p->second);
+            } else {
+                delete p->second->task;
+                delete p->second;
+            }
+        }
+    }
 }
 
 template <class K, class T, class S, class C>
-inline void AsyncRouter<K, T, S, C>::OnTimeout(Track *track)
+inline void AsyncRouter<K, T, S, C>::Clear()
 {
-    // Don't lock!
-    if (_clearing) {
-        return;
+    DropAll(false);
+
+    MutexLocker locker(&_mutex);
+    for (typename std::list<context_t *>::iterator p = _contexts.begin();
+         p != _contexts.end(); ++p) {
+
+        if ((*p)->refs.Get() > 0) {
+            _route_handler->Destroy((*p)->channel);
+        }
+
+        delete *p;
     }
 
-    _route_handler->OnTimeout(track->_seq, track->_task);
-    _map->Release(track->_context->key, track->_context);
-    delete track->_task;
-}
+    for (typename std::list<table_t *>::iterator p = _retired.begin();
+         p != _retired.end(); ++p) {
 
-template <class K, class T, class S, class C>
-inline void AsyncRouter<K, T, S, C>::Add(const K &host)
-{
-    context_t *c = _map->Add(host);
-    if (!c) {
-        return;
+        delete *p;
     }
 
-    _map->Release(host, c);
+    _contexts.clear();
+    _retired.clear();
+    _table.Get()->contexts.clear();
 }
 
 template <class K, class T, class S, class C>
-inline void AsyncRouter<K, T, S, C>::Del(const K &host)
+inline void AsyncRouter<K, T, S, C>::Shutdown()
 {
-    _map->Erase(host);
+    DropAll(true);
+    SetAll(std::vector<K>());
 }
 
 template <class K, class T, class S, class C>
-template <class A>
-inline void AsyncRouter<K, T, S, C>::SetAll(const A &hosts)
+inline size_t AsyncRouter<K, T, S, C>::pending() const
 {
-    _map->SetAll(hosts);
+    size_t pending = 0;
+    for (size_t i = 0; i < kShards; ++i) {
+        shard_t *shard = &_shards[i];
+        Spinlock::Locker locker(&shard->spinlock, true);
+        pending += shard->tracks.size();
+    }
+
+    return pending;
 }
 
 template <class K, class T, class S, class C>
-inline typename AsyncRouter<K, T, S, C>::context_t *
-AsyncRouter<K, T, S, C>::CreateConnection(const K &key)
+inline void AsyncRouter<K, T, S, C>::Add(const K &host)
 {
-    // Don't lock!
+    MutexLocker locker(&_mutex);
+    const table_t *table = _table.Get();
+    for (typename std::vector<context_t *>::const_iterator
+         p = table->contexts.begin(); p != table->contexts.end(); ++p) {
+
+        if ((*p)->key == host) {
+            return;
+        }
+    }
+
     C channel;
-    if (!_route_handler->Create(key, &channel)) {
-        return NULL;
+    if (!_route_handler->Create(host, &channel)) {
+        return;
     }
 
     context_t *c = new context_t;
+    c->key = host;
     c->channel = channel;
-    c->key = key;
-    return c;
+    c->refs.Set(1);
+    c->retired = 0;
+    _contexts.push_back(c);
+
+    table_t *next = new table_t;
+    next->contexts = table->contexts;
+    next->contexts.push_back(c);
+    Publish(next);
+    Reclaim();
+}
+
+template <class K, class T, class S, class C>
+inline void AsyncRouter<K, T, S, C>::Del(const K &host)
+{
+    MutexLocker locker(&_mutex);
+    const table_t *table = _table.Get();
+    table_t *next = new table_t;
+    context_t *gone = NULL;
+    for (typename std::vector<context_t *>::const_iterator
+         p = table->contexts.begin(); p != table->contexts.end(); ++p) {
+
+        if ((*p)->key == host) {
+            gone = *p;
+        } else {
+            next->contexts.push_back(*p);
+        }
+    }
+
+    if (!gone) {
+        delete next;
+        return;
+    }
+
+    Publish(next);
+    Retire(gone);
+    Reclaim();
 }
 
 template <class K, class T, class S, class C>
-inline void AsyncRouter<K, T, S, C>::DestroyConnection(context_t *value)
+template <class A>
+inline void AsyncRouter<K, T, S, C>::SetAll(const A &hosts)
 {
-    // Don't lock!
-    _route_handler->Destroy(value->channel);
-    delete value;
+    MutexLocker locker(&_mutex);
+    const table_t *table = _table.Get();
+    table_t *next = new table_t;
+    std::vector<context_t *> gone;
+    for (typename std::vector<context_t *>::const_iterator
+         p = table->contexts.begin(); p != table->contexts.end(); ++p) {
+
+        bool found = false;
+        for (typename A::const_iterator q = hosts.begin(); q != hosts.end(); ++q) {
+            if (*q == (*p)->key) {
+                found = true;
+                break;
+            }
+        }
+
+        if (found) {
+            next->contexts.push_back(*p);
+        } else {
+            gone.push_back(*p);
+        }
+    }
+
+    for (typename A::const_iterator q = hosts.begin(); q != hosts.end(); ++q) {
+        bool found = false;
+        for (typename std::vector<context_t *>::const_iterator
+             p = next->contexts.begin(); p != next->contexts.end(); ++p) {
+
+            if ((*p)->key == *q) {
+                found = true;
+                break;
+            }
+        }
+
+        C channel;
+        if (found || !_route_handler->Create(*q, &channel)) {
+            continue;
+        }
+
+        context_t *c = new context_t;
+        c->key = *q;
+        c->channel = channel;
+        c->refs.Set(1);
+        c->retired = 0;
+        _contexts.push_back(c);
+        next->contexts.push_back(c);
+    }
+
+    Publish(next);
+    for (typename std::vector<context_t *>::iterator p = gone.begin();
+         p != gone.end(); ++p) {
+
+        Retire(*p);
+    }
+
+    Reclaim();
 }
 
 } // namespace flinter
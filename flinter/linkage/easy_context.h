@@ -78,13 +78,20 @@ public:
     // Don't call this.
     void set_ssl_peer(const SslPeer *ssl_peer);
 
+    // Don't call this.
+    void set_peer(const LinkagePeer &peer, const LinkagePeer &me)
+    {
+        _peer = peer;
+        _me = me;
+    }
+
 private:
     EasyServer *_easy_server;
     EasyHandler *_easy_handler;
     bool _auto_release_handler;
     channel_t _channel;
-    const LinkagePeer _peer;
-    const LinkagePeer _me;
+    LinkagePeer _peer;
+    LinkagePeer _me;
     const SslPeer *_ssl_peer;
     const int _io_thread_id;
 
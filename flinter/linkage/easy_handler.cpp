@@ -57,6 +57,18 @@ bool EasyHandler::OnConnected(const EasyContext &context)
     return true;
 }
 
+void EasyHandler::OnWriteBlocked(const EasyContext &context)
+{
+    CLOG.Verbose("Linkage: WRITE BLOCKED channel = %llu",
+                 static_cast<unsigned long long>(context.channel()));
+}
+
+void EasyHandler::OnWriteDrained(const EasyContext &context)
+{
+    CLOG.Verbose("Linkage: WRITE DRAINED channel = %llu",
+                 static_cast<unsigned long long>(context.channel()));
+}
+
 bool EasyHandler::Cleanup(const EasyContext &context, int64_t now)
 {
     (void)context;
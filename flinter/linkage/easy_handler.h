@@ -57,6 +57,9 @@ public:
 
     /// Called within worker threads, in case there's none, within I/O threads.
     ///
+    /// buffer points into the very memory that was read from the socket, it's
+    /// kept valid until this call returns but not any longer.
+    ///
     /// @return >0 keep coming.
     /// @return  0 hang up gracefully.
     /// @return <0 error occurred, hang up immediately.
@@ -75,7 +78,19 @@ public:
                          bool reading_or_writing,
                          int errnum);
 
-    /// Called within I/O threads.
+    /// Called within I/O threads, once more than write_high_watermark bytes are
+    /// queued for the channel, the peer is not reading fast enough. Producers
+    /// should hold off sending until OnWriteDrained().
+    /// @sa EasyServer::Configure
+    virtual void OnWriteBlocked(const EasyContext &context);
+
+    /// Called within I/O threads, once queued bytes are back to no more than
+    /// write_low_watermark after OnWriteBlocked().
+    virtual void OnWriteDrained(const EasyContext &context);
+
+    /// Called within I/O threads when any of the timeouts might be due, and
+    /// every second if periodic_cleanup is configured.
+    /// @sa EasyServer::Configure
     virtual bool Cleanup(const EasyContext &context, int64_t now);
 
 }; // class EasyHandler
@@ -15,12 +15,18 @@
 
 #include "flinter/linkage/easy_server.h"
 
+#include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <assert.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <stdexcept>
 
+#include "flinter/linkage/async_resolver.h"
 #include "flinter/linkage/easy_context.h"
 #include "flinter/linkage/easy_handler.h"
 #include "flinter/linkage/easy_tuner.h"
@@ -31,6 +37,8 @@
 #include "flinter/linkage/linkage_peer.h"
 #include "flinter/linkage/linkage_worker.h"
 #include "flinter/linkage/listener.h"
+#include "flinter/linkage/receive_buffer.h"
+#include "flinter/linkage/resolving_io.h"
 #include "flinter/linkage/ssl_io.h"
 
 #include "flinter/thread/condition.h"
@@ -39,12 +47,15 @@
 #include "flinter/thread/mutex_locker.h"
 #include "flinter/thread/scheduler.h"
 
+#include "flinter/types/mpsc_queue.h"
 #include "flinter/types/shared_ptr.h"
+#include "flinter/types/slot_table.h"
 
 #include "flinter/explode.h"
 #include "flinter/openssl.h"
 #include "flinter/runnable.h"
 #include "flinter/logger.h"
+#include "flinter/safeio.h"
 #include "flinter/utility.h"
 
 #include "config.h"
@@ -64,12 +75,21 @@ const EasyServer::Configure EasyServer::kDefaultConfigure = {
     /* outgoing_send_timeout        = */ 5000000000LL,
     /* outgoing_idle_timeout        = */ 60000000000LL,
     /* maximum_active_connections   = */ 50000,
+    /* write_high_watermark         = */ 0,
+    /* write_low_watermark          = */ 0,
+    /* pause_reading_when_blocked   = */ false,
+    /* event_backend                = */ EventBackend::kTypeDefault,
+    /* loop_latency_probe           = */ 0,
+    /* asynchronous_resolving       = */ true,
+    /* periodic_cleanup             = */ false,
 };
 
 EasyServer::ListenOption::ListenOption()
         : easy_factory(NULL)
         , easy_handler(NULL)
         , ssl(NULL)
+        , reuse_port(false)
+        , steer_by_cpu(false)
 {
     listen_socket.domain = AF_INET6;
     listen_socket.type = SOCK_STREAM;
@@ -168,24 +188,47 @@ private:
 class EasyServer::ProxyLinkageWorker : public LinkageWorker {
 public:
     virtual ~ProxyLinkageWorker() {}
-    ProxyLinkageWorker(EasyTuner *tuner,
+    ProxyLinkageWorker(EasyServer *easy_server,
+                       EasyTuner *tuner,
                        int thread_id,
-                       const std::vector<int> &affinities)
-            : _affinities(affinities), _tuner(tuner), _thread_id(thread_id) {}
+                       const std::vector<int> &affinities,
+                       EventBackend::Type backend)
+            : LinkageWorker(backend)
+            , _affinities(affinities)
+            , _easy_server(easy_server)
+            , _tuner(tuner)
+            , _thread_id(thread_id)
+            , _accepted(0) {}
 
     int thread_id() const
     {
         return _thread_id;
     }
 
+    // Only counted by this thread, but read by others.
+    void OnAccepted()
+    {
+        _accepted.AddAndFetch(1);
+    }
+
+    uint64_t accepted() const
+    {
+        return _accepted.Get();
+    }
+
 protected:
     virtual bool OnInitialize();
     virtual void OnShutdown();
 
+    // Small messages sent from other threads, tagged with their channel.
+    virtual void OnCommand(uint64_t tag, const void *buffer, size_t length);
+
 private:
     const std::vector<int> _affinities;
+    EasyServer *const _easy_server;
     EasyTuner *const _tuner;
     const int _thread_id;
+    uatomic64_t _accepted;
 
 }; // class EasyServer::ProxyLinkageWorker
 
@@ -205,6 +248,40 @@ private:
 
 }; // class EasyServer::ProxyListener
 
+// SO_REUSEPORT sockets bound to the same address, one per I/O thread.
+class EasyServer::ListenShard {
+public:
+    ListenShard(ProxyHandler *proxy_handler,
+                const Interface::Option &option,
+                bool steer_by_cpu)
+            : _proxy_handler(proxy_handler)
+            , _option(option)
+            , _steer_by_cpu(steer_by_cpu)
+            , _domain(AF_UNSPEC)
+            , _port(0) {}
+
+    ~ListenShard();
+
+    // Bind the first one, the rest follow its address so ephemeral ports work.
+    bool Listen(EasyServer *easy_server, const Interface::Socket &socket);
+
+    // Bind another one for the I/O thread if not yet.
+    Listener *Get(EasyServer *easy_server, size_t thread_id);
+
+    // Called after all of them are bound.
+    void Steer(size_t slots);
+
+private:
+    ProxyHandler *const _proxy_handler;
+    std::vector<Listener *> _listeners;
+    const Interface::Option _option;
+    const bool _steer_by_cpu;
+    std::string _interface;
+    int _domain;
+    uint16_t _port;
+
+}; // class EasyServer::ListenShard
+
 class EasyServer::ProxyHandler : public LinkageHandler {
 public:
     virtual ~ProxyHandler() {}
@@ -231,6 +308,8 @@ public:
                          bool reading_or_writing,
                          int errnum);
 
+    virtual void OnWriteBlocked(Linkage *linkage);
+    virtual void OnWriteDrained(Linkage *linkage);
     virtual bool Cleanup(Linkage *linkage, int64_t now);
 
     SslContext *ssl() const
@@ -265,7 +344,7 @@ class EasyServer::ProxyLinkage : public Linkage {
 public:
     ProxyLinkage(EasyContext *context, AbstractIo *io, ProxyHandler *handler,
                  const LinkagePeer &peer, const LinkagePeer &me)
-            : Linkage(io, handler, peer, me), _context(context)
+            : Linkage(io, handler, peer, me), _context(context), _resolving_io(NULL)
     {
         // Intended left blank.
     }
@@ -276,8 +355,20 @@ public:
         return _context;
     }
 
+    /// Set if io() is a ResolvingIo.
+    ResolvingIo *resolving_io() const
+    {
+        return _resolving_io;
+    }
+
+    void set_resolving_io(ResolvingIo *resolving_io)
+    {
+        _resolving_io = resolving_io;
+    }
+
 private:
     shared_ptr<EasyContext> _context;
+    ResolvingIo *_resolving_io;
 
 }; // class EasyServer::ProxyLinkage
 
@@ -304,19 +395,69 @@ private:
 
 }; // class EasyServer::JobWorker
 
+class EasyServer::JobQueue {
+public:
+    JobQueue() : _sleeping(0) {}
+
+    /// Called by the owner worker before going to sleep.
+    void Sleep()
+    {
+        _sleeping.CompareAndSwap(0, 1);
+    }
+
+    /// Called by the owner worker if it finds something to do after all.
+    void Awake()
+    {
+        _sleeping.CompareAndSwap(1, 0);
+    }
+
+    /// Called by the owner worker, returns when woken up.
+    void Wait()
+    {
+        MutexLocker locker(&_mutex);
+        while (_sleeping.BarrierGet()) {
+            _wakeup.Wait(&_mutex);
+        }
+    }
+
+    /// Thread safe.
+    /// @return false if the owner worker is not sleeping.
+    bool Wake()
+    {
+        if (!_sleeping.Get() || _sleeping.CompareAndSwap(1, 0) != 1) {
+            return false;
+        }
+
+        MutexLocker locker(&_mutex);
+        _wakeup.WakeOne();
+        return true;
+    }
+
+    MpscQueue<Runnable *> _jobs;
+
+private:
+    Condition _wakeup;
+    atomic_t _sleeping;
+    Mutex _mutex;
+
+}; // class EasyServer::JobQueue
+
 class EasyServer::JobWorker::Job : public Runnable {
 public:
     /// @param context COWed.
-    /// @param buffer copied.
+    /// @param slab referenced until I'm released.
+    /// @param buffer must lie within slab, not copied.
     Job(const shared_ptr<EasyContext> &context,
-        const void *buffer, size_t length);
+        ReceiveBuffer *slab, const void *buffer, size_t length);
 
-    virtual ~Job() {}
+    virtual ~Job();
     virtual bool Run();
 
 private:
     const shared_ptr<EasyContext> _context;
-    const std::string _message;
+    ReceiveBuffer *const _slab;
+    const void *const _buffer;
+    const size_t _length;
 
 }; // class EasyServer::JobWorker::Job
 
@@ -371,6 +512,35 @@ private:
 
 }; // class EasyServer::DisconnectJob
 
+// Flush, or change write coalescing which flushes if turned off.
+class EasyServer::FlushJob : public Runnable {
+public:
+    FlushJob(EasyServer *easy_server,
+             channel_t channel,
+             bool set,
+             bool coalescing,
+             bool tcp_cork) : _easy_server(easy_server)
+                            , _channel(channel)
+                            , _set(set)
+                            , _coalescing(coalescing)
+                            , _tcp_cork(tcp_cork) {}
+
+    virtual ~FlushJob() {}
+    virtual bool Run()
+    {
+        _easy_server->DoRealFlush(_channel, _set, _coalescing, _tcp_cork);
+        return true;
+    }
+
+private:
+    EasyServer *const _easy_server;
+    const channel_t _channel;
+    const bool _set;
+    const bool _coalescing;
+    const bool _tcp_cork;
+
+}; // class EasyServer::FlushJob
+
 class EasyServer::SendJob : public Runnable {
 public:
     SendJob(EasyServer *easy_server,
@@ -401,7 +571,9 @@ public:
 
     virtual bool Run()
     {
-        _easy_server->DoRealSend(_worker, _channel, _buffer, _length);
+        // Buffer is handed over to avoid copying once more.
+        _easy_server->DoRealSend(_worker, _channel, _buffer, _length, _buffer);
+        _buffer = NULL;
         return true;
     }
 
@@ -419,6 +591,44 @@ private:
 
 }; // class EasyServer::SendJob
 
+class EasyServer::SendFileJob : public Runnable {
+public:
+    SendFileJob(EasyServer *easy_server,
+                ProxyLinkageWorker *worker,
+                channel_t channel,
+                int fd,
+                int64_t offset,
+                size_t length) : _worker(worker)
+                               , _easy_server(easy_server)
+                               , _channel(channel)
+                               , _offset(offset)
+                               , _length(length)
+                               , _fd(fd) {}
+
+    virtual ~SendFileJob()
+    {
+        if (_fd >= 0) {
+            safe_close(_fd);
+        }
+    }
+
+    virtual bool Run()
+    {
+        _easy_server->DoRealSendFile(_worker, _channel, _fd, _offset, _length);
+        _fd = -1;
+        return true;
+    }
+
+private:
+    ProxyLinkageWorker *const _worker;
+    EasyServer *const _easy_server;
+    const channel_t _channel;
+    const int64_t _offset;
+    const size_t _length;
+    int _fd;
+
+}; // class EasyServer::SendFileJob
+
 class EasyServer::IoContext {
 public:
     explicit IoContext(int thread_id);
@@ -426,10 +636,16 @@ public:
 
     outgoing_map_t _outgoing_informations;
     connect_map_t _connect_proxy_handlers;
-    channel_map_t _channel_linkages;
     const int _thread_id;
     Mutex *const _mutex;
-    channel_t _channel;
+
+    // Only used by the I/O thread, NULL to resolve by blocking.
+    AsyncResolver *_resolver;
+
+    // Allocated and released with _mutex held, linkages are only set by the
+    // I/O thread, also with _mutex held, so that thread reads them freely.
+    // Anyone can check if a channel is still valid without locking.
+    SlotTable<ProxyLinkage> _channels;
 
 }; // class EasyServer::IoContext
 
@@ -457,14 +673,29 @@ void EasyServer::ProxyLinkageWorker::OnShutdown()
     OpenSSLInitializer::ShutdownThread();
 }
 
+void EasyServer::ProxyLinkageWorker::OnCommand(uint64_t tag,
+                                               const void *buffer,
+                                               size_t length)
+{
+    _easy_server->DoRealSend(this, tag, buffer, length, NULL);
+}
+
 EasyServer::JobWorker::Job::Job(const shared_ptr<EasyContext> &context,
+                                ReceiveBuffer *slab,
                                 const void *buffer,
                                 size_t length)
         : _context(context)
-        , _message(reinterpret_cast<const char *>(buffer),
-                   reinterpret_cast<const char *>(buffer) + length)
+        , _slab(slab)
+        , _buffer(buffer)
+        , _length(length)
 {
-    // Intended left blank.
+    assert(slab);
+    _slab->Ref();
+}
+
+EasyServer::JobWorker::Job::~Job()
+{
+    _slab->Release();
 }
 
 ssize_t EasyServer::ProxyHandler::GetMessageLength(Linkage *linkage,
@@ -483,16 +714,18 @@ int EasyServer::ProxyHandler::OnMessage(Linkage *linkage,
     ProxyLinkage *l = static_cast<ProxyLinkage *>(linkage);
     EasyServer *s = l->context()->easy_server();
 
-    // Don't call QueueOrExecute() since I have to copy the buffer.
+    // Don't call QueueOrExecute() since I have to hold the buffer.
 
     // _workers are only set in single threaded environment,
     // skip locking to get better performance.
     if (s->_workers) {
-        JobWorker::Job *job = new JobWorker::Job(l->context(), buffer, length);
+        JobWorker::Job *job = new JobWorker::Job(l->context(),
+                                                 l->receiving_buffer(),
+                                                 buffer, length);
+
         int hash = l->context()->easy_handler()->HashMessage(
                 *l->context(), buffer, length);
 
-        MutexLocker glocker(s->_gmutex);
         s->DoAppendJob(job, hash);
         return 1;
     }
@@ -517,9 +750,16 @@ bool EasyServer::ProxyHandler::OnConnected(Linkage *linkage)
     ProxyLinkage *l = static_cast<ProxyLinkage *>(linkage);
     EasyHandler *h = l->context()->easy_handler();
 
+    AbstractIo *io = l->io();
+    ResolvingIo *resolving_io = l->resolving_io();
+    if (resolving_io) {
+        l->context()->set_peer(resolving_io->peer(), resolving_io->me());
+        io = resolving_io->io();
+    }
+
     if (_ssl) {
-        SslIo *io = static_cast<SslIo *>(l->io());
-        l->context()->set_ssl_peer(io->peer());
+        SslIo *ssl_io = static_cast<SslIo *>(io);
+        l->context()->set_ssl_peer(ssl_io->peer());
     }
 
     return h->OnConnected(*l->context());
@@ -534,6 +774,20 @@ void EasyServer::ProxyHandler::OnError(Linkage *linkage,
     return h->OnError(*l->context(), reading_or_writing, errnum);
 }
 
+void EasyServer::ProxyHandler::OnWriteBlocked(Linkage *linkage)
+{
+    ProxyLinkage *l = static_cast<ProxyLinkage *>(linkage);
+    EasyHandler *h = l->context()->easy_handler();
+    h->OnWriteBlocked(*l->context());
+}
+
+void EasyServer::ProxyHandler::OnWriteDrained(Linkage *linkage)
+{
+    ProxyLinkage *l = static_cast<ProxyLinkage *>(linkage);
+    EasyHandler *h = l->context()->easy_handler();
+    h->OnWriteDrained(*l->context());
+}
+
 bool EasyServer::ProxyHandler::Cleanup(Linkage *linkage, int64_t now)
 {
     ProxyLinkage *l = static_cast<ProxyLinkage *>(linkage);
@@ -548,6 +802,78 @@ LinkageBase *EasyServer::ProxyListener::CreateLinkage(LinkageWorker *worker,
     return _easy_server->AllocateChannel(worker, peer, me, _proxy_handler);
 }
 
+EasyServer::ListenShard::~ListenShard()
+{
+    for (std::vector<Listener *>::iterator p = _listeners.begin();
+         p != _listeners.end(); ++p) {
+
+        delete *p;
+    }
+}
+
+bool EasyServer::ListenShard::Listen(EasyServer *easy_server,
+                                     const Interface::Socket &socket)
+{
+    LinkagePeer me;
+    Listener *listener = new ProxyListener(easy_server, _proxy_handler);
+    if (!listener->Listen(socket, _option, &me)) {
+        delete listener;
+        return false;
+    }
+
+    struct sockaddr_storage ss;
+    socklen_t len = sizeof(ss);
+    if (getsockname(listener->fd(), reinterpret_cast<struct sockaddr *>(&ss), &len)) {
+        delete listener;
+        return false;
+    }
+
+    _domain = ss.ss_family;
+    _interface = me.ip_str();
+    _port = me.port();
+    _listeners.push_back(listener);
+    return true;
+}
+
+Listener *EasyServer::ListenShard::Get(EasyServer *easy_server, size_t thread_id)
+{
+    if (thread_id < _listeners.size()) {
+        return _listeners[thread_id];
+    }
+
+    // I/O threads are attached in order, so are the sockets bound.
+    assert(thread_id == _listeners.size());
+
+    Interface::Socket socket;
+    socket.domain = _domain;
+    socket.type = SOCK_STREAM;
+    socket.socket_interface = _interface.c_str();
+    socket.socket_bind_port = _port;
+
+    Listener *listener = new ProxyListener(easy_server, _proxy_handler);
+    if (!listener->Listen(socket, _option)) {
+        delete listener;
+        return NULL;
+    }
+
+    _listeners.push_back(listener);
+    return listener;
+}
+
+void EasyServer::ListenShard::Steer(size_t slots)
+{
+    if (!_steer_by_cpu || _listeners.empty()) {
+        return;
+    }
+
+    if (set_socket_reuse_port_by_cpu(_listeners.front()->fd(),
+                                     static_cast<unsigned int>(slots))) {
+
+        LOG(WARN) << "EasyServer: failed to steer connections by CPU, "
+                  << "fall back to hashing: " << errno << ": " << strerror(errno);
+    }
+}
+
 bool EasyServer::JobWorker::Run()
 {
     OpenSSLInitializer::InitializeThread();
@@ -590,7 +916,7 @@ bool EasyServer::JobWorker::Job::Run()
     EasyHandler *h = _context->easy_handler();
 
     CLOG.Verbose("JobWorker: executing [%p]", this);
-    int ret = h->OnMessage(*_context, _message.data(), _message.length());
+    int ret = h->OnMessage(*_context, _buffer, _length);
     CLOG.Verbose("JobWorker: job [%p] returned %d", this, ret);
 
     // Simulate LinkageWorker since we're running on our own.
@@ -608,13 +934,14 @@ bool EasyServer::JobWorker::Job::Run()
 EasyServer::IoContext::IoContext(int thread_id)
         : _thread_id(thread_id)
         , _mutex(new Mutex)
-        , _channel(static_cast<channel_t>(thread_id))
+        , _resolver(NULL)
 {
     // Intended left blank.
 }
 
 EasyServer::IoContext::~IoContext()
 {
+    delete _resolver;
     delete _mutex;
 
     for (connect_map_t::iterator p = _connect_proxy_handlers.begin();
@@ -632,9 +959,13 @@ EasyServer::IoContext::~IoContext()
 
 EasyServer::EasyServer()
         : _pool(new FixedThreadPool)
-        , _incoming(new Condition)
         , _configure(kDefaultConfigure)
         , _gmutex(new Mutex)
+        , _jobs(new MpscQueue<Runnable *>)
+        , _pending_jobs(0)
+        , _stealing(0)
+        , _waking(0)
+        , _quitting(0)
         , _workers(0)
         , _slots(0)
         , _incoming_connections(0)
@@ -649,7 +980,7 @@ EasyServer::~EasyServer()
 
     delete _pool;
     delete _gmutex;
-    delete _incoming;
+    delete _jobs;
 }
 
 bool EasyServer::Listen(const ListenOption &o)
@@ -664,12 +995,21 @@ bool EasyServer::Listen(const ListenOption &o)
         return false;
     }
 
+    if (o.reuse_port && o.listen_socket.domain == AF_UNIX) {
+        LOG(FATAL) << "EasyServer: BUG: reuse_port applies to TCP only.";
+        return false;
+    }
+
     ProxyHandler *proxy_handler = new ProxyHandler(
             o.accepted_option,
             o.easy_handler,
             o.easy_factory,
             o.ssl);
 
+    if (o.reuse_port) {
+        return ListenSharded(o, proxy_handler);
+    }
+
     Listener *listener = new ProxyListener(this, proxy_handler);
 
     if (!listener->Listen(o.listen_socket, o.listen_option)) {
@@ -690,6 +1030,31 @@ bool EasyServer::Listen(const ListenOption &o)
     return true;
 }
 
+bool EasyServer::ListenSharded(const ListenOption &o, ProxyHandler *proxy_handler)
+{
+    Interface::Option option(o.listen_option);
+    option.socket_reuse_port = true;
+
+    // Only the first socket for now, the rest are bound in Initialize().
+    ListenShard *shard = new ListenShard(proxy_handler, option, o.steer_by_cpu);
+    if (!shard->Listen(this, o.listen_socket)) {
+        delete shard;
+        delete proxy_handler;
+        return false;
+    }
+
+    MutexLocker glocker(_gmutex);
+    if (!_io_workers.empty()) {
+        delete shard;
+        delete proxy_handler;
+        throw std::logic_error("EasyServer only listens before Initialize()");
+    }
+
+    _listen_proxy_handlers.push_back(proxy_handler);
+    _listen_shards.push_back(shard);
+    return true;
+}
+
 bool EasyServer::Listen(uint16_t port, EasyHandler *easy_handler)
 {
     if (!easy_handler) {
@@ -826,9 +1191,11 @@ bool EasyServer::Initialize(const std::string &slots,
 
     MutexLocker glocker(_gmutex);
     for (size_t i = 0; i < as.size(); ++i) {
-        ProxyLinkageWorker *worker =
-                new ProxyLinkageWorker(easy_tuner, static_cast<int>(i), as[i]);
+        ProxyLinkageWorker *worker = new ProxyLinkageWorker(
+                this, easy_tuner, static_cast<int>(i), as[i],
+                _configure.event_backend);
 
+        worker->set_latency_probe(_configure.loop_latency_probe);
         _io_workers.push_back(worker);
         if (!AttachListeners(worker)) {
             LOG(ERROR) << "EasyServer: failed to initialize I/O workers.";
@@ -837,6 +1204,12 @@ bool EasyServer::Initialize(const std::string &slots,
         }
     }
 
+    for (std::list<ListenShard *>::iterator p = _listen_shards.begin();
+         p != _listen_shards.end(); ++p) {
+
+        (*p)->Steer(_slots);
+    }
+
     for (std::list<std::pair<Runnable *, std::pair<int64_t, int64_t> > >::iterator
          p = _timers.begin(); p != _timers.end();) {
 
@@ -850,18 +1223,35 @@ bool EasyServer::Initialize(const std::string &slots,
         p = _timers.erase(p);
     }
 
+    AsyncResolver::Option resolver_option;
+    if (_configure.asynchronous_resolving && !resolver_option.Load()) {
+        LOG(WARN) << "EasyServer: failed to read resolv.conf, using defaults.";
+    }
+
     _io_context.reserve(as.size());
     for (size_t i = 0; i < as.size(); ++i) {
-        _io_context.push_back(new IoContext(static_cast<int>(i)));
+        IoContext *ioc = new IoContext(static_cast<int>(i));
+        _io_context.push_back(ioc);
+        if (!_configure.asynchronous_resolving) {
+            continue;
+        }
+
+        ioc->_resolver = new AsyncResolver;
+        if (!ioc->_resolver->Initialize(_io_workers[i], resolver_option)) {
+            LOG(WARN) << "EasyServer: failed to initialize resolver, "
+                      << "hostnames will be resolved by blocking.";
+
+            delete ioc->_resolver;
+            ioc->_resolver = NULL;
+        }
     }
 
     for (size_t i = 0; i < aw.size(); ++i) {
         JobWorker *worker = new JobWorker(this, easy_tuner, i, aw[i]);
         _job_workers.push_back(worker);
+        _job_queues.push_back(new JobQueue);
     }
 
-    _hashjobs.resize(aw.size());
-
     // Now multi-threading.
     for (std::vector<ProxyLinkageWorker *>::const_iterator
          p = _io_workers.begin(); p != _io_workers.end(); ++p) {
@@ -925,25 +1315,25 @@ bool EasyServer::Shutdown()
 
 void EasyServer::DoDumpJobs()
 {
-    while (!_jobs.empty()) {
-        delete _jobs.front();
-        _jobs.pop();
+    while (!_stealing.Lock()) {
+        sched_yield();
     }
 
-    for (std::vector<std::queue<Runnable *> >::iterator p = _hashjobs.begin();
-         p != _hashjobs.end(); ++p) {
-
-        while (!p->empty()) {
-            delete p->front();
-            p->pop();
-        }
+    Runnable *job;
+    while (_jobs->Pop(&job)) {
+        _pending_jobs.SubAndFetch(1);
+        delete job;
     }
+
+    _stealing.Unlock();
 }
 
 bool EasyServer::DoShutdown(MutexLocker *locker)
 {
+    // Job workers drop what's left in their own queues since now.
+    _quitting.BarrierSet(1);
     DoDumpJobs();
-    for (size_t i = 0; i < _workers; ++i) {
+    for (size_t i = 0; i < _job_queues.size(); ++i) {
         DoAppendJob(NULL, static_cast<int>(i));
     }
 
@@ -977,6 +1367,12 @@ bool EasyServer::DoShutdown(MutexLocker *locker)
         delete *p;
     }
 
+    for (std::list<ListenShard *>::iterator p = _listen_shards.begin();
+         p != _listen_shards.end(); ++p) {
+
+        delete *p;
+    }
+
     for (std::list<std::pair<Runnable *, std::pair<int64_t, int64_t> > >::iterator
          p = _timers.begin(); p != _timers.end(); ++p) {
 
@@ -984,22 +1380,33 @@ bool EasyServer::DoShutdown(MutexLocker *locker)
     }
 
     DoDumpJobs();
+    for (std::vector<JobQueue *>::iterator p = _job_queues.begin();
+         p != _job_queues.end(); ++p) {
+
+        Runnable *job;
+        while ((*p)->_jobs.Pop(&job)) {
+            delete job;
+        }
+
+        delete *p;
+    }
 
     _listen_proxy_handlers.clear();
+    _listen_shards.clear();
     _job_workers.clear();
     _io_workers.clear();
     _io_context.clear();
     _listeners.clear();
-    _hashjobs.clear();
+    _job_queues.clear();
     _timers.clear();
+    _quitting.Set(0);
     _workers = 0;
     _slots = 0;
 
-    // Preserve _channel.
     return true;
 }
 
-bool EasyServer::AttachListeners(LinkageWorker *worker)
+bool EasyServer::AttachListeners(ProxyLinkageWorker *worker)
 {
     for (std::list<Listener *>::const_iterator p = _listeners.begin();
          p != _listeners.end(); ++p) {
@@ -1010,40 +1417,129 @@ bool EasyServer::AttachListeners(LinkageWorker *worker)
         }
     }
 
+    // Each I/O thread accepts from its own socket.
+    size_t thread_id = static_cast<size_t>(worker->thread_id());
+    for (std::list<ListenShard *>::const_iterator p = _listen_shards.begin();
+         p != _listen_shards.end(); ++p) {
+
+        Listener *l = (*p)->Get(this, thread_id);
+        if (!l || !l->Attach(worker)) {
+            return false;
+        }
+    }
+
     return true;
 }
 
-Runnable *EasyServer::GetJob(size_t id)
+uint64_t EasyServer::GetAcceptedConnections(int thread_id) const
 {
     MutexLocker glocker(_gmutex);
-    while (_jobs.empty() && _hashjobs[id].empty()) {
-        _incoming->Wait(_gmutex);
+    if (thread_id < 0 || static_cast<size_t>(thread_id) >= _io_workers.size()) {
+        return 0;
     }
 
+    return _io_workers[static_cast<size_t>(thread_id)]->accepted();
+}
+
+int64_t EasyServer::GetLoopLatency(int thread_id, double percentile, bool reset)
+{
+    MutexLocker glocker(_gmutex);
+    if (thread_id < 0 || static_cast<size_t>(thread_id) >= _io_workers.size()) {
+        return 0;
+    }
+
+    LatencyHistogram *histogram =
+            _io_workers[static_cast<size_t>(thread_id)]->loop_latency();
+
+    int64_t latency = histogram->GetPercentile(percentile);
+    if (reset) {
+        histogram->Reset();
+    }
+
+    return latency;
+}
+
+Runnable *EasyServer::GetJob(size_t id)
+{
+    JobQueue *queue = _job_queues[id];
     Runnable *job;
-    if (!_hashjobs[id].empty()) {
-        CLOG.Verbose("EasyServer: got job from my queue.");
-        job = _hashjobs[id].front();
-        _hashjobs[id].pop();
-    } else {
-        CLOG.Verbose("EasyServer: got job from global queue.");
-        job = _jobs.front();
-        _jobs.pop();
+    while (true) {
+        // Hashed jobs are only ever popped here, that's how they're ordered.
+        if (queue->_jobs.Pop(&job)) {
+            if (job && _quitting.Get()) {
+                delete job;
+                continue;
+            }
+
+            CLOG.Verbose("EasyServer: got job from my queue.");
+            return job;
+        }
+
+        if (StealJob(&job)) {
+            CLOG.Verbose("EasyServer: got job from global queue.");
+            return job;
+        }
+
+        // Declare sleeping before checking again, so that whoever appends a
+        // job after the check will see me sleeping and wake me up.
+        queue->Sleep();
+        if (!queue->_jobs.empty()) {
+            queue->Awake();
+            continue;
+
+        } else if (_pending_jobs.BarrierGet() && !_quitting.Get()) {
+            // Somebody else is stealing it, don't spin while they're at it.
+            queue->Awake();
+            sched_yield();
+            continue;
+        }
+
+        queue->Wait();
+    }
+}
+
+bool EasyServer::StealJob(Runnable **job)
+{
+    if (!_pending_jobs.Get() || _quitting.Get()) {
+        return false;
+    }
+
+    // Never wait for another worker stealing, it's probably taking this one.
+    if (!_stealing.Lock()) {
+        return false;
+    }
+
+    // Checked again so that it's never taken before counted.
+    bool got = _pending_jobs.Get() && _jobs->Pop(job);
+    if (got) {
+        _pending_jobs.SubAndFetch(1);
     }
 
-    return job;
+    _stealing.Unlock();
+    return got;
 }
 
 void EasyServer::DoAppendJob(Runnable *job, int hash)
 {
+    assert(!_job_queues.empty());
+    size_t workers = _job_queues.size();
+
     if (hash < 0) {
-        _jobs.push(job);
-        _incoming->WakeOne();
+        _jobs->Push(job);
+        _pending_jobs.AddAndFetch(1);
+
+        // Wake up one sleeping worker if any, busy ones steal it when done.
+        size_t start = static_cast<size_t>(_waking.AddAndFetch(1));
+        for (size_t i = 0; i < workers; ++i) {
+            if (_job_queues[(start + i) % workers]->Wake()) {
+                break;
+            }
+        }
+
     } else {
-        assert(!_hashjobs.empty());
-        size_t i = static_cast<size_t>(hash) % _hashjobs.size();
-        _hashjobs[i].push(job);
-        _incoming->WakeAll();
+        JobQueue *queue = _job_queues[static_cast<size_t>(hash) % workers];
+        queue->_jobs.Push(job);
+        queue->Wake();
     }
 
     CLOG.Verbose("EasyServer: appended job [%p] %d", job, hash);
@@ -1100,9 +1596,17 @@ Linkage *EasyServer::AllocateChannel(LinkageWorker *worker,
 
     MutexLocker locker(ioc->_mutex);
     channel_t channel = AllocateChannel(ioc, true);
+    if (!IsValidChannel(channel)) {
+        LOG(WARN) << "EasyServer: too many channels for I/O thread: "
+                  << w->thread_id();
+
+        _incoming_connections.SubAndFetch(1);
+        return NULL;
+    }
 
     Interface *interface = new Interface;
     if (!interface->Accepted(proxy_handler->accepted_option(), peer.fd())) {
+        ioc->_channels.Release(GetChannelIndex(channel));
         _incoming_connections.SubAndFetch(1);
         delete interface;
         return NULL;
@@ -1120,9 +1624,14 @@ Linkage *EasyServer::AllocateChannel(LinkageWorker *worker,
     linkage->set_connect_timeout(_configure.incoming_connect_timeout);
     linkage->set_send_timeout(_configure.incoming_send_timeout);
     linkage->set_idle_timeout(_configure.incoming_idle_timeout);
+    linkage->set_periodic_cleanup(_configure.periodic_cleanup);
+    linkage->set_write_watermarks(_configure.write_high_watermark,
+                                  _configure.write_low_watermark,
+                                  _configure.pause_reading_when_blocked);
 
-    ioc->_channel_linkages.insert(std::make_pair(channel, linkage));
+    ioc->_channels.Set(GetChannelIndex(channel), GetChannelGeneration(channel), linkage);
     LOG(VERBOSE) << "EasyServer: creating linkage: " << peer.ip_str();
+    w->OnAccepted();
     return linkage;
 }
 
@@ -1133,9 +1642,10 @@ void EasyServer::ReleaseChannel(channel_t channel)
         return;
     }
 
+    uint32_t index = GetChannelIndex(channel);
     MutexLocker locker(ioc->_mutex);
-    ioc->_channel_linkages.erase(channel);
     if (!IsOutgoingChannel(channel)) {
+        ioc->_channels.Release(index);
         _incoming_connections.SubAndFetch(1);
         return;
     }
@@ -1143,10 +1653,12 @@ void EasyServer::ReleaseChannel(channel_t channel)
     _outgoing_connections.SubAndFetch(1);
     if (ioc->_outgoing_informations.find(channel) != ioc->_outgoing_informations.end()) {
         // Still needed.
+        ioc->_channels.Set(index, GetChannelGeneration(channel), NULL);
         return;
     }
 
     LOG(VERBOSE) << "EasyServer: outgoing ProxyHandler released: " << channel;
+    ioc->_channels.Release(index);
     connect_map_t::iterator p = ioc->_connect_proxy_handlers.find(channel);
     assert(p != ioc->_connect_proxy_handlers.end());
     delete p->second;
@@ -1162,7 +1674,6 @@ void EasyServer::QueueOrExecuteJob(Runnable *job, int id)
     // _workers are only set in single threaded environment,
     // skip locking to get better performance.
     if (_workers) {
-        MutexLocker glocker(_gmutex);
         DoAppendJob(job, id);
         return;
     }
@@ -1194,14 +1705,20 @@ void EasyServer::Forget(channel_t channel)
         return;
     }
 
+    uint32_t index = GetChannelIndex(channel);
+    uint32_t generation = GetChannelGeneration(channel);
     MutexLocker locker(ioc->_mutex);
+    if (!ioc->_channels.IsValid(index, generation)) {
+        return;
+    }
+
     outgoing_map_t::iterator p = ioc->_outgoing_informations.find(channel);
     if (p != ioc->_outgoing_informations.end()) {
         delete p->second;
         ioc->_outgoing_informations.erase(p);
     }
 
-    if (ioc->_channel_linkages.find(channel) != ioc->_channel_linkages.end()) {
+    if (ioc->_channels.Get(index, generation)) {
         // Still needed.
         return;
     }
@@ -1211,6 +1728,7 @@ void EasyServer::Forget(channel_t channel)
         return;
     }
 
+    ioc->_channels.Release(index);
     delete q->second;
     ioc->_connect_proxy_handlers.erase(q);
     LOG(VERBOSE) << "EasyServer: outgoing ProxyHandler released: " << channel;
@@ -1228,22 +1746,25 @@ bool EasyServer::Disconnect(channel_t channel, bool finish_write)
         return true;
     }
 
-    int64_t tid = get_current_thread_id();
-    MutexLocker locker(ioc->_mutex);
-    channel_map_t::iterator p = ioc->_channel_linkages.find(channel);
-    if (p == ioc->_channel_linkages.end()) {
+    uint32_t index = GetChannelIndex(channel);
+    uint32_t generation = GetChannelGeneration(channel);
+    if (!ioc->_channels.IsValid(index, generation)) {
         return true;
     }
 
-    ProxyLinkage *linkage = p->second;
-    LinkageWorker *worker = linkage->worker();
-
+    int64_t tid = get_current_thread_id();
+    LinkageWorker *worker = GetIoWorker(GetThreadId(channel));
     if (tid > 0 && tid == worker->running_thread_id()) {
-        locker.Unlock();
+        ProxyLinkage *linkage = ioc->_channels.Get(index, generation);
+        if (!linkage) {
+            return true;
+        }
+
         int ret = linkage->Disconnect(finish_write);
         return ret >= 0;
     }
 
+    // Checked again in the I/O thread.
     Runnable *job = new DisconnectJob(this, channel, finish_write);
     return worker->SendCommand(job);
 }
@@ -1260,51 +1781,151 @@ void EasyServer::DoRealDisconnect(channel_t channel, bool finish_write)
         return;
     }
 
-    MutexLocker locker(ioc->_mutex);
-    channel_map_t::iterator p = ioc->_channel_linkages.find(channel);
-    if (p == ioc->_channel_linkages.end()) {
+    // Same thread, no need to prevent pointer being freed.
+    ProxyLinkage *linkage = ioc->_channels.Get(GetChannelIndex(channel),
+                                               GetChannelGeneration(channel));
+
+    if (!linkage) {
         return;
     }
 
-    ProxyLinkage *linkage = p->second;
+    linkage->Disconnect(finish_write);
+}
+
+bool EasyServer::SetWriteCoalescing(channel_t channel,
+                                    bool coalescing,
+                                    bool tcp_cork)
+{
+    IoContext *const ioc = GetIoContext(channel);
+    if (!ioc) {
+        return false;
+    }
+
+    uint32_t index = GetChannelIndex(channel);
+    uint32_t generation = GetChannelGeneration(channel);
+    if (!ioc->_channels.IsValid(index, generation)) {
+        return true;
+    }
+
+    int64_t tid = get_current_thread_id();
+    LinkageWorker *worker = GetIoWorker(GetThreadId(channel));
+    if (tid > 0 && tid == worker->running_thread_id()) {
+        ProxyLinkage *linkage = ioc->_channels.Get(index, generation);
+        if (linkage) {
+            linkage->set_write_coalescing(coalescing, tcp_cork);
+        }
+
+        return true;
+    }
+
+    // Checked again in the I/O thread.
+    Runnable *job = new FlushJob(this, channel, true, coalescing, tcp_cork);
+    return worker->SendCommand(job);
+}
+
+bool EasyServer::SetWriteCoalescing(const EasyContext &context,
+                                    bool coalescing,
+                                    bool tcp_cork)
+{
+    return SetWriteCoalescing(context.channel(), coalescing, tcp_cork);
+}
+
+bool EasyServer::Flush(channel_t channel)
+{
+    IoContext *const ioc = GetIoContext(channel);
+    if (!ioc) {
+        return false;
+    }
+
+    uint32_t index = GetChannelIndex(channel);
+    uint32_t generation = GetChannelGeneration(channel);
+    if (!ioc->_channels.IsValid(index, generation)) {
+        return true;
+    }
+
+    int64_t tid = get_current_thread_id();
+    LinkageWorker *worker = GetIoWorker(GetThreadId(channel));
+    if (tid > 0 && tid == worker->running_thread_id()) {
+        ProxyLinkage *linkage = ioc->_channels.Get(index, generation);
+        if (!linkage) {
+            return true;
+        }
+
+        return linkage->Flush();
+    }
+
+    // Checked again in the I/O thread.
+    Runnable *job = new FlushJob(this, channel, false, false, false);
+    return worker->SendCommand(job);
+}
+
+bool EasyServer::Flush(const EasyContext &context)
+{
+    return Flush(context.channel());
+}
+
+void EasyServer::DoRealFlush(channel_t channel,
+                             bool set,
+                             bool coalescing,
+                             bool tcp_cork)
+{
+    IoContext *const ioc = GetIoContext(channel);
+    if (!ioc) {
+        return;
+    }
 
     // Same thread, no need to prevent pointer being freed.
-    locker.Unlock();
-    linkage->Disconnect(finish_write);
+    ProxyLinkage *linkage = ioc->_channels.Get(GetChannelIndex(channel),
+                                               GetChannelGeneration(channel));
+
+    if (!linkage) {
+        return;
+    } else if (set) {
+        linkage->set_write_coalescing(coalescing, tcp_cork);
+        return;
+    }
+
+    if (!linkage->Flush()) {
+        const EasyContext &context = *linkage->context();
+        EasyHandler *h = context.easy_handler();
+        h->OnError(context, false, errno);
+        linkage->Disconnect(false);
+    }
 }
 
 void EasyServer::DoRealSend(ProxyLinkageWorker *worker,
                             channel_t channel,
                             const void *buffer,
-                            size_t length)
+                            size_t length,
+                            void *block)
 {
     IoContext *const ioc = GetIoContext(channel);
     if (!ioc) {
+        free(block);
         return;
     }
 
-    MutexLocker locker(ioc->_mutex);
-    ProxyLinkage *linkage = NULL;
-    channel_map_t::iterator p = ioc->_channel_linkages.find(channel);
-
-    if (p != ioc->_channel_linkages.end()) {
-        linkage = p->second;
+    // Same thread, no need to prevent pointer being freed.
+    ProxyLinkage *linkage = ioc->_channels.Get(GetChannelIndex(channel),
+                                               GetChannelGeneration(channel));
 
-    } else if (IsOutgoingChannel(channel)) {
+    if (!linkage && IsOutgoingChannel(channel)) {
+        MutexLocker locker(ioc->_mutex);
         outgoing_map_t::const_iterator q = ioc->_outgoing_informations.find(channel);
         if (q != ioc->_outgoing_informations.end()) {
             linkage = DoReconnect(worker, channel, q->second);
         }
     }
 
-    // Same thread, no need to prevent pointer being freed.
-    locker.Unlock();
-
-    if (!linkage || !buffer) {
+    if (!linkage || !buffer || !length) {
+        free(block);
         return;
     }
 
-    if (!linkage->Send(buffer, length)) {
+    bool sent = block ? linkage->SendAdopted(block, buffer, length)
+                      : linkage->Send(buffer, length);
+
+    if (!sent) {
         const EasyContext &context = *linkage->context();
         EasyHandler *h = context.easy_handler();
         h->OnError(context, false, ENOMEM);
@@ -1319,56 +1940,150 @@ bool EasyServer::Send(channel_t channel, const void *buffer, size_t length)
         return false;
     }
 
+    // Disconnected and forgotten, silently dropped.
+    uint32_t index = GetChannelIndex(channel);
+    uint32_t generation = GetChannelGeneration(channel);
+    if (!ioc->_channels.IsValid(index, generation)) {
+        return true;
+    }
+
     int64_t tid = get_current_thread_id();
-    MutexLocker locker(ioc->_mutex);
-    ProxyLinkageWorker *worker = NULL;
-    channel_map_t::iterator p = ioc->_channel_linkages.find(channel);
-    if (p != ioc->_channel_linkages.end()) {
-        if (!buffer || !length) {
-            return true;
-        }
+    ProxyLinkageWorker *worker = GetIoWorker(GetThreadId(channel));
+    if (tid > 0 && tid == worker->running_thread_id()) {
+        ProxyLinkage *linkage = ioc->_channels.Get(index, generation);
+        if (!linkage) {
+            if (!IsOutgoingChannel(channel)) {
+                return true;
+            }
 
-        worker = static_cast<ProxyLinkageWorker *>(p->second->worker());
-        if (tid > 0 && tid == worker->running_thread_id()) {
-            locker.Unlock();
-            if (!buffer || !length) {
+            MutexLocker locker(ioc->_mutex);
+            outgoing_map_t::const_iterator q = ioc->_outgoing_informations.find(channel);
+            if (q == ioc->_outgoing_informations.end()) {
                 return true;
             }
-            return p->second->Send(buffer, length);
+
+            linkage = DoReconnect(worker, channel, q->second);
+            if (!linkage) {
+                return false;
+            }
         }
 
-    } else if (IsOutgoingChannel(channel)) {
+        if (!buffer || !length) {
+            return true;
+        }
+
+        return linkage->Send(buffer, length);
+
+    } else if ((!buffer || !length) && !IsOutgoingChannel(channel)) {
+        return true;
+    }
+
+    // Checked again in the I/O thread, outgoing channels are reconnected if
+    // needed even if there's nothing to send.
+    if (length <= LinkageWorker::kMaximumInlineCommand) {
+        return worker->SendCommand(channel, buffer, length);
+    }
+
+    Runnable *job = new SendJob(this, worker, channel, buffer, length);
+    return worker->SendCommand(job);
+}
+
+bool EasyServer::Send(const EasyContext &context, const void *buffer, size_t length)
+{
+    return Send(context.channel(), buffer, length);
+}
+
+void EasyServer::DoRealSendFile(ProxyLinkageWorker *worker,
+                                channel_t channel,
+                                int fd,
+                                int64_t offset,
+                                size_t length)
+{
+    IoContext *const ioc = GetIoContext(channel);
+    if (!ioc) {
+        safe_close(fd);
+        return;
+    }
+
+    // Same thread, no need to prevent pointer being freed.
+    ProxyLinkage *linkage = ioc->_channels.Get(GetChannelIndex(channel),
+                                               GetChannelGeneration(channel));
+
+    if (!linkage && IsOutgoingChannel(channel)) {
+        MutexLocker locker(ioc->_mutex);
         outgoing_map_t::const_iterator q = ioc->_outgoing_informations.find(channel);
         if (q != ioc->_outgoing_informations.end()) {
-            worker = GetIoWorker(q->second->thread_id());
-            if (tid > 0 && tid == worker->running_thread_id()) {
-                Linkage *linkage = DoReconnect(worker, channel, q->second);
+            linkage = DoReconnect(worker, channel, q->second);
+        }
+    }
+
+    if (!linkage) {
+        safe_close(fd);
+        return;
+    }
+
+    if (!linkage->SendFile(fd, offset, length)) {
+        const EasyContext &context = *linkage->context();
+        EasyHandler *h = context.easy_handler();
+        h->OnError(context, false, EINVAL);
+        linkage->Disconnect(false);
+    }
+}
+
+bool EasyServer::SendFile(channel_t channel, int fd, int64_t offset, size_t length)
+{
+    IoContext *const ioc = GetIoContext(channel);
+    struct stat st;
+    if (fd < 0) {
+        return false;
+    } else if (!ioc || offset < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+        safe_close(fd);
+        return false;
+    }
+
+    // Disconnected and forgotten, silently dropped.
+    uint32_t index = GetChannelIndex(channel);
+    uint32_t generation = GetChannelGeneration(channel);
+    if (!ioc->_channels.IsValid(index, generation)) {
+        safe_close(fd);
+        return true;
+    }
+
+    int64_t tid = get_current_thread_id();
+    ProxyLinkageWorker *worker = GetIoWorker(GetThreadId(channel));
+    if (tid > 0 && tid == worker->running_thread_id()) {
+        ProxyLinkage *linkage = ioc->_channels.Get(index, generation);
+        if (!linkage && IsOutgoingChannel(channel)) {
+            MutexLocker locker(ioc->_mutex);
+            outgoing_map_t::const_iterator q = ioc->_outgoing_informations.find(channel);
+            if (q != ioc->_outgoing_informations.end()) {
+                linkage = DoReconnect(worker, channel, q->second);
                 if (!linkage) {
+                    safe_close(fd);
                     return false;
                 }
-
-                locker.Unlock();
-                if (!buffer || !length) {
-                    return true;
-                }
-
-                return linkage->Send(buffer, length);
             }
         }
-    }
 
-    locker.Unlock();
-    if (!worker) {
-        return true;
+        if (!linkage) {
+            safe_close(fd);
+            return true;
+        }
+
+        return linkage->SendFile(fd, offset, length);
     }
 
-    Runnable *job = new SendJob(this, worker, channel, buffer, length);
+    // Checked again in the I/O thread.
+    Runnable *job = new SendFileJob(this, worker, channel, fd, offset, length);
     return worker->SendCommand(job);
 }
 
-bool EasyServer::Send(const EasyContext &context, const void *buffer, size_t length)
+bool EasyServer::SendFile(const EasyContext &context,
+                          int fd,
+                          int64_t offset,
+                          size_t length)
 {
-    return Send(context.channel(), buffer, length);
+    return SendFile(context.channel(), fd, offset, length);
 }
 
 EasyServer::ProxyLinkageWorker *EasyServer::GetIoWorker(int thread_id) const
@@ -1387,6 +2102,19 @@ EasyServer::ProxyLinkageWorker *EasyServer::GetIoWorker(int thread_id) const
     return *p;
 }
 
+bool EasyServer::IsResolvingNeeded(AsyncResolver *resolver,
+                                   const Interface::Socket &socket)
+{
+    if (!resolver || !socket.socket_hostname || !*socket.socket_hostname ||
+        (socket.domain != AF_INET && socket.domain != AF_INET6)) {
+
+        return false;
+    }
+
+    struct in6_addr addr;
+    return inet_pton(socket.domain, socket.socket_hostname, &addr) != 1;
+}
+
 EasyServer::ProxyLinkage *EasyServer::DoReconnect(
         ProxyLinkageWorker *worker,
         channel_t channel,
@@ -1399,7 +2127,35 @@ EasyServer::ProxyLinkage *EasyServer::DoReconnect(
     LinkagePeer peer;
     Interface *interface = new Interface;
     std::pair<EasyHandler *, bool> h = GetEasyHandler(info->proxy_handler());
-    int ret = interface->Connect(info->socket(), info->option(), &peer, &me);
+    const Interface::Socket &socket = info->socket();
+
+    // Numeric hosts are connected right away, otherwise don't block to resolve
+    // them, peer and me are unspecified addresses until connected.
+    int ret;
+    bool resolving = IsResolvingNeeded(ioc->_resolver, socket);
+    if (resolving) {
+        ret = interface->Open(socket, info->option()) ? 1 : -1;
+        if (ret > 0) {
+            struct sockaddr_in6 a6;
+            struct sockaddr_in a4;
+            memset(&a6, 0, sizeof(a6));
+            memset(&a4, 0, sizeof(a4));
+            a6.sin6_family = AF_INET6;
+            a6.sin6_port = htons(socket.socket_port);
+            a4.sin_family = AF_INET;
+            a4.sin_port = htons(socket.socket_port);
+            if (socket.domain == AF_INET6) {
+                peer.Set(&a6, interface->fd());
+                me.Set(&a6, interface->fd());
+            } else {
+                peer.Set(&a4, interface->fd());
+                me.Set(&a4, interface->fd());
+            }
+        }
+
+    } else {
+        ret = interface->Connect(socket, info->option(), &peer, &me);
+    }
 
     EasyContext *context = new EasyContext(this, h.first, h.second,
                                            channel, peer, me,
@@ -1418,9 +2174,21 @@ EasyServer::ProxyLinkage *EasyServer::DoReconnect(
                                    true,
                                    ret > 0 ? true : false);
 
+    ResolvingIo *resolving_io = NULL;
+    if (resolving) {
+        resolving_io = new ResolvingIo(io, interface, ioc->_resolver,
+                                       socket.socket_hostname,
+                                       socket.socket_port,
+                                       socket.domain);
+
+        io = resolving_io;
+    }
+
     ProxyLinkage *linkage = new ProxyLinkage(context, io, info->proxy_handler(),
                                              peer, me);
 
+    linkage->set_resolving_io(resolving_io);
+
     if (!linkage->Attach(worker)) {
         h.first->OnError(*context, false, errno);
         delete linkage;
@@ -1431,8 +2199,12 @@ EasyServer::ProxyLinkage *EasyServer::DoReconnect(
     linkage->set_connect_timeout(_configure.outgoing_receive_timeout);
     linkage->set_send_timeout(_configure.outgoing_send_timeout);
     linkage->set_idle_timeout(_configure.outgoing_idle_timeout);
+    linkage->set_periodic_cleanup(_configure.periodic_cleanup);
+    linkage->set_write_watermarks(_configure.write_high_watermark,
+                                  _configure.write_low_watermark,
+                                  _configure.pause_reading_when_blocked);
 
-    ioc->_channel_linkages.insert(std::make_pair(channel, linkage));
+    ioc->_channels.Set(GetChannelIndex(channel), GetChannelGeneration(channel), linkage);
     _outgoing_connections.AddAndFetch(1);
     return linkage;
 }
@@ -1457,6 +2229,12 @@ EasyServer::channel_t EasyServer::Connect(const ConnectOption &o)
     IoContext *const ioc = _io_context[static_cast<size_t>(thread_id)];
 
     MutexLocker locker(ioc->_mutex);
+    channel_t c = AllocateChannel(ioc, false);
+    if (!IsValidChannel(c)) {
+        LOG(WARN) << "EasyServer: too many channels for I/O thread: " << thread_id;
+        return kInvalidChannel;
+    }
+
     ProxyHandler *proxy_handler = new ProxyHandler(Interface::Option(),
                                                    o.easy_handler,
                                                    o.easy_factory,
@@ -1468,7 +2246,6 @@ EasyServer::channel_t EasyServer::Connect(const ConnectOption &o)
                                     o.connect_option,
                                     thread_id);
 
-    channel_t c = AllocateChannel(ioc, false);
     ioc->_connect_proxy_handlers.insert(std::make_pair(c, proxy_handler));
     ioc->_outgoing_informations.insert(std::make_pair(c, info));
     return c;
@@ -1575,8 +2352,16 @@ EasyServer::channel_t EasyServer::SslConnectTcp4(
 EasyServer::channel_t EasyServer::AllocateChannel(IoContext *ioc,
                                                   bool incoming_or_outgoing)
 {
-    ioc->_channel += _slots;
-    channel_t channel = ioc->_channel;
+    uint32_t index;
+    uint32_t generation;
+    if (!ioc->_channels.Allocate(NULL, &index, &generation)) {
+        return kInvalidChannel;
+    }
+
+    channel_t channel = static_cast<channel_t>(generation) << 32
+                      | (static_cast<channel_t>(index) * _slots
+                         + static_cast<channel_t>(ioc->_thread_id));
+
     if (!incoming_or_outgoing) {
         channel |= 0x8000000000000000ull;
     }
@@ -1594,6 +2379,8 @@ std::ostream &operator << (std::ostream &s, const flinter::EasyServer::ListenOpt
       << "] H[" << d.easy_handler
       << "] F[" << d.easy_factory
       << "] S[" << d.ssl
+      << "] R[" << d.reuse_port
+      << "," << d.steer_by_cpu
       << "]";
 
     return s;
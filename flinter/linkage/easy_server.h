@@ -25,6 +25,7 @@
 #include <string>
 #include <vector>
 
+#include <flinter/linkage/event_backend.h>
 #include <flinter/linkage/interface.h>
 #include <flinter/types/atomic.h>
 #include <flinter/types/unordered_map.h>
@@ -34,7 +35,7 @@
 namespace flinter {
 
 class AbstractIo;
-class Condition;
+class AsyncResolver;
 class EasyContext;
 class EasyHandler;
 class EasyTuner;
@@ -44,6 +45,7 @@ class Linkage;
 class LinkagePeer;
 class LinkageWorker;
 class Listener;
+template <class T> class MpscQueue;
 class Mutex;
 class MutexLocker;
 class SslContext;
@@ -65,6 +67,23 @@ public:
 
          size_t maximum_incoming_connections;
 
+         size_t write_high_watermark; // 0 to disable.
+         size_t write_low_watermark;
+           bool pause_reading_when_blocked;
+
+        EventBackend::Type event_backend;
+        int64_t loop_latency_probe; // 0 to disable.
+
+        // Resolve hostnames of outgoing connections within I/O threads without
+        // blocking them, see AsyncResolver. Nameservers are read from
+        // /etc/resolv.conf once initialized.
+           bool asynchronous_resolving;
+
+        // Call EasyHandler::Cleanup() every second as it used to be, besides
+        // when timeouts might be due. Costs a wheel slot per connection every
+        // second, leave it off unless handlers keep timers of their own.
+           bool periodic_cleanup;
+
     }; // struct Configure
 
     struct ListenOption {
@@ -75,6 +94,15 @@ public:
         EasyHandler *easy_handler;
         SslContext *ssl;
 
+        /// One SO_REUSEPORT socket per I/O thread instead of a single one
+        /// shared by all of them, TCP only.
+        bool reuse_port;
+
+        /// With reuse_port, connections received on CPU n are accepted by I/O
+        /// thread (n % slots), pin I/O threads to match. Linux only, falls back
+        /// to kernel hashing if not available.
+        bool steer_by_cpu;
+
         ListenOption();
         void ToString(std::string *str) const;
     }; // struct ListenOption
@@ -164,6 +192,23 @@ public:
     bool Send(channel_t channel, const void *buffer, size_t length);
     bool Send(const EasyContext &context, const void *buffer, size_t length);
 
+    /// Send bytes of a file in order with Send(), the kernel sends them without
+    /// copying unless it's TLS without kTLS. Same rules as Send() otherwise.
+    /// @param fd a regular file, life span TAKEN even if failed, closed once
+    ///           sent or dropped. Keep the bytes unchanged until then.
+    bool SendFile(channel_t channel, int fd, int64_t offset, size_t length);
+    bool SendFile(const EasyContext &context, int fd, int64_t offset, size_t length);
+
+    /// Opt in to gather sends and write them once the round of the I/O thread
+    /// is over, trading latency for throughput, say within OnConnected().
+    /// @sa Linkage::set_write_coalescing()
+    bool SetWriteCoalescing(channel_t channel, bool coalescing, bool tcp_cork = false);
+    bool SetWriteCoalescing(const EasyContext &context, bool coalescing, bool tcp_cork = false);
+
+    /// Write what's gathered now rather than when the round is over.
+    bool Flush(channel_t channel);
+    bool Flush(const EasyContext &context);
+
     /// Allocate channel for outgoing connection.
     /// Call after Initialize().
     /// @sa Forget()
@@ -210,6 +255,24 @@ public:
     /// Queue job in specified I/O thread, assertion if thread_id is invalid.
     bool QueueIo(Runnable *job, int thread_id);
 
+    /// Connections accepted by an I/O thread so far, sample it for rates.
+    /// Thread safe.
+    /// @return 0 if thread_id is invalid.
+    uint64_t GetAcceptedConnections(int thread_id) const;
+
+    /// How late an I/O thread gets to its events, with loop_latency_probe.
+    /// Thread safe.
+    /// @param percentile in (0, 100], 99 for p99.
+    /// @param reset start over after reading, to sample time windows.
+    /// @return nanoseconds, 0 if thread_id is invalid or nothing measured.
+    int64_t GetLoopLatency(int thread_id, double percentile, bool reset = false);
+
+    /// How many I/O threads, 0 if not initialized.
+    size_t slots() const
+    {
+        return _slots;
+    }
+
     /// Thread safe.
     bool Shutdown();
 
@@ -232,18 +295,23 @@ private:
     class ProxyLinkageWorker;
     class RegisterTimerJob;
     class ProxyListener;
+    class ListenShard;
     class DisconnectJob;
+    class FlushJob;
     class ProxyLinkage;
     class ProxyHandler;
     class JobWorker;
     class IoContext;
+    class JobQueue;
     class SendJob;
+    class SendFileJob;
 
     // Locked.
     void ReleaseChannel(channel_t channel);
 
     // Called by JobWorker thread.
     Runnable *GetJob(size_t id);
+    bool StealJob(Runnable **job);
 
     // Called by ProxyListener.
     Linkage *AllocateChannel(LinkageWorker *worker,
@@ -259,15 +327,27 @@ private:
                                      bool socket_connecting);
 
     channel_t AllocateChannel(IoContext *ioc, bool incoming_or_outgoing);
-    bool AttachListeners(LinkageWorker *worker);
-    void DoAppendJob(Runnable *job, int hash); // No lock.
+    bool AttachListeners(ProxyLinkageWorker *worker);
+    bool ListenSharded(const ListenOption &o, ProxyHandler *proxy_handler);
+    void DoAppendJob(Runnable *job, int hash); // Lock free.
     bool DoShutdown(MutexLocker *locker);
     void DoDumpJobs();
 
-    // Locked.
+    // Lower 32 bits are slot index * _slots + thread id, followed by 31 bits
+    // of slot generation and the outgoing bit.
     int GetThreadId(channel_t channel) const
     {
-        return static_cast<int>((channel & 0x7fffffffffffffffull) % _slots);
+        return static_cast<int>((channel & 0xffffffffull) % _slots);
+    }
+
+    uint32_t GetChannelIndex(channel_t channel) const
+    {
+        return static_cast<uint32_t>((channel & 0xffffffffull) / _slots);
+    }
+
+    static uint32_t GetChannelGeneration(channel_t channel)
+    {
+        return static_cast<uint32_t>((channel >> 32) & 0x7fffffffull);
     }
 
     // Locked.
@@ -283,35 +363,55 @@ private:
     // thread_id can be out of range so a random one is picked.
     ProxyLinkageWorker *GetIoWorker(int thread_id) const;
 
+    static bool IsResolvingNeeded(AsyncResolver *resolver,
+                                  const Interface::Socket &socket);
+
     ProxyLinkage *DoReconnect(ProxyLinkageWorker *worker,
                               channel_t channel,
                               const OutgoingInformation *info);
 
     // Called by jobs from I/O workers.
     void DoRealDisconnect(channel_t channel, bool finish_write);
+    void DoRealFlush(channel_t channel, bool set, bool coalescing, bool tcp_cork);
+    /// @param block allocated by malloc() holding buffer, life span TAKEN,
+    ///              or NULL to copy buffer.
     void DoRealSend(ProxyLinkageWorker *worker,
                     channel_t channel,
                     const void *buffer,
-                    size_t length);
+                    size_t length,
+                    void *block);
+
+    /// @param fd life span TAKEN.
+    void DoRealSendFile(ProxyLinkageWorker *worker,
+                        channel_t channel,
+                        int fd,
+                        int64_t offset,
+                        size_t length);
 
     static const Configure kDefaultConfigure;
 
     typedef std::unordered_map<channel_t, OutgoingInformation *> outgoing_map_t;
-    typedef std::unordered_map<channel_t, ProxyLinkage *> channel_map_t;
     typedef std::unordered_map<channel_t, ProxyHandler *> connect_map_t;
 
     std::list<std::pair<Runnable *, std::pair<int64_t, int64_t> > > _timers;
     std::list<ProxyHandler *> _listen_proxy_handlers;
-    std::vector<std::queue<Runnable *> > _hashjobs;
+    std::list<ListenShard *> _listen_shards;
     std::vector<ProxyLinkageWorker *> _io_workers;
     std::vector<JobWorker *> _job_workers;
+    std::vector<JobQueue *> _job_queues;
     std::list<Listener *> _listeners;
-    std::queue<Runnable *> _jobs;
     FixedThreadPool *const _pool;
-    Condition *const _incoming;
     Configure _configure;
     Mutex *const _gmutex;
 
+    // Jobs that any worker can steal, hashed jobs go to their own JobQueue.
+    // Pushed lock free and counted afterwards, popped by one worker at a time.
+    MpscQueue<Runnable *> *const _jobs;
+    uatomic64_t _pending_jobs;
+    atomic_t _stealing;
+    uatomic64_t _waking;
+    atomic_t _quitting;
+
     // For efficiency, these variables are not lock protected.
     size_t _workers;
     size_t _slots;
@@ -0,0 +1,689 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "flinter/linkage/easy_upstream.h"
+
+#include <assert.h>
+
+#include "flinter/linkage/easy_context.h"
+#include "flinter/linkage/easy_handler.h"
+
+#include "flinter/thread/mutex.h"
+#include "flinter/thread/mutex_locker.h"
+
+#include "flinter/factory.h"
+#include "flinter/runnable.h"
+#include "flinter/logger.h"
+#include "flinter/utility.h"
+
+namespace flinter {
+
+struct EasyUpstream::table_t {
+    table_t() : retired(0) {}
+    std::vector<Backend *> backends;
+    uint64_t retired; // Epoch flips when retired.
+}; // struct EasyUpstream::table_t
+
+// Makes a Handler for every linkage of the channel, EasyServer releases it
+// along with the last reference to the context.
+class EasyUpstream::Connection : public Factory<EasyHandler> {
+public:
+    Connection(EasyUpstream *upstream,
+               Backend *backend,
+               EasyHandler *easy_handler) : _channel(EasyServer::kInvalidChannel)
+                                          , _upstream(upstream)
+                                          , _backend(backend)
+                                          , _easy_handler(easy_handler)
+                                          , _pending(0)
+                                          , _handlers(0)
+                                          , _up(0) {}
+
+    virtual ~Connection() {}
+    virtual EasyHandler *Create() const;
+
+    channel_t _channel;
+    EasyUpstream *const _upstream;
+    Backend *const _backend;
+    EasyHandler *const _easy_handler;
+    atomic64_t _pending;
+    atomic64_t _handlers;
+    atomic_t _up;
+
+}; // class EasyUpstream::Connection
+
+class EasyUpstream::Handler : public EasyHandler {
+public:
+    explicit Handler(Connection *connection) : _connection(connection)
+                                             , _easy_handler(connection->_easy_handler)
+    {
+        _connection->_handlers.AddAndFetch(1);
+    }
+
+    virtual ~Handler()
+    {
+        _connection->_handlers.SubAndFetch(1);
+    }
+
+    virtual ssize_t GetMessageLength(const EasyContext &context,
+                                     const void *buffer,
+                                     size_t length)
+    {
+        return _easy_handler->GetMessageLength(context, buffer, length);
+    }
+
+    virtual int HashMessage(const EasyContext &context,
+                            const void *buffer,
+                            size_t length)
+    {
+        return _easy_handler->HashMessage(context, buffer, length);
+    }
+
+    virtual int OnMessage(const EasyContext &context,
+                          const void *buffer,
+                          size_t length)
+    {
+        return _easy_handler->OnMessage(context, buffer, length);
+    }
+
+    virtual void OnDisconnected(const EasyContext &context)
+    {
+        _connection->_up.Set(0);
+        _easy_handler->OnDisconnected(context);
+    }
+
+    virtual bool OnConnected(const EasyContext &context)
+    {
+        if (!_easy_handler->OnConnected(context)) {
+            return false;
+        }
+
+        _connection->_up.Set(1);
+        return true;
+    }
+
+    virtual void OnError(const EasyContext &context,
+                         bool reading_or_writing,
+                         int errnum)
+    {
+        _connection->_up.Set(0);
+        _connection->_upstream->OnFailed(_connection->_backend);
+        _easy_handler->OnError(context, reading_or_writing, errnum);
+    }
+
+    virtual void OnWriteBlocked(const EasyContext &context)
+    {
+        _easy_handler->OnWriteBlocked(context);
+    }
+
+    virtual void OnWriteDrained(const EasyContext &context)
+    {
+        _easy_handler->OnWriteDrained(context);
+    }
+
+    virtual bool Cleanup(const EasyContext &context, int64_t now)
+    {
+        return _easy_handler->Cleanup(context, now);
+    }
+
+private:
+    Connection *const _connection;
+    EasyHandler *const _easy_handler;
+
+}; // class EasyUpstream::Handler
+
+EasyHandler *EasyUpstream::Connection::Create() const
+{
+    return new Handler(const_cast<Connection *>(this));
+}
+
+// Marks a lock free reader of _table.
+class EasyUpstream::Reader {
+public:
+    explicit Reader(const EasyUpstream *upstream)
+            : _readers(&upstream->_readers[upstream->_epoch.Get()])
+    {
+        _readers->AddAndFetch(1);
+    }
+
+    ~Reader()
+    {
+        _readers->SubAndFetch(1);
+    }
+
+private:
+    atomic64_t *const _readers;
+
+}; // class EasyUpstream::Reader
+
+class EasyUpstream::Backend {
+public:
+    Backend(const std::string &name, size_t regular) : _name(name)
+                                                     , _regular(regular)
+                                                     , _pending(0)
+                                                     , _failures(0)
+                                                     , _ejections(0)
+                                                     , _ejected_until(0)
+                                                     , _retired(0) {}
+
+    ~Backend()
+    {
+        for (std::vector<Connection *>::iterator p = _connections.begin();
+             p != _connections.end(); ++p) {
+
+            delete *p;
+        }
+    }
+
+    bool ejected(int64_t now) const
+    {
+        return _ejected_until.Get() > now;
+    }
+
+    // Regular connections that are up, standby ones that are up, regular ones
+    // that are down and will be reconnected once sent to.
+    Connection *GetConnection() const
+    {
+        Connection *c = GetLeastPending(0, _regular, true);
+        if (c) {
+            return c;
+        }
+
+        c = GetLeastPending(_regular, _connections.size(), true);
+        if (c) {
+            return c;
+        }
+
+        return GetLeastPending(0, _regular, false);
+    }
+
+    const std::string _name;
+    std::vector<Connection *> _connections; // Regular ones, then standby ones.
+    const size_t _regular;
+    atomic64_t _pending;
+    atomic64_t _failures;
+    atomic64_t _ejections;
+    atomic64_t _ejected_until;
+    uint64_t _retired; // Epoch flips when retired.
+
+private:
+    Connection *GetLeastPending(size_t begin, size_t end, bool up) const
+    {
+        Connection *best = NULL;
+        int64_t least = 0;
+        for (size_t i = begin; i < end; ++i) {
+            Connection *c = _connections[i];
+            if (up && !c->_up.Get()) {
+                continue;
+            }
+
+            int64_t pending = c->_pending.Get();
+            if (!best || pending < least) {
+                best = c;
+                least = pending;
+            }
+        }
+
+        return best;
+    }
+
+}; // class EasyUpstream::Backend
+
+class EasyUpstream::ReconnectTimer : public Runnable {
+public:
+    explicit ReconnectTimer(EasyUpstream *upstream) : _upstream(upstream) {}
+    virtual ~ReconnectTimer() {}
+    virtual bool Run()
+    {
+        _upstream->Reconnect();
+        return true;
+    }
+
+private:
+    EasyUpstream *const _upstream;
+
+}; // class EasyUpstream::ReconnectTimer
+
+EasyUpstream::Option::Option()
+        : connections(2)
+        , standby_connections(0)
+        , balance(kBalancePowerOfTwo)
+        , ejection_threshold(5)
+        , ejection_time(30000000000LL)              // 30s
+        , maximum_ejection_time(300000000000LL)     // 300s
+        , maximum_ejection_percent(50)
+        , reconnect_interval(1000000000LL)          // 1s
+{
+    // Intended left blank.
+}
+
+EasyUpstream::EasyUpstream(EasyServer *easy_server, const Option &option)
+        : _easy_server(easy_server)
+        , _option(option)
+        , _table(new table_t)
+        , _sequence(static_cast<uint64_t>(get_monotonic_timestamp()))
+        , _mutex(new Mutex)
+        , _epoch(0)
+        , _flips(0)
+{
+    assert(easy_server);
+    if (!_easy_server->RegisterTimer(_option.reconnect_interval,
+                                     new ReconnectTimer(this))) {
+
+        LOG(WARN) << "EasyUpstream: failed to register timer, "
+                  << "connections are only reconnected when sent to.";
+    }
+}
+
+EasyUpstream::~EasyUpstream()
+{
+    table_t *table = _table.Get();
+    for (std::vector<Backend *>::iterator p = table->backends.begin();
+         p != table->backends.end(); ++p) {
+
+        delete *p;
+    }
+
+    delete table;
+
+    for (std::list<table_t *>::iterator p = _retired_tables.begin();
+         p != _retired_tables.end(); ++p) {
+
+        delete *p;
+    }
+
+    for (std::list<Backend *>::iterator p = _retired_backends.begin();
+         p != _retired_backends.end(); ++p) {
+
+        delete *p;
+    }
+
+    delete _mutex;
+}
+
+bool EasyUpstream::Add(const std::string &name,
+                       const EasyServer::ConnectOption &o)
+{
+    if (!o.easy_handler || o.easy_factory) {
+        LOG(FATAL) << "EasyUpstream: BUG: only handler can be configured.";
+        return false;
+    }
+
+    size_t total = _option.connections + _option.standby_connections;
+    size_t slots = _easy_server->slots();
+    if (!_option.connections || !slots) {
+        LOG(ERROR) << "EasyUpstream: invalid parameters for backend: " << name;
+        return false;
+    }
+
+    MutexLocker locker(_mutex);
+    table_t *table = _table.Get();
+    for (std::vector<Backend *>::const_iterator p = table->backends.begin();
+         p != table->backends.end(); ++p) {
+
+        if ((*p)->_name == name) {
+            LOG(WARN) << "EasyUpstream: backend already exists: " << name;
+            return false;
+        }
+    }
+
+    // Stagger backends so that the first connections don't pile up.
+    Backend *backend = new Backend(name, _option.connections);
+    EasyServer::ConnectOption co(o);
+    co.easy_handler = NULL;
+    for (size_t i = 0; i < total; ++i) {
+        Connection *c = new Connection(this, backend, o.easy_handler);
+        backend->_connections.push_back(c);
+
+        co.easy_factory = c;
+        co.thread_id = static_cast<int>((table->backends.size() + i) % slots);
+        c->_channel = _easy_server->Connect(co);
+        if (!EasyServer::IsValidChannel(c->_channel)) {
+            LOG(ERROR) << "EasyUpstream: failed to connect backend: " << name;
+            for (size_t j = 0; j < i; ++j) {
+                _easy_server->Forget(backend->_connections[j]->_channel);
+            }
+
+            delete backend;
+            return false;
+        }
+    }
+
+    table_t *next = new table_t;
+    next->backends = table->backends;
+    next->backends.push_back(backend);
+    _table.BarrierSet(next);
+    Retire(table, NULL);
+
+    // Connect in advance, standby ones as well.
+    for (size_t i = 0; i < total; ++i) {
+        _easy_server->Send(backend->_connections[i]->_channel, NULL, 0);
+    }
+
+    LOG(VERBOSE) << "EasyUpstream: backend added: " << name;
+    return true;
+}
+
+bool EasyUpstream::Remove(const std::string &name)
+{
+    MutexLocker locker(_mutex);
+    table_t *table = _table.Get();
+    table_t *next = new table_t;
+    Backend *backend = NULL;
+    for (std::vector<Backend *>::const_iterator p = table->backends.begin();
+         p != table->backends.end(); ++p) {
+
+        if ((*p)->_name == name) {
+            backend = *p;
+        } else {
+            next->backends.push_back(*p);
+        }
+    }
+
+    if (!backend) {
+        delete next;
+        return false;
+    }
+
+    _table.BarrierSet(next);
+
+    // Connections are still valid for in flight requests.
+    for (std::vector<Connection *>::const_iterator p = backend->_connections.begin();
+         p != backend->_connections.end(); ++p) {
+
+        _easy_server->Disconnect((*p)->_channel, true);
+        _easy_server->Forget((*p)->_channel);
+    }
+
+    Retire(table, backend);
+
+    LOG(VERBOSE) << "EasyUpstream: backend removed: " << name;
+    return true;
+}
+
+EasyUpstream::channel_t EasyUpstream::Get(Connection **connection)
+{
+    Reader reader(this);
+    const table_t *table = _table.BarrierGet();
+    Backend *backend = Pick(table, get_monotonic_timestamp());
+    Connection *c = backend ? backend->GetConnection() : NULL;
+    if (!c) {
+        *connection = NULL;
+        return EasyServer::kInvalidChannel;
+    }
+
+    c->_pending.AddAndFetch(1);
+    backend->_pending.AddAndFetch(1);
+    *connection = c;
+    return c->_channel;
+}
+
+void EasyUpstream::Put(Connection *connection, bool succeeded)
+{
+    if (!connection) {
+        return;
+    }
+
+    // The backend might be released once nothing's pending.
+    Backend *backend = connection->_backend;
+    if (succeeded) {
+        OnSucceeded(backend);
+    } else {
+        OnFailed(backend);
+    }
+
+    connection->_pending.SubAndFetch(1);
+    backend->_pending.SubAndFetch(1);
+}
+
+EasyUpstream::Backend *EasyUpstream::Pick(const table_t *table, int64_t now)
+{
+    const std::vector<Backend *> &backends = table->backends;
+    size_t size = backends.size();
+    if (!size) {
+        return NULL;
+    }
+
+    uint64_t r = Random();
+    if (_option.balance == kBalancePowerOfTwo && size > 1) {
+        size_t i = static_cast<size_t>(r % size);
+        size_t j = (i + 1 + static_cast<size_t>((r >> 32) % (size - 1))) % size;
+        Backend *x = backends[i];
+        Backend *y = backends[j];
+        bool xe = x->ejected(now);
+        bool ye = y->ejected(now);
+        if (!xe && !ye) {
+            return x->_pending.Get() <= y->_pending.Get() ? x : y;
+        } else if (!xe) {
+            return x;
+        } else if (!ye) {
+            return y;
+        }
+
+        // Both ejected, look for any healthy one.
+    }
+
+    // Start from a random one so that ties are spread. If all backends are
+    // ejected, use them anyway rather than failing everything.
+    Backend *healthy = NULL;
+    Backend *any = NULL;
+    size_t start = static_cast<size_t>(r % size);
+    for (size_t k = 0; k < size; ++k) {
+        Backend *b = backends[(start + k) % size];
+        int64_t pending = b->_pending.Get();
+        if (!any || pending < any->_pending.Get()) {
+            any = b;
+        }
+
+        if (!b->ejected(now) && (!healthy || pending < healthy->_pending.Get())) {
+            healthy = b;
+        }
+    }
+
+    return healthy ? healthy : any;
+}
+
+void EasyUpstream::OnSucceeded(Backend *backend)
+{
+    backend->_failures.Set(0);
+    if (backend->_ejections.Get() &&
+        !backend->ejected(get_monotonic_timestamp())) {
+
+        backend->_ejections.Set(0);
+    }
+}
+
+void EasyUpstream::OnFailed(Backend *backend)
+{
+    if (!_option.ejection_threshold) {
+        return;
+    }
+
+    int64_t failures = backend->_failures.AddAndFetch(1);
+    if (failures < static_cast<int64_t>(_option.ejection_threshold)) {
+        return;
+    }
+
+    int64_t now = get_monotonic_timestamp();
+    int64_t until = backend->_ejected_until.Get();
+    if (until > now) {
+        return;
+    }
+
+    Reader reader(this);
+    const table_t *table = _table.BarrierGet();
+    size_t ejected = 0;
+    for (std::vector<Backend *>::const_iterator p = table->backends.begin();
+         p != table->backends.end(); ++p) {
+
+        if ((*p)->ejected(now)) {
+            ++ejected;
+        }
+    }
+
+    if (ejected && (ejected + 1) * 100 >
+            table->backends.size() * _option.maximum_ejection_percent) {
+
+        return;
+    }
+
+    int64_t duration = _option.ejection_time;
+    for (int64_t i = backend->_ejections.Get();
+         i > 0 && duration < _option.maximum_ejection_time; --i) {
+
+        duration *= 2;
+    }
+
+    if (duration > _option.maximum_ejection_time) {
+        duration = _option.maximum_ejection_time;
+    }
+
+    // Someone else did it.
+    if (backend->_ejected_until.CompareAndSwap(until, now + duration) != until) {
+        return;
+    }
+
+    backend->_ejections.AddAndFetch(1);
+    backend->_failures.Set(0);
+    LOG(WARN) << "EasyUpstream: backend ejected for " << duration / 1000000
+              << "ms: " << backend->_name;
+}
+
+void EasyUpstream::Reconnect()
+{
+    // Don't hold the I/O thread up if backends are being changed.
+    if (_mutex->TryLock()) {
+        Reclaim();
+        _mutex->Unlock();
+    }
+
+    Reader reader(this);
+    const table_t *table = _table.BarrierGet();
+    int64_t now = get_monotonic_timestamp();
+    for (std::vector<Backend *>::const_iterator p = table->backends.begin();
+         p != table->backends.end(); ++p) {
+
+        // Ejected ones are reconnected once they're back.
+        const Backend *backend = *p;
+        if (backend->ejected(now)) {
+            continue;
+        }
+
+        for (std::vector<Connection *>::const_iterator
+             q = backend->_connections.begin();
+             q != backend->_connections.end(); ++q) {
+
+            if (!(*q)->_up.Get()) {
+                _easy_server->Send((*q)->_channel, NULL, 0);
+            }
+        }
+    }
+}
+
+size_t EasyUpstream::backends() const
+{
+    Reader reader(this);
+    return _table.BarrierGet()->backends.size();
+}
+
+size_t EasyUpstream::ejected_backends() const
+{
+    Reader reader(this);
+    const table_t *table = _table.BarrierGet();
+    int64_t now = get_monotonic_timestamp();
+    size_t ejected = 0;
+    for (std::vector<Backend *>::const_iterator p = table->backends.begin();
+         p != table->backends.end(); ++p) {
+
+        if ((*p)->ejected(now)) {
+            ++ejected;
+        }
+    }
+
+    return ejected;
+}
+
+size_t EasyUpstream::retired_backends() const
+{
+    MutexLocker locker(_mutex);
+    return _retired_backends.size();
+}
+
+void EasyUpstream::Retire(table_t *table, Backend *backend)
+{
+    table->retired = _flips;
+    _retired_tables.push_back(table);
+    if (backend) {
+        backend->_retired = _flips;
+        _retired_backends.push_back(backend);
+    }
+
+    Reclaim();
+}
+
+void EasyUpstream::Reclaim()
+{
+    // Flip to the other epoch once it's drained, readers still in the current
+    // one must leave before flipping back. Those entering from now on only see
+    // the current table.
+    for (int i = 0; i < 2; ++i) {
+        int epoch = _epoch.Get();
+        if (_readers[epoch ^ 1].BarrierGet()) {
+            break;
+        }
+
+        _epoch.Set(epoch ^ 1);
+        ++_flips;
+    }
+
+    while (!_retired_tables.empty() &&
+           _retired_tables.front()->retired + 2 <= _flips) {
+
+        delete _retired_tables.front();
+        _retired_tables.pop_front();
+    }
+
+    std::list<Backend *>::iterator p = _retired_backends.begin();
+    while (p != _retired_backends.end()) {
+        Backend *backend = *p;
+        bool used = backend->_retired + 2 > _flips || backend->_pending.Get();
+        for (std::vector<Connection *>::const_iterator
+             q = backend->_connections.begin();
+             !used && q != backend->_connections.end(); ++q) {
+
+            used = (*q)->_handlers.Get() != 0;
+        }
+
+        if (used) {
+            ++p;
+            continue;
+        }
+
+        LOG(VERBOSE) << "EasyUpstream: backend released: " << backend->_name;
+        delete backend;
+        p = _retired_backends.erase(p);
+    }
+}
+
+uint64_t EasyUpstream::Random()
+{
+    // splitmix64, shared by all threads without locking.
+    uint64_t z = _sequence.AddAndFetch(0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+} // namespace flinter
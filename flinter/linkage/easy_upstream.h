@@ -0,0 +1,149 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef FLINTER_LINKAGE_EASY_UPSTREAM_H
+#define FLINTER_LINKAGE_EASY_UPSTREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <string>
+#include <vector>
+
+#include <flinter/linkage/easy_server.h>
+#include <flinter/types/atomic.h>
+#include <flinter/common.h>
+
+namespace flinter {
+
+class Mutex;
+
+/// EasyUpstream keeps a pool of outgoing connections to each of a set of
+/// backends, spread across I/O threads, and picks one for every request.
+///
+/// Picking is lock free, only adding and removing backends lock. Backends
+/// failing too many times in a row are ejected for a while, longer every time
+/// they're ejected again. Standby connections are connected in advance and
+/// only picked if none of the regular ones are up.
+///
+/// Connections are reconnected in the background from an EasyServer timer, so
+/// release the upstream only after the EasyServer is shut down. The same timer
+/// releases removed backends once nobody uses them any more.
+class EasyUpstream {
+public:
+    typedef EasyServer::channel_t channel_t;
+
+    enum Balance {
+        kBalanceLeastPending = 0, ///< Backend with the fewest pending requests.
+        kBalancePowerOfTwo   = 1, ///< Fewer pending of two random backends.
+    }; // enum Balance
+
+    struct Option {
+        size_t connections;             ///< Per backend.
+        size_t standby_connections;     ///< Per backend, 0 for none.
+        Balance balance;
+
+        size_t ejection_threshold;      ///< Failures in a row, 0 to never eject.
+        int64_t ejection_time;          ///< Doubled every time, nanoseconds.
+        int64_t maximum_ejection_time;  ///< In nanoseconds.
+        size_t maximum_ejection_percent;///< At least one can be ejected.
+
+        int64_t reconnect_interval;     ///< In nanoseconds.
+
+        Option();
+    }; // struct Option
+
+    class Connection;
+
+    /// @param easy_server life span NOT taken, must be initialized.
+    EasyUpstream(EasyServer *easy_server, const Option &option);
+    ~EasyUpstream();
+
+    /// Thread safe.
+    /// @param name to identify the backend, must be unique.
+    /// @param o easy_handler must be set, thread_id is ignored. Factories are
+    ///          not supported since connections share the same handler.
+    bool Add(const std::string &name, const EasyServer::ConnectOption &o);
+
+    /// Thread safe, connections are closed gracefully.
+    bool Remove(const std::string &name);
+
+    /// Thread safe and lock free.
+    /// @param connection Put() it back when the request is done.
+    /// @return kInvalidChannel if there's no backend.
+    channel_t Get(Connection **connection);
+
+    /// Thread safe and lock free.
+    /// @param succeeded false for errors and timeouts, they count toward
+    ///                  ejecting the backend.
+    void Put(Connection *connection, bool succeeded);
+
+    /// Thread safe and lock free.
+    size_t backends() const;
+
+    /// Thread safe and lock free.
+    size_t ejected_backends() const;
+
+    /// Thread safe.
+    /// @return removed backends not released yet.
+    size_t retired_backends() const;
+
+private:
+    NON_COPYABLE(EasyUpstream);
+
+    class ReconnectTimer;
+    class Handler;
+    class Backend;
+    class Reader;
+    struct table_t;
+
+    // Called by Connection.
+    void OnSucceeded(Backend *backend);
+    void OnFailed(Backend *backend);
+
+    // Called by ReconnectTimer.
+    void Reconnect();
+
+    // Called with _mutex held.
+    void Retire(table_t *table, Backend *backend);
+    void Reclaim();
+
+    Backend *Pick(const table_t *table, int64_t now);
+    uint64_t Random();
+
+    EasyServer *const _easy_server;
+    const Option _option;
+    Atomic<table_t *> _table;
+    uatomic64_t _sequence;
+    Mutex *const _mutex;
+
+    // Lock free readers of _table enter either epoch, nobody reads a table
+    // retired before the epoch is flipped twice.
+    atomic_t _epoch;
+    mutable atomic64_t _readers[2];
+    uint64_t _flips;
+
+    // Retired backends are still used by pending requests and by EasyServer
+    // until their connections are released.
+    std::list<table_t *> _retired_tables;
+    std::list<Backend *> _retired_backends;
+
+}; // class EasyUpstream
+
+} // namespace flinter
+
+#endif // FLINTER_LINKAGE_EASY_UPSTREAM_H
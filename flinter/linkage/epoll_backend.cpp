@@ -0,0 +1,311 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flinter/linkage/epoll_backend.h"
+
+#if defined(__linux__)
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+
+#include "flinter/safeio.h"
+#include "flinter/utility.h"
+
+namespace flinter {
+
+struct EpollBackend::watcher_t {
+    struct io_t io;
+    bool registered;
+    bool removed;
+}; // struct EpollBackend::watcher_t
+
+struct EpollBackend::ticker_t {
+    struct timer_t timer;
+    int64_t repeat;
+    tickers_t::iterator where;
+}; // struct EpollBackend::ticker_t
+
+const int EpollBackend::kMaximumEvents = 256;
+
+EpollBackend::EpollBackend(Callback *callback)
+        : _callback(callback)
+        , _dispatching(false)
+        , _break(false)
+        , _eventfd(-1)
+        , _epfd(-1)
+{
+    assert(callback);
+}
+
+EpollBackend::~EpollBackend()
+{
+    for (std::vector<struct watcher_t *>::iterator p = _removed.begin();
+         p != _removed.end(); ++p) {
+
+        delete *p;
+    }
+
+    for (tickers_t::iterator p = _tickers.begin(); p != _tickers.end(); ++p) {
+        delete p->second;
+    }
+
+    if (_eventfd >= 0) {
+        safe_close(_eventfd);
+    }
+
+    if (_epfd >= 0) {
+        safe_close(_epfd);
+    }
+}
+
+bool EpollBackend::Initialize()
+{
+    _epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (_epfd < 0) {
+        return false;
+    }
+
+    _eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_eventfd < 0) {
+        return false;
+    }
+
+    // NULL stands for the eventfd.
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    if (epoll_ctl(_epfd, EPOLL_CTL_ADD, _eventfd, &event)) {
+        return false;
+    }
+
+    return true;
+}
+
+bool EpollBackend::Control(struct watcher_t *watcher, bool read, bool write)
+{
+    int fd = watcher->io.fd;
+    uint32_t events = (read ? EPOLLIN : 0u) | (write ? EPOLLOUT : 0u);
+
+    // Errors and hang ups are reported regardless, so unregister instead.
+    if (!events) {
+        if (watcher->registered) {
+            struct epoll_event event;
+            memset(&event, 0, sizeof(event));
+            if (epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, &event)) {
+                return false;
+            }
+
+            watcher->registered = false;
+        }
+
+        return true;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = watcher;
+    int op = watcher->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(_epfd, op, fd, &event)) {
+        return false;
+    }
+
+    watcher->registered = true;
+    return true;
+}
+
+EventBackend::io_t *EpollBackend::AddIo(int fd, bool read, bool write, void *context)
+{
+    struct watcher_t *watcher = new struct watcher_t;
+    watcher->io.context = context;
+    watcher->io.fd = fd;
+    watcher->io.read = read;
+    watcher->io.write = write;
+    watcher->registered = false;
+    watcher->removed = false;
+
+    if (!Control(watcher, read, write)) {
+        delete watcher;
+        return NULL;
+    }
+
+    return &watcher->io;
+}
+
+bool EpollBackend::SetIo(struct io_t *io, bool read, bool write)
+{
+    struct watcher_t *watcher = reinterpret_cast<struct watcher_t *>(io);
+    if (read == io->read && write == io->write) {
+        return true;
+    }
+
+    if (!Control(watcher, read, write)) {
+        return false;
+    }
+
+    io->read = read;
+    io->write = write;
+    return true;
+}
+
+void EpollBackend::RemoveIo(struct io_t *io)
+{
+    struct watcher_t *watcher = reinterpret_cast<struct watcher_t *>(io);
+    Control(watcher, false, false);
+
+    // Events of this round might still refer to it.
+    if (_dispatching) {
+        watcher->removed = true;
+        _removed.push_back(watcher);
+        return;
+    }
+
+    delete watcher;
+}
+
+EventBackend::timer_t *EpollBackend::AddTimer(int64_t after,
+                                              int64_t repeat,
+                                              void *context)
+{
+    if (after < 0 || repeat <= 0) {
+        return NULL;
+    }
+
+    struct ticker_t *ticker = new struct ticker_t;
+    ticker->timer.context = context;
+    ticker->repeat = repeat;
+    ticker->where = _tickers.insert(std::make_pair(
+            get_monotonic_timestamp() + after, ticker));
+
+    return &ticker->timer;
+}
+
+void EpollBackend::RemoveTimer(struct timer_t *timer)
+{
+    struct ticker_t *ticker = reinterpret_cast<struct ticker_t *>(timer);
+    _tickers.erase(ticker->where);
+    delete ticker;
+}
+
+void EpollBackend::Wakeup()
+{
+    // Only fails if the counter is about to overflow, which is fine.
+    uint64_t one = 1;
+    safe_write(_eventfd, &one, sizeof(one));
+}
+
+void EpollBackend::Break()
+{
+    _break = true;
+}
+
+int EpollBackend::GetTimeout(int64_t now) const
+{
+    if (_tickers.empty()) {
+        return -1;
+    }
+
+    int64_t diff = _tickers.begin()->first - now;
+    if (diff <= 0) {
+        return 0;
+    }
+
+    // Round up, or it wakes up too early and spins.
+    int64_t ms = (diff + 999999) / 1000000;
+    return ms > INT_MAX ? INT_MAX : static_cast<int>(ms);
+}
+
+void EpollBackend::OnTimers(int64_t now)
+{
+    while (!_tickers.empty()) {
+        tickers_t::iterator p = _tickers.begin();
+        if (p->first > now) {
+            break;
+        }
+
+        // Reschedule before calling since it might remove itself.
+        struct ticker_t *ticker = p->second;
+        _tickers.erase(p);
+        ticker->where = _tickers.insert(std::make_pair(now + ticker->repeat, ticker));
+        _callback->OnTimer(&ticker->timer);
+    }
+}
+
+bool EpollBackend::Run()
+{
+    struct epoll_event events[kMaximumEvents];
+
+    _break = false;
+    while (!_break) {
+        int ret = epoll_wait(_epfd, events, kMaximumEvents,
+                             GetTimeout(get_monotonic_timestamp()));
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        _dispatching = true;
+        for (int i = 0; i < ret; ++i) {
+            struct watcher_t *watcher =
+                    reinterpret_cast<struct watcher_t *>(events[i].data.ptr);
+
+            if (!watcher) {
+                uint64_t count;
+                safe_read(_eventfd, &count, sizeof(count));
+                _callback->OnWakeup();
+                continue;
+            }
+
+            uint32_t e = events[i].events;
+            if (!watcher->removed && watcher->io.read &&
+                (e & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+
+                _callback->OnReadable(&watcher->io);
+            }
+
+            if (!watcher->removed && watcher->io.write &&
+                (e & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+
+                _callback->OnWritable(&watcher->io);
+            }
+        }
+
+        _dispatching = false;
+        for (std::vector<struct watcher_t *>::iterator p = _removed.begin();
+             p != _removed.end(); ++p) {
+
+            delete *p;
+        }
+
+        _removed.clear();
+        OnTimers(get_monotonic_timestamp());
+        _callback->OnRound();
+    }
+
+    return true;
+}
+
+} // namespace flinter
+
+#endif // defined(__linux__)
@@ -0,0 +1,71 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLINTER_LINKAGE_EPOLL_BACKEND_H
+#define FLINTER_LINKAGE_EPOLL_BACKEND_H
+
+#include <map>
+#include <vector>
+
+#include "flinter/linkage/event_backend.h"
+
+namespace flinter {
+
+/// Level triggered epoll, with timers kept in a sorted map and an eventfd to
+/// be woken up. A round costs a single epoll_wait() plus the I/O itself.
+class EpollBackend : public EventBackend {
+public:
+    explicit EpollBackend(Callback *callback);
+    virtual ~EpollBackend();
+
+    bool Initialize();
+
+    virtual struct io_t *AddIo(int fd, bool read, bool write, void *context);
+    virtual bool SetIo(struct io_t *io, bool read, bool write);
+    virtual void RemoveIo(struct io_t *io);
+
+    virtual struct timer_t *AddTimer(int64_t after, int64_t repeat, void *context);
+    virtual void RemoveTimer(struct timer_t *timer);
+
+    virtual void Wakeup();
+    virtual bool Run();
+    virtual void Break();
+
+private:
+    struct watcher_t;
+    struct ticker_t;
+    typedef std::multimap<int64_t, struct ticker_t *> tickers_t;
+
+    bool Control(struct watcher_t *watcher, bool read, bool write);
+    int GetTimeout(int64_t now) const;
+    void OnTimers(int64_t now);
+
+    static const int kMaximumEvents;
+
+    // Removed during a round, released after it.
+    std::vector<struct watcher_t *> _removed;
+
+    Callback *const _callback;
+    tickers_t _tickers;
+    bool _dispatching;
+    bool _break;
+    int _eventfd;
+    int _epfd;
+
+}; // class EpollBackend
+
+} // namespace flinter
+
+#endif // FLINTER_LINKAGE_EPOLL_BACKEND_H
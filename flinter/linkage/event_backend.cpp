@@ -0,0 +1,82 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flinter/linkage/event_backend.h"
+
+#include "flinter/linkage/epoll_backend.h"
+#include "flinter/linkage/io_uring_backend.h"
+#include "flinter/linkage/libev_backend.h"
+#include "flinter/logger.h"
+
+#include "config.h"
+
+namespace flinter {
+
+EventBackend *EventBackend::Create(Type type, Callback *callback)
+{
+    if (type == kTypeDefault) {
+#if HAVE_EV_H
+        type = kTypeLibev;
+#else
+        type = kTypeEpoll;
+#endif
+    }
+
+#if HAVE_EV_H
+    if (type == kTypeLibev) {
+        LibevBackend *backend = new LibevBackend(callback);
+        if (!backend->Initialize()) {
+            delete backend;
+            return NULL;
+        }
+
+        return backend;
+    }
+#endif
+
+#if HAVE_IO_URING
+    if (type == kTypeIoUring) {
+        IoUringBackend *backend = new IoUringBackend(callback);
+        if (backend->Initialize()) {
+            return backend;
+        }
+
+        // Disabled by sysctl or seccomp, or simply too old.
+        delete backend;
+        CLOG.Warn("EventBackend: io_uring is not available, using epoll.");
+        type = kTypeEpoll;
+    }
+#elif defined(__linux__)
+    if (type == kTypeIoUring) {
+        type = kTypeEpoll;
+    }
+#endif
+
+#if defined(__linux__)
+    if (type == kTypeEpoll) {
+        EpollBackend *backend = new EpollBackend(callback);
+        if (!backend->Initialize()) {
+            delete backend;
+            return NULL;
+        }
+
+        return backend;
+    }
+#endif
+
+    return NULL;
+}
+
+} // namespace flinter
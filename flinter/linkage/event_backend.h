@@ -0,0 +1,106 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLINTER_LINKAGE_EVENT_BACKEND_H
+#define FLINTER_LINKAGE_EVENT_BACKEND_H
+
+#include <stdint.h>
+
+#include <flinter/common.h>
+
+namespace flinter {
+
+/// Event loop driving a LinkageWorker.
+///
+/// All methods must be called from the thread running the loop, except for
+/// Wakeup(). Callbacks are called within Run().
+class EventBackend {
+public:
+    enum Type {
+        kTypeDefault,   ///< libev if available, otherwise epoll.
+        kTypeLibev,     ///< Portable, the way it has always been.
+        kTypeEpoll,     ///< Linux only, calling epoll directly.
+        kTypeIoUring    ///< Linux only, epoll if the kernel refuses io_uring.
+    }; // enum Type
+
+    /// A watched file descriptor, allocated by backends.
+    struct io_t {
+        void *context;
+        int fd;
+        bool read;
+        bool write;
+    }; // struct io_t
+
+    /// A repeating timer, allocated by backends.
+    struct timer_t {
+        void *context;
+    }; // struct timer_t
+
+    class Callback {
+    public:
+        virtual ~Callback() {}
+        virtual void OnReadable(struct io_t *io) = 0;
+        virtual void OnWritable(struct io_t *io) = 0;
+        virtual void OnTimer(struct timer_t *timer) = 0;
+        virtual void OnWakeup() = 0;
+
+        /// Once every round after callbacks, before waiting for events.
+        virtual void OnRound() = 0;
+    }; // class Callback
+
+    /// @param callback life span NOT taken.
+    /// @return NULL if the type is not available or failed to initialize.
+    static EventBackend *Create(Type type, Callback *callback);
+
+    virtual ~EventBackend() {}
+
+    /// @return NULL if failed.
+    virtual struct io_t *AddIo(int fd, bool read, bool write, void *context) = 0;
+
+    virtual bool SetIo(struct io_t *io, bool read, bool write) = 0;
+
+    /// io is released, no more callbacks even within the same round.
+    virtual void RemoveIo(struct io_t *io) = 0;
+
+    /// @param after in nanoseconds.
+    /// @param repeat in nanoseconds, must be positive.
+    /// @return NULL if failed.
+    virtual struct timer_t *AddTimer(int64_t after,
+                                     int64_t repeat,
+                                     void *context) = 0;
+
+    /// timer is released.
+    virtual void RemoveTimer(struct timer_t *timer) = 0;
+
+    /// Thread safe, OnWakeup() will be called at least once later.
+    virtual void Wakeup() = 0;
+
+    /// Returns after Break() is called.
+    /// @return false if failed.
+    virtual bool Run() = 0;
+
+    virtual void Break() = 0;
+
+protected:
+    EventBackend() {}
+
+private:
+    NON_COPYABLE(EventBackend);
+
+}; // class EventBackend
+
+} // namespace flinter
+
+#endif // FLINTER_LINKAGE_EVENT_BACKEND_H
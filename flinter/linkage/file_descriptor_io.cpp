@@ -17,6 +17,11 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
+
+#if defined(__linux__)
+# include <sys/sendfile.h>
+#endif
 
 #include "flinter/linkage/interface.h"
 #include "flinter/safeio.h"
@@ -62,6 +67,77 @@ AbstractIo::Status FileDescriptorIo::Write(const void *buffer,
     }
 }
 
+AbstractIo::Status FileDescriptorIo::Writev(const struct iovec *iov,
+                                            size_t count,
+                                            size_t *retlen)
+{
+    int fd = _i->fd();
+    if (fd < 0) {
+        return kStatusBug;
+    }
+
+    if (count > IOV_MAX) {
+        count = IOV_MAX;
+    }
+
+    ssize_t ret = safe_writev(fd, iov, static_cast<int>(count));
+    if (ret >= 0) {
+        if (retlen) {
+            *retlen = static_cast<size_t>(ret);
+        }
+
+        return kStatusOk;
+    }
+
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return kStatusJammed;
+    } else if (errno == EPIPE) {
+        return kStatusClosed;
+    } else {
+        return kStatusError;
+    }
+}
+
+AbstractIo::Status FileDescriptorIo::SendFile(int fd,
+                                              int64_t offset,
+                                              size_t length,
+                                              size_t *retlen)
+{
+#if defined(__linux__)
+    int sockfd = _i->fd();
+    if (sockfd < 0 || fd < 0 || offset < 0) {
+        return kStatusBug;
+    }
+
+    off_t off = static_cast<off_t>(offset);
+    ssize_t ret;
+    do {
+        ret = sendfile(sockfd, fd, &off, length);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret > 0) {
+        if (retlen) {
+            *retlen = static_cast<size_t>(ret);
+        }
+
+        return kStatusOk;
+
+    } else if (ret == 0) { // Truncated since queued.
+        return kStatusError;
+    }
+
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return kStatusJammed;
+    } else if (errno == EPIPE) {
+        return kStatusClosed;
+    } else {
+        return kStatusError;
+    }
+#else
+    return AbstractIo::SendFile(fd, offset, length, retlen);
+#endif
+}
+
 AbstractIo::Status FileDescriptorIo::Read(void *buffer,
                                           size_t length,
                                           size_t *retlen,
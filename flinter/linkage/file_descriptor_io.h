@@ -39,6 +39,8 @@ public:
 
     virtual Status Read(void *buffer, size_t length, size_t *retlen, bool *more);
     virtual Status Write(const void *buffer, size_t length, size_t *retlen);
+    virtual Status Writev(const struct iovec *iov, size_t count, size_t *retlen);
+    virtual Status SendFile(int fd, int64_t offset, size_t length, size_t *retlen);
     virtual Status Shutdown();
     virtual Status Connect();
     virtual Status Accept();
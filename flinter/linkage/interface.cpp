@@ -113,10 +113,12 @@ void Interface::Socket::ToString(std::string *str) const
 Interface::Option::Option()
         : tcp_defer_accept(false)
         , tcp_nodelay(false)
+        , tcp_cork(false)
         , udp_broadcast(false)
         , udp_multicast(false)
         , socket_close_on_exec(false)
         , socket_reuse_address(false)
+        , socket_reuse_port(false)
         , socket_non_blocking(false)
         , socket_keepalive(false)
 {
@@ -195,6 +197,12 @@ bool Interface::InitializeSocket(const Option &option, int s)
         }
     }
 
+    if (option.socket_reuse_port) {
+        if (set_socket_reuse_port(s)) {
+            return false;
+        }
+    }
+
     if (option.socket_non_blocking) {
         if (set_non_blocking_mode(s)) {
             return false;
@@ -225,6 +233,12 @@ bool Interface::InitializeSocket(const Option &option, int s)
         }
     }
 
+    if (option.tcp_cork) {
+        if (set_tcp_cork(s, 1)) {
+            return false;
+        }
+    }
+
     if (option.udp_broadcast) {
         if (set_socket_broadcast(s)) {
             return false;
@@ -235,22 +249,8 @@ bool Interface::InitializeSocket(const Option &option, int s)
 }
 
 template <class T>
-int Interface::DoConnectTcp(const Socket &socket,
-                            const Option &option,
-                            LinkagePeer *peer,
-                            LinkagePeer *me)
+int Interface::DoOpenTcp(const Socket &socket, const Option &option)
 {
-    if (!socket.socket_hostname  ||
-        !*socket.socket_hostname ||
-        !socket.socket_port      ){
-
-        errno = EINVAL;
-        return -1;
-    }
-
-    Resolver *const resolver = Resolver::GetInstance();
-    T addr;
-
     int s = CreateSocket(socket, option);
     if (s < 0) {
         CLOG.Verbose("Interface: failed to initialize socket: %d: %s",
@@ -260,6 +260,8 @@ int Interface::DoConnectTcp(const Socket &socket,
     }
 
     if (socket.socket_interface && *socket.socket_interface) {
+        Resolver *const resolver = Resolver::GetInstance();
+        T addr;
         if (!resolver->Resolve(socket.socket_interface,
                                socket.socket_bind_port,
                                &addr)) {
@@ -277,6 +279,30 @@ int Interface::DoConnectTcp(const Socket &socket,
         }
     }
 
+    return s;
+}
+
+template <class T>
+int Interface::DoConnectTcp(const Socket &socket,
+                            const Option &option,
+                            LinkagePeer *peer,
+                            LinkagePeer *me)
+{
+    if (!socket.socket_hostname  ||
+        !*socket.socket_hostname ||
+        !socket.socket_port      ){
+
+        errno = EINVAL;
+        return -1;
+    }
+
+    int s = DoOpenTcp<T>(socket, option);
+    if (s < 0) {
+        return -1;
+    }
+
+    T addr;
+    Resolver *const resolver = Resolver::GetInstance();
     if (!resolver->Resolve(socket.socket_hostname,
                            socket.socket_port,
                            &addr)) {
@@ -395,6 +421,72 @@ int Interface::Connect(const Socket &socket,
     return -1;
 }
 
+bool Interface::Open(const Socket &socket, const Option &option)
+{
+    if ((socket.type != SOCK_STREAM && socket.type != SOCK_DGRAM) ||
+        (socket.domain != AF_INET && socket.domain != AF_INET6)   ){
+
+        errno = EINVAL;
+        return false;
+
+    } else if (!Close()) {
+        return false;
+    }
+
+    int s = socket.domain == AF_INET6
+          ? DoOpenTcp<struct sockaddr_in6>(socket, option)
+          : DoOpenTcp<struct sockaddr_in >(socket, option);
+
+    if (s < 0) {
+        return false;
+    }
+
+    _socket = s;
+    _domain = socket.domain;
+    return true;
+}
+
+int Interface::Connect(const struct sockaddr *addr,
+                       LinkagePeer *peer,
+                       LinkagePeer *me)
+{
+    if (_socket < 0 || !addr || addr->sa_family != _domain) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    socklen_t len = _domain == AF_INET6 ? sizeof(struct sockaddr_in6)
+                                        : sizeof(struct sockaddr_in);
+
+    // Leave the socket open on failures, it's closed by Close() later.
+    int ret = safe_connect(_socket, addr, len);
+    if (ret < 0) {
+        if (errno != EINPROGRESS) {
+            CLOG.Verbose("Interface: failed to connect socket(%d): %d: %s",
+                         _socket, errno, strerror(errno));
+
+            return -1;
+        }
+    }
+
+    if (peer) {
+        if (!peer->Set(addr, _socket)) {
+            return -1;
+        }
+    }
+
+    if (me) {
+        struct sockaddr_in6 sa;
+        len = sizeof(sa);
+        struct sockaddr *p = reinterpret_cast<struct sockaddr *>(&sa);
+        if (getsockname(_socket, p, &len) || !me->Set(p, _socket)) {
+            return -1;
+        }
+    }
+
+    return ret == 0 ? 0 : 1;
+}
+
 bool Interface::DoListenTcp4(const Socket &socket,
                              const Option &option,
                              LinkagePeer *me)
@@ -918,10 +1010,12 @@ std::ostream &operator << (std::ostream &s, const flinter::Interface::Option &d)
 
     if (d.tcp_defer_accept    ) { s << delim << "Ta"; delim = ","; }
     if (d.tcp_nodelay         ) { s << delim << "Td"; delim = ","; }
+    if (d.tcp_cork            ) { s << delim << "Tc"; delim = ","; }
     if (d.udp_broadcast       ) { s << delim << "Ub"; delim = ","; }
     if (d.udp_multicast       ) { s << delim << "Um"; delim = ","; }
     if (d.socket_close_on_exec) { s << delim << "Se"; delim = ","; }
     if (d.socket_reuse_address) { s << delim << "Sr"; delim = ","; }
+    if (d.socket_reuse_port   ) { s << delim << "Sp"; delim = ","; }
     if (d.socket_non_blocking ) { s << delim << "Sn"; delim = ","; }
     if (d.socket_keepalive    ) { s << delim << "Sk"; delim = ","; }
 
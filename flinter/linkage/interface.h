@@ -22,6 +22,8 @@
 #include <ostream>
 #include <string>
 
+struct sockaddr;
+
 namespace flinter {
 
 class LinkagePeer;
@@ -61,6 +63,7 @@ public:
         // Generic
         bool socket_close_on_exec;
         bool socket_reuse_address;
+        bool socket_reuse_port;
         bool socket_non_blocking;
         bool socket_keepalive;
 
@@ -136,6 +139,17 @@ public:
                 LinkagePeer *peer = NULL,
                 LinkagePeer *me = NULL);
 
+    /// Create (and bind if asked) a TCP/UDP socket but don't connect it yet,
+    /// socket_hostname is ignored so that it can be resolved elsewhere.
+    bool Open(const Socket &socket, const Option &option);
+
+    /// Connect a socket created by Open().
+    /// <0 failed, 0 connected, >0 in progress.
+    /// @param addr must be of the same domain as the socket.
+    int Connect(const struct sockaddr *addr,
+                LinkagePeer *peer = NULL,
+                LinkagePeer *me = NULL);
+
     /// @param peer can NOT be NULL.
     /// @param me can be NULL.
     /// @retval <0 listen fd failure
@@ -175,6 +189,9 @@ private:
     int DoConnectTcp(const Socket &socket, const Option &option,
                      LinkagePeer *peer, LinkagePeer *me);
 
+    template <class T>
+    int DoOpenTcp(const Socket &socket, const Option &option);
+
     int DoConnectUnix(const Socket &socket, const Option &option,
                       LinkagePeer *peer, LinkagePeer *me);
 
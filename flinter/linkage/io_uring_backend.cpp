@@ -0,0 +1,513 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flinter/linkage/io_uring_backend.h"
+
+#include "config.h"
+#if HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <assert.h>
+#include <endian.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "flinter/safeio.h"
+#include "flinter/utility.h"
+
+namespace flinter {
+
+struct IoUringBackend::watcher_t {
+    struct io_t io;
+    uint32_t armed;     // Events of the poll in flight, 0 if none.
+    bool disarming;     // Its removal is in flight.
+    bool removed;
+}; // struct IoUringBackend::watcher_t
+
+struct IoUringBackend::ticker_t {
+    struct timer_t timer;
+    int64_t repeat;
+    tickers_t::iterator where;
+}; // struct IoUringBackend::ticker_t
+
+struct IoUringBackend::ring_t {
+    int fd;
+
+    void *sq;
+    size_t sq_size;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int sq_entries;
+    unsigned int tail; // Published when entering.
+
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    void *cq;
+    size_t cq_size;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+}; // struct IoUringBackend::ring_t
+
+const unsigned int IoUringBackend::kEntries = 256;
+
+IoUringBackend::IoUringBackend(Callback *callback)
+        : _callback(callback)
+        , _wakeup(NULL)
+        , _ring(NULL)
+        , _dispatching(false)
+        , _break(false)
+        , _eventfd(-1)
+{
+    assert(callback);
+}
+
+IoUringBackend::~IoUringBackend()
+{
+    // Polls in flight are dropped along with the ring.
+    if (_ring) {
+        if (_ring->sqes) {
+            munmap(_ring->sqes, _ring->sqes_size);
+        }
+
+        if (_ring->cq && _ring->cq != _ring->sq) {
+            munmap(_ring->cq, _ring->cq_size);
+        }
+
+        if (_ring->sq) {
+            munmap(_ring->sq, _ring->sq_size);
+        }
+
+        safe_close(_ring->fd);
+        delete _ring;
+    }
+
+    for (std::vector<struct watcher_t *>::iterator p = _removed.begin();
+         p != _removed.end(); ++p) {
+
+        delete *p;
+    }
+
+    for (tickers_t::iterator p = _tickers.begin(); p != _tickers.end(); ++p) {
+        delete p->second;
+    }
+
+    delete _wakeup;
+    if (_eventfd >= 0) {
+        safe_close(_eventfd);
+    }
+}
+
+bool IoUringBackend::Initialize()
+{
+    _eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_eventfd < 0) {
+        return false;
+    }
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, kEntries, &params));
+    if (fd < 0) {
+        return false;
+    }
+
+    _ring = new struct ring_t;
+    memset(_ring, 0, sizeof(*_ring));
+    _ring->fd = fd;
+
+    // Completions must never be dropped and waiting must take a timeout.
+    if (!(params.features & IORING_FEAT_NODROP) ||
+        !(params.features & IORING_FEAT_EXT_ARG)) {
+
+        return false;
+    }
+
+    _ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    _ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (_ring->cq_size > _ring->sq_size) {
+            _ring->sq_size = _ring->cq_size;
+        }
+    }
+
+    void *sq = mmap(NULL, _ring->sq_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+
+    if (sq == MAP_FAILED) {
+        return false;
+    }
+
+    _ring->sq = sq;
+    void *cq = sq;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        cq = mmap(NULL, _ring->cq_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+
+        if (cq == MAP_FAILED) {
+            return false;
+        }
+    }
+
+    _ring->cq = cq;
+    size_t sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+    if (sqes == MAP_FAILED) {
+        return false;
+    }
+
+    _ring->sqes = reinterpret_cast<struct io_uring_sqe *>(sqes);
+    _ring->sqes_size = sqes_size;
+
+    char *s = reinterpret_cast<char *>(sq);
+    _ring->sq_head = reinterpret_cast<unsigned int *>(s + params.sq_off.head);
+    _ring->sq_tail = reinterpret_cast<unsigned int *>(s + params.sq_off.tail);
+    _ring->sq_mask = reinterpret_cast<unsigned int *>(s + params.sq_off.ring_mask);
+    _ring->sq_array = reinterpret_cast<unsigned int *>(s + params.sq_off.array);
+    _ring->sq_entries = params.sq_entries;
+    _ring->tail = *_ring->sq_tail;
+
+    char *c = reinterpret_cast<char *>(cq);
+    _ring->cq_head = reinterpret_cast<unsigned int *>(c + params.cq_off.head);
+    _ring->cq_tail = reinterpret_cast<unsigned int *>(c + params.cq_off.tail);
+    _ring->cq_mask = reinterpret_cast<unsigned int *>(c + params.cq_off.ring_mask);
+    _ring->cqes = reinterpret_cast<struct io_uring_cqe *>(c + params.cq_off.cqes);
+
+    _wakeup = new struct watcher_t;
+    _wakeup->io.context = NULL;
+    _wakeup->io.fd = _eventfd;
+    _wakeup->io.read = true;
+    _wakeup->io.write = false;
+    _wakeup->armed = 0;
+    _wakeup->disarming = false;
+    _wakeup->removed = false;
+    return Arm(_wakeup);
+}
+
+int IoUringBackend::Enter(unsigned int min_complete, int64_t timeout)
+{
+    // Only this thread produces submissions, the kernel consumes them.
+    __atomic_store_n(_ring->sq_tail, _ring->tail, __ATOMIC_RELEASE);
+    unsigned int head = __atomic_load_n(_ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned int submit = _ring->tail - head;
+
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    unsigned int flags = IORING_ENTER_EXT_ARG;
+    if (min_complete) {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (timeout >= 0) {
+            ts.tv_sec = timeout / 1000000000LL;
+            ts.tv_nsec = timeout % 1000000000LL;
+            arg.ts = reinterpret_cast<uintptr_t>(&ts);
+        }
+    }
+
+    return static_cast<int>(syscall(__NR_io_uring_enter, _ring->fd, submit,
+                                    min_complete, flags, &arg, sizeof(arg)));
+}
+
+struct io_uring_sqe *IoUringBackend::GetSqe()
+{
+    unsigned int head = __atomic_load_n(_ring->sq_head, __ATOMIC_ACQUIRE);
+    if (_ring->tail - head >= _ring->sq_entries) {
+        if (Enter(0, -1) < 0) {
+            return NULL;
+        }
+
+        head = __atomic_load_n(_ring->sq_head, __ATOMIC_ACQUIRE);
+        if (_ring->tail - head >= _ring->sq_entries) {
+            return NULL;
+        }
+    }
+
+    unsigned int index = _ring->tail & *_ring->sq_mask;
+    struct io_uring_sqe *sqe = _ring->sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+    _ring->sq_array[index] = index;
+    ++_ring->tail;
+    return sqe;
+}
+
+bool IoUringBackend::Arm(struct watcher_t *watcher)
+{
+    uint32_t events = (watcher->io.read  ? static_cast<uint32_t>(POLLIN)  : 0u)
+                    | (watcher->io.write ? static_cast<uint32_t>(POLLOUT) : 0u);
+
+    assert(events);
+    assert(!watcher->armed);
+    struct io_uring_sqe *sqe = GetSqe();
+    if (!sqe) {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = watcher->io.fd;
+#if __BYTE_ORDER == __BIG_ENDIAN
+    sqe->poll32_events = (events << 16) | (events >> 16);
+#else
+    sqe->poll32_events = events;
+#endif
+    sqe->user_data = reinterpret_cast<uintptr_t>(watcher);
+    watcher->armed = events;
+    return true;
+}
+
+bool IoUringBackend::Disarm(struct watcher_t *watcher)
+{
+    if (watcher->disarming) {
+        return true;
+    }
+
+    // Completes with no user data, the poll itself completes as well.
+    struct io_uring_sqe *sqe = GetSqe();
+    if (!sqe) {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->addr = reinterpret_cast<uintptr_t>(watcher);
+    sqe->user_data = 0;
+    watcher->disarming = true;
+    return true;
+}
+
+EventBackend::io_t *IoUringBackend::AddIo(int fd, bool read, bool write, void *context)
+{
+    struct watcher_t *watcher = new struct watcher_t;
+    watcher->io.context = context;
+    watcher->io.fd = fd;
+    watcher->io.read = read;
+    watcher->io.write = write;
+    watcher->armed = 0;
+    watcher->disarming = false;
+    watcher->removed = false;
+
+    if ((read || write) && !Arm(watcher)) {
+        delete watcher;
+        return NULL;
+    }
+
+    return &watcher->io;
+}
+
+bool IoUringBackend::SetIo(struct io_t *io, bool read, bool write)
+{
+    struct watcher_t *watcher = reinterpret_cast<struct watcher_t *>(io);
+    if (read == io->read && write == io->write) {
+        return true;
+    }
+
+    io->read = read;
+    io->write = write;
+
+    // Armed again with the new interests once it completes.
+    if (watcher->armed) {
+        return Disarm(watcher);
+    }
+
+    if (!read && !write) {
+        return true;
+    }
+
+    return Arm(watcher);
+}
+
+void IoUringBackend::RemoveIo(struct io_t *io)
+{
+    struct watcher_t *watcher = reinterpret_cast<struct watcher_t *>(io);
+    watcher->removed = true;
+
+    // The kernel refers to it until the poll completes, and so does the
+    // current round.
+    if (watcher->armed) {
+        Disarm(watcher);
+        _removed.push_back(watcher);
+        return;
+
+    } else if (_dispatching) {
+        _removed.push_back(watcher);
+        return;
+    }
+
+    delete watcher;
+}
+
+EventBackend::timer_t *IoUringBackend::AddTimer(int64_t after,
+                                                int64_t repeat,
+                                                void *context)
+{
+    if (after < 0 || repeat <= 0) {
+        return NULL;
+    }
+
+    struct ticker_t *ticker = new struct ticker_t;
+    ticker->timer.context = context;
+    ticker->repeat = repeat;
+    ticker->where = _tickers.insert(std::make_pair(
+            get_monotonic_timestamp() + after, ticker));
+
+    return &ticker->timer;
+}
+
+void IoUringBackend::RemoveTimer(struct timer_t *timer)
+{
+    struct ticker_t *ticker = reinterpret_cast<struct ticker_t *>(timer);
+    _tickers.erase(ticker->where);
+    delete ticker;
+}
+
+void IoUringBackend::Wakeup()
+{
+    // Only fails if the counter is about to overflow, which is fine.
+    uint64_t one = 1;
+    safe_write(_eventfd, &one, sizeof(one));
+}
+
+void IoUringBackend::Break()
+{
+    _break = true;
+}
+
+int64_t IoUringBackend::GetTimeout(int64_t now) const
+{
+    if (_tickers.empty()) {
+        return -1;
+    }
+
+    int64_t diff = _tickers.begin()->first - now;
+    return diff > 0 ? diff : 0;
+}
+
+void IoUringBackend::OnTimers(int64_t now)
+{
+    while (!_tickers.empty()) {
+        tickers_t::iterator p = _tickers.begin();
+        if (p->first > now) {
+            break;
+        }
+
+        // Reschedule before calling since it might remove itself.
+        struct ticker_t *ticker = p->second;
+        _tickers.erase(p);
+        ticker->where = _tickers.insert(std::make_pair(now + ticker->repeat, ticker));
+        _callback->OnTimer(&ticker->timer);
+    }
+}
+
+bool IoUringBackend::OnCompletion(struct watcher_t *watcher, int result)
+{
+    watcher->armed = 0;
+    watcher->disarming = false;
+    if (watcher->removed) {
+        return true;
+    }
+
+    if (watcher == _wakeup) {
+        uint64_t count;
+        safe_read(_eventfd, &count, sizeof(count));
+        _callback->OnWakeup();
+
+    } else if (result != -ECANCELED) {
+        // Errors such as a bad file descriptor are reported as such.
+        uint32_t e = result < 0 ? static_cast<uint32_t>(POLLERR)
+                                : static_cast<uint32_t>(result);
+
+        if (watcher->io.read && (e & (POLLIN | POLLERR | POLLHUP))) {
+            _callback->OnReadable(&watcher->io);
+        }
+
+        if (!watcher->removed && watcher->io.write &&
+            (e & (POLLOUT | POLLERR | POLLHUP))) {
+
+            _callback->OnWritable(&watcher->io);
+        }
+    }
+
+    // One shot, so arm it again unless a callback already did.
+    if (!watcher->removed && !watcher->armed &&
+        (watcher->io.read || watcher->io.write)) {
+
+        return Arm(watcher);
+    }
+
+    return true;
+}
+
+bool IoUringBackend::Run()
+{
+    _break = false;
+    while (!_break) {
+        // Submissions queued during the last round go along with the wait.
+        int ret = Enter(1, GetTimeout(get_monotonic_timestamp()));
+        if (ret < 0 && errno != EINTR && errno != ETIME &&
+            errno != EAGAIN && errno != EBUSY) {
+
+            return false;
+        }
+
+        _dispatching = true;
+        unsigned int head = *_ring->cq_head;
+        unsigned int tail = __atomic_load_n(_ring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const struct io_uring_cqe *cqe = _ring->cqes + (head & *_ring->cq_mask);
+            uint64_t user_data = cqe->user_data;
+            int result = cqe->res;
+            __atomic_store_n(_ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+            if (user_data && !OnCompletion(reinterpret_cast<struct watcher_t *>(
+                    static_cast<uintptr_t>(user_data)), result)) {
+
+                _dispatching = false;
+                return false;
+            }
+        }
+
+        _dispatching = false;
+        std::vector<struct watcher_t *>::iterator q = _removed.begin();
+        for (std::vector<struct watcher_t *>::iterator p = _removed.begin();
+             p != _removed.end(); ++p) {
+
+            if ((*p)->armed) {
+                *q++ = *p;
+            } else {
+                delete *p;
+            }
+        }
+
+        _removed.erase(q, _removed.end());
+        OnTimers(get_monotonic_timestamp());
+        _callback->OnRound();
+    }
+
+    return true;
+}
+
+} // namespace flinter
+
+#endif // HAVE_IO_URING
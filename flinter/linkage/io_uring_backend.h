@@ -0,0 +1,86 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLINTER_LINKAGE_IO_URING_BACKEND_H
+#define FLINTER_LINKAGE_IO_URING_BACKEND_H
+
+#include <map>
+#include <vector>
+
+#include "flinter/linkage/event_backend.h"
+
+struct io_uring_sqe;
+
+namespace flinter {
+
+/// Readiness through io_uring one shot polls, which are armed again after
+/// being dispatched so they behave level triggered. Arming, disarming and
+/// waiting are all queued into the submission ring and handed to the kernel
+/// by a single io_uring_enter() per round, where epoll needs an epoll_ctl()
+/// each time interests change. Timers and wakeups work like EpollBackend.
+///
+/// Talks to the kernel directly, liburing is not required.
+class IoUringBackend : public EventBackend {
+public:
+    explicit IoUringBackend(Callback *callback);
+    virtual ~IoUringBackend();
+
+    /// @return false if the kernel doesn't support io_uring or lacks some
+    ///               features required.
+    bool Initialize();
+
+    virtual struct io_t *AddIo(int fd, bool read, bool write, void *context);
+    virtual bool SetIo(struct io_t *io, bool read, bool write);
+    virtual void RemoveIo(struct io_t *io);
+
+    virtual struct timer_t *AddTimer(int64_t after, int64_t repeat, void *context);
+    virtual void RemoveTimer(struct timer_t *timer);
+
+    virtual void Wakeup();
+    virtual bool Run();
+    virtual void Break();
+
+private:
+    struct watcher_t;
+    struct ticker_t;
+    struct ring_t;
+    typedef std::multimap<int64_t, struct ticker_t *> tickers_t;
+
+    struct io_uring_sqe *GetSqe();
+    bool Arm(struct watcher_t *watcher);
+    bool Disarm(struct watcher_t *watcher);
+    int Enter(unsigned int min_complete, int64_t timeout);
+    bool OnCompletion(struct watcher_t *watcher, int result);
+    int64_t GetTimeout(int64_t now) const;
+    void OnTimers(int64_t now);
+
+    static const unsigned int kEntries;
+
+    // Removed, released once the kernel doesn't refer to them.
+    std::vector<struct watcher_t *> _removed;
+
+    Callback *const _callback;
+    struct watcher_t *_wakeup;
+    struct ring_t *_ring;
+    tickers_t _tickers;
+    bool _dispatching;
+    bool _break;
+    int _eventfd;
+
+}; // class IoUringBackend
+
+} // namespace flinter
+
+#endif // FLINTER_LINKAGE_IO_URING_BACKEND_H
@@ -0,0 +1,220 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flinter/linkage/libev_backend.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+#include "config.h"
+#if HAVE_EV_H
+#include <ev.h>
+
+namespace flinter {
+
+struct LibevBackend::watcher_t {
+    struct io_t io;
+    struct ev_io ev_io_r;
+    struct ev_io ev_io_w;
+}; // struct LibevBackend::watcher_t
+
+struct LibevBackend::ticker_t {
+    struct timer_t timer;
+    struct ev_timer ev_timer;
+}; // struct LibevBackend::ticker_t
+
+LibevBackend::LibevBackend(Callback *callback)
+        : _callback(callback)
+        , _async(NULL)
+        , _prepare(NULL)
+        , _loop(NULL)
+{
+    assert(callback);
+}
+
+LibevBackend::~LibevBackend()
+{
+    if (_loop) {
+        ev_async_stop(_loop, _async);
+        ev_prepare_stop(_loop, _prepare);
+        ev_loop_destroy(_loop);
+    }
+
+    delete _prepare;
+    delete _async;
+}
+
+bool LibevBackend::Initialize()
+{
+    _loop = ev_loop_new(0);
+    if (!_loop) {
+        return false;
+    }
+
+    _async = new struct ev_async;
+    ev_async_init(_async, async_cb);
+    ev_async_start(_loop, _async);
+
+    // Called right before polling, which is the end of the last round.
+    _prepare = new struct ev_prepare;
+    ev_prepare_init(_prepare, prepare_cb);
+    ev_prepare_start(_loop, _prepare);
+
+    ev_set_userdata(_loop, this);
+    return true;
+}
+
+void LibevBackend::async_cb(struct ev_loop *loop, struct ev_async * /*w*/, int /*revents*/)
+{
+    LibevBackend *backend = reinterpret_cast<LibevBackend *>(ev_userdata(loop));
+    backend->_callback->OnWakeup();
+}
+
+void LibevBackend::readable_cb(struct ev_loop *loop, struct ev_io *w, int /*revents*/)
+{
+    LibevBackend *backend = reinterpret_cast<LibevBackend *>(ev_userdata(loop));
+    unsigned char *p = reinterpret_cast<unsigned char *>(w);
+    p -= offsetof(struct watcher_t, ev_io_r);
+    struct watcher_t *watcher = reinterpret_cast<struct watcher_t *>(p);
+    backend->_callback->OnReadable(&watcher->io);
+}
+
+void LibevBackend::writable_cb(struct ev_loop *loop, struct ev_io *w, int /*revents*/)
+{
+    LibevBackend *backend = reinterpret_cast<LibevBackend *>(ev_userdata(loop));
+    unsigned char *p = reinterpret_cast<unsigned char *>(w);
+    p -= offsetof(struct watcher_t, ev_io_w);
+    struct watcher_t *watcher = reinterpret_cast<struct watcher_t *>(p);
+    backend->_callback->OnWritable(&watcher->io);
+}
+
+void LibevBackend::timer_cb(struct ev_loop *loop, struct ev_timer *w, int /*revents*/)
+{
+    LibevBackend *backend = reinterpret_cast<LibevBackend *>(ev_userdata(loop));
+    unsigned char *p = reinterpret_cast<unsigned char *>(w);
+    p -= offsetof(struct ticker_t, ev_timer);
+    struct ticker_t *ticker = reinterpret_cast<struct ticker_t *>(p);
+    backend->_callback->OnTimer(&ticker->timer);
+}
+
+void LibevBackend::prepare_cb(struct ev_loop *loop, struct ev_prepare * /*w*/, int /*revents*/)
+{
+    LibevBackend *backend = reinterpret_cast<LibevBackend *>(ev_userdata(loop));
+    backend->_callback->OnRound();
+}
+
+EventBackend::io_t *LibevBackend::AddIo(int fd, bool read, bool write, void *context)
+{
+    struct watcher_t *watcher = new struct watcher_t;
+    watcher->io.context = context;
+    watcher->io.fd = fd;
+    watcher->io.read = read;
+    watcher->io.write = write;
+
+    ev_io_init(&watcher->ev_io_r, readable_cb, fd, EV_READ);
+    ev_io_init(&watcher->ev_io_w, writable_cb, fd, EV_WRITE);
+
+    if (read) {
+        ev_io_start(_loop, &watcher->ev_io_r);
+    }
+
+    if (write) {
+        ev_io_start(_loop, &watcher->ev_io_w);
+    }
+
+    return &watcher->io;
+}
+
+bool LibevBackend::SetIo(struct io_t *io, bool read, bool write)
+{
+    struct watcher_t *watcher = reinterpret_cast<struct watcher_t *>(io);
+    if (read != io->read) {
+        io->read = read;
+        if (read) {
+            ev_io_start(_loop, &watcher->ev_io_r);
+        } else {
+            ev_io_stop(_loop, &watcher->ev_io_r);
+        }
+    }
+
+    if (write != io->write) {
+        io->write = write;
+        if (write) {
+            ev_io_start(_loop, &watcher->ev_io_w);
+        } else {
+            ev_io_stop(_loop, &watcher->ev_io_w);
+        }
+    }
+
+    return true;
+}
+
+void LibevBackend::RemoveIo(struct io_t *io)
+{
+    struct watcher_t *watcher = reinterpret_cast<struct watcher_t *>(io);
+    if (io->read) {
+        ev_io_stop(_loop, &watcher->ev_io_r);
+    }
+
+    if (io->write) {
+        ev_io_stop(_loop, &watcher->ev_io_w);
+    }
+
+    delete watcher;
+}
+
+EventBackend::timer_t *LibevBackend::AddTimer(int64_t after,
+                                              int64_t repeat,
+                                              void *context)
+{
+    if (after < 0 || repeat <= 0) {
+        return NULL;
+    }
+
+    double r = static_cast<double>(repeat) / 1000000000;
+    double a = static_cast<double>(after) / 1000000000;
+    struct ticker_t *ticker = new struct ticker_t;
+    ticker->timer.context = context;
+
+    ev_timer_init(&ticker->ev_timer, timer_cb, a, r);
+    ev_timer_start(_loop, &ticker->ev_timer);
+    return &ticker->timer;
+}
+
+void LibevBackend::RemoveTimer(struct timer_t *timer)
+{
+    struct ticker_t *ticker = reinterpret_cast<struct ticker_t *>(timer);
+    ev_timer_stop(_loop, &ticker->ev_timer);
+    delete ticker;
+}
+
+void LibevBackend::Wakeup()
+{
+    ev_async_send(_loop, _async);
+}
+
+bool LibevBackend::Run()
+{
+    return !!ev_run(_loop, 0);
+}
+
+void LibevBackend::Break()
+{
+    ev_break(_loop, EVBREAK_ALL);
+}
+
+} // namespace flinter
+
+#endif // HAVE_EV_H
@@ -0,0 +1,66 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLINTER_LINKAGE_LIBEV_BACKEND_H
+#define FLINTER_LINKAGE_LIBEV_BACKEND_H
+
+#include "flinter/linkage/event_backend.h"
+
+struct ev_async;
+struct ev_loop;
+struct ev_io;
+struct ev_prepare;
+struct ev_timer;
+
+namespace flinter {
+
+class LibevBackend : public EventBackend {
+public:
+    explicit LibevBackend(Callback *callback);
+    virtual ~LibevBackend();
+
+    bool Initialize();
+
+    virtual struct io_t *AddIo(int fd, bool read, bool write, void *context);
+    virtual bool SetIo(struct io_t *io, bool read, bool write);
+    virtual void RemoveIo(struct io_t *io);
+
+    virtual struct timer_t *AddTimer(int64_t after, int64_t repeat, void *context);
+    virtual void RemoveTimer(struct timer_t *timer);
+
+    virtual void Wakeup();
+    virtual bool Run();
+    virtual void Break();
+
+private:
+    struct watcher_t;
+    struct ticker_t;
+
+    static void async_cb(struct ev_loop *loop, struct ev_async *w, int revents);
+    static void readable_cb(struct ev_loop *loop, struct ev_io *w, int revents);
+    static void writable_cb(struct ev_loop *loop, struct ev_io *w, int revents);
+    static void timer_cb(struct ev_loop *loop, struct ev_timer *w, int revents);
+    static void prepare_cb(struct ev_loop *loop, struct ev_prepare *w, int revents);
+
+    Callback *const _callback;
+    struct ev_async *_async;
+    struct ev_prepare *_prepare;
+    struct ev_loop *_loop;
+
+}; // class LibevBackend
+
+} // namespace flinter
+
+#endif // FLINTER_LINKAGE_LIBEV_BACKEND_H
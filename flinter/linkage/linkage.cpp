@@ -15,21 +15,27 @@
 
 #include "flinter/linkage/linkage.h"
 
+#include <sys/stat.h>
 #include <assert.h>
 #include <errno.h>
 #include <limits.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "flinter/linkage/abstract_io.h"
 #include "flinter/linkage/interface.h"
 #include "flinter/linkage/linkage_handler.h"
 #include "flinter/linkage/linkage_peer.h"
 #include "flinter/linkage/linkage_worker.h"
+#include "flinter/linkage/receive_buffer.h"
 
 #include "flinter/logger.h"
 #include "flinter/safeio.h"
 #include "flinter/utility.h"
 
-#define INCOMPLETE(x) ((x) == AbstractIo::kStatusWannaRead || (x) == AbstractIo::kStatusWannaWrite)
+#define INCOMPLETE(x) ((x) == AbstractIo::kStatusWannaRead  || \
+                       (x) == AbstractIo::kStatusWannaWrite || \
+                       (x) == AbstractIo::kStatusPending)
 
 namespace flinter {
 
@@ -38,11 +44,29 @@ const int64_t Linkage::kDefaultConnectTimeout = 15000000000LL;  // 15s
 const int64_t Linkage::kDefaultSendTimeout    = 15000000000LL;  // 15s
 const int64_t Linkage::kDefaultIdleTimeout    = 300000000000LL; // 5min
 
+// Handler Cleanup() is called this often if asked to.
+static const int64_t kCleanupInterval = 1000000000LL; // 1s
+
 Linkage::Linkage(AbstractIo *io,
                  LinkageHandler *handler,
                  const LinkagePeer &peer,
                  const LinkagePeer &me)
-        : _last_writing(0)
+        : _rslab(NULL)
+        , _rhead(0)
+        , _rtail(0)
+        , _rroom(kMinimumReceivingRoom)
+        , _rsparse(0)
+        , _wfile_bytes(0)
+        , _wappended(0)
+        , _wconsumed(0)
+        , _last_writing(0)
+        , _write_high_watermark(0)
+        , _write_low_watermark(0)
+        , _pause_reading(false)
+        , _write_blocked(false)
+        , _coalescing(false)
+        , _tcp_cork(false)
+        , _periodic_cleanup(false)
         , _handler(handler)
         , _peer(new LinkagePeer(peer))
         , _me(new LinkagePeer(me))
@@ -56,6 +80,7 @@ Linkage::Linkage(AbstractIo *io,
         , _connect_jam(0)
         , _last_sent(0)
         , _send_jam(0)
+        , _cleanup(0)
         , _action(AbstractIo::kActionNone)
         , _worker(NULL)
         , _rlength(0)
@@ -72,6 +97,8 @@ Linkage::Linkage(AbstractIo *io,
 
 Linkage::~Linkage()
 {
+    DropReceivingBuffer();
+    DumpSendingBuffer();
     delete _io;
     delete _me;
     delete _peer;
@@ -102,64 +129,176 @@ bool Linkage::OnConnected()
     return _handler->OnConnected(this);
 }
 
-bool Linkage::AppendSendingBuffer(const void *buffer, size_t length)
+void Linkage::OnWriteBlocked()
+{
+    _handler->OnWriteBlocked(this);
+}
+
+void Linkage::OnWriteDrained()
+{
+    _handler->OnWriteDrained(this);
+}
+
+void Linkage::set_write_watermarks(size_t high, size_t low, bool pause_reading)
+{
+    _write_high_watermark = high;
+    _write_low_watermark = low < high ? low : high;
+    _pause_reading = pause_reading;
+
+    if (_write_blocked) {
+        CheckWriteDrained();
+    } else {
+        CheckWriteBlocked();
+    }
+}
+
+void Linkage::CheckWriteBlocked()
+{
+    if (_write_blocked || !_write_high_watermark ||
+        GetSendingBufferSize() <= _write_high_watermark) {
+
+        return;
+    }
+
+    CLOG.Verbose("Linkage: write blocked with [%lu] bytes queued for fd = %d",
+                 GetSendingBufferSize(), _peer->fd());
+
+    _write_blocked = true;
+    if (_pause_reading && _worker && _action == AbstractIo::kActionNone) {
+        _worker->SetWannaRead(this, false);
+    }
+
+    OnWriteBlocked();
+}
+
+void Linkage::CheckWriteDrained()
+{
+    if (!_write_blocked || (_write_high_watermark &&
+        GetSendingBufferSize() > _write_low_watermark)) {
+
+        return;
+    }
+
+    CLOG.Verbose("Linkage: write drained with [%lu] bytes queued for fd = %d",
+                 GetSendingBufferSize(), _peer->fd());
+
+    _write_blocked = false;
+    if (_pause_reading && _worker && _action == AbstractIo::kActionNone) {
+        _worker->SetWannaRead(this, true);
+    }
+
+    OnWriteDrained();
+}
+
+bool Linkage::AppendSendingBuffer(const void *buffer,
+                                  size_t length,
+                                  void **block)
 {
     static const size_t kMaximumBytes = 64 * 1024 * 1024;
 
     assert(buffer);
     assert(length);
 
-    const unsigned char *p = reinterpret_cast<const unsigned char *>(buffer);
     size_t left = kMaximumBytes - _wbuffer.size();
     if (left < length) {
-        CLOG.Verbose("Linkage: only [%lu] bytes left for fd = %d",
-                     left, _peer->fd());
+        CLOG.Warn("Linkage: only [%lu] bytes left for fd = %d",
+                  left, _peer->fd());
+
+        return false;
+    }
 
+    if (block && *block) {
+        _wbuffer.Adopt(*block, buffer, length);
+        *block = NULL;
+
+    } else if (!_wbuffer.Append(buffer, length)) {
         return false;
     }
 
-    _wbuffer.insert(_wbuffer.end(), p, p + length);
+    _wappended += length;
     return true;
 }
 
-void Linkage::PickSendingBuffer(const void **buffer, size_t *length)
+size_t Linkage::PickSendingBuffer(struct iovec *iov,
+                                  size_t count,
+                                  size_t *length)
 {
-    assert(buffer);
+    assert(iov);
     assert(length);
 
-    if (_wbuffer.empty()) {
-        *buffer = NULL;
-        *length = 0;
-        return;
+    // Retry exactly the same bytes.
+    size_t limit = _last_writing;
+    _last_writing = 0;
+
+    // Not beyond the next file.
+    if (!_wfiles.empty()) {
+        uint64_t ahead = _wfiles.front().position - _wconsumed;
+        assert(ahead);
+        if (!limit || limit > ahead) {
+            limit = static_cast<size_t>(ahead);
+        }
     }
 
-    if (_last_writing) {
-        *length = _last_writing;
-        _last_writing = 0;
+    return _wbuffer.Peek(iov, count, limit, length);
+}
 
-    } else {
-        *length = _wbuffer.size();
+const Linkage::file_t *Linkage::PickSendingFile(size_t *length)
+{
+    assert(length);
+
+    if (_wfiles.empty() || _wfiles.front().position != _wconsumed) {
+        return NULL;
+    }
+
+    // Retry exactly the same bytes.
+    const struct file_t &file = _wfiles.front();
+    *length = file.length;
+    if (_last_writing && _last_writing < file.length) {
+        *length = _last_writing;
     }
 
-    *buffer = &_wbuffer[0];
+    _last_writing = 0;
+    return &file;
 }
 
 void Linkage::ConsumeSendingBuffer(size_t length)
 {
-    assert(length <= _wbuffer.size());
-    std::vector<unsigned char>::iterator p = _wbuffer.begin();
-    std::advance(p, static_cast<ssize_t>(length));
-    _wbuffer.erase(_wbuffer.begin(), p);
+    if (_wfiles.empty() || _wfiles.front().position != _wconsumed) {
+        _wbuffer.Consume(length);
+        _wconsumed += length;
+        return;
+    }
+
+    struct file_t &file = _wfiles.front();
+    assert(length <= file.length);
+    file.offset += static_cast<int64_t>(length);
+    file.length -= length;
+    _wfile_bytes -= length;
+    if (!file.length) {
+        safe_close(file.fd);
+        _wfiles.pop_front();
+    }
 }
 
 size_t Linkage::GetSendingBufferSize() const
 {
-    return _wbuffer.size();
+    return _wbuffer.size() + _wfile_bytes;
 }
 
 void Linkage::DumpSendingBuffer()
 {
-    _wbuffer.clear();
+    for (std::deque<struct file_t>::iterator p = _wfiles.begin();
+         p != _wfiles.end(); ++p) {
+
+        safe_close(p->fd);
+    }
+
+    _wfiles.clear();
+    _wfile_bytes = 0;
+    _wbuffer.Clear();
+    _wappended = 0;
+    _wconsumed = 0;
+    _last_writing = 0;
 }
 
 int Linkage::OnReadable(LinkageWorker *worker)
@@ -169,13 +308,47 @@ int Linkage::OnReadable(LinkageWorker *worker)
 
 int Linkage::OnWritable(LinkageWorker *worker)
 {
-    return OnEvent(worker, AbstractIo::kActionWrite);
+    // Several writes are coming, don't send partial segments in between.
+    bool corked = _tcp_cork && !_wfiles.empty() && _peer->fd() >= 0 &&
+                  set_tcp_cork(_peer->fd(), 1) == 0;
+
+    int ret = OnEvent(worker, AbstractIo::kActionWrite);
+    if (corked) {
+        set_tcp_cork(_peer->fd(), 0);
+    }
+
+    return ret;
+}
+
+void Linkage::set_write_coalescing(bool coalescing, bool tcp_cork)
+{
+    _coalescing = coalescing;
+    _tcp_cork = tcp_cork;
+
+    // Don't leave anything behind.
+    if (!coalescing && _worker && _action == AbstractIo::kActionNone &&
+        GetSendingBufferSize()) {
+
+        _worker->SetFlush(this);
+    }
+}
+
+bool Linkage::Flush()
+{
+    // Already on the way, or leave it to Disconnect().
+    if (!_worker || _graceful || _action != AbstractIo::kActionNone ||
+        !GetSendingBufferSize()) {
+
+        return true;
+    }
+
+    return OnWritable(_worker) > 0;
 }
 
 bool Linkage::DoConnected()
 {
     bool wanna_write = !!GetSendingBufferSize();
-    _worker->SetWanna(this, true, wanna_write);
+    _worker->SetWanna(this, IsReadingWanted(), wanna_write);
     _action = AbstractIo::kActionNone;
     UpdateConnectJam(false);
     UpdateLastReceived();
@@ -206,7 +379,12 @@ int Linkage::OnEvent(LinkageWorker *worker,
     }
 
     if (_action == AbstractIo::kActionNone) {
-        worker->SetWanna(this, true, !!GetSendingBufferSize());
+        worker->SetWanna(this, IsReadingWanted(), !!GetSendingBufferSize());
+    }
+
+    // Last thing to do, the handler might send or disconnect within.
+    if (ret > 0) {
+        CheckWriteDrained();
     }
 
     return ret;
@@ -221,11 +399,17 @@ int Linkage::OnEventOnce(LinkageWorker *worker,
     AbstractIo::Status status = AbstractIo::kStatusBug;
     if (action == AbstractIo::kActionRead) {
         bool more = false;
-        unsigned char buffer[65536];
-        status = _io->Read(buffer, sizeof(buffer), &retlen, &more);
+        size_t length;
+        unsigned char *buffer;
+        if (!PrepareReceivingBuffer(&buffer, &length)) {
+            return -1;
+        }
+
+        status = _io->Read(buffer, length, &retlen, &more);
         if (status == AbstractIo::kStatusOk) {
             _action = AbstractIo::kActionNone;
-            int ret = OnReceived(buffer, retlen);
+            AdaptReceivingRoom(retlen);
+            int ret = OnReceivedInPlace(retlen);
             if (ret == 0) {
                 *next_action = AbstractIo::kActionShutdown;
                 return 1;
@@ -240,15 +424,26 @@ int Linkage::OnEventOnce(LinkageWorker *worker,
             } else { // This is not a I/O error, don't fall into AfterEvent().
                 return -1;
             }
+
+        } else if (status == AbstractIo::kStatusWannaRead) {
+            // Nothing but records like TLS session tickets, reading is simply
+            // not done yet, keep writing what's queued.
+            _action = AbstractIo::kActionNone;
+            return 1;
         }
 
     } else if (action == AbstractIo::kActionWrite) {
         size_t length;
-        const void *buffer;
-        PickSendingBuffer(&buffer, &length);
+        size_t count = 0;
+        struct iovec iov[kMaximumSendingPieces];
+        const struct file_t *file = PickSendingFile(&length);
+        if (!file) {
+            count = PickSendingBuffer(iov, kMaximumSendingPieces, &length);
+        }
 
         if (length) { // Something to write.
-            status = _io->Write(buffer, length, &retlen);
+            status = file ? _io->SendFile(file->fd, file->offset, length, &retlen)
+                          : _io->Writev(iov, count, &retlen);
             if (status == AbstractIo::kStatusOk) {
                 _action = AbstractIo::kActionNone;
                 if (retlen < length) {
@@ -266,6 +461,11 @@ int Linkage::OnEventOnce(LinkageWorker *worker,
                     CLOG.Verbose("Linkage: dequeued [%lu] bytes and sent [%lu] "
                                  "bytes for fd = %d", length, retlen, peer()->fd());
 
+                    // Buffer is chained or files follow, keep writing the rest.
+                    if (GetSendingBufferSize()) {
+                        *next_action = AbstractIo::kActionWrite;
+                    }
+
                     return 1;
                 }
 
@@ -327,6 +527,10 @@ int Linkage::AfterEvent(LinkageWorker *worker,
         worker->SetWanna(this, false, true);
         return 1;
 
+    case AbstractIo::kStatusPending:
+        worker->SetWanna(this, false, false);
+        return 1;
+
     case AbstractIo::kStatusClosed:
         return 0;
 
@@ -369,80 +573,151 @@ int Linkage::OnReceived(const void *buffer, size_t length)
     const unsigned char *ptr = reinterpret_cast<const unsigned char *>(buffer);
     if (!buffer) {
         return -1;
-    } else if (!length) {
-        return 1;
     }
 
-    UpdateLastReceived();
-    if (_graceful) {
-        return 1;
-    }
+    // Not from the socket, copy into the receiving buffer.
+    while (length) {
+        size_t room;
+        unsigned char *tail;
+        if (!PrepareReceivingBuffer(&tail, &room)) {
+            return -1;
+        }
 
-    CLOG.Verbose("Linkage: received [%lu] bytes for fd = %d", length, _peer->fd());
+        size_t size = length < room ? length : room;
+        memcpy(tail, ptr, size);
 
-    // No need to move buffer.
-    if (_rbuffer.empty()) {
-        size_t consumed;
-        int ret = DoReceived(ptr, length, &consumed);
+        int ret = OnReceivedInPlace(size);
         if (ret <= 0) {
             return ret;
         }
 
-        if (consumed != length) {
-            _rbuffer.insert(_rbuffer.end(), ptr + consumed, ptr + length);
-        }
+        length -= size;
+        ptr += size;
+    }
+
+    return 1;
+}
 
-    // Buffer moving unavoidable, but I already know the minimum bytes to move.
-    } else if (_rlength && _rlength <= _rbuffer.size() + length) {
-        size_t last = _rbuffer.size();
-        assert(_rlength > last);
+bool Linkage::PrepareReceivingBuffer(unsigned char **buffer, size_t *length)
+{
+    assert(buffer);
+    assert(length);
 
-        _rbuffer.insert(_rbuffer.end(), ptr, ptr + (_rlength - last));
-        assert(_rbuffer.size() == _rlength);
+    // Room for the whole message if its length is known, but the peer might
+    // lie about it, so grow no more than doubling what's really received.
+    size_t pending = _rtail - _rhead;
+    size_t wanted = pending + _rroom;
+    if (_rlength > wanted) {
+        size_t limit = pending > kMaximumReceivingRoom ? pending * 2
+                                                       : pending + kMaximumReceivingRoom;
 
-        size_t consumed;
-        int ret = DoReceived(&_rbuffer[0], _rlength, &consumed);
-        if (ret <= 0) {
-            return ret;
-        }
+        wanted = _rlength < limit ? _rlength : limit;
+    }
+
+    if (!_rslab || _rslab->capacity() - _rhead < wanted) {
+        if (_rslab && !_rslab->shared() && _rslab->capacity() >= wanted) {
+            // Nobody else is looking at it, move to the front.
+            memmove(_rslab->data(), _rslab->data() + _rhead, pending);
+
+        } else {
+            ReceiveBufferPool *pool = _worker ? _worker->receive_buffer_pool()
+                                              : NULL;
 
-        // Everything must have been extracted.
-        _rbuffer.clear();
+            ReceiveBuffer *slab = pool ? pool->Get(wanted)
+                                       : ReceiveBuffer::Create(wanted);
+
+            if (!slab) {
+                CLOG.Verbose("Linkage: failed to allocate [%lu] bytes for fd = %d",
+                             wanted, _peer->fd());
+
+                return false;
+            }
 
-        // Now the remaining buffer.
-        ptr += consumed - last;
-        length -= consumed - last;
-        if (length) {
-            ret = DoReceived(ptr, length, &consumed);
-            if (ret <= 0) {
-                return ret;
+            // Only the incomplete message is copied, if any.
+            if (pending) {
+                memcpy(slab->data(), _rslab->data() + _rhead, pending);
             }
 
-            if (consumed != length) {
-                _rbuffer.insert(_rbuffer.end(), ptr + consumed, ptr + length);
+            if (_rslab) {
+                _rslab->Release();
             }
+
+            _rslab = slab;
         }
 
-    // The worst case, all the buffer must be moved.
-    } else {
-        _rbuffer.insert(_rbuffer.end(), ptr, ptr + length);
+        _rhead = 0;
+        _rtail = pending;
+    }
 
-        size_t consumed;
-        int ret = DoReceived(&_rbuffer[0], _rbuffer.size(), &consumed);
-        if (ret <= 0) {
-            return ret;
+    *buffer = _rslab->data() + _rtail;
+    *length = _rslab->capacity() - _rtail;
+    return true;
+}
+
+void Linkage::AdaptReceivingRoom(size_t received)
+{
+    static const size_t kSparseReads = 16;
+
+    if (received >= _rroom) {
+        _rsparse = 0;
+        if (_rroom < kMaximumReceivingRoom) {
+            _rroom <<= 1;
         }
 
-        if (consumed) {
-            std::vector<unsigned char>::iterator p = _rbuffer.begin();
-            std::advance(p, static_cast<ssize_t>(consumed));
-            _rbuffer.erase(_rbuffer.begin(), p);
+    } else if (received <= _rroom / 4 && _rroom > kMinimumReceivingRoom) {
+        if (++_rsparse >= kSparseReads) {
+            _rsparse = 0;
+            _rroom >>= 1;
         }
+
+    } else {
+        _rsparse = 0;
+    }
+}
+
+int Linkage::OnReceivedInPlace(size_t length)
+{
+    assert(_rslab);
+    assert(_rtail + length <= _rslab->capacity());
+
+    if (!length) {
+        return 1;
+    }
+
+    UpdateLastReceived();
+    if (_graceful) {
+        return 1;
+    }
+
+    CLOG.Verbose("Linkage: received [%lu] bytes for fd = %d", length, _peer->fd());
+
+    _rtail += length;
+    size_t consumed;
+    int ret = DoReceived(_rslab->data() + _rhead, _rtail - _rhead, &consumed);
+    _rhead += consumed;
+    if (ret <= 0) {
+        return ret;
+    }
+
+    // Don't hold memory for idle connections.
+    if (_rhead == _rtail) {
+        DropReceivingBuffer();
     }
 
     return 1;
 }
 
+void Linkage::DropReceivingBuffer()
+{
+    if (_rslab) {
+        _rslab->Release();
+        _rslab = NULL;
+    }
+
+    _rhead = 0;
+    _rtail = 0;
+}
+
 int Linkage::DoReceived(const void *buffer, size_t length, size_t *consumed)
 {
     const unsigned char *ptr = reinterpret_cast<const unsigned char *>(buffer);
@@ -513,6 +788,7 @@ void Linkage::UpdateReceiveJam(bool jammed)
     if (jammed) {
         if (!_receive_jam) {
             _receive_jam = get_monotonic_timestamp();
+            ScheduleCleanup(false);
         }
     } else {
         _receive_jam = 0;
@@ -524,6 +800,7 @@ void Linkage::UpdateConnectJam(bool jammed)
     if (jammed) {
         if (!_connect_jam) {
             _connect_jam = get_monotonic_timestamp();
+            ScheduleCleanup(false);
         }
     } else {
         _connect_jam = 0;
@@ -540,12 +817,112 @@ void Linkage::UpdateLastSent(bool sent, bool jammed)
     if (jammed) {
         if (!_send_jam) {
             _send_jam = now;
+            ScheduleCleanup(false);
         }
     } else {
         _send_jam = 0;
     }
 }
 
+int64_t Linkage::GetDeadline() const
+{
+    int64_t deadline = 0;
+    if (_connect_timeout && _connect_jam) {
+        deadline = _connect_jam + _connect_timeout;
+    }
+
+    if (_send_timeout && _send_jam) {
+        int64_t d = _send_jam + _send_timeout;
+        if (!deadline || d < deadline) {
+            deadline = d;
+        }
+    }
+
+    if (_receive_timeout && _receive_jam) {
+        int64_t d = _receive_jam + _receive_timeout;
+        if (!deadline || d < deadline) {
+            deadline = d;
+        }
+    }
+
+    if (_idle_timeout) {
+        int64_t last = _last_received > _last_sent ? _last_received : _last_sent;
+        int64_t d = last + _idle_timeout;
+        if (!deadline || d < deadline) {
+            deadline = d;
+        }
+    }
+
+    return deadline;
+}
+
+void Linkage::ScheduleCleanup(bool force)
+{
+    if (!_worker) {
+        return;
+    }
+
+    // The periodic one can only be earlier than the moved deadline.
+    if (!force && _cleanup && _periodic_cleanup) {
+        return;
+    }
+
+    int64_t deadline = GetDeadline();
+    if (_periodic_cleanup) {
+        int64_t periodic = get_monotonic_timestamp() + kCleanupInterval;
+        if (!deadline || periodic < deadline) {
+            deadline = periodic;
+        }
+    }
+
+    if (!deadline) {
+        if (force) {
+            _cleanup = 0;
+        }
+
+        return;
+    }
+
+    if (!force && _cleanup && _cleanup <= deadline) {
+        return;
+    }
+
+    _cleanup = deadline;
+    DoSetCleanup(_worker, deadline);
+}
+
+void Linkage::set_receive_timeout(int64_t timeout)
+{
+    _receive_timeout = timeout;
+    ScheduleCleanup(true);
+}
+
+void Linkage::set_connect_timeout(int64_t timeout)
+{
+    _connect_timeout = timeout;
+    ScheduleCleanup(true);
+}
+
+void Linkage::set_send_timeout(int64_t timeout)
+{
+    _send_timeout = timeout;
+    ScheduleCleanup(true);
+}
+
+void Linkage::set_idle_timeout(int64_t timeout)
+{
+    _idle_timeout = timeout;
+    ScheduleCleanup(true);
+}
+
+void Linkage::set_periodic_cleanup(bool periodic)
+{
+    if (_periodic_cleanup != periodic) {
+        _periodic_cleanup = periodic;
+        ScheduleCleanup(true);
+    }
+}
+
 bool Linkage::Cleanup(int64_t now)
 {
     int64_t jammed_c = _connect_jam ? now - _connect_jam : 0;
@@ -574,7 +951,12 @@ bool Linkage::Cleanup(int64_t now)
         return false;
     }
 
-    return _handler->Cleanup(this, now);
+    if (!_handler->Cleanup(this, now)) {
+        return false;
+    }
+
+    ScheduleCleanup(true);
+    return true;
 }
 
 bool Linkage::Attach(LinkageWorker *worker)
@@ -609,10 +991,14 @@ bool Linkage::Attach(LinkageWorker *worker)
     }
 
     _worker = worker;
+    _io->SetOwner(worker, this);
+    _cleanup = 0;
+    ScheduleCleanup(true);
     if (!connecting) {
         if (!DoConnected()) {
             DoDetach(worker);
             _worker = NULL;
+            _io->SetOwner(NULL, NULL);
             return false;
         }
 
@@ -632,6 +1018,7 @@ bool Linkage::Attach(LinkageWorker *worker)
     if (ret <= 0) {
         DoDetach(worker);
         _worker = NULL;
+        _io->SetOwner(NULL, NULL);
         return false;
     }
 
@@ -651,6 +1038,9 @@ bool Linkage::Detach(LinkageWorker *worker)
     }
 
     _worker = NULL;
+    _io->SetOwner(NULL, NULL);
+
+    _cleanup = 0;
     return true;
 }
 
@@ -693,6 +1083,50 @@ int Linkage::Shutdown(AbstractIo::Status *status)
 }
 
 bool Linkage::Send(const void *buffer, size_t length)
+{
+    return DoSend(buffer, length, NULL);
+}
+
+bool Linkage::SendAdopted(void *block, const void *buffer, size_t length)
+{
+    bool result = DoSend(buffer, length, &block);
+    free(block); // Still mine if not queued.
+    return result;
+}
+
+bool Linkage::SendFile(int fd, int64_t offset, size_t length)
+{
+    struct stat st;
+    if (fd < 0) {
+        return false;
+    } else if (offset < 0 || !_worker || _graceful ||
+               fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+
+        safe_close(fd);
+        return false;
+    } else if (length == 0) {
+        safe_close(fd);
+        return true;
+    }
+
+    CLOG.Verbose("Linkage: queued [%lu] bytes of file for fd = %d",
+                 length, _peer->fd());
+
+    bool idle = _action == AbstractIo::kActionNone && !GetSendingBufferSize();
+    struct file_t file = { fd, offset, length, _wappended };
+    _wfiles.push_back(file);
+    _wfile_bytes += length;
+
+    // Written once the round is over, otherwise already on the way.
+    if (idle) {
+        _worker->SetFlush(this);
+    }
+
+    CheckWriteBlocked();
+    return true;
+}
+
+bool Linkage::DoSend(const void *buffer, size_t length, void **block)
 {
     if (!buffer || length > INT_MAX || !_worker || _graceful) {
         return false;
@@ -701,12 +1135,19 @@ bool Linkage::Send(const void *buffer, size_t length)
     }
 
     CLOG.Verbose("Linkage: sending [%lu] bytes for fd = %d", length, _peer->fd());
-    if (!_worker || _action != AbstractIo::kActionNone || GetSendingBufferSize()) {
-        if (!AppendSendingBuffer(buffer, length)) {
+    if (_coalescing || _action != AbstractIo::kActionNone || GetSendingBufferSize()) {
+        bool idle = _action == AbstractIo::kActionNone && !GetSendingBufferSize();
+        if (!AppendSendingBuffer(buffer, length, block)) {
             return false;
         }
 
+        // The first one within the round, written once the round is over.
+        if (idle) {
+            _worker->SetFlush(this);
+        }
+
         CLOG.Verbose("Linkage: queued [%lu] bytes for fd = %d", length, _peer->fd());
+        CheckWriteBlocked();
         return true;
     }
 
@@ -715,7 +1156,7 @@ bool Linkage::Send(const void *buffer, size_t length)
     AbstractIo::Status status = _io->Write(buffer, length, &retlen);
     switch (status) {
     case AbstractIo::kStatusJammed:
-        if (!AppendSendingBuffer(buffer, length)) {
+        if (!AppendSendingBuffer(buffer, length, block)) {
             return false;
         }
 
@@ -725,7 +1166,7 @@ bool Linkage::Send(const void *buffer, size_t length)
         break;
 
     case AbstractIo::kStatusWannaRead:
-        if (!AppendSendingBuffer(buffer, length)) {
+        if (!AppendSendingBuffer(buffer, length, block)) {
             return false;
         }
 
@@ -737,7 +1178,7 @@ bool Linkage::Send(const void *buffer, size_t length)
         break;
 
     case AbstractIo::kStatusWannaWrite:
-        if (!AppendSendingBuffer(buffer, length)) {
+        if (!AppendSendingBuffer(buffer, length, block)) {
             return false;
         }
 
@@ -751,7 +1192,7 @@ bool Linkage::Send(const void *buffer, size_t length)
     case AbstractIo::kStatusOk:
         if (retlen < length) {
             const unsigned char *buf = reinterpret_cast<const unsigned char *>(buffer);
-            if (!AppendSendingBuffer(buf + retlen, length - retlen)) {
+            if (!AppendSendingBuffer(buf + retlen, length - retlen, block)) {
                 return false;
             }
 
@@ -771,6 +1212,7 @@ bool Linkage::Send(const void *buffer, size_t length)
         return false;
     };
 
+    CheckWriteBlocked();
     return true;
 }
 
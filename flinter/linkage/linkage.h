@@ -19,16 +19,18 @@
 #include <sys/types.h>
 #include <stdint.h>
 
+#include <deque>
 #include <string>
-#include <vector>
 
 #include <flinter/linkage/abstract_io.h>
 #include <flinter/linkage/linkage_base.h>
+#include <flinter/types/chained_buffer.h>
 
 namespace flinter {
 
 class LinkageHandler;
 class LinkagePeer;
+class ReceiveBuffer;
 
 class Linkage : public LinkageBase {
 public:
@@ -53,14 +55,59 @@ public:
     virtual void OnError(bool reading_or_writing, int errnum);
     virtual void OnDisconnected();
     virtual bool OnConnected();
+    virtual void OnWriteBlocked();
+    virtual void OnWriteDrained();
 
     /// @return true sent or queued.
     virtual bool Send(const void *buffer, size_t length);
 
-    void set_receive_timeout(int64_t timeout) { _receive_timeout = timeout; }
-    void set_connect_timeout(int64_t timeout) { _connect_timeout = timeout; }
-    void set_send_timeout   (int64_t timeout) { _send_timeout    = timeout; }
-    void set_idle_timeout   (int64_t timeout) { _idle_timeout    = timeout; }
+    /// Same as Send() but queue the bytes without copying if needed.
+    /// @param block allocated by malloc(), life span TAKEN even if failed.
+    /// @param buffer bytes to send, must lie within block.
+    /// @return true sent or queued.
+    bool SendAdopted(void *block, const void *buffer, size_t length);
+
+    /// Queue bytes of a file in order with other sends, the kernel sends them
+    /// without copying if the I/O supports it. Bytes are read when sent, keep
+    /// them unchanged until then.
+    /// @param fd a regular file, life span TAKEN even if failed, closed once
+    ///           sent or dropped. Pipes are refused, nothing tells when they
+    ///           can be read.
+    /// @return true queued.
+    bool SendFile(int fd, int64_t offset, size_t length);
+
+    void set_receive_timeout(int64_t timeout);
+    void set_connect_timeout(int64_t timeout);
+    void set_send_timeout   (int64_t timeout);
+    void set_idle_timeout   (int64_t timeout);
+
+    /// Also call handler Cleanup() every second, not only when timeouts might
+    /// be due. Off by default so that idle linkages cost nothing until their
+    /// timeouts, turn it on for heartbeats or request timeouts kept by the
+    /// handler.
+    void set_periodic_cleanup(bool periodic);
+
+    /// OnWriteBlocked() is called once more than high bytes are queued, and
+    /// OnWriteDrained() once it's back to no more than low.
+    /// @param high 0 to disable.
+    /// @param pause_reading stop reading in between.
+    void set_write_watermarks(size_t high, size_t low, bool pause_reading);
+
+    bool write_blocked() const
+    {
+        return _write_blocked;
+    }
+
+    /// Sends are gathered and written at once when the round of the event
+    /// loop is over or Flush() is called, fewer writes and segments at the
+    /// cost of latency within the round.
+    /// @param tcp_cork also cork the socket while writing if bytes of files
+    ///                 are queued, so that segments are full across writes.
+    void set_write_coalescing(bool coalescing, bool tcp_cork);
+
+    /// Write what's gathered now rather than when the round is over.
+    /// @return false if failed, disconnect it.
+    bool Flush();
 
     static const int64_t kDefaultReceiveTimeout;
     static const int64_t kDefaultConnectTimeout;
@@ -87,6 +134,13 @@ public:
         return _io;
     }
 
+    /// Only valid within OnMessage(), the message lies in this buffer.
+    /// Ref() it to keep the message after OnMessage() returns.
+    ReceiveBuffer *receiving_buffer()
+    {
+        return _rslab;
+    }
+
 protected:
     /// Return the packet size even if it's incomplete as long as you can tell.
     /// Very handy when you write the message length in the header.
@@ -117,15 +171,57 @@ protected:
     virtual int Shutdown(AbstractIo::Status *status);
 
 private:
+    // Queued pieces written within a single Writev().
+    static const size_t kMaximumSendingPieces = 64;
+
+    // Bytes offered to a single Read() adapt within these.
+    static const size_t kMinimumReceivingRoom = 4096;
+    static const size_t kMaximumReceivingRoom = 262144;
+
     static const char *GetActionString(const AbstractIo::Action &action);
 
     int DoReceived(const void *buffer, size_t length, size_t *consumed);
-    bool AppendSendingBuffer(const void *buffer, size_t length);
-    void PickSendingBuffer(const void **buffer, size_t *length);
+
+    /// Make room at the tail of the receiving buffer.
+    bool PrepareReceivingBuffer(unsigned char **buffer, size_t *length);
+
+    /// Some bytes are just written to the tail of the receiving buffer.
+    int OnReceivedInPlace(size_t length);
+    void DropReceivingBuffer();
+
+    /// Read more at a time if reads fill up the room, less if they hardly
+    /// use it for a while.
+    void AdaptReceivingRoom(size_t received);
+
+    // Queued behind bytes that are appended to _wbuffer before it.
+    struct file_t {
+        int fd;
+        int64_t offset;
+        size_t length;
+        uint64_t position;
+    }; // struct file_t
+
+    /// @param block if not NULL, adopted instead of copied and set to NULL.
+    bool AppendSendingBuffer(const void *buffer, size_t length, void **block);
+    size_t PickSendingBuffer(struct iovec *iov, size_t count, size_t *length);
+
+    /// @return NULL unless a file is at the front.
+    const struct file_t *PickSendingFile(size_t *length);
+    bool DoSend(const void *buffer, size_t length, void **block);
     void ConsumeSendingBuffer(size_t length);
     size_t GetSendingBufferSize() const;
     void DumpSendingBuffer();
 
+    /// Check watermarks after the sending buffer grows or shrinks.
+    void CheckWriteBlocked();
+    void CheckWriteDrained();
+
+    /// Reading is paused while write blocked if so configured.
+    bool IsReadingWanted() const
+    {
+        return !_write_blocked || !_pause_reading;
+    }
+
     int OnEvent(LinkageWorker *worker,
                 const AbstractIo::Action &idle_action);
 
@@ -152,15 +248,47 @@ private:
     /// @param jammed if the message is incomplete.
     void UpdateLastSent(bool sent, bool jammed);
 
-    // Not a very good data structure, use it for now.
-    std::vector<unsigned char> _rbuffer;
+    /// Earliest time any timeout can expire, 0 if none.
+    int64_t GetDeadline() const;
+
+    /// Deadlines only move later as bytes come and go, so the worker is only
+    /// told if one moves earlier, or unless forced. When it fires Cleanup()
+    /// finds the real deadline. Without any, the worker checks every second.
+    /// Never later than a second if periodic cleanup is on.
+    void ScheduleCleanup(bool force);
+
+    // Read into directly, [_rhead, _rtail) are bytes not yet consumed.
+    ReceiveBuffer *_rslab;
+    size_t _rhead;
+    size_t _rtail;
+
+    // Offered to each read, and how many reads in a row hardly used it.
+    size_t _rroom;
+    size_t _rsparse;
 
     // Only used when kernel send buffer is full.
-    std::vector<unsigned char> _wbuffer;
+    ChainedBuffer _wbuffer;
+
+    // Files in between, positioned by bytes ever appended and consumed.
+    std::deque<struct file_t> _wfiles;
+    size_t _wfile_bytes;
+    uint64_t _wappended;
+    uint64_t _wconsumed;
 
     // If jammed, find exactly the same length of last write.
     size_t _last_writing;
 
+    // Backpressure.
+    size_t _write_high_watermark;
+    size_t _write_low_watermark;
+    bool _pause_reading;
+    bool _write_blocked;
+
+    // Write coalescing.
+    bool _coalescing;
+    bool _tcp_cork;
+    bool _periodic_cleanup;
+
     LinkageHandler *const _handler;
     LinkagePeer *const _peer;
     LinkagePeer *const _me;
@@ -175,6 +303,7 @@ private:
     int64_t _connect_jam;
     int64_t _last_sent;
     int64_t _send_jam;
+    int64_t _cleanup;
 
     AbstractIo::Action _action;
     LinkageWorker *_worker;
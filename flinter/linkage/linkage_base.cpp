@@ -31,4 +31,9 @@ bool LinkageBase::DoDetach(LinkageWorker *worker)
     return worker->Detach(this);
 }
 
+bool LinkageBase::DoSetCleanup(LinkageWorker *worker, int64_t when)
+{
+    return worker->SetCleanup(this, when);
+}
+
 } // namespace flinter
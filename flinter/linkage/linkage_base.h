@@ -72,6 +72,9 @@ protected:
                   bool read_now, bool write_now,
                   bool auto_release);
 
+    /// See LinkageWorker::SetCleanup().
+    bool DoSetCleanup(LinkageWorker *worker, int64_t when);
+
 }; // class LinkageBase
 
 } // namespace flinter
@@ -50,6 +50,16 @@ bool LinkageHandler::OnConnected(Linkage *linkage)
     return true;
 }
 
+void LinkageHandler::OnWriteBlocked(Linkage *linkage)
+{
+    (void)linkage;
+}
+
+void LinkageHandler::OnWriteDrained(Linkage *linkage)
+{
+    (void)linkage;
+}
+
 bool LinkageHandler::Cleanup(Linkage *linkage, int64_t now)
 {
     (void)linkage;
@@ -50,6 +50,13 @@ public:
                          bool reading_or_writing,
                          int errnum);
 
+    /// Too many bytes are queued for writing, see
+    /// Linkage::set_write_watermarks().
+    virtual void OnWriteBlocked(Linkage *linkage);
+    virtual void OnWriteDrained(Linkage *linkage);
+
+    /// Called when any of the timeouts might be due, and every second if
+    /// Linkage::set_periodic_cleanup() is on.
     virtual bool Cleanup(Linkage *linkage, int64_t now);
 
 }; // class LinkageHandler
@@ -17,44 +17,91 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
-#include <list>
 #include <stdexcept>
 
 #include "flinter/linkage/interface.h"
 #include "flinter/linkage/linkage_base.h"
 #include "flinter/linkage/linkage_peer.h"
-#include "flinter/thread/mutex.h"
-#include "flinter/thread/mutex_locker.h"
+#include "flinter/linkage/receive_buffer.h"
+#include "flinter/linkage/timer_wheel.h"
 #include "flinter/logger.h"
 #include "flinter/safeio.h"
 #include "flinter/utility.h"
 
-#include "config.h"
-#if HAVE_EV_H
-#include <ev.h>
-
 namespace flinter {
 
 struct LinkageWorker::client_t {
+    TimerWheel::node_t cleanup;
     LinkageBase *linkage;
-    struct ev_io ev_io_r;
-    struct ev_io ev_io_w;
+    EventBackend::io_t *io;
     bool auto_release;
-    bool running_r;
-    bool running_w;
+    bool rescheduled;
+    bool flushing;
     int fd;
 }; // struct LinkageWorker::client_t
 
+struct LinkageWorker::command_t {
+    enum Type {
+        kRunnable,
+        kBytes,
+        kQuit
+    }; // enum Type
+
+    Atomic<struct command_t *> next;
+    Runnable *runnable;
+    Type type;
+    uint64_t tag;
+    size_t length;
+    unsigned char data[kMaximumInlineCommand];
+}; // struct LinkageWorker::command_t
+
 struct LinkageWorker::timer_t {
-    struct ev_timer ev_timer;
+    EventBackend::timer_t *timer;
     Runnable *runnable;
     bool auto_release;
 }; // struct LinkageWorker::timer_t
 
+class LinkageWorker::Callback : public EventBackend::Callback {
+public:
+    explicit Callback(LinkageWorker *worker) : _worker(worker) {}
+    virtual ~Callback() {}
+
+    virtual void OnReadable(EventBackend::io_t *io)
+    {
+        _worker->OnReadable(reinterpret_cast<struct client_t *>(io->context));
+    }
+
+    virtual void OnWritable(EventBackend::io_t *io)
+    {
+        _worker->OnWritable(reinterpret_cast<struct client_t *>(io->context));
+    }
+
+    virtual void OnTimer(EventBackend::timer_t *timer)
+    {
+        _worker->OnTimer(reinterpret_cast<struct timer_t *>(timer->context));
+    }
+
+    virtual void OnWakeup()
+    {
+        _worker->OnCommands();
+    }
+
+    virtual void OnRound()
+    {
+        _worker->OnRound();
+    }
+
+private:
+    LinkageWorker *const _worker;
+
+}; // class LinkageWorker::Callback
+
 class LinkageWorker::HealthTimer : public Runnable {
 public:
     HealthTimer(LinkageWorker *worker) : _worker(worker) {}
@@ -71,60 +118,91 @@ private:
 
 }; // class LinkageWorker::HealthTimer
 
-LinkageWorker::LinkageWorker() : _loop(ev_loop_new(0))
-                               , _quit(false)
-                               , _running_thread_id(0)
-                               , _async(new struct ev_async)
-                               , _mutex(new Mutex)
+class LinkageWorker::LatencyTimer : public Runnable {
+public:
+    LatencyTimer(LinkageWorker *worker, int64_t interval)
+            : _worker(worker), _interval(interval), _expected(0) {}
+
+    virtual ~LatencyTimer() {}
+
+protected:
+    virtual bool Run()
+    {
+        // Backends wake up a little late anyway, in the order of 1ms.
+        int64_t now = get_monotonic_timestamp();
+        if (_expected) {
+            _worker->_loop_latency.Record(now - _expected);
+        }
+
+        _expected = now + _interval;
+        return true;
+    }
+
+private:
+    LinkageWorker *const _worker;
+    const int64_t _interval;
+    int64_t _expected;
+
+}; // class LinkageWorker::LatencyTimer
+
+const size_t LinkageWorker::kMaximumInlineCommand;
+
+// Pooled commands per worker.
+static const size_t kMaximumCachedCommands = 256;
+
+// Timeouts are checked this often, a wheel turns around in about 100s.
+static const int64_t kCleanupResolution = 100000000LL;
+static const size_t kCleanupSlots = 1024;
+
+// For linkages not scheduling their own cleanups.
+static const int64_t kCleanupInterval = 1000000000LL;
+
+LinkageWorker::LinkageWorker(EventBackend::Type backend)
+        : _callback(new Callback(this))
+        , _backend(EventBackend::Create(backend, _callback))
+        , _quit(false)
+        , _running_thread_id(0)
+        , _commands(new IntrusiveMpscQueue<struct command_t>)
+        , _command_signaled(0)
+        , _free_commands(NULL)
+        , _free_count(0)
+        , _wheel(new TimerWheel(kCleanupResolution, kCleanupSlots,
+                                get_monotonic_timestamp()))
+        , _latency_probe(0)
+        , _receive_buffer_pool(ReceiveBufferPool::Create())
 {
-    if (!_loop) {
+    if (!_backend) {
+        _receive_buffer_pool->Release();
+        delete _wheel;
+        delete _commands;
+        delete _callback;
         throw std::runtime_error("LinkageWorker: failed to initialize loop.");
     }
-
-    ev_async_init(_async, command_cb);
-    ev_async_start(_loop, _async);
-    ev_set_userdata(_loop, this);
 }
 
 LinkageWorker::~LinkageWorker()
 {
-    ev_async_stop(_loop, _async);
-    ev_loop_destroy(_loop);
-    delete _mutex;
-    delete _async;
-}
+    delete _backend;
+    delete _callback;
+    delete _wheel;
 
-void LinkageWorker::command_cb(struct ev_loop *loop, struct ev_async * /*w*/, int /*revents*/)
-{
-    LinkageWorker *worker = reinterpret_cast<LinkageWorker *>(ev_userdata(loop));
-    worker->OnCommand();
-}
+    // Slabs still held by linkages or messages keep it alive.
+    _receive_buffer_pool->Release();
 
-void LinkageWorker::readable_cb(struct ev_loop *loop, struct ev_io *w, int /*revents*/)
-{
-    LinkageWorker *worker = reinterpret_cast<LinkageWorker *>(ev_userdata(loop));
-    unsigned char *p = reinterpret_cast<unsigned char *>(w);
-    p -= offsetof(struct client_t, ev_io_r);
-    struct client_t *client = reinterpret_cast<struct client_t *>(p);
-    worker->OnReadable(client);
-}
+    // Commands left behind after quitting.
+    struct command_t *command;
+    while ((command = _commands->Pop())) {
+        delete command->runnable;
+        delete command;
+    }
 
-void LinkageWorker::writable_cb(struct ev_loop *loop, struct ev_io *w, int /*revents*/)
-{
-    LinkageWorker *worker = reinterpret_cast<LinkageWorker *>(ev_userdata(loop));
-    unsigned char *p = reinterpret_cast<unsigned char *>(w);
-    p -= offsetof(struct client_t, ev_io_w);
-    struct client_t *client = reinterpret_cast<struct client_t *>(p);
-    worker->OnWritable(client);
-}
+    while (_free_commands) {
+        command = _free_commands;
+        _free_commands = command->next.Get();
+        delete command;
+    }
 
-void LinkageWorker::timer_cb(struct ev_loop *loop, struct ev_timer *w, int /*revents*/)
-{
-    LinkageWorker *worker = reinterpret_cast<LinkageWorker *>(ev_userdata(loop));
-    unsigned char *p = reinterpret_cast<unsigned char *>(w);
-    p -= offsetof(struct timer_t, ev_timer);
-    struct timer_t *timer = reinterpret_cast<struct timer_t *>(p);
-    worker->OnTimer(timer);
+    delete _commands;
 }
 
 void LinkageWorker::OnTimer(struct timer_t *timer)
@@ -150,16 +228,16 @@ bool LinkageWorker::RegisterTimer(int64_t after,
         return false;
     }
 
-    double r = static_cast<double>(repeat) / 1000000000;
-    double a = static_cast<double>(after) / 1000000000;
     struct timer_t *timer = new struct timer_t;
-    struct ev_timer *t = &timer->ev_timer;
+    timer->timer = _backend->AddTimer(after, repeat, timer);
+    if (!timer->timer) {
+        delete timer;
+        return false;
+    }
+
     timer->auto_release = auto_release;
     timer->runnable = runnable;
     _timers.insert(timer);
-
-    ev_timer_init(t, timer_cb, a, r);
-    ev_timer_start(_loop, &timer->ev_timer);
     return true;
 }
 
@@ -171,18 +249,27 @@ bool LinkageWorker::Run()
     }
 
     HealthTimer *health = new HealthTimer(this);
-    if (!RegisterTimer(1000000000LL, health, true)) {
+    if (!RegisterTimer(kCleanupResolution, health, true)) {
         delete health;
         CLOG.Error("Linkage: failed to register timers.");
         throw std::runtime_error("Linkage: failed to register timers.");
     }
 
+    if (_latency_probe > 0) {
+        LatencyTimer *latency = new LatencyTimer(this, _latency_probe);
+        if (!RegisterTimer(_latency_probe, latency, true)) {
+            delete latency;
+            CLOG.Error("Linkage: failed to register timers.");
+            throw std::runtime_error("Linkage: failed to register timers.");
+        }
+    }
+
     _running_thread_id = get_current_thread_id();
     LOG(VERBOSE) << "Linkage: enter event loop [" << _running_thread_id << "]";
     while (!_quit) {
-        if (!ev_run(_loop, 0)) {
-            CLOG.Error("Linkage: ev_run() returned false.");
-            throw std::runtime_error("Linkage: ev_run() returned false.");
+        if (!_backend->Run()) {
+            CLOG.Error("Linkage: event loop returned false.");
+            throw std::runtime_error("Linkage: event loop returned false.");
         }
     }
     LOG(VERBOSE) << "Linkage: leave event loop [" << _running_thread_id << "]";
@@ -208,41 +295,121 @@ bool LinkageWorker::Shutdown()
     return SendCommand(NULL);
 }
 
-bool LinkageWorker::SendCommand(Runnable *command)
+struct LinkageWorker::command_t *LinkageWorker::AllocateCommand()
+{
+    Spinlock::Locker locker(&_free_lock);
+    struct command_t *command = _free_commands;
+    if (command) {
+        _free_commands = command->next.Get();
+        --_free_count;
+        return command;
+    }
+
+    locker.Unlock();
+    return new struct command_t;
+}
+
+void LinkageWorker::ReleaseCommands(struct command_t *commands)
 {
-    MutexLocker locker(_mutex);
-    _commands.push_back(command);
+    Spinlock::Locker locker(&_free_lock);
+    while (commands && _free_count < kMaximumCachedCommands) {
+        struct command_t *command = commands;
+        commands = command->next.Get();
+        command->next.Set(_free_commands);
+        _free_commands = command;
+        ++_free_count;
+    }
+
     locker.Unlock();
+    while (commands) {
+        struct command_t *command = commands;
+        commands = command->next.Get();
+        delete command;
+    }
+}
+
+void LinkageWorker::PushCommand(struct command_t *command)
+{
+    _commands->Push(command);
 
-    ev_async_send(_loop, _async);
+    // Only the first command since last drained wakes the loop up.
+    if (_command_signaled.CompareAndSwap(0, 1) == 0) {
+        _backend->Wakeup();
+    }
+}
+
+bool LinkageWorker::SendCommand(Runnable *command)
+{
+    struct command_t *c = AllocateCommand();
+    c->type = command ? command_t::kRunnable : command_t::kQuit;
+    c->runnable = command;
+    PushCommand(c);
     return true;
 }
 
-void LinkageWorker::OnCommand()
+bool LinkageWorker::SendCommand(uint64_t tag, const void *buffer, size_t length)
 {
-    std::list<Runnable *> q;
-    MutexLocker locker(_mutex);
-    q.swap(_commands);
-    locker.Unlock();
+    if (length > kMaximumInlineCommand || (length && !buffer)) {
+        return false;
+    }
+
+    struct command_t *c = AllocateCommand();
+    c->type = command_t::kBytes;
+    c->runnable = NULL;
+    c->tag = tag;
+    c->length = length;
+    if (length) {
+        memcpy(c->data, buffer, length);
+    }
 
-    for (std::list<Runnable *>::iterator p = q.begin(); p != q.end(); ++p) {
-        Runnable *command = *p;
-        if (!command) {
-            ev_break(_loop, EVBREAK_ALL);
+    PushCommand(c);
+    return true;
+}
+
+void LinkageWorker::OnCommands()
+{
+    // Reset before draining, whatever is pushed since will fire once more.
+    _command_signaled.BarrierSet(0);
+
+    struct command_t *done = NULL;
+    bool dropping = false;
+    struct command_t *command;
+    while (!_quit && (command = _commands->Pop())) {
+        if (command->type == command_t::kQuit) {
+            _backend->Break();
             _quit = true;
-            return;
-        }
 
-        if (!command->Run()) {
-            break;
+        } else if (command->type == command_t::kBytes) {
+            if (!dropping) {
+                OnCommand(command->tag, command->data, command->length);
+            }
+
+        } else {
+            // A failed command drops the rest of the batch, as it always did.
+            if (!dropping && !command->runnable->Run()) {
+                dropping = true;
+            }
+
+            delete command->runnable;
+            command->runnable = NULL;
         }
+
+        command->next.Set(done);
+        done = command;
     }
 
-    for (std::list<Runnable *>::iterator p = q.begin(); p != q.end(); ++p) {
-        delete *p;
+    if (done) {
+        ReleaseCommands(done);
     }
 }
 
+void LinkageWorker::OnCommand(uint64_t /*tag*/,
+                              const void * /*buffer*/,
+                              size_t /*length*/)
+{
+    // Intended left blank.
+}
+
 bool LinkageWorker::Attach(LinkageBase *linkage,
                            int fd,
                            bool read_now,
@@ -256,27 +423,22 @@ bool LinkageWorker::Attach(LinkageBase *linkage,
     }
 
     struct client_t *client = new struct client_t;
-    struct ev_io *ev_io_r = &client->ev_io_r;
-    struct ev_io *ev_io_w = &client->ev_io_w;
-    ev_io_init(ev_io_r, readable_cb, fd, EV_READ);
-    ev_io_init(ev_io_w, writable_cb, fd, EV_WRITE);
+    client->io = _backend->AddIo(fd, read_now, write_now, client);
+    if (!client->io) {
+        delete client;
+        return false;
+    }
+
+    TimerWheel::Initialize(&client->cleanup);
+    _wheel->Schedule(&client->cleanup, get_monotonic_timestamp() + kCleanupInterval);
     client->auto_release = auto_release;
+    client->rescheduled = false;
+    client->flushing = false;
     client->linkage = linkage;
-    client->running_r = read_now;
-    client->running_w = write_now;
     client->fd = fd;
 
     CLOG.Verbose("Linkage: attached %p:%p:%d:%d", this, linkage, fd, auto_release);
     _events.insert(std::make_pair(linkage, client));
-
-    if (read_now) {
-        ev_io_start(_loop, &client->ev_io_r);
-    }
-
-    if (write_now) {
-        ev_io_start(_loop, &client->ev_io_w);
-    }
-
     return true;
 }
 
@@ -292,13 +454,8 @@ bool LinkageWorker::Detach(LinkageBase *linkage)
     }
 
     struct client_t *client = p->second;
-    if (client->running_r) {
-        ev_io_stop(_loop, &client->ev_io_r);
-    }
-
-    if (client->running_w) {
-        ev_io_stop(_loop, &client->ev_io_w);
-    }
+    _backend->RemoveIo(client->io);
+    TimerWheel::Cancel(&client->cleanup);
 
     CLOG.Verbose("Linkage: detached %p:%p", this, linkage);
     _events.erase(p);
@@ -341,13 +498,8 @@ void LinkageWorker::OnDisconnected(struct client_t *client)
 
 void LinkageWorker::DoRelease(struct client_t *client, bool erase_container)
 {
-    if (client->running_r) {
-        ev_io_stop(_loop, &client->ev_io_r);
-    }
-
-    if (client->running_w) {
-        ev_io_stop(_loop, &client->ev_io_w);
-    }
+    _backend->RemoveIo(client->io);
+    TimerWheel::Cancel(&client->cleanup);
 
     if (erase_container) {
         events_t::iterator p = _events.find(client->linkage);
@@ -389,7 +541,7 @@ void LinkageWorker::DoRelease(struct client_t *client, bool erase_container)
 
 void LinkageWorker::DoRelease(struct timer_t *timer, bool erase_container)
 {
-    ev_timer_stop(_loop, &timer->ev_timer);
+    _backend->RemoveTimer(timer->timer);
     if (timer->auto_release) {
         CLOG.Verbose("Linkage: stopped timer [%p], auto released.", timer->runnable);
         delete timer->runnable;
@@ -411,25 +563,7 @@ bool LinkageWorker::SetWanna(LinkageBase *linkage, bool wanna_read, bool wanna_w
     }
 
     struct client_t *client = p->second;
-    if (wanna_read != client->running_r) {
-        client->running_r = wanna_read;
-        if (wanna_read) {
-            ev_io_start(_loop, &client->ev_io_r);
-        } else {
-            ev_io_stop(_loop, &client->ev_io_r);
-        }
-    }
-
-    if (wanna_write != client->running_w) {
-        client->running_w = wanna_write;
-        if (wanna_write) {
-            ev_io_start(_loop, &client->ev_io_w);
-        } else {
-            ev_io_stop(_loop, &client->ev_io_w);
-        }
-    }
-
-    return true;
+    return _backend->SetIo(client->io, wanna_read, wanna_write);
 }
 
 bool LinkageWorker::SetWannaRead(LinkageBase *linkage, bool wanna)
@@ -440,21 +574,31 @@ bool LinkageWorker::SetWannaRead(LinkageBase *linkage, bool wanna)
     }
 
     struct client_t *client = p->second;
-    if (wanna == client->running_r) {
-        return true;
-    }
+    return _backend->SetIo(client->io, wanna, client->io->write);
+}
 
-    if (wanna) {
-        ev_io_start(_loop, &client->ev_io_r);
-    } else {
-        ev_io_stop(_loop, &client->ev_io_r);
+bool LinkageWorker::SetWannaWrite(LinkageBase *linkage, bool wanna)
+{
+    events_t::iterator p = _events.find(linkage);
+    if (p == _events.end()) {
+        return false;
     }
 
-    client->running_r = wanna;
+    struct client_t *client = p->second;
+    return _backend->SetIo(client->io, client->io->read, wanna);
+}
+
+bool LinkageWorker::OnInitialize()
+{
     return true;
 }
 
-bool LinkageWorker::SetWannaWrite(LinkageBase *linkage, bool wanna)
+void LinkageWorker::OnShutdown()
+{
+    // Intended left blank.
+}
+
+bool LinkageWorker::SetCleanup(LinkageBase *linkage, int64_t when)
 {
     events_t::iterator p = _events.find(linkage);
     if (p == _events.end()) {
@@ -462,54 +606,86 @@ bool LinkageWorker::SetWannaWrite(LinkageBase *linkage, bool wanna)
     }
 
     struct client_t *client = p->second;
-    if (wanna == client->running_w) {
-        return true;
-    }
-
-    if (wanna) {
-        ev_io_start(_loop, &client->ev_io_w);
+    client->rescheduled = true;
+    if (when <= 0) {
+        TimerWheel::Cancel(&client->cleanup);
     } else {
-        ev_io_stop(_loop, &client->ev_io_w);
+        _wheel->Schedule(&client->cleanup, when);
     }
 
-    client->running_w = wanna;
     return true;
 }
 
-bool LinkageWorker::OnInitialize()
+void LinkageWorker::Resume(LinkageBase *linkage)
 {
-    return true;
+    events_t::iterator p = _events.find(linkage);
+    if (p == _events.end()) {
+        return;
+    }
+
+    OnReadable(p->second);
 }
 
-void LinkageWorker::OnShutdown()
+void LinkageWorker::SetFlush(LinkageBase *linkage)
 {
-    // Intended left blank.
+    events_t::iterator p = _events.find(linkage);
+    if (p == _events.end() || p->second->flushing) {
+        return;
+    }
+
+    p->second->flushing = true;
+    _flushing.push_back(linkage);
 }
 
-bool LinkageWorker::OnHealthCheck(int64_t now)
+void LinkageWorker::OnRound()
 {
-    std::list<struct client_t *> drops;
-    for (events_t::iterator p = _events.begin(); p != _events.end(); ++p) {
-        struct client_t *client = p->second;
-        LinkageBase *linkage = client->linkage;
-        if (!linkage->Cleanup(now)) {
-            drops.push_back(client);
+    if (_flushing.empty()) {
+        return;
+    }
+
+    // Might be flushed again within, for the next round.
+    std::vector<LinkageBase *> flushing;
+    flushing.swap(_flushing);
+
+    for (std::vector<LinkageBase *>::iterator p = flushing.begin();
+         p != flushing.end(); ++p) {
+
+        // Released or even replaced by another one within the round.
+        events_t::iterator q = _events.find(*p);
+        if (q == _events.end() || !q->second->flushing) {
+            continue;
         }
+
+        q->second->flushing = false;
+        OnWritable(q->second);
     }
+}
+
+bool LinkageWorker::OnHealthCheck(int64_t now)
+{
+    _wheel->Advance(now);
+
+    TimerWheel::node_t *node;
+    while ((node = _wheel->PopExpired())) {
+        unsigned char *p = reinterpret_cast<unsigned char *>(node);
+        p -= offsetof(struct client_t, cleanup);
+        struct client_t *client = reinterpret_cast<struct client_t *>(p);
 
-    for (std::list<struct client_t *>::iterator p = drops.begin();
-         p != drops.end(); ++p) {
+        client->rescheduled = false;
+        if (!client->linkage->Cleanup(now)) {
+            CLOG.Verbose("Linkage: disconnect timed out connection: fd = %d",
+                         client->fd);
 
-        struct client_t *client = *p;
-        CLOG.Verbose("Linkage: disconnect timed out connection: fd = %d",
-                     client->fd);
+            DoRelease(client, true);
+            continue;
+        }
 
-        DoRelease(client, true);
+        if (!client->rescheduled) {
+            _wheel->Schedule(&client->cleanup, now + kCleanupInterval);
+        }
     }
 
     return true;
 }
 
 } // namespace flinter
-
-#endif // HAVE_EV_H
@@ -19,28 +19,30 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#include <list>
+#include <vector>
 
+#include <flinter/linkage/event_backend.h>
+#include <flinter/thread/spinlock.h>
+#include <flinter/types/atomic.h>
+#include <flinter/types/latency_histogram.h>
+#include <flinter/types/mpsc_queue.h>
 #include <flinter/types/unordered_map.h>
 #include <flinter/types/unordered_set.h>
 #include <flinter/runnable.h>
 
-struct ev_async;
-struct ev_loop;
-struct ev_io;
-struct ev_timer;
-
 namespace flinter {
 
 class LinkageBase;
 class LinkagePeer;
-class Mutex;
+class ReceiveBufferPool;
+class TimerWheel;
 
 class LinkageWorker : public Runnable {
 public:
     friend class LinkageBase;
 
-    LinkageWorker();
+    /// @param backend throws if not available.
+    explicit LinkageWorker(EventBackend::Type backend = EventBackend::kTypeDefault);
     virtual ~LinkageWorker();
 
     // Methods below can be called from another thread.
@@ -61,6 +63,11 @@ public:
     ///                auto released when done.
     bool SendCommand(Runnable *command);
 
+    /// Cheaper than sending a Runnable, nothing is allocated since the bytes
+    /// are copied into a pooled command, handed to OnCommand() later.
+    /// @param length no more than kMaximumInlineCommand.
+    bool SendCommand(uint64_t tag, const void *buffer, size_t length);
+
     /// Won't block, but Run() will eventually quit.
     virtual bool Shutdown();
 
@@ -70,40 +77,79 @@ public:
     bool SetWannaWrite(LinkageBase *linkage, bool wanna);
     bool SetWannaRead(LinkageBase *linkage, bool wanna);
 
+    /// Drive a linkage whose I/O returned kStatusPending, as if it's readable.
+    /// Ignored if the linkage is no longer attached.
+    void Resume(LinkageBase *linkage);
+
+    /// Drive a linkage as if it's writable once this round is over, so that
+    /// whatever it sends within the round is written at once. Ignored if the
+    /// linkage is no longer attached by then.
+    void SetFlush(LinkageBase *linkage);
+
     virtual bool Run();
 
+    /// Measure how late a timer fires every interval, which is how long the
+    /// event loop gets stuck. Must be set before Run(), 0 to disable.
+    /// @param interval in nanoseconds.
+    void set_latency_probe(int64_t interval)
+    {
+        _latency_probe = interval;
+    }
+
+    /// Thread safe.
+    LatencyHistogram *loop_latency()
+    {
+        return &_loop_latency;
+    }
+
+    /// Slabs linkages attached to me read into.
+    ReceiveBufferPool *receive_buffer_pool()
+    {
+        return _receive_buffer_pool;
+    }
+
     int64_t running_thread_id() const
     {
         return _running_thread_id;
     }
 
+    static const size_t kMaximumInlineCommand = 1024;
+
 protected:
     virtual bool OnInitialize();
     virtual void OnShutdown();
 
+    /// Called for commands sent with bytes, default to drop them.
+    /// @param buffer only valid until return.
+    virtual void OnCommand(uint64_t tag, const void *buffer, size_t length);
+
     // Only used by Linkages, don't call explicitly.
     bool Detach(LinkageBase *linkage);
     bool Attach(LinkageBase *linkage, int fd,
                 bool read_now, bool write_now,
                 bool auto_release);
 
+    /// Have linkage->Cleanup() called once it's when, replacing any earlier
+    /// request. If Cleanup() doesn't ask again, it's called after a second.
+    /// @param when monotonic nanoseconds, <=0 to cancel.
+    bool SetCleanup(LinkageBase *linkage, int64_t when);
+
 private:
+    struct command_t;
     struct timer_t;
     struct client_t;
     class HealthTimer;
+    class LatencyTimer;
+    class Callback;
     typedef std::unordered_set<struct timer_t *> timers_t;
     typedef std::unordered_map<LinkageBase *, struct client_t *> events_t;
 
-    static void command_cb(struct ev_loop *loop, struct ev_async *w, int revents);
-    static void readable_cb(struct ev_loop *loop, struct ev_io *w, int revents);
-    static void writable_cb(struct ev_loop *loop, struct ev_io *w, int revents);
-    static void timer_cb(struct ev_loop *loop, struct ev_timer *w, int revents);
-
     // Level 1 callbacks.
     void OnReadable(struct client_t *client);
     void OnWritable(struct client_t *client);
     void OnTimer(struct timer_t *timer);
-    void OnCommand();
+    void OnCommands();
+    void OnRound();
 
     // Level 2 callbacks.
     void OnError(struct client_t *client, bool reading_or_writing, int errnum);
@@ -112,20 +158,41 @@ private:
     void DoRelease(struct client_t *client, bool erase_container);
     void DoRelease(struct timer_t *timer, bool erase_container);
 
-    struct ev_loop *_loop;
+    Callback *_callback;
+    EventBackend *_backend;
     volatile bool _quit;
 
-    std::list<Runnable *> _commands;
     int64_t _running_thread_id;
-    struct ev_async *_async;
-    Mutex *_mutex;
 
-    // Health checking related.
+    // Commands are queued lock free, the first one since last drained wakes
+    // the backend up and the rest ride along.
+    struct command_t *AllocateCommand();
+    void PushCommand(struct command_t *command);
+    void ReleaseCommands(struct command_t *commands);
+
+    IntrusiveMpscQueue<struct command_t> *_commands;
+    atomic_t _command_signaled;
+
+    // Nodes are allocated by senders but released in my thread.
+    struct command_t *_free_commands;
+    size_t _free_count;
+    Spinlock _free_lock;
+
+    // Health checking related, only linkages due are checked.
     bool OnHealthCheck(int64_t now);
+    TimerWheel *_wheel;
+
+    int64_t _latency_probe;
+    LatencyHistogram _loop_latency;
+
+    ReceiveBufferPool *_receive_buffer_pool;
 
     timers_t _timers;
     events_t _events;
 
+    // Linkages to flush at the end of this round.
+    std::vector<LinkageBase *> _flushing;
+
     explicit LinkageWorker(const LinkageWorker &);
     LinkageWorker &operator = (const LinkageWorker &);
 
@@ -137,19 +137,20 @@ int Listener::OnReadable(LinkageWorker *worker)
 }
 
 bool Listener::Listen(const Interface::Socket &socket,
-                      const Interface::Option &option)
+                      const Interface::Option &option,
+                      LinkagePeer *me)
 {
     bool ret;
     if (socket.domain == AF_UNSPEC) {
         Interface::Socket s(socket);
         s.domain = AF_INET6;
-        ret = _listener.Listen(s, option);
+        ret = _listener.Listen(s, option, me);
         if (!ret) {
             s.domain = AF_INET;
-            ret = _listener.Listen(s, option);
+            ret = _listener.Listen(s, option, me);
         }
     } else {
-        ret = _listener.Listen(socket, option);
+        ret = _listener.Listen(socket, option, me);
     }
 
     if (!ret) {
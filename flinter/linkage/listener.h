@@ -33,8 +33,10 @@ public:
     virtual ~Listener();
     explicit Listener(const Interface::Option &acceptedOption);
 
+    /// @param me where it's actually bound, can be NULL.
     bool Listen(const Interface::Socket &socket,
-                const Interface::Option &option);
+                const Interface::Option &option,
+                LinkagePeer *me = NULL);
 
     bool ListenTcp6(uint16_t port, bool loopback);
     bool ListenTcp4(uint16_t port, bool loopback);
@@ -55,6 +57,11 @@ public:
     virtual bool Detach(LinkageWorker *worker);
     virtual bool Cleanup(int64_t now);
 
+    int fd() const
+    {
+        return _listener.fd();
+    }
+
 protected:
     virtual LinkageBase *CreateLinkage(LinkageWorker *worker,
                                        const LinkagePeer &peer,
@@ -0,0 +1,113 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flinter/linkage/local_ssl_session_cache.h"
+
+#include "flinter/thread/mutex.h"
+#include "flinter/thread/mutex_locker.h"
+#include "flinter/hash.h"
+
+namespace flinter {
+
+LocalSslSessionCache::LocalSslSessionCache(size_t capacity, size_t stripes)
+        : _stripes(stripes ? stripes : 1)
+        , _capacity(capacity / _stripes.size())
+{
+    if (!_capacity) {
+        _capacity = 1;
+    }
+
+    for (std::vector<struct stripe_t>::iterator p = _stripes.begin();
+         p != _stripes.end(); ++p) {
+
+        p->mutex = new Mutex;
+    }
+}
+
+LocalSslSessionCache::~LocalSslSessionCache()
+{
+    for (std::vector<struct stripe_t>::iterator p = _stripes.begin();
+         p != _stripes.end(); ++p) {
+
+        delete p->mutex;
+    }
+}
+
+LocalSslSessionCache::stripe_t *LocalSslSessionCache::GetStripe(
+        const std::string &id)
+{
+    uint32_t hash = hash_murmurhash3(id.data(), id.length());
+    return &_stripes[hash % _stripes.size()];
+}
+
+void LocalSslSessionCache::Remove(struct stripe_t *stripe, map_t::iterator p)
+{
+    stripe->order.erase(p->second.order);
+    stripe->entries.erase(p);
+}
+
+void LocalSslSessionCache::Insert(const std::string &id,
+                                  const std::string &session,
+                                  int64_t expire)
+{
+    struct stripe_t *stripe = GetStripe(id);
+    MutexLocker locker(stripe->mutex);
+
+    map_t::iterator p = stripe->entries.find(id);
+    if (p != stripe->entries.end()) {
+        Remove(stripe, p);
+    }
+
+    while (stripe->entries.size() >= _capacity) {
+        Remove(stripe, stripe->entries.find(stripe->order.front()));
+    }
+
+    p = stripe->entries.insert(map_t::value_type(id, entry_t())).first;
+    p->second.session = session;
+    p->second.expire = expire;
+    p->second.order = stripe->order.insert(stripe->order.end(), id);
+}
+
+bool LocalSslSessionCache::Find(const std::string &id,
+                                int64_t now,
+                                std::string *session)
+{
+    struct stripe_t *stripe = GetStripe(id);
+    MutexLocker locker(stripe->mutex);
+
+    map_t::iterator p = stripe->entries.find(id);
+    if (p == stripe->entries.end()) {
+        return false;
+    } else if (p->second.expire <= now) {
+        Remove(stripe, p);
+        return false;
+    }
+
+    *session = p->second.session;
+    return true;
+}
+
+void LocalSslSessionCache::Erase(const std::string &id)
+{
+    struct stripe_t *stripe = GetStripe(id);
+    MutexLocker locker(stripe->mutex);
+
+    map_t::iterator p = stripe->entries.find(id);
+    if (p != stripe->entries.end()) {
+        Remove(stripe, p);
+    }
+}
+
+} // namespace flinter
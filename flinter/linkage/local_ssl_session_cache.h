@@ -0,0 +1,82 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLINTER_LINKAGE_LOCAL_SSL_SESSION_CACHE_H
+#define FLINTER_LINKAGE_LOCAL_SSL_SESSION_CACHE_H
+
+#include <stddef.h>
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <flinter/linkage/ssl_session_cache.h>
+#include <flinter/common.h>
+
+namespace flinter {
+
+class Mutex;
+
+/// In process session cache shared by all I/O threads.
+///
+/// Entries are spread over independently locked stripes so that concurrent
+/// handshakes rarely contend, each stripe evicts its oldest entry when full.
+class LocalSslSessionCache : public SslSessionCache {
+public:
+    /// @param capacity total entries, divided among stripes.
+    explicit LocalSslSessionCache(size_t capacity, size_t stripes = 16);
+    virtual ~LocalSslSessionCache();
+
+    virtual void Insert(const std::string &id,
+                        const std::string &session,
+                        int64_t expire);
+
+    virtual bool Find(const std::string &id,
+                      int64_t now,
+                      std::string *session);
+
+    virtual void Erase(const std::string &id);
+
+private:
+    NON_COPYABLE(LocalSslSessionCache);
+
+    typedef std::list<std::string> list_t;
+
+    struct entry_t {
+        std::string session;
+        int64_t expire;
+        list_t::iterator order;
+    }; // struct entry_t
+
+    typedef std::map<std::string, struct entry_t> map_t;
+
+    struct stripe_t {
+        Mutex *mutex;
+        map_t entries;
+        list_t order; // Oldest first.
+    }; // struct stripe_t
+
+    struct stripe_t *GetStripe(const std::string &id);
+    static void Remove(struct stripe_t *stripe, map_t::iterator p);
+
+    std::vector<struct stripe_t> _stripes;
+    size_t _capacity; // Per stripe.
+
+}; // class LocalSslSessionCache
+
+} // namespace flinter
+
+#endif // FLINTER_LINKAGE_LOCAL_SSL_SESSION_CACHE_H
@@ -0,0 +1,425 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "flinter/linkage/message_codec.h"
+
+#include <assert.h>
+#include <string.h>
+#include <strings.h>
+
+namespace flinter {
+
+// Longest chunk size line or trailer field.
+static const size_t kMaximumChunkLine = 4096;
+
+static const void *Find(const void *haystack, size_t length,
+                        const char *needle, size_t size)
+{
+    // Both are vectorized by glibc.
+    if (size == 1) {
+        return memchr(haystack, needle[0], length);
+    }
+
+    return memmem(haystack, length, needle, size);
+}
+
+static const char *Trim(const char *begin, const char **end)
+{
+    while (begin < *end && (*begin == ' ' || *begin == '\t')) {
+        ++begin;
+    }
+
+    while (*end > begin && ((*end)[-1] == ' ' || (*end)[-1] == '\t')) {
+        --*end;
+    }
+
+    return begin;
+}
+
+static bool IsName(const char *name, size_t length, const char *expected)
+{
+    return strlen(expected) == length &&
+           strncasecmp(name, expected, length) == 0;
+}
+
+LengthFieldCodec::LengthFieldCodec(size_t offset,
+                                   size_t size,
+                                   bool big_endian,
+                                   int64_t adjustment,
+                                   size_t maximum_length)
+        : _offset(offset)
+        , _size(size)
+        , _big_endian(big_endian)
+        , _adjustment(adjustment)
+        , _maximum_length(maximum_length)
+{
+    assert(size == 1 || size == 2 || size == 4 || size == 8);
+}
+
+ssize_t LengthFieldCodec::GetMessageLength(const void *buffer, size_t length)
+{
+    size_t header = _offset + _size;
+    if (length < header) {
+        return 0;
+    }
+
+    const unsigned char *p =
+            reinterpret_cast<const unsigned char *>(buffer) + _offset;
+    uint64_t value = 0;
+    if (_big_endian) {
+        for (size_t i = 0; i < _size; ++i) {
+            value = (value << 8) | p[i];
+        }
+    } else {
+        for (size_t i = _size; i > 0; --i) {
+            value = (value << 8) | p[i - 1];
+        }
+    }
+
+    if (value > _maximum_length) {
+        return -1;
+    }
+
+    int64_t total = static_cast<int64_t>(value) + _adjustment;
+    if (total < static_cast<int64_t>(header) ||
+        static_cast<uint64_t>(total) > _maximum_length) {
+
+        return -1;
+    }
+
+    return static_cast<ssize_t>(total);
+}
+
+VarintCodec::VarintCodec(size_t maximum_length)
+        : _maximum_length(maximum_length)
+{
+    // Intended left blank.
+}
+
+ssize_t VarintCodec::GetMessageLength(const void *buffer, size_t length)
+{
+    static const size_t kMaximumPrefix = 10;
+
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(buffer);
+    uint64_t value = 0;
+    for (size_t i = 0; i < length && i < kMaximumPrefix; ++i) {
+        value |= static_cast<uint64_t>(p[i] & 0x7f) << (7 * i);
+        if (p[i] & 0x80) {
+            continue;
+        }
+
+        uint64_t total = value + i + 1;
+        if (value > _maximum_length || total > _maximum_length) {
+            return -1;
+        }
+
+        return static_cast<ssize_t>(total);
+    }
+
+    return length >= kMaximumPrefix ? -1 : 0;
+}
+
+DelimiterCodec::DelimiterCodec(const std::string &delimiter,
+                               size_t maximum_length)
+        : _delimiter(delimiter)
+        , _maximum_length(maximum_length)
+        , _scanned(0)
+{
+    assert(!delimiter.empty());
+}
+
+void DelimiterCodec::Reset()
+{
+    _scanned = 0;
+}
+
+ssize_t DelimiterCodec::GetMessageLength(const void *buffer, size_t length)
+{
+    const char *p = reinterpret_cast<const char *>(buffer);
+    size_t size = _delimiter.length();
+
+    // The delimiter might straddle what's been scanned and what's new.
+    size_t from = _scanned >= size ? _scanned - size + 1 : 0;
+    if (length > from) {
+        const void *found = Find(p + from, length - from,
+                                 _delimiter.data(), size);
+
+        if (found) {
+            size_t total = static_cast<size_t>(
+                    reinterpret_cast<const char *>(found) - p) + size;
+
+            _scanned = 0;
+            if (total > _maximum_length) {
+                return -1;
+            }
+
+            return static_cast<ssize_t>(total);
+        }
+    }
+
+    _scanned = length;
+    return length >= _maximum_length ? -1 : 0;
+}
+
+HttpCodec::HttpCodec(bool request,
+                     size_t maximum_header_length,
+                     size_t maximum_length)
+        : _request(request)
+        , _maximum_header_length(maximum_header_length)
+        , _maximum_length(maximum_length)
+        , _scanned(0)
+        , _header_length(0)
+        , _chunk(0)
+        , _trailer(false)
+{
+    // Intended left blank.
+}
+
+void HttpCodec::Reset()
+{
+    _scanned = 0;
+    _header_length = 0;
+    _chunk = 0;
+    _trailer = false;
+}
+
+ssize_t HttpCodec::GetMessageLength(const void *buffer, size_t length)
+{
+    const char *p = reinterpret_cast<const char *>(buffer);
+    if (_header_length) {
+        return ParseChunks(p, length);
+    }
+
+    size_t from = _scanned >= 3 ? _scanned - 3 : 0;
+    const void *end = NULL;
+    if (length > from) {
+        end = Find(p + from, length - from, "\r\n\r\n", 4);
+    }
+
+    if (!end) {
+        _scanned = length;
+        return length >= _maximum_header_length ? -1 : 0;
+    }
+
+    size_t header = static_cast<size_t>(
+            reinterpret_cast<const char *>(end) - p) + 4;
+    if (header > _maximum_header_length || header > _maximum_length) {
+        return -1;
+    }
+
+    size_t content_length = 0;
+    int body = ParseHeader(p, header, &content_length);
+    if (body < 0) {
+        return -1;
+
+    } else if (body == 0) {
+        Reset();
+        return static_cast<ssize_t>(header);
+
+    } else if (body == 1) {
+        if (content_length > _maximum_length - header) {
+            return -1;
+        }
+
+        Reset();
+        return static_cast<ssize_t>(header + content_length);
+    }
+
+    _header_length = header;
+    _chunk = header;
+    _trailer = false;
+    return ParseChunks(p, length);
+}
+
+ssize_t HttpCodec::ParseChunks(const char *buffer, size_t length)
+{
+    while (true) {
+        if (_chunk > _maximum_length) {
+            return -1;
+        } else if (_chunk >= length) {
+            return 0;
+        }
+
+        // Data of the previous chunk must be followed by CRLF.
+        if (_chunk > _header_length &&
+            (buffer[_chunk - 2] != '\r' || buffer[_chunk - 1] != '\n')) {
+
+            return -1;
+        }
+
+        const char *line = buffer + _chunk;
+        size_t left = length - _chunk;
+        const char *eol = reinterpret_cast<const char *>(
+                Find(line, left, "\r\n", 2));
+        if (!eol) {
+            return left > kMaximumChunkLine ? -1 : 0;
+        }
+
+        size_t line_length = static_cast<size_t>(eol - line);
+        if (line_length > kMaximumChunkLine) {
+            return -1;
+        }
+
+        if (_trailer) {
+            if (!line_length) {
+                size_t total = _chunk + 2;
+                Reset();
+                if (total > _maximum_length) {
+                    return -1;
+                }
+
+                return static_cast<ssize_t>(total);
+            }
+
+            _chunk += line_length + 2;
+            continue;
+        }
+
+        size_t size = 0;
+        size_t i = 0;
+        for (; i < line_length; ++i) {
+            char c = line[i];
+            size_t digit;
+            if (c >= '0' && c <= '9') {
+                digit = static_cast<size_t>(c - '0');
+            } else if (c >= 'a' && c <= 'f') {
+                digit = static_cast<size_t>(c - 'a' + 10);
+            } else if (c >= 'A' && c <= 'F') {
+                digit = static_cast<size_t>(c - 'A' + 10);
+            } else {
+                break;
+            }
+
+            if (size > (_maximum_length >> 4)) {
+                return -1;
+            }
+
+            size = (size << 4) | digit;
+        }
+
+        // Extensions are ignored.
+        if (!i || (i < line_length && line[i] != ';' &&
+                   line[i] != ' ' && line[i] != '\t')) {
+
+            return -1;
+        }
+
+        _chunk += line_length + 2;
+        if (!size) {
+            _trailer = true;
+        } else {
+            _chunk += size + 2;
+        }
+    }
+}
+
+int HttpCodec::ParseHeader(const char *header,
+                           size_t length,
+                           size_t *content_length)
+{
+    const char *end = header + length - 2;
+    const char *eol = reinterpret_cast<const char *>(
+            Find(header, length, "\r\n", 2));
+    assert(eol);
+
+    bool no_body = false;
+    if (!_request) {
+        // HTTP/1.1 200 OK
+        if (eol - header < 12 || memcmp(header, "HTTP/", 5) != 0) {
+            return -1;
+        }
+
+        const char *status = reinterpret_cast<const char *>(
+                memchr(header, ' ', static_cast<size_t>(eol - header)));
+
+        if (!status || eol - status < 4 ||
+            status[1] < '1' || status[1] > '5' ||
+            status[2] < '0' || status[2] > '9' ||
+            status[3] < '0' || status[3] > '9') {
+
+            return -1;
+        }
+
+        no_body = status[1] == '1' || memcmp(status + 1, "204", 3) == 0
+                                   || memcmp(status + 1, "304", 3) == 0;
+
+    } else if (eol == header || *header == ' ') {
+        return -1;
+    }
+
+    bool chunked = false;
+    bool has_content_length = false;
+    for (const char *line = eol + 2; line < end; line = eol + 2) {
+        size_t left = static_cast<size_t>(end - line) + 2;
+        eol = reinterpret_cast<const char *>(Find(line, left, "\r\n", 2));
+        const char *colon = reinterpret_cast<const char *>(
+                memchr(line, ':', static_cast<size_t>(eol - line)));
+
+        if (!colon || colon == line) {
+            return -1;
+        }
+
+        const char *vend = eol;
+        const char *value = Trim(colon + 1, &vend);
+        size_t name_length = static_cast<size_t>(colon - line);
+        if (IsName(line, name_length, "Content-Length")) {
+            if (value == vend) {
+                return -1;
+            }
+
+            size_t v = 0;
+            for (const char *p = value; p < vend; ++p) {
+                if (*p < '0' || *p > '9' || v > _maximum_length) {
+                    return -1;
+                }
+
+                v = v * 10 + static_cast<size_t>(*p - '0');
+            }
+
+            // Conflicting lengths are smuggling attempts.
+            if (has_content_length && v != *content_length) {
+                return -1;
+            }
+
+            has_content_length = true;
+            *content_length = v;
+
+        } else if (IsName(line, name_length, "Transfer-Encoding")) {
+            // Chunked must be the last one.
+            const char *token = vend - 7;
+            if (token < value || strncasecmp(token, "chunked", 7) != 0 ||
+                (token > value && token[-1] != ',' && token[-1] != ' ')) {
+
+                return -1;
+            }
+
+            chunked = true;
+        }
+    }
+
+    if (no_body) {
+        return 0;
+    } else if (chunked) {
+        return 2;
+    } else if (has_content_length) {
+        return 1;
+    }
+
+    // Responses without lengths end when the connection is closed.
+    return _request ? 0 : -1;
+}
+
+} // namespace flinter
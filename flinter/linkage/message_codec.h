@@ -0,0 +1,149 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef FLINTER_LINKAGE_MESSAGE_CODEC_H
+#define FLINTER_LINKAGE_MESSAGE_CODEC_H
+
+#include <sys/types.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+namespace flinter {
+
+/// MessageCodec tells message lengths for common framings, call it from
+/// GetMessageLength() of handlers.
+///
+/// buffer always begins with a message. Once a length is returned, the next
+/// call is taken as the beginning of the next message, and while 0 is returned
+/// the next call is taken as the same message with more bytes received. Codecs
+/// that remember how far they've looked are stateful, keep one per connection
+/// (see Factory<EasyHandler>) and Reset() it if the connection is reused.
+class MessageCodec {
+public:
+    virtual ~MessageCodec() {}
+
+    /// @return >0 message length.
+    /// @return  0 message length is yet determined, keep receiving.
+    /// @return <0 message is invalid.
+    virtual ssize_t GetMessageLength(const void *buffer, size_t length) = 0;
+
+    /// Forget about any partially inspected message.
+    virtual void Reset() {}
+
+}; // class MessageCodec
+
+/// Length field at a fixed offset in a fixed length header. Stateless.
+class LengthFieldCodec : public MessageCodec {
+public:
+    /// @param offset bytes before the length field.
+    /// @param size bytes of the length field, 1, 2, 4 or 8.
+    /// @param big_endian or little endian.
+    /// @param adjustment added to the length field to get the message length,
+    ///                   i.e. offset + size if it doesn't count the header.
+    /// @param maximum_length larger messages are invalid.
+    LengthFieldCodec(size_t offset,
+                     size_t size,
+                     bool big_endian,
+                     int64_t adjustment,
+                     size_t maximum_length);
+
+    virtual ~LengthFieldCodec() {}
+    virtual ssize_t GetMessageLength(const void *buffer, size_t length);
+
+private:
+    const size_t _offset;
+    const size_t _size;
+    const bool _big_endian;
+    const int64_t _adjustment;
+    const size_t _maximum_length;
+
+}; // class LengthFieldCodec
+
+/// Base 128 varint length prefix as in protobuf, followed by that many bytes.
+/// Stateless.
+class VarintCodec : public MessageCodec {
+public:
+    /// @param maximum_length larger messages are invalid, prefix included.
+    explicit VarintCodec(size_t maximum_length);
+
+    virtual ~VarintCodec() {}
+    virtual ssize_t GetMessageLength(const void *buffer, size_t length);
+
+private:
+    const size_t _maximum_length;
+
+}; // class VarintCodec
+
+/// Messages ending with a delimiter, which is part of the message. Bytes are
+/// only scanned once no matter how slowly a message trickles in.
+class DelimiterCodec : public MessageCodec {
+public:
+    /// @param delimiter not empty, say "\r\n".
+    /// @param maximum_length larger messages are invalid, delimiter included.
+    DelimiterCodec(const std::string &delimiter, size_t maximum_length);
+
+    virtual ~DelimiterCodec() {}
+    virtual ssize_t GetMessageLength(const void *buffer, size_t length);
+    virtual void Reset();
+
+private:
+    const std::string _delimiter;
+    const size_t _maximum_length;
+    size_t _scanned;
+
+}; // class DelimiterCodec
+
+/// HTTP/1.1 messages, body framed by Content-Length or chunked encoding.
+///
+/// Requests without either have no body. Responses without either are invalid
+/// since they end when the connection is closed, unless they're 1xx, 204 or
+/// 304. Responses to HEAD requests can't be told and are not supported.
+class HttpCodec : public MessageCodec {
+public:
+    /// @param request requests or responses.
+    /// @param maximum_header_length larger headers are invalid.
+    /// @param maximum_length larger messages are invalid, header included.
+    HttpCodec(bool request,
+              size_t maximum_header_length,
+              size_t maximum_length);
+
+    virtual ~HttpCodec() {}
+    virtual ssize_t GetMessageLength(const void *buffer, size_t length);
+    virtual void Reset();
+
+private:
+    // @return -1 invalid, 0 no body, 1 Content-Length, 2 chunked.
+    int ParseHeader(const char *header, size_t length, size_t *content_length);
+
+    // @return same as GetMessageLength().
+    ssize_t ParseChunks(const char *buffer, size_t length);
+
+    const bool _request;
+    const size_t _maximum_header_length;
+    const size_t _maximum_length;
+
+    size_t _scanned;        // Header bytes known not to end the header.
+    size_t _header_length;  // 0 if the header is incomplete.
+    size_t _chunk;          // Where the next chunk begins.
+    bool _trailer;          // Last chunk seen, looking for the end.
+
+}; // class HttpCodec
+
+} // namespace flinter
+
+#endif // FLINTER_LINKAGE_MESSAGE_CODEC_H
@@ -0,0 +1,203 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flinter/linkage/receive_buffer.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include <new>
+
+namespace flinter {
+
+const size_t ReceiveBuffer::kDefaultCapacity = 65536;
+const size_t ReceiveBuffer::kMinimumCapacity = 4096;
+const size_t ReceiveBuffer::kMaximumClass = 262144;
+const size_t ReceiveBuffer::kMaximumCached = 256;
+
+ReceiveBuffer::ReceiveBuffer(size_t capacity,
+                             ReceiveBufferPool *pool,
+                             int size_class)
+        : _capacity(capacity)
+        , _data(reinterpret_cast<unsigned char *>(this + 1))
+        , _pool(pool)
+        , _size_class(size_class)
+        , _next(NULL)
+        , _ref(1)
+{
+    // Intended left blank.
+}
+
+int ReceiveBuffer::GetSizeClass(size_t capacity)
+{
+    if (capacity > kMaximumClass) {
+        return -1;
+    }
+
+    int size_class = 0;
+    for (size_t c = kMinimumCapacity; c < capacity; c <<= 1) {
+        ++size_class;
+    }
+
+    return size_class;
+}
+
+size_t ReceiveBuffer::GetCapacity(size_t capacity)
+{
+    int size_class = GetSizeClass(capacity);
+    if (size_class < 0) {
+        return capacity;
+    }
+
+    return kMinimumCapacity << size_class;
+}
+
+ReceiveBuffer *ReceiveBuffer::Create(size_t capacity)
+{
+    // Never freed, slabs might be released during exiting.
+    static ReceiveBufferPool *pool = ReceiveBufferPool::Create();
+    return pool->Get(capacity);
+}
+
+void ReceiveBuffer::Release()
+{
+    int ref = _ref.SubAndFetch(1);
+    assert(ref >= 0);
+    if (!ref) {
+        _pool->Put(this);
+    }
+}
+
+ReceiveBufferPool::ReceiveBufferPool(size_t maximum_cached)
+        : _maximum_cached(maximum_cached)
+        , _ref(1)
+        , _closed(false)
+{
+    for (size_t i = 0; i < kSizeClasses; ++i) {
+        _free[i] = NULL;
+        _cached[i] = 0;
+    }
+}
+
+ReceiveBufferPool *ReceiveBufferPool::Create(size_t maximum_cached)
+{
+    return new ReceiveBufferPool(maximum_cached);
+}
+
+ReceiveBuffer *ReceiveBufferPool::Get(size_t capacity)
+{
+    if (!capacity) {
+        return NULL;
+    }
+
+    int size_class = ReceiveBuffer::GetSizeClass(capacity);
+    if (size_class >= 0) {
+        size_t index = static_cast<size_t>(size_class);
+        capacity = ReceiveBuffer::kMinimumCapacity << index;
+
+        Spinlock::Locker locker(&_spinlock);
+        ReceiveBuffer *b = _free[index];
+        if (b) {
+            _free[index] = b->_next;
+            --_cached[index];
+            locker.Unlock();
+
+            b->_next = NULL;
+            b->_ref.Set(1);
+            return b;
+        }
+    }
+
+    void *p = malloc(sizeof(ReceiveBuffer) + capacity);
+    if (!p) {
+        return NULL;
+    }
+
+    // Every slab out there holds a reference.
+    _ref.AddAndFetch(1);
+    return new (p) ReceiveBuffer(capacity, this, size_class);
+}
+
+void ReceiveBufferPool::Put(ReceiveBuffer *slab)
+{
+    if (slab->_size_class >= 0) {
+        // Larger classes keep fewer, every class holds about the same bytes.
+        size_t index = static_cast<size_t>(slab->_size_class);
+        size_t limit = _maximum_cached >> index;
+        if (!limit && _maximum_cached) {
+            limit = 1;
+        }
+
+        Spinlock::Locker locker(&_spinlock);
+        if (!_closed && _cached[index] < limit) {
+            slab->_next = _free[index];
+            _free[index] = slab;
+            ++_cached[index];
+            return;
+        }
+    }
+
+    slab->~ReceiveBuffer();
+    free(slab);
+    Unref();
+}
+
+void ReceiveBufferPool::Release()
+{
+    ReceiveBuffer *free_lists[kSizeClasses];
+    Spinlock::Locker locker(&_spinlock);
+    _closed = true;
+    for (size_t i = 0; i < kSizeClasses; ++i) {
+        free_lists[i] = _free[i];
+        _free[i] = NULL;
+        _cached[i] = 0;
+    }
+
+    locker.Unlock();
+
+    for (size_t i = 0; i < kSizeClasses; ++i) {
+        while (free_lists[i]) {
+            ReceiveBuffer *slab = free_lists[i];
+            free_lists[i] = slab->_next;
+            slab->~ReceiveBuffer();
+            free(slab);
+            Unref();
+        }
+    }
+
+    Unref();
+}
+
+void ReceiveBufferPool::Unref()
+{
+    int ref = _ref.SubAndFetch(1);
+    assert(ref >= 0);
+    if (!ref) {
+        delete this;
+    }
+}
+
+size_t ReceiveBufferPool::cached() const
+{
+    size_t cached = 0;
+    Spinlock::Locker locker(&_spinlock);
+    for (size_t i = 0; i < kSizeClasses; ++i) {
+        cached += _cached[i];
+    }
+
+    return cached;
+}
+
+} // namespace flinter
@@ -0,0 +1,153 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLINTER_LINKAGE_RECEIVE_BUFFER_H
+#define FLINTER_LINKAGE_RECEIVE_BUFFER_H
+
+#include <stddef.h>
+
+#include <flinter/thread/spinlock.h>
+#include <flinter/types/atomic.h>
+#include <flinter/common.h>
+
+namespace flinter {
+
+class ReceiveBufferPool;
+
+/// Reference counted slab that Linkage reads into directly.
+///
+/// Messages are handed to handlers as pointers into the slab, anyone who wants
+/// to keep a message after OnMessage() returns calls Ref() and later Release()
+/// instead of copying it. Linkage never overwrites bytes that have been handed
+/// out, it switches to a new slab if the current one is shared.
+///
+/// Capacities are rounded up to size classes, powers of 2 from
+/// kMinimumCapacity to kMaximumClass, which are recycled through the pool
+/// they come from. Larger slabs are allocated exactly and freed.
+class ReceiveBuffer {
+public:
+    /// Taken from a process wide pool.
+    /// @return NULL if out of memory, or a slab with reference count of 1.
+    static ReceiveBuffer *Create(size_t capacity = kDefaultCapacity);
+
+    /// @return capacity of the slab that'd be created.
+    static size_t GetCapacity(size_t capacity);
+
+    /// Thread safe.
+    void Ref()
+    {
+        _ref.AddAndFetch(1);
+    }
+
+    /// Thread safe, slab is recycled or freed when last reference is gone.
+    void Release();
+
+    /// @return true if anyone else is holding a reference.
+    /// @warning might be stale, but never goes from false to true unless the
+    ///          caller calls Ref() itself.
+    bool shared() const
+    {
+        return _ref.BarrierGet() > 1;
+    }
+
+    unsigned char *data()
+    {
+        return _data;
+    }
+
+    const unsigned char *data() const
+    {
+        return _data;
+    }
+
+    size_t capacity() const
+    {
+        return _capacity;
+    }
+
+    static const size_t kDefaultCapacity;
+    static const size_t kMinimumCapacity;
+    static const size_t kMaximumClass;
+    static const size_t kMaximumCached;
+
+private:
+    friend class ReceiveBufferPool;
+
+    ReceiveBuffer(size_t capacity, ReceiveBufferPool *pool, int size_class);
+    ~ReceiveBuffer() {}
+    NON_COPYABLE(ReceiveBuffer);
+
+    // -1 if the capacity is too large.
+    static int GetSizeClass(size_t capacity);
+
+    const size_t _capacity;
+    unsigned char *const _data;
+    ReceiveBufferPool *const _pool;
+    const int _size_class;
+    ReceiveBuffer *_next;
+    atomic_t _ref;
+
+}; // class ReceiveBuffer
+
+/// Free lists of slabs for each size class.
+///
+/// Every LinkageWorker has one so that workers don't contend with each other.
+/// Slabs can be released in any thread, they go back to where they're from.
+/// Reference counted by its owner and outstanding slabs, so it's safe to
+/// Release() it while slabs are still held by others.
+class ReceiveBufferPool {
+public:
+    /// @param maximum_cached slabs of kMinimumCapacity kept, halved for each
+    ///                       larger size class.
+    /// @return a pool with reference count of 1.
+    static ReceiveBufferPool *Create(
+            size_t maximum_cached = ReceiveBuffer::kMaximumCached);
+
+    /// Thread safe.
+    /// @return NULL if out of memory, or a slab with reference count of 1.
+    ReceiveBuffer *Get(size_t capacity);
+
+    /// Cached slabs are freed, and the pool is freed once outstanding slabs
+    /// are released.
+    void Release();
+
+    /// Slabs in free lists, might be stale.
+    size_t cached() const;
+
+private:
+    friend class ReceiveBuffer;
+
+    explicit ReceiveBufferPool(size_t maximum_cached);
+    ~ReceiveBufferPool() {}
+    NON_COPYABLE(ReceiveBufferPool);
+
+    static const size_t kSizeClasses = 7;
+
+    // Called by slabs whose last reference is gone.
+    void Put(ReceiveBuffer *slab);
+    void Unref();
+
+    const size_t _maximum_cached;
+    ReceiveBuffer *_free[kSizeClasses];
+    size_t _cached[kSizeClasses];
+    mutable Spinlock _spinlock;
+    atomic_t _ref;
+    bool _closed;
+
+}; // class ReceiveBufferPool
+
+} // namespace flinter
+
+#endif // FLINTER_LINKAGE_RECEIVE_BUFFER_H
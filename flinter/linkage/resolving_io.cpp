@@ -0,0 +1,215 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "flinter/linkage/resolving_io.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flinter/linkage/interface.h"
+#include "flinter/linkage/linkage_worker.h"
+#include "flinter/logger.h"
+
+namespace flinter {
+
+ResolvingIo::ResolvingIo(AbstractIo *io,
+                         Interface *i,
+                         AsyncResolver *resolver,
+                         const std::string &hostname,
+                         uint16_t port,
+                         int domain)
+        : _io(io)
+        , _i(i)
+        , _resolver(resolver)
+        , _hostname(hostname)
+        , _port(port)
+        , _domain(domain)
+        , _state(kStateIdle)
+        , _result(AsyncResolver::kResultFailed)
+        , _worker(NULL)
+        , _linkage(NULL)
+{
+    assert(io);
+    assert(i);
+    assert(resolver);
+}
+
+ResolvingIo::~ResolvingIo()
+{
+    if (_state == kStateResolving) {
+        _resolver->Cancel(this);
+    }
+
+    delete _io;
+}
+
+bool ResolvingIo::Initialize(Action *action,
+                             Action *next_action,
+                             bool *wanna_read,
+                             bool *wanna_write)
+{
+    // Nothing to wait for yet, the socket is not connected.
+    *action      = kActionConnect;
+    *next_action = kActionNone;
+    *wanna_read  = false;
+    *wanna_write = false;
+    return true;
+}
+
+AbstractIo::Status ResolvingIo::Connect()
+{
+    switch (_state) {
+    case kStateConnected:
+        return _io->Connect();
+
+    case kStateResolving:
+        return kStatusPending;
+
+    case kStateIdle:
+        _result = _resolver->Resolve(_hostname, _domain, &_addresses, this);
+        if (_result == AsyncResolver::kResultPending) {
+            CLOG.Verbose("Linkage: resolving [%s] for fd = %d",
+                         _hostname.c_str(), _i->fd());
+
+            _state = kStateResolving;
+            return kStatusPending;
+        }
+
+        _state = kStateResolved;
+        return DoConnect();
+
+    case kStateResolved:
+    default:
+        return DoConnect();
+    };
+}
+
+AbstractIo::Status ResolvingIo::DoConnect()
+{
+    if (_result != AsyncResolver::kResultOk || _addresses.empty()) {
+        CLOG.Verbose("Linkage: failed to resolve [%s] for fd = %d",
+                     _hostname.c_str(), _i->fd());
+
+        errno = _result == AsyncResolver::kResultNotFound ? ENXIO : EAGAIN;
+        return kStatusError;
+    }
+
+    // Spread connections among all addresses.
+    const AsyncResolver::address_t &address = _addresses[
+            static_cast<size_t>(rand()) % _addresses.size()];
+
+    struct sockaddr_in6 a6;
+    struct sockaddr_in a4;
+    struct sockaddr *sa;
+    if (_domain == AF_INET6) {
+        memset(&a6, 0, sizeof(a6));
+        a6.sin6_family = AF_INET6;
+        a6.sin6_port = htons(_port);
+        a6.sin6_addr = address.in6;
+        sa = reinterpret_cast<struct sockaddr *>(&a6);
+
+    } else {
+        memset(&a4, 0, sizeof(a4));
+        a4.sin_family = AF_INET;
+        a4.sin_port = htons(_port);
+        a4.sin_addr = address.in;
+        sa = reinterpret_cast<struct sockaddr *>(&a4);
+    }
+
+    int ret = _i->Connect(sa, &_peer, &_me);
+    if (ret < 0) {
+        return kStatusError;
+    }
+
+    _state = kStateConnected;
+    if (ret > 0) {
+        return kStatusWannaWrite;
+    }
+
+    return _io->Connect();
+}
+
+void ResolvingIo::OnResolved(const std::string & /*hostname*/,
+                             int /*domain*/,
+                             AsyncResolver::Result result,
+                             const std::vector<AsyncResolver::address_t> &addresses)
+{
+    assert(_state == kStateResolving);
+    _state = kStateResolved;
+    _result = result;
+    _addresses = addresses;
+
+    if (_worker) {
+        _worker->Resume(_linkage);
+    }
+}
+
+void ResolvingIo::SetOwner(LinkageWorker *worker, LinkageBase *linkage)
+{
+    _worker = worker;
+    _linkage = linkage;
+    _io->SetOwner(worker, linkage);
+}
+
+AbstractIo::Status ResolvingIo::Read(void *buffer,
+                                     size_t length,
+                                     size_t *retlen,
+                                     bool *more)
+{
+    return _io->Read(buffer, length, retlen, more);
+}
+
+AbstractIo::Status ResolvingIo::Write(const void *buffer,
+                                      size_t length,
+                                      size_t *retlen)
+{
+    return _io->Write(buffer, length, retlen);
+}
+
+AbstractIo::Status ResolvingIo::Writev(const struct iovec *iov,
+                                       size_t count,
+                                       size_t *retlen)
+{
+    return _io->Writev(iov, count, retlen);
+}
+
+AbstractIo::Status ResolvingIo::SendFile(int fd,
+                                         int64_t offset,
+                                         size_t length,
+                                         size_t *retlen)
+{
+    return _io->SendFile(fd, offset, length, retlen);
+}
+
+AbstractIo::Status ResolvingIo::Shutdown()
+{
+    if (_state != kStateConnected) {
+        return kStatusClosed;
+    }
+
+    return _io->Shutdown();
+}
+
+AbstractIo::Status ResolvingIo::Accept()
+{
+    return kStatusBug;
+}
+
+} // namespace flinter
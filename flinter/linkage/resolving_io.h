@@ -0,0 +1,115 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef FLINTER_LINKAGE_RESOLVING_IO_H
+#define FLINTER_LINKAGE_RESOLVING_IO_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <flinter/linkage/abstract_io.h>
+#include <flinter/linkage/async_resolver.h>
+#include <flinter/linkage/linkage_peer.h>
+
+namespace flinter {
+
+class Interface;
+
+/// Connects a socket only after its hostname is resolved by AsyncResolver,
+/// then hands everything over to the underlying I/O.
+class ResolvingIo : public AbstractIo, public AsyncResolver::Callback {
+public:
+    /// @param io life span TAKEN, created as connecting.
+    /// @param i life span NOT taken, Interface::Open()-ed and owned by io.
+    /// @param resolver life span NOT taken, running in the same worker.
+    ResolvingIo(AbstractIo *io,
+                Interface *i,
+                AsyncResolver *resolver,
+                const std::string &hostname,
+                uint16_t port,
+                int domain);
+
+    virtual ~ResolvingIo();
+
+    virtual bool Initialize(Action *action,
+                            Action *next_action,
+                            bool *wanna_read,
+                            bool *wanna_write);
+
+    virtual Status Read(void *buffer, size_t length, size_t *retlen, bool *more);
+    virtual Status Write(const void *buffer, size_t length, size_t *retlen);
+    virtual Status Writev(const struct iovec *iov, size_t count, size_t *retlen);
+    virtual Status SendFile(int fd, int64_t offset, size_t length, size_t *retlen);
+    virtual Status Shutdown();
+    virtual Status Connect();
+    virtual Status Accept();
+
+    virtual void SetOwner(LinkageWorker *worker, LinkageBase *linkage);
+
+    virtual void OnResolved(const std::string &hostname,
+                            int domain,
+                            AsyncResolver::Result result,
+                            const std::vector<AsyncResolver::address_t> &addresses);
+
+    AbstractIo *io() const
+    {
+        return _io;
+    }
+
+    /// Only valid after connected.
+    const LinkagePeer &peer() const
+    {
+        return _peer;
+    }
+
+    /// Only valid after connected.
+    const LinkagePeer &me() const
+    {
+        return _me;
+    }
+
+private:
+    enum State {
+        kStateIdle,
+        kStateResolving,
+        kStateResolved,
+        kStateConnected,
+    }; // enum State
+
+    Status DoConnect();
+
+    AbstractIo *const _io;
+    Interface *const _i;
+    AsyncResolver *const _resolver;
+    const std::string _hostname;
+    const uint16_t _port;
+    const int _domain;
+
+    State _state;
+    AsyncResolver::Result _result;
+    std::vector<AsyncResolver::address_t> _addresses;
+    LinkageWorker *_worker;
+    LinkageBase *_linkage;
+    LinkagePeer _peer;
+    LinkagePeer _me;
+
+}; // class ResolvingIo
+
+} // namespace flinter
+
+#endif // FLINTER_LINKAGE_RESOLVING_IO_H
@@ -0,0 +1,172 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flinter/linkage/shared_ssl_session_cache.h"
+
+#include <sys/mman.h>
+#include <string.h>
+
+#include <new>
+#include <stdexcept>
+
+#include "flinter/thread/spinlock.h"
+#include "flinter/hash.h"
+
+namespace flinter {
+
+const size_t SharedSslSessionCache::kMaximumIdLength;
+const size_t SharedSslSessionCache::kWays;
+
+static size_t Align(size_t size)
+{
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+SharedSslSessionCache::SharedSslSessionCache(size_t capacity,
+                                             size_t maximum_length)
+        : _maximum_length(maximum_length)
+        , _entry_size(Align(sizeof(struct entry_t) + maximum_length))
+        , _set_size(Align(sizeof(Spinlock)) + kWays * _entry_size)
+        , _sets((capacity + kWays - 1) / kWays)
+        , _size(0)
+        , _memory(NULL)
+{
+    if (!_sets) {
+        _sets = 1;
+    }
+
+    _size = _sets * _set_size;
+    void *memory = mmap(NULL, _size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (memory == MAP_FAILED) {
+        throw std::runtime_error("SharedSslSessionCache: mapping memory");
+    }
+
+    // Anonymous mappings are zeroed, all entries are empty.
+    _memory = reinterpret_cast<unsigned char *>(memory);
+    for (size_t i = 0; i < _sets; ++i) {
+        new (_memory + i * _set_size) Spinlock;
+    }
+}
+
+SharedSslSessionCache::~SharedSslSessionCache()
+{
+    munmap(_memory, _size);
+}
+
+Spinlock *SharedSslSessionCache::GetSet(const std::string &id)
+{
+    uint32_t hash = hash_murmurhash3(id.data(), id.length());
+    return reinterpret_cast<Spinlock *>(_memory + (hash % _sets) * _set_size);
+}
+
+SharedSslSessionCache::entry_t *SharedSslSessionCache::GetEntry(
+        Spinlock *set, size_t way) const
+{
+    unsigned char *base = reinterpret_cast<unsigned char *>(set);
+    return reinterpret_cast<struct entry_t *>(
+            base + Align(sizeof(Spinlock)) + way * _entry_size);
+}
+
+bool SharedSslSessionCache::Match(const struct entry_t *entry,
+                                  const std::string &id)
+{
+    return entry->id_length == id.length() &&
+           memcmp(entry->id, id.data(), id.length()) == 0;
+}
+
+void SharedSslSessionCache::Insert(const std::string &id,
+                                   const std::string &session,
+                                   int64_t expire)
+{
+    if (id.empty() || id.length() > kMaximumIdLength ||
+        session.length() > _maximum_length) {
+
+        return;
+    }
+
+    Spinlock *set = GetSet(id);
+    Spinlock::Locker locker(set, true);
+
+    // Same ID, or else an empty one, or else the one expiring first.
+    struct entry_t *victim = NULL;
+    for (size_t i = 0; i < kWays; ++i) {
+        struct entry_t *entry = GetEntry(set, i);
+        if (Match(entry, id)) {
+            victim = entry;
+            break;
+        }
+
+        if (!victim || !entry->id_length ||
+            (victim->id_length && entry->expire < victim->expire)) {
+
+            victim = entry;
+        }
+    }
+
+    victim->expire = expire;
+    victim->id_length = static_cast<uint32_t>(id.length());
+    victim->length = static_cast<uint32_t>(session.length());
+    memcpy(victim->id, id.data(), id.length());
+    memcpy(victim + 1, session.data(), session.length());
+}
+
+bool SharedSslSessionCache::Find(const std::string &id,
+                                 int64_t now,
+                                 std::string *session)
+{
+    if (id.empty() || id.length() > kMaximumIdLength) {
+        return false;
+    }
+
+    Spinlock *set = GetSet(id);
+    Spinlock::Locker locker(set, true);
+
+    for (size_t i = 0; i < kWays; ++i) {
+        struct entry_t *entry = GetEntry(set, i);
+        if (!Match(entry, id)) {
+            continue;
+        } else if (entry->expire <= now) {
+            entry->id_length = 0;
+            return false;
+        }
+
+        session->assign(reinterpret_cast<const char *>(entry + 1), entry->length);
+        return true;
+    }
+
+    return false;
+}
+
+void SharedSslSessionCache::Erase(const std::string &id)
+{
+    if (id.empty() || id.length() > kMaximumIdLength) {
+        return;
+    }
+
+    Spinlock *set = GetSet(id);
+    Spinlock::Locker locker(set, true);
+
+    for (size_t i = 0; i < kWays; ++i) {
+        struct entry_t *entry = GetEntry(set, i);
+        if (Match(entry, id)) {
+            entry->id_length = 0;
+            return;
+        }
+    }
+}
+
+} // namespace flinter
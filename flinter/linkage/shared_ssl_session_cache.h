@@ -0,0 +1,86 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLINTER_LINKAGE_SHARED_SSL_SESSION_CACHE_H
+#define FLINTER_LINKAGE_SHARED_SSL_SESSION_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <flinter/linkage/ssl_session_cache.h>
+#include <flinter/common.h>
+
+namespace flinter {
+
+class Spinlock;
+
+/// Session cache in shared memory, for prefork servers.
+///
+/// Construct it before forking, every child then sees the same entries. It's
+/// a set associative table with fixed sized entries, each set guarded by a
+/// spinlock living in the shared memory, and the entry expiring first in a
+/// set is replaced when it's full.
+class SharedSslSessionCache : public SslSessionCache {
+public:
+    /// Same as SSL_MAX_SSL_SESSION_ID_LENGTH.
+    static const size_t kMaximumIdLength = 32;
+
+    /// @param capacity total entries, rounded up to whole sets.
+    /// @param maximum_length longer sessions are not cached.
+    /// @throws std::runtime_error if shared memory can't be mapped.
+    explicit SharedSslSessionCache(size_t capacity,
+                                   size_t maximum_length = 2048);
+
+    virtual ~SharedSslSessionCache();
+
+    virtual void Insert(const std::string &id,
+                        const std::string &session,
+                        int64_t expire);
+
+    virtual bool Find(const std::string &id,
+                      int64_t now,
+                      std::string *session);
+
+    virtual void Erase(const std::string &id);
+
+private:
+    NON_COPYABLE(SharedSslSessionCache);
+
+    static const size_t kWays = 4;
+
+    // Followed by session bytes.
+    struct entry_t {
+        int64_t expire;
+        uint32_t id_length; // 0 if empty.
+        uint32_t length;
+        unsigned char id[kMaximumIdLength];
+    }; // struct entry_t
+
+    Spinlock *GetSet(const std::string &id);
+    struct entry_t *GetEntry(Spinlock *set, size_t way) const;
+    static bool Match(const struct entry_t *entry, const std::string &id);
+
+    const size_t _maximum_length;
+    size_t _entry_size;
+    size_t _set_size;
+    size_t _sets;
+    size_t _size;
+    unsigned char *_memory;
+
+}; // class SharedSslSessionCache
+
+} // namespace flinter
+
+#endif // FLINTER_LINKAGE_SHARED_SSL_SESSION_CACHE_H
@@ -15,10 +15,14 @@
 
 #include "flinter/linkage/ssl_context.h"
 
+#include <sys/mman.h>
 #include <string.h>
+#include <time.h>
 
-#include <vector>
+#include <new>
 
+#include "flinter/linkage/ssl_session_cache.h"
+#include "flinter/thread/spinlock.h"
 #include "flinter/logger.h"
 
 #include "config.h"
@@ -27,9 +31,17 @@
 #include <openssl/rand.h>
 #include <openssl/ssl.h>
 
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+#define SESSION_ID_CONST const
+#else
+#define SESSION_ID_CONST
+#endif
+
 namespace flinter {
 
 int SslContext::_tls_ticket_key_index = -1;
+static int g_session_cache_index = -1;
+
 typedef struct {
     unsigned char hmac[32];
     unsigned char ekey[32];
@@ -37,8 +49,21 @@ typedef struct {
     size_t bits;
 } key_t;
 
+static const size_t kMaximumTicketKeys = 16;
+
+// Lives in shared memory so that forked children see the same keys.
+struct SslContext::ticket_keys_t {
+    Spinlock lock;
+    int64_t rotated;
+    int interval;               // 0 for never.
+    size_t keep;
+    size_t count;
+    key_t keys[kMaximumTicketKeys]; // First one signs new tickets.
+}; // struct SslContext::ticket_keys_t
+
 SslContext::SslContext(bool enhanced_security)
         : _context(NULL)
+        , _handshake_pool(NULL)
         , _enhanced_security(enhanced_security)
 {
     Initialize();
@@ -50,12 +75,10 @@ SslContext::~SslContext()
         return;
     }
 
-    std::vector<key_t> *const keys =
-            reinterpret_cast<std::vector<key_t> *>(
-                    SSL_CTX_get_ex_data(_context, _tls_ticket_key_index));
-
+    struct ticket_keys_t *const keys = GetTicketKeys(_context);
     if (keys) {
-        delete keys;
+        OPENSSL_cleanse(keys, sizeof(*keys));
+        munmap(keys, sizeof(*keys));
         SSL_CTX_set_ex_data(_context, _tls_ticket_key_index, NULL);
     }
 
@@ -360,7 +383,9 @@ bool SslContext::SetSessionIdContext(const std::string &context)
         return false;
     }
 
-    SSL_CTX_set_session_cache_mode(_context, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_set_session_cache_mode(_context,
+            SSL_CTX_get_session_cache_mode(_context) | SSL_SESS_CACHE_SERVER);
+
     if (SSL_CTX_set_session_id_context(_context,
             reinterpret_cast<const unsigned char *>(context.data()),
             static_cast<unsigned int>(context.length())) != 1) {
@@ -398,6 +423,25 @@ bool SslContext::SetAllowTlsTicket(bool allow)
     return true;
 }
 
+bool SslContext::SetKernelTls(bool enable)
+{
+#ifdef SSL_OP_ENABLE_KTLS
+    if (!Initialize()) {
+        return false;
+    }
+
+    if (enable) {
+        SSL_CTX_set_options(_context, SSL_OP_ENABLE_KTLS);
+    } else {
+        SSL_CTX_clear_options(_context, SSL_OP_ENABLE_KTLS);
+    }
+
+    return true;
+#else
+    return !enable;
+#endif
+}
+
 ssize_t SslContext::LoadFile(
         const std::string &filename,
         void *buffer, size_t length)
@@ -447,47 +491,270 @@ bool SslContext::LoadTlsTicketKey(const std::string &filename)
         return false;
     }
 
+    struct ticket_keys_t *keys = PrepareTicketKeys();
+    if (!keys) {
+        return false;
+    }
+
+    key_t key;
+    if (ret == 48) {
+        key.bits = 128;
+        memcpy(key.name, buffer +  0, 16);
+        memcpy(key.hmac, buffer + 16, 16);
+        memcpy(key.ekey, buffer + 32, 16);
+    } else {
+        key.bits = 256;
+        memcpy(key.name, buffer +  0, 16);
+        memcpy(key.hmac, buffer + 16, 32);
+        memcpy(key.ekey, buffer + 48, 32);
+    }
+
+    Spinlock::Locker locker(&keys->lock);
+    if (keys->count >= kMaximumTicketKeys) {
+        return false;
+    }
+
+    keys->keys[keys->count++] = key;
+    return true;
+}
+
+SslContext::ticket_keys_t *SslContext::PrepareTicketKeys()
+{
     // Initializing static data, a mutex shall be implemented but it's usually
     // not necessary and will slow down every session establishing.
     if (_tls_ticket_key_index < 0) {
         _tls_ticket_key_index = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, NULL);
         if (_tls_ticket_key_index < 0) {
-            return false;
+            return NULL;
         }
     }
     // End of initializing static data
 
-    std::vector<key_t> *keys =
-            reinterpret_cast<std::vector<key_t> *>(
-                    SSL_CTX_get_ex_data(_context, _tls_ticket_key_index));
+    struct ticket_keys_t *keys = GetTicketKeys(_context);
+    if (keys) {
+        return keys;
+    }
+
+    void *memory = mmap(NULL, sizeof(*keys), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (memory == MAP_FAILED) {
+        return NULL;
+    }
+
+    // Anonymous mappings are zeroed.
+    keys = new (memory) struct ticket_keys_t;
+    if (SSL_CTX_set_ex_data(_context, _tls_ticket_key_index, keys) != 1) {
+        munmap(memory, sizeof(*keys));
+        return NULL;
+    }
+
+    // keys are kept in context and destroyed in dtor.
+    if (SSL_CTX_set_tlsext_ticket_key_cb(_context, TlsTicketKeyCallback) != 1) {
+        return NULL;
+    }
+
+    return keys;
+}
+
+SslContext::ticket_keys_t *SslContext::GetTicketKeys(SSL_CTX *context)
+{
+    if (_tls_ticket_key_index < 0) {
+        return NULL;
+    }
+
+    return reinterpret_cast<struct ticket_keys_t *>(
+            SSL_CTX_get_ex_data(context, _tls_ticket_key_index));
+}
+
+bool SslContext::RotateTicketKeys(struct ticket_keys_t *keys, int64_t now)
+{
+    if (!keys->interval || now < keys->rotated + keys->interval) {
+        return true;
+    }
+
+    key_t key;
+    key.bits = 256;
+    if (RAND_bytes(key.name, sizeof(key.name)) != 1 ||
+        RAND_bytes(key.hmac, sizeof(key.hmac)) != 1 ||
+        RAND_bytes(key.ekey, sizeof(key.ekey)) != 1 ){
+
+        return false;
+    }
+
+    // Keys missing more than one round are too old even if not rotated out,
+    // no handshakes happened in between.
+    int64_t rounds = (now - keys->rotated) / keys->interval;
+    size_t kept = keys->count;
+    if (rounds > static_cast<int64_t>(keys->keep)) {
+        kept = 0;
+    } else if (kept > keys->keep + 1 - static_cast<size_t>(rounds)) {
+        kept = keys->keep + 1 - static_cast<size_t>(rounds);
+    }
+
+    memmove(keys->keys + 1, keys->keys, kept * sizeof(key_t));
+    if (keys->count > kept + 1) {
+        OPENSSL_cleanse(keys->keys + kept + 1,
+                        (keys->count - kept - 1) * sizeof(key_t));
+    }
+
+    size_t count = kept + 1;
+
+    keys->keys[0] = key;
+    keys->count = count;
+    keys->rotated = now;
+    OPENSSL_cleanse(&key, sizeof(key));
+    CLOG.Verbose("SSL: session ticket key rotated, %lu keys in use",
+                 static_cast<unsigned long>(count));
+
+    return true;
+}
+
+bool SslContext::SetTlsTicketKeyRotation(int interval, size_t keep)
+{
+    if (interval <= 0 || keep >= kMaximumTicketKeys) {
+        return false;
+    } else if (!Initialize()) {
+        return false;
+    }
 
+    struct ticket_keys_t *keys = PrepareTicketKeys();
     if (!keys) {
-        keys = new std::vector<key_t>;
-        if (SSL_CTX_set_ex_data(_context, _tls_ticket_key_index, keys) != 1) {
-            delete keys;
-            return false;
-        }
+        return false;
+    }
+
+    Spinlock::Locker locker(&keys->lock);
+    keys->interval = interval;
+    keys->keep = keep;
+    keys->rotated = 0;
+    if (!RotateTicketKeys(keys, time(NULL))) {
+        return false;
+    }
+
+    SSL_CTX_clear_options(_context, SSL_OP_NO_TICKET);
+    return true;
+}
+
+static SslSessionCache *GetSessionCache(SSL_CTX *context)
+{
+    if (g_session_cache_index < 0) {
+        return NULL;
+    }
+
+    return reinterpret_cast<SslSessionCache *>(
+            SSL_CTX_get_ex_data(context, g_session_cache_index));
+}
+
+static int NewSessionCallback(SSL *s, SSL_SESSION *session)
+{
+    SslSessionCache *cache = GetSessionCache(SSL_get_SSL_CTX(s));
+    if (!cache) {
+        return 0;
+    }
+
+    unsigned int length;
+    const unsigned char *id = SSL_SESSION_get_id(session, &length);
+    int size = i2d_SSL_SESSION(session, NULL);
+    if (!length || size <= 0) {
+        return 0;
+    }
+
+    std::string buffer(static_cast<size_t>(size), '\0');
+    unsigned char *p = reinterpret_cast<unsigned char *>(&buffer[0]);
+    if (i2d_SSL_SESSION(session, &p) != size) {
+        return 0;
+    }
+
+    int64_t expire = static_cast<int64_t>(SSL_SESSION_get_time(session)) +
+                     SSL_SESSION_get_timeout(session);
+
+    cache->Insert(std::string(reinterpret_cast<const char *>(id), length),
+                  buffer, expire);
+
+    // Not keeping a reference.
+    return 0;
+}
+
+static SSL_SESSION *GetSessionCallback(SSL *s,
+                                       SESSION_ID_CONST unsigned char *id,
+                                       int length,
+                                       int *copy)
+{
+    *copy = 0;
+    SslSessionCache *cache = GetSessionCache(SSL_get_SSL_CTX(s));
+    if (!cache || length <= 0) {
+        return NULL;
+    }
+
+    std::string buffer;
+    if (!cache->Find(std::string(reinterpret_cast<const char *>(id),
+                                 static_cast<size_t>(length)),
+                     time(NULL), &buffer)) {
+
+        CLOG.Verbose("SSL: session is not found in cache");
+        return NULL;
+    }
+
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(buffer.data());
+    SSL_SESSION *session = d2i_SSL_SESSION(NULL, &p, static_cast<long>(buffer.length()));
+    if (!session) {
+        CLOG.Verbose("SSL: failed to decode cached session");
+        return NULL;
+    }
+
+    // The reference is handed over since copy is 0.
+    CLOG.Verbose("SSL: session resumed from cache");
+    return session;
+}
+
+static void RemoveSessionCallback(SSL_CTX *context, SSL_SESSION *session)
+{
+    SslSessionCache *cache = GetSessionCache(context);
+    if (!cache) {
+        return;
+    }
+
+    unsigned int length;
+    const unsigned char *id = SSL_SESSION_get_id(session, &length);
+    if (length) {
+        cache->Erase(std::string(reinterpret_cast<const char *>(id), length));
+    }
+}
+
+bool SslContext::SetSessionCache(SslSessionCache *cache)
+{
+    if (!Initialize()) {
+        return false;
+    }
 
-        // keys are kept in context and destroyed in dtor.
-        if (SSL_CTX_set_tlsext_ticket_key_cb(_context, TlsTicketKeyCallback) != 1) {
+    // Initializing static data, same as above.
+    if (g_session_cache_index < 0) {
+        g_session_cache_index = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+        if (g_session_cache_index < 0) {
             return false;
         }
     }
+    // End of initializing static data
+
+    if (SSL_CTX_set_ex_data(_context, g_session_cache_index, cache) != 1) {
+        return false;
+    }
+
+    long mode = SSL_CTX_get_session_cache_mode(_context);
+    if (cache) {
+        mode |= SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL;
+        SSL_CTX_sess_set_new_cb(_context, NewSessionCallback);
+        SSL_CTX_sess_set_get_cb(_context, GetSessionCallback);
+        SSL_CTX_sess_set_remove_cb(_context, RemoveSessionCallback);
 
-    key_t key;
-    if (ret == 48) {
-        key.bits = 128;
-        memcpy(key.name, buffer +  0, 16);
-        memcpy(key.hmac, buffer + 16, 16);
-        memcpy(key.ekey, buffer + 32, 16);
     } else {
-        key.bits = 256;
-        memcpy(key.name, buffer +  0, 16);
-        memcpy(key.hmac, buffer + 16, 32);
-        memcpy(key.ekey, buffer + 48, 32);
+        mode &= ~SSL_SESS_CACHE_NO_INTERNAL;
+        SSL_CTX_sess_set_new_cb(_context, NULL);
+        SSL_CTX_sess_set_get_cb(_context, NULL);
+        SSL_CTX_sess_set_remove_cb(_context, NULL);
     }
 
-    keys->push_back(key);
+    SSL_CTX_set_session_cache_mode(_context, mode);
     return true;
 }
 
@@ -505,48 +772,35 @@ int SslContext::TlsTicketKeyCallback(
     const EVP_MD *const digest = EVP_sha256();
 #endif
 
-    SSL_CTX *const context = SSL_get_SSL_CTX(s);
-    const std::vector<key_t> *const keys =
-            reinterpret_cast<std::vector<key_t> *>(
-                    SSL_CTX_get_ex_data(context, _tls_ticket_key_index));
+    struct ticket_keys_t *const keys = GetTicketKeys(SSL_get_SSL_CTX(s));
 
-    if (!keys || keys->empty()) {
+    if (!keys) {
         CLOG.Error("SSL: BUG session ticket keys are not set");
         return -1;
     }
 
-    if (enc) {
-        const key_t *const key = &keys->at(0);
-        const EVP_CIPHER *cipher;
-        int size;
-
-        if (key->bits == 128) {
-            cipher = EVP_aes_128_cbc();
-            size = 16;
-        } else {
-            cipher = EVP_aes_256_cbc();
-            size = 32;
-        }
-
-        if (RAND_bytes(iv, EVP_CIPHER_iv_length(cipher))         != 1 ||
-            EVP_EncryptInit_ex(ctx, cipher, NULL, key->ekey, iv) != 1 ||
-            HMAC_Init_ex(hctx, key->hmac, size, digest, NULL)    != 1 ){
+    // Take a copy and get out of the lock as soon as possible.
+    Spinlock::Locker locker(&keys->lock);
+    if (!RotateTicketKeys(keys, time(NULL))) {
+        CLOG.Warn("SSL: failed to rotate session ticket key");
+    }
 
-            return -1;
-        }
+    if (!keys->count) {
+        CLOG.Error("SSL: BUG session ticket keys are not set");
+        return -1;
+    }
 
-        memcpy(key_name, key->name, 16);
-        CLOG.Verbose("SSL: new session ticket generated");
-        return 1;
+    key_t key;
+    bool renew = false;
+    if (enc) {
+        key = keys->keys[0];
 
     } else {
-        const key_t *key;
         bool found = false;
-        bool renew = false;
-        for (std::vector<key_t>::const_iterator p = keys->begin(); p != keys->end(); ++p) {
-            if (memcmp(key_name, p->name, 16) == 0) {
+        for (size_t i = 0; i < keys->count; ++i) {
+            if (memcmp(key_name, keys->keys[i].name, 16) == 0) {
                 found = true;
-                key = &*p;
+                key = keys->keys[i];
                 break;
             }
 
@@ -554,27 +808,47 @@ int SslContext::TlsTicketKeyCallback(
         }
 
         if (!found) {
+            locker.Unlock();
             CLOG.Verbose("SSL: session ticket key name is not found");
             return 0;
         }
+    }
+
+    locker.Unlock();
+    const EVP_CIPHER *cipher;
+    int size;
+
+    if (key.bits == 128) {
+        cipher = EVP_aes_128_cbc();
+        size = 16;
+    } else {
+        cipher = EVP_aes_256_cbc();
+        size = 32;
+    }
 
-        const EVP_CIPHER *cipher;
-        int size;
+    if (enc) {
+        if (RAND_bytes(iv, EVP_CIPHER_iv_length(cipher))        != 1 ||
+            EVP_EncryptInit_ex(ctx, cipher, NULL, key.ekey, iv) != 1 ||
+            HMAC_Init_ex(hctx, key.hmac, size, digest, NULL)    != 1 ){
 
-        if (key->bits == 128) {
-            cipher = EVP_aes_128_cbc();
-            size = 16;
-        } else {
-            cipher = EVP_aes_256_cbc();
-            size = 32;
+            OPENSSL_cleanse(&key, sizeof(key));
+            return -1;
         }
 
-        if (HMAC_Init_ex(hctx, key->hmac, size, digest, NULL)    != 1 ||
-            EVP_DecryptInit_ex(ctx, cipher, NULL, key->ekey, iv) != 1 ){
+        memcpy(key_name, key.name, 16);
+        OPENSSL_cleanse(&key, sizeof(key));
+        CLOG.Verbose("SSL: new session ticket generated");
+        return 1;
+
+    } else {
+        if (HMAC_Init_ex(hctx, key.hmac, size, digest, NULL)    != 1 ||
+            EVP_DecryptInit_ex(ctx, cipher, NULL, key.ekey, iv) != 1 ){
 
+            OPENSSL_cleanse(&key, sizeof(key));
             return -1;
         }
 
+        OPENSSL_cleanse(&key, sizeof(key));
         CLOG.Verbose("SSL: session ticket %s", renew ? "needs renewal" : "accepted");
         return renew ? 2 : 1;
     }
@@ -18,6 +18,9 @@
 
 #include <string>
 
+#include <stddef.h>
+#include <stdint.h>
+
 struct evp_cipher_ctx_st;
 struct hmac_ctx_st;
 struct ssl_ctx_st;
@@ -25,6 +28,9 @@ struct ssl_st;
 
 namespace flinter {
 
+class AbstractThreadPool;
+class SslSessionCache;
+
 // Warning: make sure you have sufficient knowledge of TLS security, especially
 //          perfect forward secrecy which is much much more important than key
 //          types, key length or ciphers, before you turn on session resumption.
@@ -46,6 +52,14 @@ public:
     // can obtain all session keys and decrypt all traffic.
     bool SetAllowTlsTicket(bool allow);
 
+    // Let the kernel encrypt and decrypt records after handshaking (kTLS).
+    //
+    // Connections fall back to userspace crypto silently if the kernel or the
+    // negotiated cipher doesn't support it, or if OpenSSL is built without it,
+    // check SslIo::kernel_tls_send() to know which one it ends up with.
+    // Returns false if OpenSSL doesn't know about kTLS at all.
+    bool SetKernelTls(bool enable);
+
     // Only necessary for session resumptions (ID or ticket based).
     bool SetSessionTimeout(int seconds);
 
@@ -63,6 +77,17 @@ public:
     // sufficient rights to read virtual/physical memory.
     bool SetSessionIdContext(const std::string &context);
 
+    // Use an external session cache instead of the internal one, so that
+    // sessions can be resumed by any context, or any process if the cache is
+    // shared. With TLS 1.3 it also makes session tickets stateful, that is,
+    // tickets only carry IDs but no keys, when session tickets are disallowed.
+    //
+    // Same warning as above, and call SetSessionIdContext() as well before
+    // verifying peers.
+    //
+    // @param cache life span NOT taken, NULL to go back to the internal one.
+    bool SetSessionCache(SslSessionCache *cache);
+
     // To enable verifying, it's necessary to enable internal session cache by
     // calling SetSessionIdContext(). This requirement is a limitation of the
     // underlying cryptographic implementation (OpenSSL) and might be removed
@@ -95,6 +120,35 @@ public:
     // openssl rand 80 > ticket.key
     bool LoadTlsTicketKey(const std::string &filename);
 
+    // Enable session tickets with keys randomly generated in memory and
+    // replaced every `interval` seconds. Previous `keep` keys still decrypt
+    // tickets (which are then renewed), and are wiped once rotated out, so
+    // that a compromised key only ever exposes a limited window.
+    //
+    // Rotation happens along with handshakes, no restart or timer needed.
+    // Keys are kept in shared memory, contexts set up before forking share
+    // keys among all children, thus tickets can be resumed by any of them.
+    // Statically loaded keys are rotated out as well.
+    bool SetTlsTicketKeyRotation(int interval, size_t keep = 1);
+
+    // Run handshakes in the pool rather than I/O threads, once peers have
+    // said something, so that a burst of handshakes, expensive as they are,
+    // won't hold up established connections.
+    //
+    // Pool threads call OpenSSL, make sure they're initialized if it's old
+    // enough to need OpenSSLInitializer::InitializeThread().
+    //
+    // @param pool life span NOT taken, NULL to handshake inline.
+    void SetHandshakePool(AbstractThreadPool *pool)
+    {
+        _handshake_pool = pool;
+    }
+
+    AbstractThreadPool *handshake_pool() const
+    {
+        return _handshake_pool;
+    }
+
     struct ssl_ctx_st *context()
     {
         return _context;
@@ -109,12 +163,19 @@ private:
             hmac_ctx_st *hctx,
             int enc);
 
+    struct ticket_keys_t;
+
+    static struct ticket_keys_t *GetTicketKeys(struct ssl_ctx_st *context);
+    static bool RotateTicketKeys(struct ticket_keys_t *keys, int64_t now);
+    struct ticket_keys_t *PrepareTicketKeys();
+
     static ssize_t LoadFile(const std::string &filename, void *buffer, size_t length);
     static int PasswordCallback(char *buf, int size, int rwflag, void *userdata);
     bool Initialize();
 
     static int _tls_ticket_key_index;
     struct ssl_ctx_st *_context;
+    AbstractThreadPool *_handshake_pool;
     bool _enhanced_security;
 
 }; // class SslContext
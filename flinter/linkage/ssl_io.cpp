@@ -22,17 +22,106 @@
 
 #include <stdexcept>
 
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#if defined(__linux__)
+# include <sys/sendfile.h>
+#endif
+
+#include <openssl/bio.h>
 #include <openssl/err.h>
 #include <openssl/ssl.h>
 
 #include "flinter/linkage/interface.h"
+#include "flinter/linkage/linkage_worker.h"
 #include "flinter/linkage/ssl_context.h"
 #include "flinter/linkage/ssl_peer.h"
+#include "flinter/thread/abstract_thread_pool.h"
+#include "flinter/thread/mutex.h"
+#include "flinter/thread/mutex_locker.h"
+#include "flinter/types/atomic.h"
 #include "flinter/logger.h"
+#include "flinter/runnable.h"
 #include "flinter/safeio.h"
 
 namespace flinter {
 
+// Shared by the I/O thread and the pool thread running the handshake.
+struct SslIo::handshake_t {
+    Mutex mutex;
+    atomic_t references;
+    struct ssl_st *ssl;
+    Interface *i;               // Only if abandoned before done.
+    LinkageWorker *worker;      // NULL if detached.
+    LinkageBase *linkage;
+    LinkageWorker *notified;    // Sent a ResumeCommand.
+    Action action;
+    bool abandoned;             // SslIo is gone.
+    bool done;
+    Status status;
+    int errnum;
+}; // struct SslIo::handshake_t
+
+class SslIo::HandshakeJob : public Runnable {
+public:
+    explicit HandshakeJob(struct handshake_t *handshake)
+            : _handshake(handshake) {}
+
+    virtual ~HandshakeJob()
+    {
+        ReleaseHandshake(_handshake);
+    }
+
+    virtual bool Run()
+    {
+        RunHandshake(_handshake);
+        return true;
+    }
+
+private:
+    struct handshake_t *const _handshake;
+
+}; // class SslIo::HandshakeJob
+
+class SslIo::ResumeCommand : public Runnable {
+public:
+    ResumeCommand(struct handshake_t *handshake, LinkageWorker *worker)
+            : _handshake(handshake), _worker(worker) {}
+
+    virtual ~ResumeCommand()
+    {
+        ReleaseHandshake(_handshake);
+    }
+
+    // Within the I/O thread of _worker. If the linkage is still attached to
+    // it, it can't be detached or released before this returns.
+    virtual bool Run()
+    {
+        MutexLocker locker(&_handshake->mutex);
+        if (_handshake->abandoned) {
+            return true;
+        } else if (_handshake->worker != _worker) {
+            // Detached, tell the next owner in SetOwner().
+            if (_handshake->notified == _worker) {
+                _handshake->notified = NULL;
+            }
+
+            return true;
+        }
+
+        LinkageBase *linkage = _handshake->linkage;
+        locker.Unlock();
+        _worker->Resume(linkage);
+        return true;
+    }
+
+private:
+    struct handshake_t *const _handshake;
+    LinkageWorker *const _worker;
+
+}; // class SslIo::ResumeCommand
+
 SslIo::SslIo(Interface *i,
              bool client_or_server,
              bool socket_connecting,
@@ -41,7 +130,14 @@ SslIo::SslIo(Interface *i,
         , _client_mode(client_or_server)
         , _i(i)
         , _connecting(socket_connecting)
+        , _pending_writing(0)
         , _peer(NULL)
+        , _kernel_tls_send(false)
+        , _kernel_tls_recv(false)
+        , _pool(context->handshake_pool())
+        , _handshake(NULL)
+        , _worker(NULL)
+        , _linkage(NULL)
 {
     assert(i);
     assert(i->fd() >= 0);
@@ -54,11 +150,164 @@ SslIo::SslIo(Interface *i,
 
 SslIo::~SslIo()
 {
-    delete _i;
     delete _peer;
+    if (_handshake) {
+        MutexLocker locker(&_handshake->mutex);
+        _handshake->abandoned = true;
+        if (!_handshake->done) {
+            // Still in use, the pool thread frees them.
+            _handshake->i = _i;
+            locker.Unlock();
+            ReleaseHandshake(_handshake);
+            return;
+        }
+
+        locker.Unlock();
+        ReleaseHandshake(_handshake);
+    }
+
+    delete _i;
     SSL_free(_ssl);
 }
 
+void SslIo::SetOwner(LinkageWorker *worker, LinkageBase *linkage)
+{
+    _worker = worker;
+    _linkage = linkage;
+    if (!_handshake) {
+        return;
+    }
+
+    // Done while detached, or the old owner was told instead.
+    MutexLocker locker(&_handshake->mutex);
+    _handshake->worker = worker;
+    _handshake->linkage = linkage;
+    if (worker && _handshake->done && _handshake->notified != worker) {
+        NotifyHandshake(_handshake);
+    }
+}
+
+void SslIo::ReleaseHandshake(struct handshake_t *handshake)
+{
+    if (!handshake->references.SubAndFetch(1)) {
+        delete handshake;
+    }
+}
+
+// Under lock so that the worker is still there.
+void SslIo::NotifyHandshake(struct handshake_t *handshake)
+{
+    handshake->references.AddAndFetch(1);
+    ResumeCommand *command = new ResumeCommand(handshake, handshake->worker);
+    if (!handshake->worker->SendCommand(command)) {
+        delete command;
+        return;
+    }
+
+    handshake->notified = handshake->worker;
+}
+
+bool SslIo::OffloadHandshake(const Action &action)
+{
+    if (!_pool || !_worker) {
+        return false;
+    }
+
+    // Nothing to work on yet, which is cheap and most likely the first call.
+    char c;
+    int fd = _i->fd();
+    if (recv(fd, &c, sizeof(c), MSG_PEEK | MSG_DONTWAIT) <= 0) {
+        return false;
+    }
+
+    struct handshake_t *handshake = new struct handshake_t;
+    handshake->references.Set(2);
+    handshake->ssl = _ssl;
+    handshake->i = NULL;
+    handshake->worker = _worker;
+    handshake->linkage = _linkage;
+    handshake->notified = NULL;
+    handshake->action = action;
+    handshake->abandoned = false;
+    handshake->done = false;
+    handshake->status = kStatusBug;
+    handshake->errnum = 0;
+
+    // Not released by the pool if not appended.
+    HandshakeJob *job = new HandshakeJob(handshake);
+    if (!_pool->AppendJob(job, true)) {
+        delete job;
+        ReleaseHandshake(handshake);
+        return false;
+    }
+
+    CLOG.Verbose("Linkage: SSL handshake offloaded for fd = %d", fd);
+    _handshake = handshake;
+    return true;
+}
+
+void SslIo::RunHandshake(struct handshake_t *handshake)
+{
+    struct ssl_st *ssl = handshake->ssl;
+    int fd = SSL_get_fd(ssl);
+
+    // Errors are queued per thread.
+    ERR_clear_error();
+    errno = 0;
+
+    Status status;
+    int ret = handshake->action == kActionConnect ? SSL_connect(ssl)
+                                                  : SSL_accept(ssl);
+
+    if (ret == 1) {
+        status = kStatusOk;
+    } else if (ret == 0 && handshake->action == kActionConnect) {
+        CLOG.Verbose("Linkage: SSL initiating failed and closed for fd = %d", fd);
+        status = kStatusClosed;
+    } else {
+        status = HandleError(ssl, fd, handshake->action, ret);
+    }
+
+    int errnum = errno;
+    MutexLocker locker(&handshake->mutex);
+    handshake->status = status;
+    handshake->errnum = errnum;
+    handshake->done = true;
+
+    if (handshake->abandoned) {
+        locker.Unlock();
+        delete handshake->i;
+        SSL_free(ssl);
+        return;
+    }
+
+    if (handshake->worker) {
+        NotifyHandshake(handshake);
+    }
+}
+
+AbstractIo::Status SslIo::PickHandshake()
+{
+    MutexLocker locker(&_handshake->mutex);
+    if (!_handshake->done) {
+        return kStatusPending;
+    }
+
+    Status status = _handshake->status;
+    int errnum = _handshake->errnum;
+    locker.Unlock();
+
+    ReleaseHandshake(_handshake);
+    _handshake = NULL;
+
+    if (status == kStatusOk) {
+        return OnHandshaked() ? kStatusOk : kStatusError;
+    }
+
+    errno = errnum;
+    return status;
+}
+
 const char *SslIo::GetActionString(const Action &in_progress)
 {
     switch (in_progress) {
@@ -85,13 +334,18 @@ const char *SslIo::GetActionString(const Action &in_progress)
 
 AbstractIo::Status SslIo::HandleError(const Action &in_progress, int ret)
 {
-    int fd = _i->fd();
+    return HandleError(_ssl, _i->fd(), in_progress, ret);
+}
+
+AbstractIo::Status SslIo::HandleError(struct ssl_st *ssl, int fd,
+                                      const Action &in_progress, int ret)
+{
     const char *actstr = GetActionString(in_progress);
     if (!actstr) {
         return kStatusError;
     }
 
-    int r = SSL_get_error(_ssl, ret);
+    int r = SSL_get_error(ssl, ret);
     if (r == SSL_ERROR_WANT_READ) {
         CLOG.Verbose("Linkage: %s but want to read for fd = %d", actstr, fd);
         return kStatusWannaRead;
@@ -102,6 +356,10 @@ AbstractIo::Status SslIo::HandleError(const Action &in_progress, int ret)
 
     } else if (r == SSL_ERROR_ZERO_RETURN) {
         CLOG.Verbose("Linkage: %s but connection closed for fd = %d", actstr, fd);
+
+        // Closed properly, or else OpenSSL drops the session from cache when
+        // freed as if it was broken, since I'm not replying close_notify.
+        SSL_set_shutdown(ssl, SSL_get_shutdown(ssl) | SSL_SENT_SHUTDOWN);
         return kStatusClosed;
 
     } else if (r == SSL_ERROR_SYSCALL) {
@@ -142,6 +400,23 @@ AbstractIo::Status SslIo::HandleError(const Action &in_progress, int ret)
     }
 }
 
+AbstractIo::Status SslIo::HandleKernelError(const Action &in_progress)
+{
+    int fd = _i->fd();
+    const char *actstr = GetActionString(in_progress);
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return in_progress == kActionRead ? kStatusWannaRead : kStatusWannaWrite;
+    } else if (errno == EPIPE) {
+        CLOG.Verbose("Linkage: %s but peer hung for fd = %d", actstr, fd);
+        return kStatusClosed;
+    }
+
+    CLOG.Verbose("Linkage: %s but system error for fd = %d: %d: %s",
+                 actstr, fd, errno, strerror(errno));
+
+    return kStatusError;
+}
+
 AbstractIo::Status SslIo::Write(const void *buffer, size_t length, size_t *retlen)
 {
     if (length > INT_MAX) {
@@ -149,6 +424,19 @@ AbstractIo::Status SslIo::Write(const void *buffer, size_t length, size_t *retle
     }
 
     int fd = _i->fd();
+    if (_kernel_tls_send) {
+        ssize_t ret = safe_write(fd, buffer, length);
+        if (ret < 0) {
+            return HandleKernelError(kActionWrite);
+        }
+
+        if (retlen) {
+            *retlen = static_cast<size_t>(ret);
+        }
+
+        return kStatusOk;
+    }
+
     int ret = SSL_write(_ssl, buffer, static_cast<int>(length));
     if (ret > 0) {
         if (retlen) {
@@ -164,6 +452,157 @@ AbstractIo::Status SslIo::Write(const void *buffer, size_t length, size_t *retle
     return HandleError(kActionWrite, ret);
 }
 
+AbstractIo::Status SslIo::SendFile(int fd,
+                                   int64_t offset,
+                                   size_t length,
+                                   size_t *retlen)
+{
+#if defined(__linux__)
+    // Records are cut by the kernel, pages go from the file to the wire.
+    if (_kernel_tls_send) {
+        if (fd < 0 || offset < 0) {
+            return kStatusBug;
+        }
+
+        off_t off = static_cast<off_t>(offset);
+        ssize_t ret;
+        do {
+            ret = sendfile(_i->fd(), fd, &off, length);
+        } while (ret < 0 && errno == EINTR);
+
+        if (ret < 0) {
+            return HandleKernelError(kActionWrite);
+        } else if (ret == 0) { // Truncated since queued.
+            return kStatusError;
+        }
+
+        if (retlen) {
+            *retlen = static_cast<size_t>(ret);
+        }
+
+        return kStatusOk;
+    }
+#endif
+
+    return AbstractIo::SendFile(fd, offset, length, retlen);
+}
+
+AbstractIo::Status SslIo::Writev(const struct iovec *iov,
+                                 size_t count,
+                                 size_t *retlen)
+{
+    // One TLS record can't carry more than this anyway.
+    static const size_t kMaximumCoalescing = 16384;
+
+    if (!iov || !count) {
+        return kStatusBug;
+    }
+
+    // The kernel cuts records itself, no need to coalesce or to retry with
+    // exactly the same length.
+    if (_kernel_tls_send) {
+        if (count > IOV_MAX) {
+            count = IOV_MAX;
+        }
+
+        ssize_t ret = safe_writev(_i->fd(), iov, static_cast<int>(count));
+        if (ret < 0) {
+            return HandleKernelError(kActionWrite);
+        }
+
+        if (retlen) {
+            *retlen = static_cast<size_t>(ret);
+        }
+
+        return kStatusOk;
+    }
+
+    unsigned char buffer[kMaximumCoalescing];
+    size_t offset = 0;
+    size_t total = 0;
+    size_t i = 0;
+
+    while (i < count) {
+        size_t left = iov[i].iov_len - offset;
+        if (!left) {
+            offset = 0;
+            ++i;
+            continue;
+        }
+
+        // Chunks are picked deterministically by the bytes, except that an
+        // incomplete SSL_write() must be retried with exactly the same length.
+        const void *chunk;
+        size_t length;
+        if (_pending_writing ? left >= _pending_writing
+                             : left >= kMaximumCoalescing) {
+
+            chunk = reinterpret_cast<const unsigned char *>(iov[i].iov_base) + offset;
+            length = _pending_writing ? _pending_writing : left;
+
+        } else {
+            size_t wanted = _pending_writing ? _pending_writing : sizeof(buffer);
+            length = 0;
+            for (size_t j = i, o = offset; j < count && length < wanted; ++j, o = 0) {
+                size_t size = iov[j].iov_len - o;
+                if (size > wanted - length) {
+                    size = wanted - length;
+                }
+
+                memcpy(buffer + length,
+                       reinterpret_cast<const unsigned char *>(iov[j].iov_base) + o,
+                       size);
+
+                length += size;
+            }
+
+            if (_pending_writing && length != _pending_writing) {
+                return kStatusBug;
+            }
+
+            chunk = buffer;
+        }
+
+        size_t written = 0;
+        Status status = Write(chunk, length, &written);
+        if (status != kStatusOk) {
+            if (status == kStatusWannaRead || status == kStatusWannaWrite) {
+                _pending_writing = length;
+            }
+
+            if (!total) {
+                return status;
+            }
+
+            break;
+        }
+
+        // Without SSL_MODE_ENABLE_PARTIAL_WRITE, it's all or nothing.
+        assert(written == length);
+        _pending_writing = 0;
+        total += written;
+
+        // Advance the cursor.
+        while (written) {
+            size_t size = iov[i].iov_len - offset;
+            if (written < size) {
+                offset += written;
+                break;
+            }
+
+            written -= size;
+            offset = 0;
+            ++i;
+        }
+    }
+
+    if (retlen) {
+        *retlen = total;
+    }
+
+    return kStatusOk;
+}
+
 AbstractIo::Status SslIo::Read(void *buffer,
                                size_t length,
                                size_t *retlen,
@@ -174,6 +613,28 @@ AbstractIo::Status SslIo::Read(void *buffer,
     }
 
     int fd = _i->fd();
+
+    // Plain read(2) only returns application data, anything else like alerts
+    // fails with EIO and is left for SSL_read() to pick up.
+    if (_kernel_tls_recv && !SSL_pending(_ssl)) {
+        ssize_t ret = safe_read(fd, buffer, length);
+        if (ret > 0) {
+            if (retlen) {
+                *retlen = static_cast<size_t>(ret);
+            }
+
+            CLOG.Verbose("Linkage: read [%ld] bytes for fd = %d", ret, fd);
+            return kStatusOk;
+
+        } else if (ret == 0) {
+            CLOG.Verbose("Linkage: reading but peer hung for fd = %d", fd);
+            return kStatusClosed;
+
+        } else if (errno != EIO) {
+            return HandleKernelError(kActionRead);
+        }
+    }
+
     int ret = SSL_read(_ssl, buffer, static_cast<int>(length));
     if (ret > 0) {
         if (retlen) {
@@ -196,6 +657,18 @@ bool SslIo::OnHandshaked()
     CLOG.Verbose("Linkage: SSL handshaked with [%s/%s] for fd = %d",
                  version.c_str(), cipher.c_str(), fd);
 
+#if defined(SSL_OP_ENABLE_KTLS) && defined(BIO_CTRL_GET_KTLS_SEND)
+    // OpenSSL installs kTLS itself if asked to and possible, or it's simply
+    // not there and everything goes through SSL_read() and SSL_write().
+    _kernel_tls_send = !!BIO_get_ktls_send(SSL_get_wbio(_ssl));
+    _kernel_tls_recv = !!BIO_get_ktls_recv(SSL_get_rbio(_ssl));
+    if (SSL_get_options(_ssl) & SSL_OP_ENABLE_KTLS) {
+        CLOG.Verbose("Linkage: kTLS send %s, receive %s for fd = %d",
+                     _kernel_tls_send ? "on" : "off",
+                     _kernel_tls_recv ? "on" : "off", fd);
+    }
+#endif
+
     X509 *x509 = SSL_get_peer_certificate(_ssl);
     if (!x509) {
         CLOG.Verbose("Linkage: no peer certificate for fd = %d", fd);
@@ -250,6 +723,10 @@ bool SslIo::OnHandshaked()
 
 AbstractIo::Status SslIo::Connect()
 {
+    if (_handshake) {
+        return PickHandshake();
+    }
+
     int fd = _i->fd();
     if (_connecting) {
         if (safe_test_if_connected(fd)) {
@@ -258,6 +735,10 @@ AbstractIo::Status SslIo::Connect()
     }
 
     _connecting = false;
+    if (OffloadHandshake(kActionConnect)) {
+        return kStatusPending;
+    }
+
     CLOG.Verbose("Linkage: SSL initiating for fd = %d", fd);
     int ret = SSL_connect(_ssl);
     if (ret == 1) { // Handshake completed.
@@ -277,6 +758,10 @@ AbstractIo::Status SslIo::Connect()
 
 AbstractIo::Status SslIo::Accept()
 {
+    if (_handshake) {
+        return PickHandshake();
+    }
+
     int fd = _i->fd();
     if (_connecting) {
         if (safe_test_if_connected(fd)) {
@@ -285,6 +770,10 @@ AbstractIo::Status SslIo::Accept()
     }
 
     _connecting = false;
+    if (OffloadHandshake(kActionAccept)) {
+        return kStatusPending;
+    }
+
     CLOG.Verbose("Linkage: SSL handshaking for fd = %d", fd);
     int ret = SSL_accept(_ssl);
     if (ret == 1) { // Handshake completed.
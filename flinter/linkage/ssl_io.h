@@ -24,6 +24,7 @@ struct ssl_st;
 
 namespace flinter {
 
+class AbstractThreadPool;
 class Interface;
 class SslContext;
 class SslPeer;
@@ -46,21 +47,53 @@ public:
 
     virtual Status Read(void *buffer, size_t length, size_t *retlen, bool *more);
     virtual Status Write(const void *buffer, size_t length, size_t *retlen);
+    virtual Status Writev(const struct iovec *iov, size_t count, size_t *retlen);
+    virtual Status SendFile(int fd, int64_t offset, size_t length, size_t *retlen);
     virtual Status Shutdown();
     virtual Status Connect();
     virtual Status Accept();
 
+    virtual void SetOwner(LinkageWorker *worker, LinkageBase *linkage);
+
     // Might be NULL.
     const SslPeer *peer() const
     {
         return _peer;
     }
 
+    // Records are written by the kernel (kTLS), plain writes go straight to
+    //     the socket, so does sendfile(2).
+    bool kernel_tls_send() const
+    {
+        return _kernel_tls_send;
+    }
+
+    // Records are read by the kernel (kTLS).
+    bool kernel_tls_recv() const
+    {
+        return _kernel_tls_recv;
+    }
+
 private:
+    struct handshake_t;
+    class HandshakeJob;
+    class ResumeCommand;
+
     static const char *GetActionString(const Action &in_progress);
     bool OnHandshaked();
 
+    // Handshakes might be running in other threads, done with the results.
+    static void RunHandshake(struct handshake_t *handshake);
+    static void ReleaseHandshake(struct handshake_t *handshake);
+    static void NotifyHandshake(struct handshake_t *handshake);
+    bool OffloadHandshake(const Action &action);
+    Status PickHandshake();
+
+    static Status HandleError(struct ssl_st *ssl, int fd,
+                              const Action &in_progress, int ret);
+
     Status HandleError(const Action &in_progress, int ret);
+    Status HandleKernelError(const Action &in_progress);
     Status OnEvent(bool reading_or_writing);
     Status DoShutdown();
     Status DoConnect();
@@ -69,7 +102,15 @@ private:
     const bool _client_mode;
     Interface *const _i;
     bool _connecting;
+    size_t _pending_writing;
     SslPeer *_peer;
+    bool _kernel_tls_send;
+    bool _kernel_tls_recv;
+
+    AbstractThreadPool *const _pool;
+    struct handshake_t *_handshake;
+    LinkageWorker *_worker;
+    LinkageBase *_linkage;
 
 }; // class SslIo
 
@@ -0,0 +1,50 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLINTER_LINKAGE_SSL_SESSION_CACHE_H
+#define FLINTER_LINKAGE_SSL_SESSION_CACHE_H
+
+#include <stdint.h>
+
+#include <string>
+
+namespace flinter {
+
+/// External TLS session cache, sessions are opaque serialized bytes.
+///
+/// Called from every I/O thread concurrently, implementations must be thread
+/// safe. Losing entries is always fine, clients simply do full handshakes.
+class SslSessionCache {
+public:
+    virtual ~SslSessionCache() {}
+
+    /// @param expire wall clock time in seconds.
+    virtual void Insert(const std::string &id,
+                        const std::string &session,
+                        int64_t expire) = 0;
+
+    /// @param now wall clock time in seconds.
+    /// @return false if not found or expired.
+    virtual bool Find(const std::string &id,
+                      int64_t now,
+                      std::string *session) = 0;
+
+    virtual void Erase(const std::string &id) = 0;
+
+}; // class SslSessionCache
+
+} // namespace flinter
+
+#endif // FLINTER_LINKAGE_SSL_SESSION_CACHE_H
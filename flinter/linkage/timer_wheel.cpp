@@ -0,0 +1,139 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flinter/linkage/timer_wheel.h"
+
+namespace flinter {
+
+TimerWheel::TimerWheel(int64_t resolution, size_t slots, int64_t now)
+        : _resolution(resolution > 0 ? resolution : 1)
+        , _slots(slots ? slots : 1)
+        , _wheel(new struct node_t[_slots])
+        , _current(now / _resolution)
+{
+    for (size_t i = 0; i < _slots; ++i) {
+        _wheel[i].prev = &_wheel[i];
+        _wheel[i].next = &_wheel[i];
+        _wheel[i].tick = 0;
+    }
+
+    _expired.prev = &_expired;
+    _expired.next = &_expired;
+    _expired.tick = 0;
+}
+
+TimerWheel::~TimerWheel()
+{
+    // Leave nodes alone, but don't let them point to freed memory.
+    for (size_t i = 0; i < _slots; ++i) {
+        while (_wheel[i].next != &_wheel[i]) {
+            Cancel(_wheel[i].next);
+        }
+    }
+
+    while (_expired.next != &_expired) {
+        Cancel(_expired.next);
+    }
+
+    delete [] _wheel;
+}
+
+void TimerWheel::Initialize(struct node_t *node)
+{
+    node->prev = NULL;
+    node->next = NULL;
+    node->tick = 0;
+}
+
+void TimerWheel::Link(struct node_t *head, struct node_t *node)
+{
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+void TimerWheel::Cancel(struct node_t *node)
+{
+    if (!node->next) {
+        return;
+    }
+
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = NULL;
+    node->next = NULL;
+}
+
+void TimerWheel::Schedule(struct node_t *node, int64_t when)
+{
+    Cancel(node);
+
+    // Round up, and anything already due expires on the next tick.
+    int64_t tick = when / _resolution;
+    if (when % _resolution) {
+        ++tick;
+    }
+
+    if (tick <= _current) {
+        tick = _current + 1;
+    }
+
+    node->tick = tick;
+    Link(&_wheel[static_cast<size_t>(tick) % _slots], node);
+}
+
+void TimerWheel::Advance(int64_t now)
+{
+    int64_t target = now / _resolution;
+    if (target <= _current) {
+        return;
+    }
+
+    // Every slot is visited at most once no matter how long it's been.
+    int64_t ticks = target - _current;
+    if (ticks > static_cast<int64_t>(_slots)) {
+        ticks = static_cast<int64_t>(_slots);
+    }
+
+    for (int64_t i = 1; i <= ticks; ++i) {
+        struct node_t *head = &_wheel[static_cast<size_t>(_current + i) % _slots];
+        struct node_t *node = head->next;
+        while (node != head) {
+            struct node_t *next = node->next;
+            if (node->tick <= target) {
+                Cancel(node);
+                Link(&_expired, node);
+            }
+
+            node = next;
+        }
+    }
+
+    _current = target;
+}
+
+TimerWheel::node_t *TimerWheel::PopExpired()
+{
+    struct node_t *node = _expired.next;
+    if (node == &_expired) {
+        return NULL;
+    }
+
+    Cancel(node);
+    return node;
+}
+
+} // namespace flinter
@@ -0,0 +1,84 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLINTER_LINKAGE_TIMER_WHEEL_H
+#define FLINTER_LINKAGE_TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <flinter/common.h>
+
+namespace flinter {
+
+/// Hashed timing wheel, nodes are embedded by the caller.
+///
+/// Scheduling and cancelling are O(1), advancing costs O(expired) plus the
+/// nodes sharing the same slots but due in later rounds. Deadlines are rounded
+/// up to the resolution, nodes never expire early.
+///
+/// Not thread safe.
+class TimerWheel {
+public:
+    struct node_t {
+        struct node_t *prev;
+        struct node_t *next;
+        int64_t tick;
+    }; // struct node_t
+
+    /// @param resolution in nanoseconds.
+    /// @param now in nanoseconds, usually get_monotonic_timestamp().
+    TimerWheel(int64_t resolution, size_t slots, int64_t now);
+    ~TimerWheel();
+
+    /// Must be called before the node is used.
+    static void Initialize(struct node_t *node);
+
+    /// (Re)schedule node to expire at when, in nanoseconds.
+    void Schedule(struct node_t *node, int64_t when);
+
+    /// Can be called even if node is not scheduled or has expired.
+    static void Cancel(struct node_t *node);
+
+    static bool IsScheduled(const struct node_t *node)
+    {
+        return !!node->next;
+    }
+
+    /// Move nodes expired by now aside, take them with PopExpired().
+    void Advance(int64_t now);
+
+    /// Cancelling nodes in between is fine.
+    /// @return NULL if no more.
+    struct node_t *PopExpired();
+
+private:
+    NON_COPYABLE(TimerWheel);
+
+    static void Link(struct node_t *head, struct node_t *node);
+
+    const int64_t _resolution;
+    const size_t _slots;
+
+    // Circular lists, heads are dummy nodes.
+    struct node_t *_wheel;
+    struct node_t _expired;
+    int64_t _current;
+
+}; // class TimerWheel
+
+} // namespace flinter
+
+#endif // FLINTER_LINKAGE_TIMER_WHEEL_H
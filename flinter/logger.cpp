@@ -30,7 +30,7 @@
 #include <sstream>
 #include <string>
 
-#include "flinter/thread/read_write_lock.h"
+#include "flinter/thread/distributed_read_write_lock.h"
 #include "flinter/thread/write_locker.h"
 #include "flinter/thread/read_locker.h"
 #include "flinter/cmdline.h"
@@ -57,7 +57,7 @@ static Logger::Level g_filter = Logger::kLevelDebug;
 static bool g_with_filename = true;
 static std::string g_filename;
 static bool g_colorful = true;
-static ReadWriteLock g_mutex;
+static DistributedReadWriteLock g_mutex;
 static struct stat g_fstat;
 static time_t g_stated;
 static int g_fd = -1;
@@ -112,7 +112,7 @@ static bool DoProcessAttach(const std::string &filename)
 
 static bool Write(time_t now, const void *buffer, size_t length)
 {
-    ReadLocker rlocker(&g_mutex);
+    DistributedReadLocker rlocker(&g_mutex);
 
     bool reopen = false;
     if (g_filename.empty()) {
@@ -135,7 +135,7 @@ static bool Write(time_t now, const void *buffer, size_t length)
     if (reopen) {
         time_t stated = g_stated;
         rlocker.Unlock();
-        WriteLocker wlocker(&g_mutex);
+        DistributedWriteLocker wlocker(&g_mutex);
 
         // Multiple threads can enter here one by one.
         if (stated == g_stated) {
@@ -328,7 +328,7 @@ bool CLogger::ProcessAttach(const std::string &filename, int filter_level)
 {
     SetFilter(filter_level);
 
-    WriteLocker locker(&g_mutex);
+    DistributedWriteLocker locker(&g_mutex);
     g_filename.clear();
     DoProcessDetach();
 
@@ -346,7 +346,7 @@ bool CLogger::ProcessAttach(const std::string &filename, int filter_level)
 
 void CLogger::ProcessDetach()
 {
-    WriteLocker locker(&g_mutex);
+    DistributedWriteLocker locker(&g_mutex);
     g_filename.clear();
     DoProcessDetach();
 }
@@ -315,6 +315,20 @@ ssize_t safe_write(int fd, const void *buf, size_t count)
     return ret;
 }
 
+ssize_t safe_writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    ssize_t ret;
+    if (fd < 0 || !iov || iovcnt <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    do {
+        ret = writev(fd, iov, iovcnt);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
 int safe_listen(int sockfd, int backlog)
 {
     /* listen() will not be interrupted by EINTR. */
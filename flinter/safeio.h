@@ -20,6 +20,7 @@
 
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -38,6 +39,10 @@ extern ssize_t safe_read(int fd, void *buf, size_t count);
 /** @warning use with caution: EINTR will be swallowed if sockfd is blocking. */
 extern ssize_t safe_write(int fd, const void *buf, size_t count);
 
+/** writev() without interrupted by EINTR */
+/** @warning use with caution: EINTR will be swallowed if sockfd is blocking. */
+extern ssize_t safe_writev(int fd, const struct iovec *iov, int iovcnt);
+
 /** listen() without interrupted by EINTR */
 /** @warning use with caution: EINTR will be swallowed if sockfd is blocking. */
 extern int safe_listen(int sockfd, int backlog);
@@ -23,16 +23,18 @@ namespace flinter {
 
 void AbstractThreadPool::Purge(job_list_t *jobs)
 {
-    for (job_list_t::iterator p = jobs->begin(); p != jobs->end(); ++p) {
-        internal::ThreadJob *job = *p;
-        if (job->auto_release()) {
-            delete job->runnable();
-        }
+    while (!jobs->empty()) {
+        internal::ThreadJob *job = jobs->front();
+        jobs->pop_front();
 
-        delete job;
+        // Intrusive jobs are gone with their runnables.
+        Runnable *runnable = job->runnable();
+        bool auto_release = job->auto_release();
+        internal::ThreadJob::Release(job);
+        if (auto_release) {
+            delete runnable;
+        }
     }
-
-    jobs->clear();
 }
 
 } // namespace flinter
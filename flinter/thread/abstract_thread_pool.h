@@ -18,15 +18,28 @@
 
 #include <stddef.h>
 
-#include <list>
+#include <flinter/thread/thread_job.h>
+#include <flinter/runnable.h>
 
 namespace flinter {
 namespace internal {
 class Thread;
-class ThreadJob;
 } // namespace internal
 
-class Runnable;
+/// Runnable with its job header inside, appending it allocates nothing.
+///
+/// Don't append it again before it's run. It's yours again as soon as Run()
+/// is called, it can even append itself again from there.
+class IntrusiveRunnable : public Runnable {
+public:
+    IntrusiveRunnable() {}
+    virtual ~IntrusiveRunnable() {}
+
+private:
+    friend class AbstractThreadPool;
+    internal::ThreadJob _thread_job;
+
+}; // class IntrusiveRunnable
 
 class AbstractThreadPool {
 public:
@@ -34,12 +47,13 @@ public:
     virtual ~AbstractThreadPool() {}
 
     virtual bool AppendJob(Runnable *runnable, bool auto_release = false) = 0;
+    virtual bool AppendJob(IntrusiveRunnable *runnable, bool auto_release = false) = 0;
     virtual bool Shutdown(bool wait_for_jobs_done = true) = 0;
     virtual bool Initialize(size_t size) = 0;
     virtual bool KillAll(int signum) = 0;
 
 protected:
-    typedef std::list<internal::ThreadJob *> job_list_t;
+    typedef internal::ThreadJobList job_list_t;
 
     AbstractThreadPool() {}
     virtual internal::ThreadJob *RequestJob(internal::Thread *thread) = 0;
@@ -47,6 +61,22 @@ protected:
     /// Will delete jobs if auto releasing.
     static void Purge(job_list_t *jobs);
 
+    /// Allocated from the cache of the calling thread.
+    static internal::ThreadJob *NewThreadJob(Runnable *runnable, bool auto_release)
+    {
+        return internal::ThreadJob::Allocate(runnable, auto_release);
+    }
+
+    /// The one inside, allocates nothing.
+    static internal::ThreadJob *NewThreadJob(IntrusiveRunnable *runnable, bool auto_release)
+    {
+        internal::ThreadJob *job = &runnable->_thread_job;
+        *job = internal::ThreadJob(runnable, auto_release,
+                                   internal::ThreadJob::kStorageEmbedded);
+
+        return job;
+    }
+
 private:
     AbstractThreadPool(const AbstractThreadPool &);
     AbstractThreadPool &operator = (const AbstractThreadPool &);
@@ -17,6 +17,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <time.h>
 
 #include <stdexcept>
@@ -25,7 +26,9 @@
 #include "flinter/utility.h"
 
 #include "config.h"
-#if defined(WIN32)
+#if defined(__linux__)
+# include "flinter/thread/futex.h"
+#elif defined(WIN32)
 # include <Windows.h>
 #elif HAVE_PTHREAD_H
 # include <pthread.h>
@@ -35,6 +38,65 @@
 
 namespace flinter {
 
+#if defined(__linux__)
+Condition::Condition() : _sequence(0), _waiters(0)
+{
+    // Intended left blank.
+}
+
+Condition::~Condition()
+{
+    // Intended left blank.
+}
+
+bool Condition::Wait(Mutex *mutex)
+{
+    return Wait(mutex, -1);
+}
+
+bool Condition::Wait(Mutex *mutex, int64_t timeout)
+{
+    assert(mutex);
+
+    // Both are done with the mutex locked, so wakes after unlocking are seen.
+    __sync_add_and_fetch(&_waiters, 1);
+    int sequence = internal::FutexGet(&_sequence);
+    mutex->Unlock();
+
+    int ret = internal::FutexWait(&_sequence, sequence, timeout);
+    int error = errno;
+
+    // Other waiters might have been woken up as well, relock as contended so
+    // that they're not left sleeping when it's unlocked.
+    __sync_sub_and_fetch(&_waiters, 1);
+    mutex->LockContended();
+
+    if (ret == 0) {
+        return true;
+    } else if (error == ETIMEDOUT) {
+        return false;
+    }
+
+    throw std::runtime_error("Condition::Wait()");
+}
+
+void Condition::WakeOne()
+{
+    __sync_add_and_fetch(&_sequence, 1);
+    if (internal::FutexGet(&_waiters)) {
+        internal::FutexWake(&_sequence, 1);
+    }
+}
+
+void Condition::WakeAll()
+{
+    __sync_add_and_fetch(&_sequence, 1);
+    if (internal::FutexGet(&_waiters)) {
+        internal::FutexWake(&_sequence, INT_MAX);
+    }
+}
+
+#else
 #ifdef WIN32
 # define CALL(x,s) if (!(x)) { throw std::runtime_error("Condition::" #s); }
 
@@ -214,4 +276,6 @@ void Condition::WakeAll()
 #endif
 }
 
+#endif
+
 } // namespace flinter
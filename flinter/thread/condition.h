@@ -24,7 +24,7 @@ namespace flinter {
 
 class Mutex;
 
-/// POSIX condition.
+/// Futex on Linux, POSIX condition otherwise.
 class Condition {
 public:
     Condition();                                ///< Constructor.
@@ -37,8 +37,13 @@ public:
     bool Wait(Mutex *mutex, int64_t timeout);   ///< Mutex must be locked, <0 means infinity.
 
 private:
+#if defined(__linux__)
+    int _sequence;                              ///< Bumped for every wake.
+    int _waiters;                               ///< Skip waking if none.
+#else
     class Context;                              ///< Internally used.
     Context *_context;                          ///< Internally used.
+#endif
 
     NON_COPYABLE(Condition);                    ///< Don't copy me.
 
@@ -0,0 +1,224 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flinter/thread/distributed_read_write_lock.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <new>
+#include <stdexcept>
+
+#include "flinter/types/atomic.h"
+
+#include "config.h"
+#if defined(__linux__)
+# include "flinter/thread/futex.h"
+#endif
+
+namespace flinter {
+
+#if defined(__linux__)
+static const size_t kCacheLineSize = 64;
+
+// Threads don't stay on one CPU, and must unlock the counter they locked, so
+// they're spread over the slots round robin instead, starting from 1.
+static Atomic<size_t> g_threads(0);
+static __thread size_t g_thread = 0;
+
+class DistributedReadWriteLock::Slot {
+public:
+    int _readers;
+    char _padding[kCacheLineSize - sizeof(int)];
+}; // class DistributedReadWriteLock::Slot
+
+DistributedReadWriteLock::DistributedReadWriteLock()
+        : _slots(NULL), _mask(0), _writer(0), _owned(0), _waiters(0)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    size_t slots = 1;
+    while (static_cast<long>(slots) < cpus) {
+        slots <<= 1;
+    }
+
+    void *memory;
+    if (posix_memalign(&memory, kCacheLineSize, sizeof(Slot) * slots)) {
+        throw std::bad_alloc();
+    }
+
+    _slots = static_cast<Slot *>(memory);
+    for (size_t i = 0; i < slots; ++i) {
+        _slots[i]._readers = 0;
+    }
+
+    _mask = slots - 1;
+}
+
+DistributedReadWriteLock::~DistributedReadWriteLock()
+{
+    free(_slots);
+}
+
+int *DistributedReadWriteLock::GetReaders() const
+{
+    if (!g_thread) {
+        g_thread = g_threads.AddAndFetch(1);
+    }
+
+    return &_slots[(g_thread - 1) & _mask]._readers;
+}
+
+void DistributedReadWriteLock::ReaderLock()
+{
+    int *readers = GetReaders();
+    while (true) {
+        // Announce before checking, the writer does it in the reverse order.
+        __sync_add_and_fetch(readers, 1);
+        if (!internal::FutexGet(&_writer)) {
+            return;
+        }
+
+        // Back off to let the writer in.
+        ReaderUnlock(readers);
+        __sync_add_and_fetch(&_waiters, 1);
+        while (internal::FutexGet(&_writer)) {
+            if (internal::FutexWait(&_writer, 1, -1)) {
+                __sync_sub_and_fetch(&_waiters, 1);
+                throw std::runtime_error("DistributedReadWriteLock::ReaderLock()");
+            }
+        }
+
+        __sync_sub_and_fetch(&_waiters, 1);
+    }
+}
+
+bool DistributedReadWriteLock::TryReaderLock()
+{
+    int *readers = GetReaders();
+    __sync_add_and_fetch(readers, 1);
+    if (!internal::FutexGet(&_writer)) {
+        return true;
+    }
+
+    ReaderUnlock(readers);
+    return false;
+}
+
+void DistributedReadWriteLock::ReaderUnlock(int *readers)
+{
+    if (__sync_sub_and_fetch(readers, 1) == 0 && internal::FutexGet(&_writer)) {
+        internal::FutexWake(readers, 1);
+    }
+}
+
+void DistributedReadWriteLock::WriterLock()
+{
+    _mutex.Lock();
+    __sync_fetch_and_or(&_writer, 1);
+
+    // New readers back off from now on, wait for the current ones to leave.
+    for (size_t i = 0; i <= _mask; ++i) {
+        int *readers = &_slots[i]._readers;
+        int count;
+        while ((count = internal::FutexGet(readers)) != 0) {
+            if (internal::FutexWait(readers, count, -1)) {
+                WriterUnlock();
+                throw std::runtime_error("DistributedReadWriteLock::WriterLock()");
+            }
+        }
+    }
+
+    _owned = 1;
+}
+
+bool DistributedReadWriteLock::TryWriterLock()
+{
+    if (!_mutex.TryLock()) {
+        return false;
+    }
+
+    __sync_fetch_and_or(&_writer, 1);
+    for (size_t i = 0; i <= _mask; ++i) {
+        if (internal::FutexGet(&_slots[i]._readers)) {
+            WriterUnlock();
+            return false;
+        }
+    }
+
+    _owned = 1;
+    return true;
+}
+
+void DistributedReadWriteLock::WriterUnlock()
+{
+    _owned = 0;
+    __sync_fetch_and_and(&_writer, 0);
+    if (internal::FutexGet(&_waiters)) {
+        internal::FutexWake(&_writer, INT_MAX);
+    }
+
+    _mutex.Unlock();
+}
+
+void DistributedReadWriteLock::Unlock()
+{
+    // Readers can't be in while the writer owns it.
+    if (internal::FutexGet(&_owned)) {
+        WriterUnlock();
+    } else {
+        ReaderUnlock(GetReaders());
+    }
+}
+
+#else
+DistributedReadWriteLock::DistributedReadWriteLock()
+{
+    // Intended left blank.
+}
+
+DistributedReadWriteLock::~DistributedReadWriteLock()
+{
+    // Intended left blank.
+}
+
+void DistributedReadWriteLock::ReaderLock()
+{
+    _lock.ReaderLock();
+}
+
+void DistributedReadWriteLock::WriterLock()
+{
+    _lock.WriterLock();
+}
+
+bool DistributedReadWriteLock::TryReaderLock()
+{
+    return _lock.TryReaderLock();
+}
+
+bool DistributedReadWriteLock::TryWriterLock()
+{
+    return _lock.TryWriterLock();
+}
+
+void DistributedReadWriteLock::Unlock()
+{
+    _lock.Unlock();
+}
+
+#endif
+
+} // namespace flinter
@@ -0,0 +1,74 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ * @brief
+ * Distributed read-write lock keeps one reader counter per CPU, each in its
+ * own cache line, so that readers on different CPUs never bounce a shared
+ * counter. Writers pay for it by scanning all counters, use it for read mostly
+ * data only.
+ *
+ * Non recursive, writer first, a plain ReadWriteLock on non-Linux platforms.
+ **/
+
+#ifndef FLINTER_THREAD_DISTRIBUTED_READ_WRITE_LOCK_H
+#define FLINTER_THREAD_DISTRIBUTED_READ_WRITE_LOCK_H
+
+#include <stddef.h>
+
+#include <flinter/thread/mutex.h>
+#include <flinter/thread/read_write_lock.h>
+#include <flinter/common.h>
+
+namespace flinter {
+
+/// Read-write lock with per CPU reader counters.
+class DistributedReadWriteLock {
+public:
+    DistributedReadWriteLock();                 ///< Constructor.
+    ~DistributedReadWriteLock();                ///< Destructor.
+
+    void ReaderLock();                          ///< Reader lock.
+    void WriterLock();                          ///< Writer lock.
+    bool TryReaderLock();                       ///< Immediately returns.
+    bool TryWriterLock();                       ///< Immediately returns.
+    void Unlock();                              ///< Unlocks.
+
+private:
+#if defined(__linux__)
+    class Slot;                                 ///< Internally used.
+
+    int *GetReaders() const;                    ///< Counter of this thread.
+    void ReaderUnlock(int *readers);            ///< Wake the writer if last.
+    void WriterUnlock();                        ///< Wake readers if any.
+
+    Slot *_slots;                               ///< One per CPU.
+    size_t _mask;                               ///< Slots minus one.
+    Mutex _mutex;                               ///< Between writers.
+    int _writer;                                ///< Writer pending or owning.
+    int _owned;                                 ///< Writer owning.
+    int _waiters;                               ///< Readers waiting for writer.
+#else
+    ReadWriteLock _lock;                        ///< Internally used.
+#endif
+
+    NON_COPYABLE(DistributedReadWriteLock);     ///< Don't copy me.
+
+}; // class DistributedReadWriteLock
+
+} // namespace flinter
+
+#endif // FLINTER_THREAD_DISTRIBUTED_READ_WRITE_LOCK_H
@@ -75,15 +75,16 @@ bool FixedThreadPool::Shutdown(bool wait_for_jobs_done)
     Purge(&_pending_jobs);
 
     // Kill active threads.
-    if (!wait_for_jobs_done && !_actives.empty()) {
-        CLOG.Verbose("ThreadPool: terminating %lu threads...", _actives.size());
-        for (actives_t::iterator p = _actives.begin(); p != _actives.end(); ++p) {
+    if (!wait_for_jobs_done) {
+        for (threads_t::iterator p = _threads.begin(); p != _threads.end(); ++p) {
             internal::Thread *thread = *p;
-            thread->Terminate();
+            if (thread->active()) {
+                CLOG.Verbose("ThreadPool: terminating thread [%p]...", thread);
+                thread->Terminate();
+            }
         }
     }
 
-    _actives.clear();
     threads_t threads;
     threads.swap(_threads);
     _job_available.WakeAll();
@@ -122,7 +123,7 @@ internal::ThreadJob *FixedThreadPool::RequestJob(internal::Thread *thread)
 {
     assert(thread);
     MutexLocker locker(&_mutex);
-    _actives.erase(thread);
+    thread->set_active(false);
 
     internal::ThreadJob *job;
     while (!TryRequestJob(&job)) {
@@ -130,7 +131,7 @@ internal::ThreadJob *FixedThreadPool::RequestJob(internal::Thread *thread)
     }
 
     if (job) {
-        _actives.insert(thread);
+        thread->set_active(true);
     }
 
     return job;
@@ -143,12 +144,28 @@ bool FixedThreadPool::AppendJob(Runnable *runnable, bool auto_release)
         return false;
     }
 
+    return AppendThreadJob(NewThreadJob(runnable, auto_release));
+}
+
+bool FixedThreadPool::AppendJob(IntrusiveRunnable *runnable, bool auto_release)
+{
+    assert(runnable);
+    if (!runnable) {
+        return false;
+    }
+
+    return AppendThreadJob(NewThreadJob(runnable, auto_release));
+}
+
+bool FixedThreadPool::AppendThreadJob(internal::ThreadJob *job)
+{
     MutexLocker locker(&_mutex);
     if (_initializing) {
+        internal::ThreadJob::Release(job);
         return false;
     }
 
-    _pending_jobs.push_back(new internal::ThreadJob(runnable, auto_release));
+    _pending_jobs.push_back(job);
     _job_available.WakeOne();
     return true;
 }
@@ -162,9 +179,11 @@ bool FixedThreadPool::KillAll(int signum)
 
     bool result = true;
 
-    for (actives_t::iterator p = _actives.begin(); p != _actives.end(); ++p) {
+    for (threads_t::iterator p = _threads.begin(); p != _threads.end(); ++p) {
         internal::Thread *thread = *p;
-        result &= thread->Kill(signum);
+        if (thread->active()) {
+            result &= thread->Kill(signum);
+        }
     }
 
     return result;
@@ -16,7 +16,6 @@
 #ifndef FLINTER_THREAD_FIXED_THREAD_POOL_H
 #define FLINTER_THREAD_FIXED_THREAD_POOL_H
 
-#include <set>
 #include <vector>
 
 #include <flinter/thread/abstract_thread_pool.h>
@@ -51,6 +50,9 @@ public:
     /// @param auto_release to delete runnable when it's done.
     virtual bool AppendJob(Runnable *runnable, bool auto_release = false);
 
+    /// Same as above, but allocates nothing.
+    virtual bool AppendJob(IntrusiveRunnable *runnable, bool auto_release = false);
+
     /// Only implemented on *nix;
     virtual bool KillAll(int signum);
 
@@ -60,19 +62,18 @@ protected:
     virtual internal::ThreadJob *RequestJob(internal::Thread *thread);
 
 private:
-    typedef std::set<internal::Thread *> actives_t;
     typedef std::vector<internal::Thread *> threads_t;
 
     /// Will not block. No lock.
     /// @return NULL if no jobs are available.
     bool TryRequestJob(internal::ThreadJob **job);
 
+    /// Append the job or release it.
+    bool AppendThreadJob(internal::ThreadJob *job);
+
     /// Batch spawn threads. No lock.
     void Spawn(size_t size);
 
-    /// Threads that have jobs running.
-    actives_t _actives;
-
     /// Threads.
     threads_t _threads;
 
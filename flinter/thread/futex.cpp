@@ -0,0 +1,109 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flinter/thread/lock_statistics.h"
+
+#include "config.h"
+#if defined(__linux__)
+
+#include <errno.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "flinter/thread/futex.h"
+
+namespace flinter {
+namespace internal {
+
+// Roughly a context switch.
+static const int kMaximumSpins = 100;
+
+#if ENABLE_LOCK_STATISTICS
+atomic64_t g_lock_counters[kLockCounters];
+#endif
+
+int FutexWait(int *futex, int value, int64_t timeout)
+{
+    struct timespec ts;
+    struct timespec *pts = NULL;
+    if (timeout >= 0) {
+        ts.tv_sec = static_cast<time_t>(timeout / 1000000000LL);
+        ts.tv_nsec = static_cast<long>(timeout % 1000000000LL);
+        pts = &ts;
+    }
+
+    LOCK_STATISTICS(kLockSlept);
+    long ret = syscall(SYS_futex, futex, FUTEX_WAIT_PRIVATE, value, pts, NULL, 0);
+    if (ret == 0 || errno == EAGAIN || errno == EINTR) {
+        return 0;
+    }
+
+    return -1;
+}
+
+int FutexWake(int *futex, int count)
+{
+    LOCK_STATISTICS(kLockWoken);
+    long ret = syscall(SYS_futex, futex, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+    return ret < 0 ? 0 : static_cast<int>(ret);
+}
+
+int GetSpinLimit()
+{
+    // Spinning on a single CPU only delays the owner.
+    static int limit = -1;
+    if (limit < 0) {
+        limit = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? kMaximumSpins : 0;
+    }
+
+    return limit;
+}
+
+} // namespace internal
+} // namespace flinter
+
+#endif // defined(__linux__)
+
+namespace flinter {
+
+bool GetLockStatistics(LockStatistics *statistics, bool reset)
+{
+#if defined(__linux__) && ENABLE_LOCK_STATISTICS
+    int64_t *counters[internal::kLockCounters] = {
+        &statistics->contended,
+        &statistics->spun,
+        &statistics->slept,
+        &statistics->woken,
+    };
+
+    for (int i = 0; i < internal::kLockCounters; ++i) {
+        atomic64_t *counter = &internal::g_lock_counters[i];
+        *counters[i] = reset ? counter->BarrierSet(0) : counter->BarrierGet();
+    }
+
+    return true;
+#else
+    statistics->contended = 0;
+    statistics->spun = 0;
+    statistics->slept = 0;
+    statistics->woken = 0;
+    (void)reset;
+    return false;
+#endif
+}
+
+} // namespace flinter
@@ -0,0 +1,73 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLINTER_THREAD_FUTEX_H
+#define FLINTER_THREAD_FUTEX_H
+
+#include <stdint.h>
+
+#include <flinter/types/atomic.h>
+
+// Linux only, include after config.h for ENABLE_LOCK_STATISTICS.
+
+namespace flinter {
+namespace internal {
+
+/// Sleep if *futex is still value.
+/// @param timeout <0 means infinity.
+/// @return 0 if woken up, maybe spuriously, or -1 with errno.
+extern int FutexWait(int *futex, int value, int64_t timeout);
+
+/// @return how many are woken up.
+extern int FutexWake(int *futex, int count);
+
+/// How many rounds to spin before sleeping, 0 if there's only one CPU.
+extern int GetSpinLimit();
+
+/// Read without barriers, for spinning.
+inline int FutexGet(const int *futex)
+{
+    return *static_cast<const volatile int *>(futex);
+}
+
+/// Tell the CPU that we're spinning.
+inline void CpuRelax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__ ("pause" ::: "memory");
+#else
+    __asm__ __volatile__ ("" ::: "memory");
+#endif
+}
+
+#if ENABLE_LOCK_STATISTICS
+enum LockCounter {
+    kLockContended,
+    kLockSpun,
+    kLockSlept,
+    kLockWoken,
+    kLockCounters,
+}; // enum LockCounter
+
+extern atomic64_t g_lock_counters[kLockCounters];
+# define LOCK_STATISTICS(c) internal::g_lock_counters[internal::c].AddAndFetch(1)
+#else
+# define LOCK_STATISTICS(c) do {} while (false)
+#endif
+
+} // namespace internal
+} // namespace flinter
+
+#endif // FLINTER_THREAD_FUTEX_H
@@ -25,7 +25,8 @@
 
 namespace flinter {
 
-GrowableThreadPool::GrowableThreadPool() : _exits(0)
+GrowableThreadPool::GrowableThreadPool() : _actives(0)
+                                         , _exits(0)
                                          , _size(0)
                                          , _initializing(false)
 {
@@ -75,17 +76,25 @@ bool GrowableThreadPool::Shutdown(bool wait_for_jobs_done)
     _exits = _threads.size();
 
     // Kill active threads.
-    if (!wait_for_jobs_done && !_actives.empty()) {
-        CLOG.Verbose("ThreadPool: terminating %lu threads...", _actives.size());
-        for (actives_t::iterator p = _actives.begin(); p != _actives.end(); ++p) {
+    if (!wait_for_jobs_done && _actives) {
+        CLOG.Verbose("ThreadPool: terminating %lu threads...", _actives);
+        for (threads_t::iterator p = _threads.begin(); p != _threads.end(); ++p) {
             internal::Thread *thread = *p;
-            thread->Terminate();
+            if (thread->active()) {
+                thread->Terminate();
+            }
         }
 
-        _exits -= _actives.size();
+        _exits -= _actives;
     }
 
-    _actives.clear();
+    // Threads coming back don't count.
+    for (threads_t::iterator p = _threads.begin(); p != _threads.end(); ++p) {
+        internal::Thread *thread = *p;
+        thread->set_active(false);
+    }
+
+    _actives = 0;
     threads_t threads;
     threads.swap(_threads);
     _job_available.WakeAll();
@@ -125,7 +134,11 @@ internal::ThreadJob *GrowableThreadPool::RequestJob(internal::Thread *thread)
 {
     assert(thread);
     MutexLocker locker(&_mutex);
-    _actives.erase(thread);
+    if (thread->active()) {
+        thread->set_active(false);
+        --_actives;
+    }
+
     MaybeShrink();
 
     internal::ThreadJob *job;
@@ -134,7 +147,8 @@ internal::ThreadJob *GrowableThreadPool::RequestJob(internal::Thread *thread)
     }
 
     if (job) {
-        _actives.insert(thread);
+        thread->set_active(true);
+        ++_actives;
 
     } else if (!_initializing) {
         _exited.push_back(thread);
@@ -153,7 +167,7 @@ void GrowableThreadPool::MaybeShrink()
 
     size_t extra = _size / 2 + _size % 2;
     size_t threshold = _size + extra;
-    size_t idles = _threads.size() - _actives.size()
+    size_t idles = _threads.size() - _actives
                  - _pending_jobs.size() - _exits;
 
     if (idles < threshold) {
@@ -200,14 +214,30 @@ bool GrowableThreadPool::AppendJob(Runnable *runnable, bool auto_release)
         return false;
     }
 
+    return AppendThreadJob(NewThreadJob(runnable, auto_release));
+}
+
+bool GrowableThreadPool::AppendJob(IntrusiveRunnable *runnable, bool auto_release)
+{
+    assert(runnable);
+    if (!runnable) {
+        return false;
+    }
+
+    return AppendThreadJob(NewThreadJob(runnable, auto_release));
+}
+
+bool GrowableThreadPool::AppendThreadJob(internal::ThreadJob *job)
+{
     MutexLocker locker(&_mutex);
     if (_initializing) {
+        internal::ThreadJob::Release(job);
         return false;
     }
 
-    _pending_jobs.push_back(new internal::ThreadJob(runnable, auto_release));
+    _pending_jobs.push_back(job);
 
-    size_t remains = _threads.size() - _actives.size() - _exits;
+    size_t remains = _threads.size() - _actives - _exits;
     if (remains < _pending_jobs.size()) {
         Spawn(_size);
     }
@@ -225,9 +255,11 @@ bool GrowableThreadPool::KillAll(int signum)
 
     bool result = true;
 
-    for (actives_t::iterator p = _actives.begin(); p != _actives.end(); ++p) {
+    for (threads_t::iterator p = _threads.begin(); p != _threads.end(); ++p) {
         internal::Thread *thread = *p;
-        result &= thread->Kill(signum);
+        if (thread->active()) {
+            result &= thread->Kill(signum);
+        }
     }
 
     return result;
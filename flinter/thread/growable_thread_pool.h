@@ -51,6 +51,9 @@ public:
     /// @param auto_release to delete runnable when it's done.
     virtual bool AppendJob(Runnable *runnable, bool auto_release = false);
 
+    /// Same as above, but allocates nothing.
+    virtual bool AppendJob(IntrusiveRunnable *runnable, bool auto_release = false);
+
     /// Only implemented on *nix;
     virtual bool KillAll(int signum);
 
@@ -60,7 +63,6 @@ protected:
     virtual internal::ThreadJob *RequestJob(internal::Thread *thread);
 
 private:
-    typedef std::set<internal::Thread *> actives_t;
     typedef std::set<internal::Thread *> threads_t;
     typedef std::list<internal::Thread *> exited_t;
 
@@ -68,14 +70,17 @@ private:
     /// @return NULL if no jobs are available.
     bool TryRequestJob(internal::ThreadJob **job);
 
+    /// Append the job or release it.
+    bool AppendThreadJob(internal::ThreadJob *job);
+
     /// Batch spawn threads. No lock.
     void Spawn(size_t size);
 
     /// Batch destroy threads. No lock.
     void MaybeShrink();
 
-    /// Threads that have jobs running.
-    actives_t _actives;
+    /// How many threads have jobs running.
+    size_t _actives;
 
     /// Threads that are exited.
     exited_t _exited;
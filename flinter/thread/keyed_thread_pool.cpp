@@ -15,6 +15,8 @@
 
 #include "flinter/thread/keyed_thread_pool.h"
 
+#include <sched.h>
+
 #include <algorithm>
 
 #include "flinter/thread/mutex_locker.h"
@@ -22,10 +24,16 @@
 #include "flinter/thread/thread_job.h"
 #include "flinter/logger.h"
 #include "flinter/runnable.h"
+#include "flinter/utility.h"
 
 namespace flinter {
 
-KeyedThreadPool::KeyedThreadPool() : _initializing(false)
+KeyedThreadPool::KeyedThreadPool() : _buckets(NULL)
+                                   , _migration(0)
+                                   , _ready(0)
+                                   , _appending(0)
+                                   , _stopping(0)
+                                   , _initializing(false)
 {
     // Intended left blank.
 }
@@ -46,21 +54,38 @@ bool KeyedThreadPool::Initialize(size_t size)
         return false;
     }
 
-    Spawn(size);
+    if (_migration > 0) {
+        _buckets = new Bucket[kMigrationBuckets];
+        for (size_t i = 0; i < kMigrationBuckets; ++i) {
+            _buckets[i]._state.Set(static_cast<uint64_t>(i % size) << 32);
+        }
+    }
+
+    _migrations.Set(0);
+
+    // Appenders walk through all contexts, publish them once complete.
+    threads_t threads;
+    Spawn(size, &threads);
+    _threads.swap(threads);
+    _ready.BarrierSet(1);
     return true;
 }
 
-void KeyedThreadPool::Spawn(size_t size)
+void KeyedThreadPool::Spawn(size_t size, threads_t *threads)
 {
-    assert(_threads.empty());
+    threads->reserve(size);
+    for (size_t i = 0; i < size; i++) {
+        Context *context = new Context;
+        context->_running = 0;
+        context->_thread = NULL;
+        threads->push_back(context);
+    }
 
+    // Threads only look at their own context.
     CLOG.Verbose("ThreadPool: spawning %lu threads...", size);
-    _threads.reserve(size);
     for (size_t i = 0; i < size; i++) {
-        Context *context = new Context;
-        internal::Thread *thread = new internal::Thread(this, context);
-        context->_thread = thread;
-        _threads.push_back(context);
+        Context *context = (*threads)[i];
+        context->_thread = new internal::Thread(this, context);
     }
 }
 
@@ -73,80 +98,162 @@ bool KeyedThreadPool::Shutdown(bool wait_for_jobs_done)
         return true;
     }
 
-    // Purge any jobs that are not yet scheduled.
+    // Appenders might still be looking at contexts.
+    _ready.BarrierSet(0);
+    while (_appending.BarrierGet()) {
+        sched_yield();
+    }
+
+    _stopping.BarrierSet(1);
+
     for (threads_t::iterator p = _threads.begin(); p != _threads.end(); ++p) {
         Context *context = *p;
-        Purge(&context->_pending_jobs);
+        MutexLocker l(&context->_mutex);
         context->_job_available.WakeOne();
     }
 
     // Kill active threads.
-    if (!wait_for_jobs_done && !_actives.empty()) {
-        CLOG.Verbose("ThreadPool: terminating %lu threads...", _actives.size());
-        for (actives_t::iterator p = _actives.begin(); p != _actives.end(); ++p) {
-            internal::Thread *thread = *p;
-            thread->Terminate();
+    if (!wait_for_jobs_done) {
+        for (threads_t::iterator p = _threads.begin(); p != _threads.end(); ++p) {
+            Context *context = *p;
+            if (context->_active.Get()) {
+                CLOG.Verbose("ThreadPool: terminating thread [%p]...",
+                             context->_thread);
+
+                context->_thread->Terminate();
+            }
         }
     }
 
-    _actives.clear();
-    threads_t threads;
-    threads.swap(_threads);
-
     _initializing = true;
     locker.Unlock();
 
-    CLOG.Verbose("ThreadPool: joining %lu threads...", threads.size());
-    for (threads_t::iterator p = threads.begin(); p != threads.end(); ++p) {
+    // Nobody else touches _threads now.
+    CLOG.Verbose("ThreadPool: joining %lu threads...", _threads.size());
+    for (threads_t::iterator p = _threads.begin(); p != _threads.end(); ++p) {
         Context *context = *p;
         context->_thread->Join();
         delete context->_thread;
+    }
+
+    // Purge any jobs that are not yet scheduled.
+    job_list_t jobs;
+    for (threads_t::iterator p = _threads.begin(); p != _threads.end(); ++p) {
+        Context *context = *p;
+        while (internal::ThreadJob *job = context->_pending_jobs.Pop()) {
+            jobs.push_back(job);
+        }
+
         delete context;
     }
 
+    Purge(&jobs);
+    delete [] _buckets;
+    _buckets = NULL;
+
     locker.Relock();
+    _threads.clear();
+    _stopping.BarrierSet(0);
     _initializing = false;
     return true;
 }
 
-bool KeyedThreadPool::TryRequestJob(Context *context,
-                                    internal::ThreadJob **job)
+void KeyedThreadPool::Finish(Context *context)
 {
-    if (_initializing) {
-        *job = NULL;
-        return true;
+    context->_active.Set(0);
+    if (!context->_running) {
+        return;
     }
 
-    if (context->_pending_jobs.empty()) {
-        return false;
-    }
+    Bucket *bucket = &_buckets[context->_running - 1];
+    context->_running = 0;
 
-    *job = context->_pending_jobs.front();
-    context->_pending_jobs.pop_front();
-    return true;
+    if ((bucket->_state.SubAndFetch(1) & 0xFFFFFFFFu) == 0) {
+        bucket->_idle_since.Set(get_monotonic_timestamp());
+    }
 }
 
 internal::ThreadJob *KeyedThreadPool::RequestJob(internal::Thread *thread)
 {
     assert(thread);
-    MutexLocker locker(&_mutex);
-    _actives.erase(thread);
-
     Context *context = reinterpret_cast<Context *>(thread->parameter());
     assert(context);
+    Finish(context);
+
+    internal::ThreadJob *job = NULL;
+    while (!_stopping.BarrierGet()) {
+        if ((job = context->_pending_jobs.Pop())) {
+            break;
+        }
+
+        // Appenders check it after pushing, and we pop after announcing, one
+        // of us must see the other.
+        MutexLocker locker(&context->_mutex);
+        context->_sleeping.Set(1);
+        __sync_synchronize();
+
+        job = context->_pending_jobs.Pop();
+        if (!job && !_stopping.Get()) {
+            context->_job_available.Wait(&context->_mutex);
+        }
 
-    internal::ThreadJob *job;
-    while (!TryRequestJob(context, &job)) {
-        context->_job_available.Wait(&_mutex);
+        context->_sleeping.Set(0);
+        if (job) {
+            break;
+        }
     }
 
     if (job) {
-        _actives.insert(thread);
+        context->_depth.SubAndFetch(1);
+        context->_running = job->tag;
+        context->_active.Set(1);
     }
 
     return job;
 }
 
+size_t KeyedThreadPool::Bind(size_t key, internal::ThreadJob *job)
+{
+    if (!_buckets) {
+        job->tag = 0;
+        return key % _threads.size();
+    }
+
+    size_t index = key % kMigrationBuckets;
+    Bucket *bucket = &_buckets[index];
+    job->tag = index + 1;
+
+    // Only move idle buckets, so that jobs of a key never run concurrently.
+    uint64_t state = bucket->_state.Get();
+    while (true) {
+        size_t thread = static_cast<size_t>(state >> 32);
+        if ((state & 0xFFFFFFFFu) == 0 &&
+            get_monotonic_timestamp() - bucket->_idle_since.Get() >= _migration) {
+
+            size_t depth = _threads[thread]->_depth.Get();
+            for (size_t i = 0; i < _threads.size(); ++i) {
+                size_t d = _threads[i]->_depth.Get();
+                if (d < depth) {
+                    depth = d;
+                    thread = i;
+                }
+            }
+        }
+
+        uint64_t next = (static_cast<uint64_t>(thread) << 32) | ((state + 1) & 0xFFFFFFFFu);
+        uint64_t previous = bucket->_state.CompareAndSwap(state, next);
+        if (previous == state) {
+            if ((previous >> 32) != thread) {
+                _migrations.AddAndFetch(1);
+            }
+
+            return thread;
+        }
+
+        state = previous;
+    }
+}
+
 bool KeyedThreadPool::AppendJobWithKey(size_t key,
                                        Runnable *runnable,
                                        bool auto_release)
@@ -156,21 +263,79 @@ bool KeyedThreadPool::AppendJobWithKey(size_t key,
         return false;
     }
 
-    MutexLocker locker(&_mutex);
-    if (_initializing) {
+    return AppendThreadJobWithKey(key, NewThreadJob(runnable, auto_release));
+}
+
+bool KeyedThreadPool::AppendJobWithKey(size_t key,
+                                       IntrusiveRunnable *runnable,
+                                       bool auto_release)
+{
+    assert(runnable);
+    if (!runnable) {
+        return false;
+    }
+
+    return AppendThreadJobWithKey(key, NewThreadJob(runnable, auto_release));
+}
+
+bool KeyedThreadPool::AppendThreadJobWithKey(size_t key, internal::ThreadJob *job)
+{
+    // Shutdown() waits for us before tearing contexts down.
+    _appending.AddAndFetch(1);
+    if (!_ready.BarrierGet()) {
+        _appending.SubAndFetch(1);
+        internal::ThreadJob::Release(job);
         return false;
     }
 
-    size_t size = _threads.size();
-    size_t index = key % size;
-    Context *context = _threads[index];
+    Context *context = _threads[Bind(key, job)];
+    size_t depth = context->_depth.AddAndFetch(1);
+    size_t maximum = context->_maximum_depth.Get();
+    while (depth > maximum) {
+        size_t previous = context->_maximum_depth.CompareAndSwap(maximum, depth);
+        if (previous == maximum) {
+            break;
+        }
+
+        maximum = previous;
+    }
 
-    internal::ThreadJob *job = new internal::ThreadJob(runnable, auto_release);
-    context->_pending_jobs.push_back(job);
-    context->_job_available.WakeOne();
+    context->_pending_jobs.Push(job);
+    __sync_synchronize();
+    if (context->_sleeping.Get()) {
+        MutexLocker locker(&context->_mutex);
+        context->_job_available.WakeOne();
+    }
+
+    _appending.SubAndFetch(1);
     return true;
 }
 
+size_t KeyedThreadPool::GetQueueDepth(size_t index) const
+{
+    size_t depth = 0;
+    _appending.AddAndFetch(1);
+    if (_ready.BarrierGet() && index < _threads.size()) {
+        depth = _threads[index]->_depth.Get();
+    }
+
+    _appending.SubAndFetch(1);
+    return depth;
+}
+
+size_t KeyedThreadPool::GetMaximumQueueDepth(size_t index, bool reset)
+{
+    size_t depth = 0;
+    _appending.AddAndFetch(1);
+    if (_ready.BarrierGet() && index < _threads.size()) {
+        Atomic<size_t> *maximum = &_threads[index]->_maximum_depth;
+        depth = reset ? maximum->BarrierSet(0) : maximum->Get();
+    }
+
+    _appending.SubAndFetch(1);
+    return depth;
+}
+
 bool KeyedThreadPool::KillAll(int signum)
 {
     MutexLocker locker(&_mutex);
@@ -180,9 +345,11 @@ bool KeyedThreadPool::KillAll(int signum)
 
     bool result = true;
 
-    for (actives_t::iterator p = _actives.begin(); p != _actives.end(); ++p) {
-        internal::Thread *thread = *p;
-        result &= thread->Kill(signum);
+    for (threads_t::iterator p = _threads.begin(); p != _threads.end(); ++p) {
+        Context *context = *p;
+        if (context->_active.Get()) {
+            result &= context->_thread->Kill(signum);
+        }
     }
 
     return result;
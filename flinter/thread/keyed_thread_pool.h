@@ -16,12 +16,15 @@
 #ifndef FLINTER_THREAD_KEYED_THREAD_POOL_H
 #define FLINTER_THREAD_KEYED_THREAD_POOL_H
 
-#include <set>
+#include <stdint.h>
+
 #include <vector>
 
 #include <flinter/thread/abstract_thread_pool.h>
 #include <flinter/thread/condition.h>
 #include <flinter/thread/mutex.h>
+#include <flinter/types/atomic.h>
+#include <flinter/types/mpsc_queue.h>
 #include <flinter/common.h>
 
 namespace flinter {
@@ -32,7 +35,12 @@ class ThreadJob;
 
 class Runnable;
 
-/// KeyedThreadPool holds threads.
+/// KeyedThreadPool holds threads, jobs with the same key run in order.
+///
+/// Each thread has its own lock free queue, appending takes no locks unless
+/// the thread is sleeping. Keys are bound to threads by key % size, or if
+/// migration is enabled, keys which have been idle for a while move to the
+/// thread with the shortest queue when they come back.
 class KeyedThreadPool : public AbstractThreadPool {
 public:
     explicit KeyedThreadPool();  ///< Constructor.
@@ -56,13 +64,53 @@ public:
         return AppendJobWithKey(0, runnable, auto_release);
     }
 
+    /// Same as above, but allocates nothing.
+    virtual bool AppendJob(IntrusiveRunnable *runnable, bool auto_release = false)
+    {
+        return AppendJobWithKey(0, runnable, auto_release);
+    }
+
     virtual bool AppendJobWithKey(size_t key,
                                   Runnable *runnable,
                                   bool auto_release = false);
 
+    /// Same as above, but allocates nothing.
+    virtual bool AppendJobWithKey(size_t key,
+                                  IntrusiveRunnable *runnable,
+                                  bool auto_release = false);
+
     /// Only implemented on *nix;
     virtual bool KillAll(int signum);
 
+    /// Keys with no jobs queued or running for that long can be moved to
+    /// another thread, 0 to disable, which is the default.
+    /// Keys share kMigrationBuckets buckets, and buckets are moved together.
+    /// @warning only call before Initialize().
+    void set_migration(int64_t idle_timeout)
+    {
+        _migration = idle_timeout;
+    }
+
+    /// Thread count.
+    size_t size() const
+    {
+        return _threads.size();
+    }
+
+    /// Jobs queued but not yet taken by the thread, to spot skews.
+    size_t GetQueueDepth(size_t index) const;
+
+    /// The deepest the queue has been.
+    size_t GetMaximumQueueDepth(size_t index, bool reset = false);
+
+    /// How many times keys are moved since initialized.
+    int64_t migrations() const
+    {
+        return _migrations.Get();
+    }
+
+    static const size_t kMigrationBuckets = 4096;
+
 protected:
     /// Called by internal::Thread.
     /// @return NULL to exit the worker thread.
@@ -71,27 +119,56 @@ protected:
 private:
     class Context {
     public:
-        job_list_t _pending_jobs;
+        IntrusiveMpscQueue<internal::ThreadJob> _pending_jobs;
+        Atomic<size_t> _maximum_depth;
+        Atomic<size_t> _depth;
+        atomic_t _sleeping;
+        atomic_t _active;
+        size_t _running;            ///< Tag of the running job.
+
         Condition _job_available;
+        Mutex _mutex;
+
         internal::Thread *_thread;
     }; // class Context
 
-    typedef std::set<internal::Thread *> actives_t;
+    // Thread index in higher 32 bits, jobs queued or running in lower.
+    class Bucket {
+    public:
+        Bucket() : _state(0), _idle_since(0) {}
+        uatomic64_t _state;
+        atomic64_t _idle_since;
+    }; // class Bucket
+
     typedef std::vector<Context *> threads_t;
 
-    /// Will not block. No lock.
-    /// @return NULL if no jobs are available.
-    bool TryRequestJob(Context *context, internal::ThreadJob **job);
+    /// Append the job or release it. No lock.
+    bool AppendThreadJobWithKey(size_t key, internal::ThreadJob *job);
 
-    /// Batch spawn threads. No lock.
-    void Spawn(size_t size);
+    /// Bind a job to a thread by its bucket, might move the bucket.
+    size_t Bind(size_t key, internal::ThreadJob *job);
 
-    /// Threads that have jobs running.
-    actives_t _actives;
+    /// The running job of the context is done.
+    void Finish(Context *context);
+
+    /// Batch spawn threads. No lock.
+    void Spawn(size_t size, threads_t *threads);
 
-    /// Threads.
+    /// Threads, published by _ready and never changes while it's set.
     threads_t _threads;
 
+    /// Buckets if migration is enabled.
+    Bucket *_buckets;
+    int64_t _migration;
+    atomic64_t _migrations;
+
+    /// Accepting jobs, and how many are appending or looking at _threads.
+    atomic_t _ready;
+    mutable atomic_t _appending;
+
+    /// Stop scheduling jobs.
+    atomic_t _stopping;
+
     /// Critical lock.
     bool _initializing;
 
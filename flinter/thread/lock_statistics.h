@@ -0,0 +1,38 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLINTER_THREAD_LOCK_STATISTICS_H
+#define FLINTER_THREAD_LOCK_STATISTICS_H
+
+#include <stdint.h>
+
+namespace flinter {
+
+/// Contentions of all Mutex, Condition and Semaphore in the process.
+struct LockStatistics {
+    int64_t contended;  ///< Found it taken when locking or acquiring.
+    int64_t spun;       ///< Then got it by spinning.
+    int64_t slept;      ///< Went to sleep in the kernel.
+    int64_t woken;      ///< Called the kernel to wake others up.
+}; // struct LockStatistics
+
+/// Only counted if configured with --enable-lock-statistics, since counting
+/// adds atomic operations to slow paths.
+/// @return false if not counted, and statistics are all zeros.
+extern bool GetLockStatistics(LockStatistics *statistics, bool reset = false);
+
+} // namespace flinter
+
+#endif // FLINTER_THREAD_LOCK_STATISTICS_H
@@ -17,10 +17,13 @@
 
 #include <errno.h>
 
+#include <algorithm>
 #include <stdexcept>
 
 #include "config.h"
-#if defined(WIN32)
+#if defined(__linux__)
+# include "flinter/thread/futex.h"
+#elif defined(WIN32)
 # include <Windows.h>
 #elif HAVE_PTHREAD_H
 # include <pthread.h>
@@ -30,6 +33,66 @@
 
 namespace flinter {
 
+#if defined(__linux__)
+Mutex::Mutex() : _futex(0), _spins(0)
+{
+    // Intended left blank.
+}
+
+Mutex::~Mutex()
+{
+    // Intended left blank.
+}
+
+void Mutex::Lock()
+{
+    if (__sync_bool_compare_and_swap(&_futex, 0, 1)) {
+        return;
+    }
+
+    // Spin about as long as it took last times, the owner is likely running on
+    // another CPU and about to unlock, which is cheaper than sleeping.
+    LOCK_STATISTICS(kLockContended);
+    int limit = std::min(internal::GetSpinLimit(), _spins * 2 + 10);
+    for (int i = 0; i < limit; ++i) {
+        internal::CpuRelax();
+        if (internal::FutexGet(&_futex) == 0 &&
+            __sync_bool_compare_and_swap(&_futex, 0, 1)) {
+
+            LOCK_STATISTICS(kLockSpun);
+            _spins += (i - _spins) / 8;
+            return;
+        }
+    }
+
+    LockContended();
+    _spins += (limit - _spins) / 8;
+}
+
+void Mutex::LockContended()
+{
+    // Once slept, always mark it contended so that unlocking wakes others.
+    while (__sync_lock_test_and_set(&_futex, 2) != 0) {
+        if (internal::FutexWait(&_futex, 2, -1)) {
+            throw std::runtime_error("Mutex::Lock()");
+        }
+    }
+}
+
+void Mutex::Unlock()
+{
+    if (__sync_fetch_and_sub(&_futex, 1) != 1) {
+        __sync_lock_release(&_futex);
+        internal::FutexWake(&_futex, 1);
+    }
+}
+
+bool Mutex::TryLock()
+{
+    return __sync_bool_compare_and_swap(&_futex, 0, 1);
+}
+
+#else
 Mutex::Mutex() : _context(NULL)
 {
 #ifdef WIN32
@@ -99,4 +162,6 @@ bool Mutex::TryLock()
     }
 }
 
+#endif
+
 } // namespace flinter
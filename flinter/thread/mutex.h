@@ -20,7 +20,8 @@
 
 namespace flinter {
 
-/// POSIX mutex, might or might not be recursive.
+/// Futex on Linux, which spins a while before sleeping, POSIX mutex otherwise,
+/// might or might not be recursive.
 class Mutex {
 public:
     friend class Condition;
@@ -34,8 +35,15 @@ public:
     bool TryLock();                     ///< Immediately returns.
 
 private:
+#if defined(__linux__)
+    void LockContended();               ///< Sleep until locked.
+
+    int _futex;                         ///< 0 unlocked, 1 locked, 2 contended.
+    int _spins;                         ///< Average spins before locked.
+#else
     class Context;                      ///< Internally used.
     Context *_context;                  ///< Internally used.
+#endif
 
     NON_COPYABLE(Mutex);                ///< Don't copy me.
 
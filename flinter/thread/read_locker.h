@@ -18,26 +18,28 @@
 
 #include <assert.h>
 
+#include <flinter/thread/distributed_read_write_lock.h>
 #include <flinter/thread/read_write_lock.h>
 #include <flinter/common.h>
 
 namespace flinter {
 
-/// ReadLocker automatically read locks a rw lock when constructed and then unlocks it when
-/// deconstructed.
-/// @warning ReadLocker itself is not thread safe.
-class ReadLocker {
+/// BasicReadLocker automatically read locks a rw lock when constructed and then
+/// unlocks it when deconstructed, ReadWriteLock or DistributedReadWriteLock.
+/// @warning BasicReadLocker itself is not thread safe.
+template <class T>
+class BasicReadLocker {
 public:
     /// Constructor.
     /// @warning Don't operate the rw lock since on.
-    ReadLocker(ReadWriteLock *read_write_lock) : _read_write_lock(read_write_lock), _locked(true)
+    BasicReadLocker(T *read_write_lock) : _read_write_lock(read_write_lock), _locked(true)
     {
         assert(read_write_lock);
         _read_write_lock->ReaderLock();
     }
 
     /// Destructor.
-    ~ReadLocker()
+    ~BasicReadLocker()
     {
         Unlock();
     }
@@ -60,11 +62,14 @@ public:
     }
 
 private:
-    NON_COPYABLE(ReadLocker);           ///< Don't copy me.
+    NON_COPYABLE(BasicReadLocker);      ///< Don't copy me.
 
-    ReadWriteLock *_read_write_lock;    ///< rw lock instance.
+    T *_read_write_lock;                ///< rw lock instance.
     bool _locked;                       ///< Remember state.
-}; // class ReadLocker
+}; // class BasicReadLocker
+
+typedef BasicReadLocker<ReadWriteLock> ReadLocker;
+typedef BasicReadLocker<DistributedReadWriteLock> DistributedReadLocker;
 
 } // namespace flinter
 
@@ -21,7 +21,9 @@
 #include <stdexcept>
 
 #include "config.h"
-#if defined(WIN32)
+#if defined(__linux__)
+# include "flinter/thread/futex.h"
+#elif defined(WIN32)
 # include <Windows.h>
 # define H reinterpret_cast<HANDLE *>(_context)
 #elif defined(__MACH__)
@@ -36,6 +38,74 @@
 
 namespace flinter {
 
+#if defined(__linux__)
+Semaphore::Semaphore(int initial_count) : _count(initial_count), _waiters(0)
+{
+    assert(initial_count >= 0);
+}
+
+Semaphore::~Semaphore()
+{
+    // Intended left blank.
+}
+
+bool Semaphore::TryAcquire()
+{
+    int count = internal::FutexGet(&_count);
+    while (count > 0) {
+        int old = __sync_val_compare_and_swap(&_count, count, count - 1);
+        if (old == count) {
+            return true;
+        }
+
+        count = old;
+    }
+
+    return false;
+}
+
+void Semaphore::Acquire()
+{
+    if (TryAcquire()) {
+        return;
+    }
+
+    LOCK_STATISTICS(kLockContended);
+    int limit = internal::GetSpinLimit();
+    for (int i = 0; i < limit; ++i) {
+        internal::CpuRelax();
+        if (internal::FutexGet(&_count) > 0 && TryAcquire()) {
+            LOCK_STATISTICS(kLockSpun);
+            return;
+        }
+    }
+
+    // Announce before checking again, releasing checks in the reverse order.
+    __sync_add_and_fetch(&_waiters, 1);
+    while (!TryAcquire()) {
+        if (internal::FutexWait(&_count, 0, -1)) {
+            __sync_sub_and_fetch(&_waiters, 1);
+            throw std::runtime_error("Semaphore::Acquire()");
+        }
+    }
+
+    __sync_sub_and_fetch(&_waiters, 1);
+}
+
+void Semaphore::Release(int count)
+{
+    assert(count > 0);
+    if (!count) {
+        return;
+    }
+
+    __sync_add_and_fetch(&_count, count);
+    if (internal::FutexGet(&_waiters)) {
+        internal::FutexWake(&_count, count);
+    }
+}
+
+#else
 Semaphore::Semaphore(int initial_count) : _context(NULL)
 {
     assert(initial_count >= 0);
@@ -139,4 +209,6 @@ bool Semaphore::TryAcquire()
     }
 }
 
+#endif
+
 } // namespace flinter
@@ -20,7 +20,7 @@
 
 namespace flinter {
 
-/// POSIX semaphore.
+/// Futex on Linux, POSIX semaphore otherwise.
 class Semaphore {
 public:
     /// Not all implementations support maximum count.
@@ -40,8 +40,13 @@ public:
     void Release(int count = 1);
 
 private:
+#if defined(__linux__)
+    int _count;                             ///< Available count.
+    int _waiters;                           ///< Skip waking if none.
+#else
     class Context;                          ///< Internally used.
     Context *_context;                      ///< Internally used.
+#endif
 
     NON_COPYABLE(Semaphore);                ///< Don't copy me.
 
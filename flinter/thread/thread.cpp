@@ -57,6 +57,7 @@ Thread::Thread(AbstractThreadPool *pool, void *parameter)
         : _parameter(parameter)
         , _context(NULL)
         , _pool(pool)
+        , _active(false)
 {
     assert(pool);
 
@@ -124,16 +125,19 @@ void Thread::ThreadDaemon()
     Logger::ThreadAttach();
 
     while ((job = RequestJob())) {
-        CLOG.Verbose("Thread: executing job [%p]", job->runnable());
-        job->runnable()->Run();
-        if (job->auto_release()) {
-            delete job->runnable();
-            CLOG.Verbose("Thread: done exeuting job [%p], auto released.", job);
+        // Intrusive runnables might be appended again once running.
+        Runnable *runnable = job->runnable();
+        bool auto_release = job->auto_release();
+        ThreadJob::Release(job);
+
+        CLOG.Verbose("Thread: executing job [%p]", runnable);
+        runnable->Run();
+        if (auto_release) {
+            CLOG.Verbose("Thread: done exeuting job [%p], auto released.", runnable);
+            delete runnable;
         } else {
-            CLOG.Verbose("Thread: done exeuting job [%p], not released.", job);
+            CLOG.Verbose("Thread: done exeuting job [%p], not released.", runnable);
         }
-
-        delete job;
     }
 
     Logger::ThreadDetach();
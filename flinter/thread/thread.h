@@ -58,6 +58,17 @@ public:
         return _parameter;
     }
 
+    /// Running a job, maintained by the pool under its own lock.
+    bool active() const
+    {
+        return _active;
+    }
+
+    void set_active(bool active)
+    {
+        _active = active;
+    }
+
 private:
     NON_COPYABLE(Thread);       ///< Don't copy me.
 
@@ -66,6 +77,7 @@ private:
     void *_parameter;           ///< ThreadPool parameter.
     ThreadContext *_context;    ///< Internally used.
     AbstractThreadPool *_pool;  ///< ThreadPool instance.
+    bool _active;               ///< Running a job.
 
 }; // class Thread
 
@@ -0,0 +1,167 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flinter/thread/thread_job.h"
+
+#include <assert.h>
+#include <pthread.h>
+
+#include "flinter/types/mpsc_queue.h"
+
+namespace flinter {
+namespace internal {
+
+/// Jobs allocated by a thread, given back by whichever thread runs them.
+class ThreadJobCache {
+public:
+    ThreadJobCache() : _free(NULL), _references(1) {}
+
+    /// Nobody's giving back now.
+    ~ThreadJobCache()
+    {
+        Drain();
+        while (ThreadJob *job = _returned.Pop()) {
+            delete job;
+        }
+    }
+
+    ThreadJob *Get()
+    {
+        ThreadJob *job = _free;
+        if (job) {
+            _free = job->next.Get();
+        } else if (!(job = _returned.Pop())) {
+            job = new ThreadJob;
+            job->_storage = ThreadJob::kStorageCache;
+            job->_cache = this;
+        }
+
+        _references.AddAndFetch(1);
+        return job;
+    }
+
+    /// @param owner called by the thread owning the cache.
+    void Put(ThreadJob *job, bool owner)
+    {
+        if (owner) {
+            job->next.Set(_free);
+            _free = job;
+        } else {
+            _returned.Push(job);
+        }
+
+        Unref();
+    }
+
+    /// Called when the owner exits, jobs out there keep us alive.
+    void Drain()
+    {
+        while (_free) {
+            ThreadJob *job = _free;
+            _free = job->next.Get();
+            delete job;
+        }
+    }
+
+    void Unref()
+    {
+        if (_references.SubAndFetch(1) == 0) {
+            delete this;
+        }
+    }
+
+private:
+    NON_COPYABLE(ThreadJobCache);
+
+    ThreadJob *_free;                           ///< Only touched by the owner.
+    IntrusiveMpscQueue<ThreadJob> _returned;    ///< Given back by others.
+    atomic_t _references;                       ///< The owner and jobs out there.
+
+}; // class ThreadJobCache
+
+static __thread ThreadJobCache *g_cache = NULL;
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_key;
+static bool g_keyed = false;
+
+static void DestroyCache(void *cache)
+{
+    ThreadJobCache *c = reinterpret_cast<ThreadJobCache *>(cache);
+    g_cache = NULL;
+    c->Drain();
+    c->Unref();
+}
+
+static void CreateKey()
+{
+    g_keyed = pthread_key_create(&g_key, DestroyCache) == 0;
+}
+
+static ThreadJobCache *GetCache()
+{
+    if (g_cache) {
+        return g_cache;
+    }
+
+    // Can't clean up when the thread exits, don't cache.
+    pthread_once(&g_once, CreateKey);
+    if (!g_keyed) {
+        return NULL;
+    }
+
+    ThreadJobCache *cache = new ThreadJobCache;
+    if (pthread_setspecific(g_key, cache)) {
+        cache->Unref();
+        return NULL;
+    }
+
+    g_cache = cache;
+    return cache;
+}
+
+ThreadJob *ThreadJob::Allocate(Runnable *runnable, bool auto_release)
+{
+    ThreadJobCache *cache = GetCache();
+    if (!cache) {
+        return new ThreadJob(runnable, auto_release);
+    }
+
+    ThreadJob *job = cache->Get();
+    job->next.Set(NULL);
+    job->tag = 0;
+    job->_runnable = runnable;
+    job->_auto_release = auto_release;
+    return job;
+}
+
+void ThreadJob::Release(ThreadJob *job)
+{
+    assert(job);
+    switch (job->_storage) {
+    case kStorageHeap:
+        delete job;
+        break;
+
+    case kStorageCache:
+        job->_cache->Put(job, job->_cache == g_cache);
+        break;
+
+    case kStorageEmbedded:
+        break;
+    }
+}
+
+} // namespace internal
+} // namespace flinter
@@ -16,16 +16,45 @@
 #ifndef FLINTER_THREAD_THREAD_JOB_H
 #define FLINTER_THREAD_THREAD_JOB_H
 
+#include <stddef.h>
+
+#include <flinter/types/atomic.h>
+#include <flinter/common.h>
+
 namespace flinter {
 
 class Runnable;
 
 namespace internal {
 
+class ThreadJobCache;
+
+/// Header of a job, linked in lists and queues of thread pools by itself.
 class ThreadJob {
 public:
-    ThreadJob(Runnable *runnable, bool auto_release)
-            : _runnable(runnable), _auto_release(auto_release)
+    enum Storage {
+        kStorageHeap,       ///< Deleted when released.
+        kStorageCache,      ///< Given back to the thread that allocated it.
+        kStorageEmbedded,   ///< Inside an IntrusiveRunnable, left alone.
+    }; // enum Storage
+
+    ThreadJob() : next(NULL)
+                , tag(0)
+                , _runnable(NULL)
+                , _cache(NULL)
+                , _storage(kStorageHeap)
+                , _auto_release(false)
+    {
+        // Intended left blank.
+    }
+
+    ThreadJob(Runnable *runnable, bool auto_release, Storage storage = kStorageHeap)
+            : next(NULL)
+            , tag(0)
+            , _runnable(runnable)
+            , _cache(NULL)
+            , _storage(storage)
+            , _auto_release(auto_release)
     {
         // Intended left blank.
     }
@@ -40,12 +69,82 @@ public:
         return _auto_release;
     }
 
+    /// Taken from the cache of the calling thread, which allocates nothing
+    /// once warmed up. Thread safe.
+    static ThreadJob *Allocate(Runnable *runnable, bool auto_release);
+
+    /// Done with the job, whatever its storage is. Thread safe.
+    /// Runnable is not touched, copy what's needed before releasing.
+    static void Release(ThreadJob *job);
+
+    /// Used by lists and queues, the job is in at most one of them.
+    Atomic<ThreadJob *> next;
+
+    /// Used by pools, say to remember the key.
+    size_t tag;
+
 private:
+    friend class ThreadJobCache;
+
     Runnable *_runnable;
+    ThreadJobCache *_cache;
+    Storage _storage;
     bool _auto_release;
 
 }; // class ThreadJob
 
+/// First in first out list linked by ThreadJob::next, allocates nothing.
+class ThreadJobList {
+public:
+    ThreadJobList() : _head(NULL), _tail(NULL), _size(0) {}
+
+    bool empty() const
+    {
+        return !_head;
+    }
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+    ThreadJob *front() const
+    {
+        return _head;
+    }
+
+    void push_back(ThreadJob *job)
+    {
+        job->next.Set(NULL);
+        if (_tail) {
+            _tail->next.Set(job);
+        } else {
+            _head = job;
+        }
+
+        _tail = job;
+        ++_size;
+    }
+
+    void pop_front()
+    {
+        _head = _head->next.Get();
+        if (!_head) {
+            _tail = NULL;
+        }
+
+        --_size;
+    }
+
+private:
+    NON_COPYABLE(ThreadJobList);
+
+    ThreadJob *_head;
+    ThreadJob *_tail;
+    size_t _size;
+
+}; // class ThreadJobList
+
 } // namespace internal
 } // namespace flinter
 
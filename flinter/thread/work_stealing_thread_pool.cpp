@@ -0,0 +1,341 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flinter/thread/work_stealing_thread_pool.h"
+
+#include <assert.h>
+
+#include "flinter/thread/mutex_locker.h"
+#include "flinter/thread/thread.h"
+#include "flinter/thread/thread_job.h"
+#include "flinter/logger.h"
+#include "flinter/runnable.h"
+
+namespace flinter {
+
+// Pool threads remember their own context to append jobs locally.
+static __thread void *g_context = NULL;
+
+// At most that many jobs are moved from the shared list at a time.
+static const size_t kMaximumBatch = 32;
+
+WorkStealingThreadPool::WorkStealingThreadPool() : _pendings(0)
+                                                 , _sleepers(0)
+                                                 , _stopping(0)
+                                                 , _initializing(false)
+{
+    // Intended left blank.
+}
+
+WorkStealingThreadPool::~WorkStealingThreadPool()
+{
+    Shutdown(false);
+}
+
+bool WorkStealingThreadPool::Initialize(size_t size)
+{
+    if (!size) {
+        return false;
+    }
+
+    MutexLocker locker(&_mutex);
+    if (_initializing || !_threads.empty()) {
+        return false;
+    }
+
+    Spawn(size);
+    return true;
+}
+
+void WorkStealingThreadPool::Spawn(size_t size)
+{
+    assert(_threads.empty());
+
+    // Threads walk through all contexts to steal, so fill them up first.
+    _threads.reserve(size);
+    for (size_t i = 0; i < size; i++) {
+        Context *context = new Context;
+        context->_pool = this;
+        context->_thread = NULL;
+        context->_victim = i + 1;
+        context->_index = i;
+        _threads.push_back(context);
+    }
+
+    CLOG.Verbose("ThreadPool: spawning %lu threads...", size);
+    for (size_t i = 0; i < size; i++) {
+        Context *context = _threads[i];
+        context->_thread = new internal::Thread(this, context);
+    }
+}
+
+bool WorkStealingThreadPool::Shutdown(bool wait_for_jobs_done)
+{
+    MutexLocker locker(&_mutex);
+    if (_initializing) {
+        return false;
+    } else if (_threads.empty()) {
+        return true;
+    }
+
+    // Purge any jobs that are not yet scheduled, deques are purged later.
+    _stopping.BarrierSet(1);
+    Purge(&_pending_jobs);
+    _pendings.Set(0);
+
+    // Kill active threads.
+    if (!wait_for_jobs_done) {
+        for (threads_t::iterator p = _threads.begin(); p != _threads.end(); ++p) {
+            Context *context = *p;
+            if (context->_active.Get()) {
+                CLOG.Verbose("ThreadPool: terminating thread [%p]...",
+                             context->_thread);
+
+                context->_thread->Terminate();
+            }
+        }
+    }
+
+    _job_available.WakeAll();
+    _initializing = true;
+    locker.Unlock();
+
+    // Nobody else touches _threads now.
+    CLOG.Verbose("ThreadPool: joining %lu threads...", _threads.size());
+    for (threads_t::iterator p = _threads.begin(); p != _threads.end(); ++p) {
+        Context *context = *p;
+        context->_thread->Join();
+        delete context->_thread;
+    }
+
+    job_list_t jobs;
+    for (threads_t::iterator p = _threads.begin(); p != _threads.end(); ++p) {
+        Context *context = *p;
+        internal::ThreadJob *job;
+        while (context->_deque.Pop(&job)) {
+            jobs.push_back(job);
+        }
+
+        delete context;
+    }
+
+    Purge(&jobs);
+
+    locker.Relock();
+    _threads.clear();
+    _stopping.BarrierSet(0);
+    _initializing = false;
+    return true;
+}
+
+bool WorkStealingThreadPool::TryPopOrSteal(Context *context,
+                                           internal::ThreadJob **job)
+{
+    if (context->_deque.Pop(job)) {
+        return true;
+    }
+
+    // Start from where we succeeded last time.
+    size_t size = _threads.size();
+    for (size_t i = 0; i < size; ++i) {
+        size_t index = (context->_victim + i) % size;
+        Context *victim = _threads[index];
+        if (victim == context) {
+            continue;
+        }
+
+        // Steal fails if others are faster, retry as long as there're jobs.
+        while (!victim->_deque.empty()) {
+            if (victim->_deque.Steal(job)) {
+                context->_victim = index;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool WorkStealingThreadPool::TryTakePendingJobs(Context *context,
+                                                internal::ThreadJob **job)
+{
+    if (_pending_jobs.empty()) {
+        return false;
+    }
+
+    *job = _pending_jobs.front();
+    _pending_jobs.pop_front();
+
+    // Take a fair share so that others can steal from us.
+    size_t batch = _pending_jobs.size() / _threads.size();
+    if (batch > kMaximumBatch) {
+        batch = kMaximumBatch;
+    }
+
+    for (size_t i = 0; i < batch; ++i) {
+        context->_deque.Push(_pending_jobs.front());
+        _pending_jobs.pop_front();
+    }
+
+    _pendings.Set(_pending_jobs.size());
+    if (batch && _sleepers.Get()) {
+        _job_available.WakeOne();
+    }
+
+    return true;
+}
+
+bool WorkStealingThreadPool::TryRequestJob(Context *context,
+                                           internal::ThreadJob **job)
+{
+    if (context->_deque.Pop(job)) {
+        return true;
+    }
+
+    // Jobs from other threads go before stolen ones so they don't starve.
+    if (_pendings.BarrierGet()) {
+        MutexLocker locker(&_mutex);
+        if (!_stopping.Get() && TryTakePendingJobs(context, job)) {
+            return true;
+        }
+    }
+
+    return TryPopOrSteal(context, job);
+}
+
+internal::ThreadJob *WorkStealingThreadPool::RequestJob(internal::Thread *thread)
+{
+    assert(thread);
+    Context *context = reinterpret_cast<Context *>(thread->parameter());
+    context->_active.Set(0);
+    g_context = context;
+
+    internal::ThreadJob *job = NULL;
+    while (!_stopping.BarrierGet()) {
+        if (TryRequestJob(context, &job)) {
+            break;
+        }
+
+        MutexLocker locker(&_mutex);
+        if (_stopping.Get()) {
+            job = NULL;
+            break;
+
+        } else if (TryTakePendingJobs(context, &job)) {
+            break;
+        }
+
+        // Appenders check sleepers after pushing, and we check deques after
+        // announcing, one of us must see the other.
+        _sleepers.AddAndFetch(1);
+        bool found = TryPopOrSteal(context, &job);
+        if (!found) {
+            _job_available.Wait(&_mutex);
+        }
+
+        _sleepers.SubAndFetch(1);
+        if (found) {
+            break;
+        }
+
+        job = NULL;
+    }
+
+    if (job) {
+        context->_active.Set(1);
+    }
+
+    return job;
+}
+
+void WorkStealingThreadPool::WakeOne()
+{
+    __sync_synchronize();
+    if (_sleepers.Get()) {
+        MutexLocker locker(&_mutex);
+        _job_available.WakeOne();
+    }
+}
+
+bool WorkStealingThreadPool::AppendJob(Runnable *runnable, bool auto_release)
+{
+    assert(runnable);
+    if (!runnable) {
+        return false;
+    }
+
+    return AppendThreadJob(NewThreadJob(runnable, auto_release));
+}
+
+bool WorkStealingThreadPool::AppendJob(IntrusiveRunnable *runnable, bool auto_release)
+{
+    assert(runnable);
+    if (!runnable) {
+        return false;
+    }
+
+    return AppendThreadJob(NewThreadJob(runnable, auto_release));
+}
+
+bool WorkStealingThreadPool::AppendThreadJob(internal::ThreadJob *job)
+{
+    // Appended by a job of ours, no lock.
+    Context *context = reinterpret_cast<Context *>(g_context);
+    if (context && context->_pool == this) {
+        if (_stopping.Get()) {
+            internal::ThreadJob::Release(job);
+            return false;
+        }
+
+        context->_deque.Push(job);
+        WakeOne();
+        return true;
+    }
+
+    MutexLocker locker(&_mutex);
+    if (_initializing) {
+        internal::ThreadJob::Release(job);
+        return false;
+    }
+
+    _pending_jobs.push_back(job);
+    _pendings.Set(_pending_jobs.size());
+    if (_sleepers.Get()) {
+        _job_available.WakeOne();
+    }
+
+    return true;
+}
+
+bool WorkStealingThreadPool::KillAll(int signum)
+{
+    MutexLocker locker(&_mutex);
+    if (_initializing) {
+        return false;
+    }
+
+    bool result = true;
+
+    for (threads_t::iterator p = _threads.begin(); p != _threads.end(); ++p) {
+        Context *context = *p;
+        if (context->_active.Get()) {
+            result &= context->_thread->Kill(signum);
+        }
+    }
+
+    return result;
+}
+
+} // namespace flinter
@@ -0,0 +1,128 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLINTER_THREAD_WORK_STEALING_THREAD_POOL_H
+#define FLINTER_THREAD_WORK_STEALING_THREAD_POOL_H
+
+#include <vector>
+
+#include <flinter/thread/abstract_thread_pool.h>
+#include <flinter/thread/condition.h>
+#include <flinter/thread/mutex.h>
+#include <flinter/types/atomic.h>
+#include <flinter/types/work_stealing_deque.h>
+#include <flinter/common.h>
+
+namespace flinter {
+namespace internal {
+class Thread;
+class ThreadJob;
+} // namespace internal
+
+class Runnable;
+
+/// WorkStealingThreadPool holds threads, each with its own deque.
+///
+/// Jobs appended by a job running in the pool go to the deque of that thread
+/// without locking, other threads append to a shared list. Threads run their
+/// own jobs newest first, and steal the oldest ones from others when idle.
+/// Suits jobs that spawn jobs, there's no ordering among jobs whatsoever.
+class WorkStealingThreadPool : public AbstractThreadPool {
+public:
+    explicit WorkStealingThreadPool();  ///< Constructor.
+    virtual ~WorkStealingThreadPool();  ///< Destructor.
+
+    /// @param size thread count.
+    /// @warning not thread-safe, only call in the main thread.
+    virtual bool Initialize(size_t size);
+
+    /// @param wait_for_jobs_done wait for running jobs to be done, or to terminate them.
+    /// @warning not thread-safe, only call in the main thread.
+    virtual bool Shutdown(bool wait_for_jobs_done = true);
+
+    /// Append a job to the pool, might be scheduled when we have an idle thread.
+    /// @param runnable the job to run.
+    /// @param auto_release to delete runnable when it's done.
+    virtual bool AppendJob(Runnable *runnable, bool auto_release = false);
+
+    /// Same as above, but allocates nothing.
+    virtual bool AppendJob(IntrusiveRunnable *runnable, bool auto_release = false);
+
+    /// Only implemented on *nix;
+    virtual bool KillAll(int signum);
+
+protected:
+    /// Called by internal::Thread.
+    /// @return NULL to exit the worker thread.
+    virtual internal::ThreadJob *RequestJob(internal::Thread *thread);
+
+private:
+    class Context {
+    public:
+        WorkStealingDeque<internal::ThreadJob *> _deque;
+        WorkStealingThreadPool *_pool;
+        internal::Thread *_thread;
+        atomic_t _active;
+        size_t _victim;
+        size_t _index;
+    }; // class Context
+
+    typedef std::vector<Context *> threads_t;
+
+    /// Will not block. Only locks if there're pending jobs.
+    /// @return false if no jobs are available.
+    bool TryRequestJob(Context *context, internal::ThreadJob **job);
+
+    /// Pop from the own deque, or steal from others. No lock.
+    /// @return false if no jobs are available.
+    bool TryPopOrSteal(Context *context, internal::ThreadJob **job);
+
+    /// Take jobs from the shared list, keep some in the deque. Locked.
+    /// @return false if no jobs are available.
+    bool TryTakePendingJobs(Context *context, internal::ThreadJob **job);
+
+    /// Append the job or release it.
+    bool AppendThreadJob(internal::ThreadJob *job);
+
+    /// Wake up an idle thread if there's any. No lock.
+    void WakeOne();
+
+    /// Batch spawn threads. No lock.
+    void Spawn(size_t size);
+
+    /// Threads, never changes while running.
+    threads_t _threads;
+
+    /// Jobs appended by other threads, and how many of them.
+    job_list_t _pending_jobs;
+    Atomic<size_t> _pendings;
+
+    /// How many threads are going to sleep or sleeping.
+    atomic_t _sleepers;
+
+    /// Stop accepting and scheduling jobs.
+    atomic_t _stopping;
+
+    /// Critical lock.
+    bool _initializing;
+
+    Condition _job_available;
+    Mutex _mutex;
+
+}; // class WorkStealingThreadPool
+
+} // namespace flinter
+
+#endif // FLINTER_THREAD_WORK_STEALING_THREAD_POOL_H
@@ -18,27 +18,29 @@
 
 #include <assert.h>
 
+#include <flinter/thread/distributed_read_write_lock.h>
 #include <flinter/thread/read_write_lock.h>
 #include <flinter/common.h>
 
 namespace flinter {
 
-/// WriteLocker automatically read locks a rw lock when constructed and then unlocks it when
-/// deconstructed.
-/// @warning WriteLocker itself is not thread safe.
-class WriteLocker {
+/// BasicWriteLocker automatically write locks a rw lock when constructed and then
+/// unlocks it when deconstructed, ReadWriteLock or DistributedReadWriteLock.
+/// @warning BasicWriteLocker itself is not thread safe.
+template <class T>
+class BasicWriteLocker {
 public:
     /// Constructor.
     /// @warning Don't operate the rw lock since on.
-    WriteLocker(ReadWriteLock *read_write_lock) : _read_write_lock(read_write_lock)
-                                                , _locked(true)
+    BasicWriteLocker(T *read_write_lock) : _read_write_lock(read_write_lock)
+                                         , _locked(true)
     {
         assert(read_write_lock);
         _read_write_lock->WriterLock();
     }
 
     /// Destructor.
-    ~WriteLocker()
+    ~BasicWriteLocker()
     {
         Unlock();
     }
@@ -62,12 +64,15 @@ public:
     }
 
 private:
-    NON_COPYABLE(WriteLocker);          ///< Don't copy me.
+    NON_COPYABLE(BasicWriteLocker);     ///< Don't copy me.
 
-    ReadWriteLock *_read_write_lock;    ///< rw lock instance.
+    T *_read_write_lock;                ///< rw lock instance.
     bool _locked;                       ///< Remember state.
 
-}; // class WriteLocker
+}; // class BasicWriteLocker
+
+typedef BasicWriteLocker<ReadWriteLock> WriteLocker;
+typedef BasicWriteLocker<DistributedReadWriteLock> DistributedWriteLocker;
 
 } // namespace flinter
 
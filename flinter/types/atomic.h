@@ -41,7 +41,7 @@ public:
 
     T BarrierGet() const
     {
-        return __sync_add_and_fetch(&_t, 0);
+        return __sync_add_and_fetch(const_cast<T *>(&_t), 0);
     }
 
     // Acquire barrier
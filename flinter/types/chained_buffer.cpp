@@ -0,0 +1,189 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flinter/types/chained_buffer.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace flinter {
+
+const size_t ChainedBuffer::kDefaultSegmentSize = 16384;
+
+ChainedBuffer::ChainedBuffer(size_t segment_size)
+        : _segment_size(segment_size ? segment_size : kDefaultSegmentSize)
+        , _size(0)
+{
+    // Intended left blank.
+}
+
+ChainedBuffer::~ChainedBuffer()
+{
+    Clear();
+}
+
+void ChainedBuffer::Clear()
+{
+    for (std::deque<Segment>::iterator p = _segments.begin();
+         p != _segments.end(); ++p) {
+
+        free(p->data);
+    }
+
+    _segments.clear();
+    _size = 0;
+}
+
+bool ChainedBuffer::Append(const void *buffer, size_t length)
+{
+    const unsigned char *ptr = reinterpret_cast<const unsigned char *>(buffer);
+    if (!length) {
+        return true;
+    }
+
+    assert(buffer);
+
+    // Fill up the last segment, but don't split a piece for an empty buffer.
+    size_t room = 0;
+    if (!_segments.empty()) {
+        const Segment &last = _segments.back();
+        room = last.capacity - last.tail;
+        if (room > length) {
+            room = length;
+        }
+    }
+
+    // Allocate before touching anything so that failure appends nothing.
+    Segment s;
+    s.data = NULL;
+    if (room < length) {
+        s.capacity = length - room;
+        if (s.capacity < _segment_size) {
+            s.capacity = _segment_size;
+        }
+
+        s.data = reinterpret_cast<unsigned char *>(malloc(s.capacity));
+        if (!s.data) {
+            return false;
+        }
+
+        s.head = 0;
+        s.tail = length - room;
+        memcpy(s.data, ptr + room, s.tail);
+    }
+
+    if (room) {
+        Segment &last = _segments.back();
+        memcpy(last.data + last.tail, ptr, room);
+        last.tail += room;
+    }
+
+    if (s.data) {
+        _segments.push_back(s);
+    }
+
+    _size += length;
+    return true;
+}
+
+void ChainedBuffer::Adopt(void *block, const void *buffer, size_t length)
+{
+    unsigned char *b = reinterpret_cast<unsigned char *>(block);
+    const unsigned char *ptr = reinterpret_cast<const unsigned char *>(buffer);
+    if (!length) {
+        free(block);
+        return;
+    }
+
+    assert(block);
+    assert(ptr >= b);
+
+    Segment s;
+    s.data = b;
+    s.head = static_cast<size_t>(ptr - b);
+    s.tail = s.head + length;
+    s.capacity = s.tail;
+    _segments.push_back(s);
+    _size += length;
+}
+
+void ChainedBuffer::Peek(const void **buffer, size_t *length) const
+{
+    assert(buffer);
+    assert(length);
+
+    if (_segments.empty()) {
+        *buffer = NULL;
+        *length = 0;
+        return;
+    }
+
+    const Segment &s = _segments.front();
+    *buffer = s.data + s.head;
+    *length = s.tail - s.head;
+}
+
+size_t ChainedBuffer::Peek(struct iovec *iov, size_t count,
+                          size_t limit, size_t *length) const
+{
+    assert(iov);
+    assert(length);
+
+    size_t i = 0;
+    size_t total = 0;
+    for (std::deque<Segment>::const_iterator p = _segments.begin();
+         p != _segments.end() && i < count; ++p) {
+
+        size_t size = p->tail - p->head;
+        if (limit) {
+            if (total == limit) {
+                break;
+            } else if (size > limit - total) {
+                size = limit - total;
+            }
+        }
+
+        iov[i].iov_base = p->data + p->head;
+        iov[i].iov_len = size;
+        total += size;
+        ++i;
+    }
+
+    *length = total;
+    return i;
+}
+
+void ChainedBuffer::Consume(size_t length)
+{
+    assert(length <= _size);
+
+    _size -= length;
+    while (length) {
+        assert(!_segments.empty());
+        Segment &s = _segments.front();
+        size_t available = s.tail - s.head;
+        if (length < available) {
+            s.head += length;
+            break;
+        }
+
+        length -= available;
+        free(s.data);
+        _segments.pop_front();
+    }
+}
+
+} // namespace flinter
@@ -0,0 +1,95 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLINTER_TYPES_CHAINED_BUFFER_H
+#define FLINTER_TYPES_CHAINED_BUFFER_H
+
+#include <sys/uio.h>
+#include <stddef.h>
+
+#include <deque>
+
+#include <flinter/common.h>
+
+namespace flinter {
+
+/// FIFO byte queue made of chained segments.
+///
+/// Appending copies into the last segment, consuming from the front only moves
+/// an offset and frees segments that are drained, so both are O(1) per byte no
+/// matter how large the backlog grows. Segment memory is never moved.
+class ChainedBuffer {
+public:
+    explicit ChainedBuffer(size_t segment_size = kDefaultSegmentSize);
+    ~ChainedBuffer();
+
+    /// If the buffer is empty, the whole piece is kept contiguous.
+    /// @return false if out of memory, nothing is appended.
+    bool Append(const void *buffer, size_t length);
+
+    /// Chain a piece without copying.
+    /// @param block allocated by malloc(), life span TAKEN.
+    /// @param buffer bytes to append, must lie within block.
+    void Adopt(void *block, const void *buffer, size_t length);
+
+    /// Get the contiguous bytes at the front.
+    /// @param buffer set to NULL if empty.
+    void Peek(const void **buffer, size_t *length) const;
+
+    /// Gather bytes at the front into iov.
+    /// @param limit gather no more than these bytes, 0 for unlimited.
+    /// @param length set to total bytes gathered.
+    /// @return pieces filled into iov.
+    size_t Peek(struct iovec *iov, size_t count,
+                size_t limit, size_t *length) const;
+
+    /// Drop bytes at the front.
+    void Consume(size_t length);
+
+    /// Drop everything and release memory.
+    void Clear();
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+    bool empty() const
+    {
+        return !_size;
+    }
+
+    static const size_t kDefaultSegmentSize;
+
+private:
+    NON_COPYABLE(ChainedBuffer);
+
+    // Adopted pieces are full so that nothing is appended to them.
+    struct Segment {
+        unsigned char *data;
+        size_t capacity;
+        size_t head;
+        size_t tail;
+    }; // struct Segment
+
+    std::deque<Segment> _segments;
+    const size_t _segment_size;
+    size_t _size;
+
+}; // class ChainedBuffer
+
+} // namespace flinter
+
+#endif // FLINTER_TYPES_CHAINED_BUFFER_H
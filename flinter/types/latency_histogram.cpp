@@ -0,0 +1,97 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flinter/types/latency_histogram.h"
+
+namespace flinter {
+
+const size_t LatencyHistogram::kBuckets;
+
+size_t LatencyHistogram::GetBucket(int64_t microseconds)
+{
+    if (microseconds < 4) {
+        return microseconds > 0 ? static_cast<size_t>(microseconds) : 0;
+    }
+
+    uint64_t value = static_cast<uint64_t>(microseconds);
+    size_t exponent = 63 - static_cast<size_t>(__builtin_clzll(value));
+    size_t sub = static_cast<size_t>(value >> (exponent - 2)) & 3;
+    size_t bucket = 4 + (exponent - 2) * 4 + sub;
+    return bucket < kBuckets ? bucket : kBuckets - 1;
+}
+
+int64_t LatencyHistogram::GetUpperBound(size_t bucket)
+{
+    if (bucket < 4) {
+        return static_cast<int64_t>(bucket + 1) * 1000;
+    }
+
+    size_t exponent = (bucket - 4) / 4 + 2;
+    size_t sub = (bucket - 4) % 4;
+    return static_cast<int64_t>((5 + sub) << (exponent - 2)) * 1000;
+}
+
+void LatencyHistogram::Record(int64_t latency)
+{
+    _buckets[GetBucket(latency / 1000)].AddAndFetch(1);
+}
+
+uint64_t LatencyHistogram::count() const
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        total += _buckets[i].Get();
+    }
+
+    return total;
+}
+
+int64_t LatencyHistogram::GetPercentile(double percentile) const
+{
+    uint64_t counts[kBuckets];
+    uint64_t total = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        counts[i] = _buckets[i].Get();
+        total += counts[i];
+    }
+
+    if (!total || percentile <= 0) {
+        return 0;
+    }
+
+    uint64_t wanted = static_cast<uint64_t>(static_cast<double>(total) * percentile / 100);
+    if (wanted < 1) {
+        wanted = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        seen += counts[i];
+        if (seen >= wanted) {
+            return GetUpperBound(i);
+        }
+    }
+
+    return GetUpperBound(kBuckets - 1);
+}
+
+void LatencyHistogram::Reset()
+{
+    for (size_t i = 0; i < kBuckets; ++i) {
+        _buckets[i].BarrierSet(0);
+    }
+}
+
+} // namespace flinter
@@ -0,0 +1,60 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLINTER_TYPES_LATENCY_HISTOGRAM_H
+#define FLINTER_TYPES_LATENCY_HISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <flinter/types/atomic.h>
+#include <flinter/common.h>
+
+namespace flinter {
+
+/// Histogram of latencies for percentiles, recorded and read from any thread.
+///
+/// Buckets are log linear in microseconds, 4 per power of 2, so percentiles
+/// are accurate to about 25%, from 1us up to hours.
+class LatencyHistogram {
+public:
+    LatencyHistogram() {}
+
+    /// @param latency in nanoseconds.
+    void Record(int64_t latency);
+
+    /// @param percentile in (0, 100].
+    /// @return upper bound of the bucket in nanoseconds, 0 if nothing recorded.
+    int64_t GetPercentile(double percentile) const;
+
+    uint64_t count() const;
+
+    /// Samples recorded at the same time might get lost.
+    void Reset();
+
+private:
+    NON_COPYABLE(LatencyHistogram);
+
+    static const size_t kBuckets = 160;
+    static size_t GetBucket(int64_t microseconds);
+    static int64_t GetUpperBound(size_t bucket);
+
+    uatomic64_t _buckets[kBuckets];
+
+}; // class LatencyHistogram
+
+} // namespace flinter
+
+#endif // FLINTER_TYPES_LATENCY_HISTOGRAM_H
@@ -0,0 +1,166 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLINTER_TYPES_MPSC_QUEUE_H
+#define FLINTER_TYPES_MPSC_QUEUE_H
+
+#include <stddef.h>
+
+#include <flinter/types/atomic.h>
+#include <flinter/common.h>
+
+namespace flinter {
+
+/// Lock free FIFO queue, any threads push but only one thread pops.
+///
+/// Pushing takes a single atomic exchange so producers never wait for each
+/// other. A pop running concurrently with a push might not see that very item
+/// yet, the pusher is expected to wake up the consumer afterwards.
+template <class T>
+class MpscQueue {
+public:
+    MpscQueue() : _head(new Node), _tail(_head.Get()) {}
+
+    /// Not thread safe.
+    ~MpscQueue()
+    {
+        while (_tail) {
+            Node *next = _tail->next.Get();
+            delete _tail;
+            _tail = next;
+        }
+    }
+
+    /// Thread safe.
+    void Push(const T &value)
+    {
+        Node *node = new Node(value);
+        __sync_synchronize();
+        Node *prev = _head.BarrierSet(node);
+        __sync_synchronize();
+        prev->next.Set(node);
+    }
+
+    /// Called by the consumer only.
+    /// @return false if nothing is available.
+    bool Pop(T *value)
+    {
+        Node *next = _tail->next.BarrierGet();
+        if (!next) {
+            return false;
+        }
+
+        *value = next->value;
+        next->value = T();
+        delete _tail;
+        _tail = next;
+        return true;
+    }
+
+    /// Called by the consumer only.
+    bool empty() const
+    {
+        return !_tail->next.BarrierGet();
+    }
+
+private:
+    NON_COPYABLE(MpscQueue);
+
+    struct Node {
+        Node() : value(), next(NULL) {}
+        explicit Node(const T &v) : value(v), next(NULL) {}
+
+        T value;
+        Atomic<Node *> next;
+
+    }; // struct Node
+
+    // Producers swap the head, the consumer walks from the tail, which is
+    // always a dummy node whose value has been taken.
+    Atomic<Node *> _head;
+    Node *_tail;
+
+}; // class MpscQueue
+
+/// Same as MpscQueue, but nodes are linked by their own member `next', which is
+/// an Atomic<N *>, so that callers can pool them and nothing is allocated.
+template <class N>
+class IntrusiveMpscQueue {
+public:
+    IntrusiveMpscQueue() : _stub(), _head(&_stub), _tail(&_stub)
+    {
+        _stub.next.Set(NULL);
+    }
+
+    /// Thread safe.
+    /// @param node life span NOT taken, keep it until popped.
+    void Push(N *node)
+    {
+        node->next.Set(NULL);
+        __sync_synchronize();
+        N *prev = _head.BarrierSet(node);
+        __sync_synchronize();
+        prev->next.Set(node);
+    }
+
+    /// Called by the consumer only.
+    /// @return NULL if nothing is available.
+    N *Pop()
+    {
+        N *tail = _tail;
+        N *next = tail->next.BarrierGet();
+        if (tail == &_stub) {
+            if (!next) {
+                return NULL;
+            }
+
+            _tail = next;
+            tail = next;
+            next = next->next.BarrierGet();
+        }
+
+        if (next) {
+            _tail = next;
+            return tail;
+        }
+
+        // The last node can only be taken by putting the stub behind it, but
+        // not if some producer is still linking another node in.
+        if (tail != _head.BarrierGet()) {
+            return NULL;
+        }
+
+        Push(&_stub);
+        next = tail->next.BarrierGet();
+        if (next) {
+            _tail = next;
+            return tail;
+        }
+
+        return NULL;
+    }
+
+private:
+    NON_COPYABLE(IntrusiveMpscQueue);
+
+    N _stub;
+    Atomic<N *> _head;
+    N *_tail;
+
+}; // class IntrusiveMpscQueue
+
+} // namespace flinter
+
+#endif // FLINTER_TYPES_MPSC_QUEUE_H
@@ -0,0 +1,167 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLINTER_TYPES_SLOT_TABLE_H
+#define FLINTER_TYPES_SLOT_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+
+#include <flinter/types/atomic.h>
+#include <flinter/common.h>
+
+namespace flinter {
+
+/// Array of slots addressed by index and generation.
+///
+/// A slot gets a new generation every time it's released, so a stale handle
+/// pointing to a reused slot simply misses. Slots are allocated in chunks that
+/// never move or go away, so IsValid() can be called from any thread without
+/// locking or hashing, everything else must be serialized by the caller.
+///
+/// Generations are 31 bits and never 0, released slots are reused in FIFO
+/// order to make wrapping around even less likely.
+template <class T>
+class SlotTable {
+public:
+    static const uint32_t kChunkSize = 1024;
+    static const uint32_t kMaximumChunks = 4096;
+    static const uint32_t kMaximumSlots = kChunkSize * kMaximumChunks;
+    static const uint32_t kGenerationMask = 0x7fffffffu;
+
+    SlotTable() : _size(0) {}
+
+    ~SlotTable()
+    {
+        for (uint32_t i = 0; i < kMaximumChunks; ++i) {
+            delete [] _chunks[i].Get();
+        }
+    }
+
+    /// @return false if full.
+    bool Allocate(T *value, uint32_t *index, uint32_t *generation)
+    {
+        uint32_t i;
+        if (!_free.empty()) {
+            i = _free.front();
+            _free.pop_front();
+
+        } else if (_size < kMaximumSlots) {
+            i = _size;
+            if (i % kChunkSize == 0) {
+                struct slot_t *chunk = new struct slot_t[kChunkSize];
+                for (uint32_t j = 0; j < kChunkSize; ++j) {
+                    chunk[j].generation.Set(1);
+                    chunk[j].value = NULL;
+                }
+
+                _chunks[i / kChunkSize].BarrierSet(chunk);
+            }
+
+            ++_size;
+
+        } else {
+            return false;
+        }
+
+        struct slot_t *slot = GetSlot(i);
+        slot->value = value;
+        *generation = slot->generation.Get();
+        *index = i;
+        return true;
+    }
+
+    /// The slot can no longer be found with its current generation.
+    void Release(uint32_t index)
+    {
+        struct slot_t *slot = GetSlot(index);
+        uint32_t generation = (slot->generation.Get() + 1) & kGenerationMask;
+        slot->value = NULL;
+        slot->generation.BarrierSet(generation ? generation : 1);
+        _free.push_back(index);
+    }
+
+    /// Thread safe, a positive answer might be outdated right away.
+    bool IsValid(uint32_t index, uint32_t generation) const
+    {
+        if (index >= kMaximumSlots) {
+            return false;
+        }
+
+        // Chunks are published with a barrier, dependent loads keep order.
+        const struct slot_t *chunk = _chunks[index / kChunkSize].Get();
+        if (!chunk) {
+            return false;
+        }
+
+        return chunk[index % kChunkSize].generation.Get() == generation;
+    }
+
+    /// @return NULL if stale.
+    T *Get(uint32_t index, uint32_t generation) const
+    {
+        if (!IsValid(index, generation)) {
+            return NULL;
+        }
+
+        return _chunks[index / kChunkSize].Get()[index % kChunkSize].value;
+    }
+
+    /// @return false if stale.
+    bool Set(uint32_t index, uint32_t generation, T *value)
+    {
+        if (!IsValid(index, generation)) {
+            return false;
+        }
+
+        GetSlot(index)->value = value;
+        return true;
+    }
+
+    /// Slots in use.
+    size_t size() const
+    {
+        return _size - _free.size();
+    }
+
+private:
+    NON_COPYABLE(SlotTable);
+
+    struct slot_t {
+        Atomic<uint32_t> generation;
+        T *value;
+    }; // struct slot_t
+
+    struct slot_t *GetSlot(uint32_t index) const
+    {
+        return &_chunks[index / kChunkSize].Get()[index % kChunkSize];
+    }
+
+    Atomic<struct slot_t *> _chunks[kMaximumChunks];
+    std::deque<uint32_t> _free;
+    uint32_t _size;
+
+}; // class SlotTable
+
+template <class T> const uint32_t SlotTable<T>::kChunkSize;
+template <class T> const uint32_t SlotTable<T>::kMaximumChunks;
+template <class T> const uint32_t SlotTable<T>::kMaximumSlots;
+template <class T> const uint32_t SlotTable<T>::kGenerationMask;
+
+} // namespace flinter
+
+#endif // FLINTER_TYPES_SLOT_TABLE_H
@@ -0,0 +1,179 @@
+/* Copyright 2015 yiyuanzhong@gmail.com (Yiyuan Zhong)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLINTER_TYPES_WORK_STEALING_DEQUE_H
+#define FLINTER_TYPES_WORK_STEALING_DEQUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <flinter/types/atomic.h>
+#include <flinter/common.h>
+
+namespace flinter {
+
+/// Chase-Lev lock free deque, the owner pushes and pops at the bottom while
+/// any other threads steal from the top.
+///
+/// The owner never waits for thieves unless both go for the very last item.
+/// T must be copied with a single word, say a pointer. Grown arrays are kept
+/// until destruction since thieves might still be reading them.
+template <class T>
+class WorkStealingDeque {
+public:
+    /// @param capacity initial capacity, rounded up to a power of 2.
+    explicit WorkStealingDeque(size_t capacity = 64) : _top(0), _bottom(0)
+    {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+
+        _array.Set(new Array(size));
+    }
+
+    /// Not thread safe.
+    ~WorkStealingDeque()
+    {
+        delete _array.Get();
+        for (size_t i = 0; i < _retired.size(); ++i) {
+            delete _retired[i];
+        }
+    }
+
+    /// Called by the owner only.
+    void Push(const T &value)
+    {
+        int64_t b = _bottom.Get();
+        int64_t t = _top.BarrierGet();
+        Array *a = _array.Get();
+        if (b - t > static_cast<int64_t>(a->mask)) {
+            a = Grow(a, t, b);
+        }
+
+        a->Put(b, value);
+        __sync_synchronize();
+        _bottom.Set(b + 1);
+    }
+
+    /// Called by the owner only, last in first out.
+    /// @return false if nothing is available.
+    bool Pop(T *value)
+    {
+        int64_t b = _bottom.Get() - 1;
+        Array *a = _array.Get();
+        _bottom.Set(b);
+        __sync_synchronize();
+
+        int64_t t = _top.Get();
+        if (t > b) {
+            _bottom.Set(b + 1);
+            return false;
+        }
+
+        *value = a->Get(b);
+        if (t == b) { // The last one, race with thieves.
+            bool won = _top.CompareAndSwap(t, t + 1) == t;
+            _bottom.Set(b + 1);
+            return won;
+        }
+
+        return true;
+    }
+
+    /// Thread safe, first in first out.
+    /// @return false if nothing is available or another thread is faster.
+    bool Steal(T *value)
+    {
+        int64_t t = _top.BarrierGet();
+        int64_t b = _bottom.BarrierGet();
+        if (t >= b) {
+            return false;
+        }
+
+        Array *a = _array.BarrierGet();
+        T v = a->Get(t);
+        if (_top.CompareAndSwap(t, t + 1) != t) {
+            return false;
+        }
+
+        *value = v;
+        return true;
+    }
+
+    /// Thread safe, but only a hint when others are running.
+    size_t size() const
+    {
+        int64_t b = _bottom.BarrierGet();
+        int64_t t = _top.BarrierGet();
+        return b > t ? static_cast<size_t>(b - t) : 0;
+    }
+
+    /// Thread safe, but only a hint when others are running.
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+private:
+    NON_COPYABLE(WorkStealingDeque);
+
+    struct Array {
+        explicit Array(size_t size) : mask(size - 1), slots(new Atomic<T>[size]) {}
+        ~Array()
+        {
+            delete [] slots;
+        }
+
+        T Get(int64_t i) const
+        {
+            return slots[static_cast<size_t>(i) & mask].Get();
+        }
+
+        void Put(int64_t i, const T &value)
+        {
+            slots[static_cast<size_t>(i) & mask].Set(value);
+        }
+
+        const size_t mask;
+        Atomic<T> *const slots;
+
+    }; // struct Array
+
+    Array *Grow(Array *a, int64_t t, int64_t b)
+    {
+        Array *n = new Array((a->mask + 1) << 1);
+        for (int64_t i = t; i < b; ++i) {
+            n->Put(i, a->Get(i));
+        }
+
+        _retired.push_back(a);
+        __sync_synchronize();
+        _array.Set(n);
+        return n;
+    }
+
+    Atomic<int64_t> _top;
+    Atomic<int64_t> _bottom;
+    Atomic<Array *> _array;
+    std::vector<Array *> _retired;
+
+}; // class WorkStealingDeque
+
+} // namespace flinter
+
+#endif // FLINTER_TYPES_WORK_STEALING_DEQUE_H
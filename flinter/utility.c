@@ -47,6 +47,10 @@
 #include <pthread_np.h>
 #endif
 
+#if defined(__linux__)
+#include <linux/filter.h>
+#endif
+
 #include "flinter/msleep.h"
 #include "flinter/safeio.h"
 #include "config.h"
@@ -456,6 +460,45 @@ int set_socket_reuse_address(int sockfd)
     return setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &one, (socklen_t)sizeof(one));
 }
 
+int set_socket_reuse_port(int sockfd)
+{
+#if defined(SO_REUSEPORT)
+    static const int one = 1;
+    return setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &one, (socklen_t)sizeof(one));
+#else
+    (void)sockfd;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+int set_socket_reuse_port_by_cpu(int sockfd, unsigned int sockets)
+{
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+    /* A = current CPU; A %= sockets; return A; */
+    struct sock_filter code[] = {
+        { BPF_LD  | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU) },
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, sockets                             },
+        { BPF_RET | BPF_A,           0, 0, 0                                   },
+    };
+
+    struct sock_fprog prog;
+    if (!sockets) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    prog.len = (unsigned short)(sizeof(code) / sizeof(*code));
+    prog.filter = code;
+    return setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, (socklen_t)sizeof(prog));
+#else
+    (void)sockfd;
+    (void)sockets;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
 int set_socket_keepalive(int sockfd)
 {
     static const int one = 1;
@@ -474,6 +517,18 @@ int set_tcp_nodelay(int sockfd)
     return setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &one, (socklen_t)sizeof(one));
 }
 
+int set_tcp_cork(int sockfd, int cork)
+{
+#if __linux__
+    return setsockopt(sockfd, IPPROTO_TCP, TCP_CORK, &cork, (socklen_t)sizeof(cork));
+#else
+    (void)sockfd;
+    (void)cork;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
 int set_tcp_defer_accept(int sockfd)
 {
 #if __linux__
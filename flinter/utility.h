@@ -89,12 +89,25 @@ extern int set_blocking_mode(int fd);
 /** Allow socket to re-use binding addresses. */
 extern int set_socket_reuse_address(int sockfd);
 
+/** Allow multiple sockets to bind the same address, kernel balances them. */
+extern int set_socket_reuse_port(int sockfd);
+
+/**
+ * Steer connections within a SO_REUSEPORT group by the CPU receiving them,
+ * CPU n goes to the (n % sockets)th socket in the order they were bound.
+ * Linux only, call on any socket of the group after all of them are bound.
+ */
+extern int set_socket_reuse_port_by_cpu(int sockfd, unsigned int sockets);
+
 /** Allow TCP defered accept. */
 extern int set_tcp_defer_accept(int sockfd);
 
 /** Allow TCP no delay. */
 extern int set_tcp_nodelay(int sockfd);
 
+/** Hold partial TCP segments until uncorked, Linux only. */
+extern int set_tcp_cork(int sockfd, int cork);
+
 /** Allow socket to send broadcast packets. */
 extern int set_socket_broadcast(int sockfd);
 
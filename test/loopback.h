@@ -0,0 +1,55 @@
+#ifndef FLINTER_TEST_LOOPBACK_H
+#define FLINTER_TEST_LOOPBACK_H
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+// For tests running a server and talking to it over the loopback.
+
+/// Differs between processes so that tests can run side by side.
+inline uint16_t GetLoopbackPort()
+{
+    return static_cast<uint16_t>(20000 + getpid() % 20000);
+}
+
+/// @return a blocking socket or -1.
+inline int ConnectLoopback(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr))) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/// @return exactly length bytes unless the peer hangs up.
+inline std::string ReceiveLoopback(int fd, size_t length)
+{
+    std::string result;
+    char buffer[65536];
+    while (result.length() < length) {
+        ssize_t ret = read(fd, buffer, sizeof(buffer));
+        if (ret <= 0) {
+            break;
+        }
+
+        result.append(buffer, static_cast<size_t>(ret));
+    }
+
+    return result;
+}
+
+#endif // FLINTER_TEST_LOOPBACK_H
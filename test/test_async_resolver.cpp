@@ -0,0 +1,480 @@
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <flinter/linkage/async_resolver.h>
+#include <flinter/linkage/linkage_worker.h>
+#include <flinter/thread/fixed_thread_pool.h>
+#include <flinter/thread/mutex.h>
+#include <flinter/thread/mutex_locker.h>
+#include <flinter/types/atomic.h>
+#include <flinter/msleep.h>
+#include <flinter/runnable.h>
+
+using flinter::AsyncResolver;
+
+// Answers A queries from a table over UDP on loopback.
+class StubServer {
+public:
+    struct answer_t {
+        int rcode;
+        uint32_t ttl;
+        std::vector<std::string> addresses;
+        int64_t minimum; // SOA in the authority section if >=0.
+    }; // struct answer_t
+
+    StubServer() : _drop(0), _quit(0)
+    {
+        _fd = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(_fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+
+        socklen_t len = sizeof(addr);
+        getsockname(_fd, reinterpret_cast<struct sockaddr *>(&addr), &len);
+        _port = ntohs(addr.sin_port);
+        pthread_create(&_thread, NULL, Main, this);
+    }
+
+    ~StubServer()
+    {
+        _quit.Set(1);
+        pthread_join(_thread, NULL);
+        close(_fd);
+    }
+
+    void Set(const std::string &name, int rcode, uint32_t ttl,
+             const std::string &addresses, int64_t minimum = -1)
+    {
+        flinter::MutexLocker locker(&_mutex);
+        answer_t &answer = _answers[name];
+        answer.rcode = rcode;
+        answer.ttl = ttl;
+        answer.minimum = minimum;
+        answer.addresses.clear();
+        std::string::size_type b = 0;
+        while (b < addresses.length()) {
+            std::string::size_type e = addresses.find(',', b);
+            if (e == std::string::npos) {
+                e = addresses.length();
+            }
+
+            answer.addresses.push_back(addresses.substr(b, e - b));
+            b = e + 1;
+        }
+    }
+
+    int queries(const std::string &name)
+    {
+        flinter::MutexLocker locker(&_mutex);
+        return _queries[name];
+    }
+
+    // Source ports seen.
+    size_t ports()
+    {
+        flinter::MutexLocker locker(&_mutex);
+        return _ports.size();
+    }
+
+    void set_drop(int drop)
+    {
+        _drop.Set(drop);
+    }
+
+    std::string address() const
+    {
+        char buffer[64];
+        sprintf(buffer, "127.0.0.1:%u", _port);
+        return buffer;
+    }
+
+private:
+    static void *Main(void *parameter)
+    {
+        static_cast<StubServer *>(parameter)->Serve();
+        return NULL;
+    }
+
+    static void Put16(std::string *s, uint16_t v)
+    {
+        s->push_back(static_cast<char>(v >> 8));
+        s->push_back(static_cast<char>(v & 0xff));
+    }
+
+    static void Put32(std::string *s, uint32_t v)
+    {
+        Put16(s, static_cast<uint16_t>(v >> 16));
+        Put16(s, static_cast<uint16_t>(v & 0xffff));
+    }
+
+    void Serve()
+    {
+        while (!_quit.Get()) {
+            struct pollfd pfd;
+            pfd.fd = _fd;
+            pfd.events = POLLIN;
+            if (poll(&pfd, 1, 50) <= 0) {
+                continue;
+            }
+
+            unsigned char q[512];
+            struct sockaddr_in from;
+            socklen_t len = sizeof(from);
+            ssize_t ret = recvfrom(_fd, q, sizeof(q), 0,
+                                   reinterpret_cast<struct sockaddr *>(&from), &len);
+
+            if (ret < 17) {
+                continue;
+            }
+
+            // Uncompressed question right after the header.
+            std::string name;
+            size_t o = 12;
+            while (o < static_cast<size_t>(ret) && q[o]) {
+                if (!name.empty()) {
+                    name.push_back('.');
+                }
+
+                name.append(reinterpret_cast<char *>(q + o + 1), q[o]);
+                o += 1 + q[o];
+            }
+
+            size_t qend = o + 5;
+            answer_t answer;
+            answer.rcode = 3;
+            answer.ttl = 0;
+            answer.minimum = -1;
+            {
+                flinter::MutexLocker locker(&_mutex);
+                ++_queries[name];
+                _ports.insert(ntohs(from.sin_port));
+                std::map<std::string, answer_t>::iterator p = _answers.find(name);
+                if (p != _answers.end()) {
+                    answer = p->second;
+                }
+            }
+
+            if (_drop.Get() > 0) {
+                _drop.SubAndFetch(1);
+                continue;
+            }
+
+            std::string r(reinterpret_cast<char *>(q), 2);
+            Put16(&r, static_cast<uint16_t>(0x8180 | answer.rcode));
+            Put16(&r, 1);
+            Put16(&r, static_cast<uint16_t>(answer.addresses.size()));
+            Put16(&r, answer.minimum >= 0 ? 1 : 0);
+            Put16(&r, 0);
+            r.append(reinterpret_cast<char *>(q + 12), qend - 12);
+
+            for (size_t i = 0; i < answer.addresses.size(); ++i) {
+                struct in_addr in;
+                inet_pton(AF_INET, answer.addresses[i].c_str(), &in);
+                Put16(&r, 0xc00c);
+                Put16(&r, 1);
+                Put16(&r, 1);
+                Put32(&r, answer.ttl);
+                Put16(&r, 4);
+                r.append(reinterpret_cast<char *>(&in), 4);
+            }
+
+            if (answer.minimum >= 0) {
+                Put16(&r, 0xc00c);
+                Put16(&r, 6);
+                Put16(&r, 1);
+                Put32(&r, 300);
+                Put16(&r, 22);
+                r.push_back('\0'); // MNAME
+                r.push_back('\0'); // RNAME
+                Put32(&r, 1);      // SERIAL
+                Put32(&r, 3600);   // REFRESH
+                Put32(&r, 600);    // RETRY
+                Put32(&r, 86400);  // EXPIRE
+                Put32(&r, static_cast<uint32_t>(answer.minimum));
+            }
+
+            sendto(_fd, r.data(), r.length(), 0,
+                   reinterpret_cast<struct sockaddr *>(&from), len);
+        }
+    }
+
+    int _fd;
+    uint16_t _port;
+    pthread_t _thread;
+    flinter::Mutex _mutex;
+    flinter::atomic_t _drop;
+    flinter::atomic_t _quit;
+    std::map<std::string, answer_t> _answers;
+    std::map<std::string, int> _queries;
+    std::set<uint16_t> _ports;
+
+}; // class StubServer
+
+class Probe : public AsyncResolver::Callback {
+public:
+    Probe(AsyncResolver *resolver, const std::string &hostname)
+            : _resolver(resolver), _hostname(hostname), _done(0)
+            , _immediate(false), _result(AsyncResolver::kResultPending) {}
+
+    virtual void OnResolved(const std::string & /*hostname*/,
+                            int /*domain*/,
+                            AsyncResolver::Result result,
+                            const std::vector<AsyncResolver::address_t> &addresses)
+    {
+        _result = result;
+        _addresses = addresses;
+        _done.Set(1);
+    }
+
+    void Resolve()
+    {
+        _result = _resolver->Resolve(_hostname, AF_INET, &_addresses, this);
+        if (_result != AsyncResolver::kResultPending) {
+            _immediate = true;
+            _done.Set(1);
+        }
+    }
+
+    bool Wait()
+    {
+        for (int i = 0; i < 500 && !_done.Get(); ++i) {
+            msleep(10);
+        }
+
+        return !!_done.Get();
+    }
+
+    std::string first() const
+    {
+        char buffer[64];
+        if (_addresses.empty()) {
+            return std::string();
+        }
+
+        return inet_ntop(AF_INET, &_addresses[0].in, buffer, sizeof(buffer));
+    }
+
+    AsyncResolver *_resolver;
+    std::string _hostname;
+    flinter::atomic_t _done;
+    bool _immediate;
+    AsyncResolver::Result _result;
+    std::vector<AsyncResolver::address_t> _addresses;
+
+}; // class Probe
+
+// Resolve within the worker thread.
+class ResolveJob : public flinter::Runnable {
+public:
+    explicit ResolveJob(Probe *a, Probe *b = NULL) : _a(a), _b(b) {}
+    virtual bool Run()
+    {
+        _a->Resolve();
+        if (_b) {
+            _b->Resolve();
+        }
+
+        return true;
+    }
+
+private:
+    Probe *_a;
+    Probe *_b;
+
+}; // class ResolveJob
+
+class AsyncResolverTest : public ::testing::Test {
+protected:
+    virtual void SetUp()
+    {
+        _option.hosts.clear();
+        _option.nameservers.push_back(_stub.address());
+        _option.timeout = 200000000LL;
+        _option.attempts = 2;
+    }
+
+    void Start()
+    {
+        ASSERT_TRUE(_resolver.Initialize(&_worker, _option));
+        ASSERT_TRUE(_pool.Initialize(1));
+        ASSERT_TRUE(_pool.AppendJob(&_worker, false));
+    }
+
+    virtual void TearDown()
+    {
+        _worker.Shutdown();
+        _pool.Shutdown();
+    }
+
+    void Resolve(Probe *a, Probe *b = NULL)
+    {
+        ASSERT_TRUE(_worker.SendCommand(new ResolveJob(a, b)));
+        ASSERT_TRUE(a->Wait());
+        if (b) {
+            ASSERT_TRUE(b->Wait());
+        }
+    }
+
+    StubServer _stub;
+    AsyncResolver::Option _option;
+    flinter::LinkageWorker _worker;
+    AsyncResolver _resolver;
+    flinter::FixedThreadPool _pool;
+
+}; // class AsyncResolverTest
+
+TEST_F(AsyncResolverTest, TestImmediate)
+{
+    char hosts[] = "/tmp/test_async_resolver.XXXXXX";
+    int fd = mkstemp(hosts);
+    ASSERT_GE(fd, 0);
+    const char content[] = "# comment\n10.1.2.3 MyHost alias\n::1 myhost6\n";
+    ASSERT_EQ(static_cast<ssize_t>(sizeof(content) - 1),
+              write(fd, content, sizeof(content) - 1));
+    close(fd);
+
+    _option.hosts = hosts;
+    ASSERT_TRUE(_resolver.Initialize(&_worker, _option));
+    unlink(hosts);
+
+    std::vector<AsyncResolver::address_t> addresses;
+    EXPECT_EQ(AsyncResolver::kResultOk,
+              _resolver.Resolve("192.168.0.1", AF_INET, &addresses, NULL));
+    ASSERT_EQ(1u, addresses.size());
+    EXPECT_EQ(htonl(0xc0a80001), addresses[0].in.s_addr);
+
+    EXPECT_EQ(AsyncResolver::kResultOk,
+              _resolver.Resolve("ALIAS", AF_INET, &addresses, NULL));
+    ASSERT_EQ(1u, addresses.size());
+    EXPECT_EQ(htonl(0x0a010203), addresses[0].in.s_addr);
+
+    EXPECT_EQ(AsyncResolver::kResultOk,
+              _resolver.Resolve("myhost6", AF_INET6, &addresses, NULL));
+    ASSERT_EQ(1u, addresses.size());
+    EXPECT_EQ(AF_INET6, addresses[0].domain);
+
+    EXPECT_EQ(AsyncResolver::kResultNotFound,
+              _resolver.Resolve("bad..name", AF_INET, &addresses, NULL));
+}
+
+TEST_F(AsyncResolverTest, TestCoalesceAndCache)
+{
+    _stub.Set("svc.test", 0, 60, "10.0.0.1,10.0.0.2");
+    Start();
+
+    Probe a(&_resolver, "svc.test.");
+    Probe b(&_resolver, "SVC.test.");
+    Resolve(&a, &b);
+    EXPECT_FALSE(a._immediate);
+    EXPECT_EQ(AsyncResolver::kResultOk, a._result);
+    EXPECT_EQ(AsyncResolver::kResultOk, b._result);
+    EXPECT_EQ(2u, a._addresses.size());
+    EXPECT_EQ(2u, b._addresses.size());
+    EXPECT_EQ("10.0.0.1", a.first());
+    EXPECT_EQ(1, _stub.queries("svc.test"));
+
+    Probe c(&_resolver, "svc.test.");
+    Resolve(&c);
+    EXPECT_TRUE(c._immediate);
+    EXPECT_EQ(AsyncResolver::kResultOk, c._result);
+    EXPECT_EQ(1, _stub.queries("svc.test"));
+}
+
+TEST_F(AsyncResolverTest, TestNegativeCache)
+{
+    _stub.Set("missing.test", 3, 0, "", 1);
+    Start();
+
+    Probe a(&_resolver, "missing.test.");
+    Resolve(&a);
+    EXPECT_EQ(AsyncResolver::kResultNotFound, a._result);
+    EXPECT_EQ(1, _stub.queries("missing.test"));
+
+    Probe b(&_resolver, "missing.test.");
+    Resolve(&b);
+    EXPECT_TRUE(b._immediate);
+    EXPECT_EQ(AsyncResolver::kResultNotFound, b._result);
+    EXPECT_EQ(1, _stub.queries("missing.test"));
+
+    // SOA MINIMUM is 1s.
+    msleep(1100);
+    Probe c(&_resolver, "missing.test.");
+    Resolve(&c);
+    EXPECT_FALSE(c._immediate);
+    EXPECT_EQ(AsyncResolver::kResultNotFound, c._result);
+    EXPECT_EQ(2, _stub.queries("missing.test"));
+}
+
+TEST_F(AsyncResolverTest, TestSearch)
+{
+    _option.search.push_back("a.test");
+    _option.search.push_back("b.test");
+    _stub.Set("db.b.test", 0, 60, "10.0.0.3");
+    Start();
+
+    Probe a(&_resolver, "db");
+    Resolve(&a);
+    EXPECT_EQ(AsyncResolver::kResultOk, a._result);
+    EXPECT_EQ("10.0.0.3", a.first());
+    EXPECT_EQ(1, _stub.queries("db.a.test"));
+    EXPECT_EQ(1, _stub.queries("db.b.test"));
+    EXPECT_EQ(0, _stub.queries("db"));
+
+    // Enough dots, tried as is first.
+    Probe b(&_resolver, "db.b.test");
+    Resolve(&b);
+    EXPECT_EQ(AsyncResolver::kResultOk, b._result);
+    EXPECT_EQ(2, _stub.queries("db.b.test"));
+    EXPECT_EQ(0, _stub.queries("db.b.test.a.test"));
+}
+
+TEST_F(AsyncResolverTest, TestRetransmit)
+{
+    _stub.Set("slow.test", 0, 60, "10.0.0.4");
+    _stub.set_drop(1);
+    Start();
+
+    Probe a(&_resolver, "slow.test.");
+    Resolve(&a);
+    EXPECT_EQ(AsyncResolver::kResultOk, a._result);
+    EXPECT_EQ("10.0.0.4", a.first());
+    EXPECT_EQ(2, _stub.queries("slow.test"));
+
+    // Every try from a new port.
+    EXPECT_EQ(2u, _stub.ports());
+}
+
+TEST_F(AsyncResolverTest, TestTimeout)
+{
+    _stub.Set("dead.test", 0, 60, "10.0.0.5");
+    _stub.set_drop(100);
+    Start();
+
+    Probe a(&_resolver, "dead.test.");
+    Resolve(&a);
+    EXPECT_EQ(AsyncResolver::kResultFailed, a._result);
+    EXPECT_EQ(2, _stub.queries("dead.test"));
+
+    // Failures are not remembered.
+    _stub.set_drop(0);
+    Probe b(&_resolver, "dead.test.");
+    Resolve(&b);
+    EXPECT_FALSE(b._immediate);
+    EXPECT_EQ(AsyncResolver::kResultOk, b._result);
+}
@@ -0,0 +1,211 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <flinter/linkage/async_router.h>
+#include <flinter/types/atomic.h>
+#include <flinter/msleep.h>
+
+class Handler : public flinter::RouteHandler<std::string, int> {
+public:
+    Handler() : _next(100), _timeouts(0) {}
+
+    virtual bool Create(const std::string &key, uint64_t *channel)
+    {
+        if (key == "bad") {
+            return false;
+        }
+
+        *channel = static_cast<uint64_t>(_next.AddAndFetch(1));
+        _created.insert(key);
+        return true;
+    }
+
+    virtual bool Destroy(const uint64_t &channel)
+    {
+        _destroyed.AddAndFetch(1);
+        _last_destroyed = channel;
+        return true;
+    }
+
+    virtual void OnTimeout(const uint64_t &seq, int * /*task*/)
+    {
+        _timeouts.AddAndFetch(1);
+        _last_timeout = seq;
+    }
+
+    flinter::atomic_t _next;
+    flinter::atomic_t _timeouts;
+    flinter::atomic_t _destroyed;
+    std::set<std::string> _created;
+    uint64_t _last_destroyed;
+    uint64_t _last_timeout;
+
+}; // class Handler
+
+typedef flinter::AsyncRouter<std::string, int> Router;
+
+TEST(AsyncRouterTest, TestGetPut)
+{
+    Handler h;
+    Router r(&h);
+    uint64_t channel;
+    EXPECT_FALSE(r.Get(1, NULL, &channel));
+
+    r.Add("a");
+    r.Add("a");
+    r.Add("bad");
+    EXPECT_EQ(1u, h._created.size());
+
+    int *task = new int(5);
+    ASSERT_TRUE(r.Get(1, task, &channel));
+    EXPECT_EQ(101u, channel);
+    EXPECT_EQ(1u, r.pending());
+
+    int *back = NULL;
+    EXPECT_TRUE(r.Put(1, 0, &back));
+    EXPECT_EQ(task, back);
+    EXPECT_FALSE(r.Put(1, 0, &back));
+    EXPECT_EQ(0u, r.pending());
+    delete back;
+}
+
+TEST(AsyncRouterTest, TestRoundRobin)
+{
+    Handler h;
+    Router r(&h);
+    std::vector<std::string> hosts;
+    hosts.push_back("a");
+    hosts.push_back("b");
+    hosts.push_back("c");
+    r.SetAll(hosts);
+
+    std::map<uint64_t, int> channels;
+    for (uint64_t i = 0; i < 300; ++i) {
+        uint64_t channel;
+        ASSERT_TRUE(r.Get(i, NULL, &channel));
+        ++channels[channel];
+        ASSERT_TRUE(r.Put(i, 0, NULL));
+    }
+
+    ASSERT_EQ(3u, channels.size());
+    for (std::map<uint64_t, int>::const_iterator p = channels.begin();
+         p != channels.end(); ++p) {
+
+        EXPECT_EQ(100, p->second);
+    }
+
+    // Only changes are applied.
+    hosts.erase(hosts.begin());
+    hosts.push_back("d");
+    r.SetAll(hosts);
+    EXPECT_EQ(1, h._destroyed.Get());
+    EXPECT_EQ(4u, h._created.size());
+}
+
+TEST(AsyncRouterTest, TestTimeout)
+{
+    Handler h;
+    Router r(&h, 50000000LL);
+    r.Add("a");
+
+    uint64_t channel;
+    ASSERT_TRUE(r.Get(1, new int(1), &channel));
+    ASSERT_TRUE(r.Get(2, new int(2), &channel, 1000000000LL));
+
+    r.Cleanup();
+    EXPECT_EQ(0, h._timeouts.Get());
+
+    msleep(100);
+    r.Cleanup();
+    EXPECT_EQ(1, h._timeouts.Get());
+    EXPECT_EQ(1u, h._last_timeout);
+    EXPECT_FALSE(r.Put(1, 0, NULL));
+    EXPECT_EQ(1u, r.pending());
+
+    // Reusing a sequence times out the previous call.
+    ASSERT_TRUE(r.Get(2, new int(3), &channel));
+    EXPECT_EQ(2, h._timeouts.Get());
+    EXPECT_EQ(2u, h._last_timeout);
+
+    r.Shutdown();
+    EXPECT_EQ(3, h._timeouts.Get());
+    EXPECT_EQ(1, h._destroyed.Get());
+    EXPECT_FALSE(r.Get(3, NULL, &channel));
+}
+
+TEST(AsyncRouterTest, TestDelInFlight)
+{
+    Handler h;
+    Router r(&h);
+    r.Add("a");
+
+    uint64_t channel;
+    ASSERT_TRUE(r.Get(1, NULL, &channel));
+    r.Del("a");
+    EXPECT_FALSE(r.Get(2, NULL, &channel));
+
+    // Destroyed once the last call is done.
+    EXPECT_EQ(0, h._destroyed.Get());
+    EXPECT_TRUE(r.Put(1, 0, NULL));
+    EXPECT_EQ(1, h._destroyed.Get());
+    EXPECT_EQ(channel, h._last_destroyed);
+}
+
+static Router *g_router;
+static flinter::atomic_t g_failures;
+
+static void *Worker(void *parameter)
+{
+    uint64_t base = static_cast<uint64_t>(reinterpret_cast<intptr_t>(parameter)) << 32;
+    for (uint64_t i = 0; i < 100000; ++i) {
+        uint64_t channel;
+        uint64_t seq = base + i;
+        if (!g_router->Get(seq, new int(0), &channel)) {
+            g_failures.AddAndFetch(1);
+            continue;
+        }
+
+        int *task = NULL;
+        if (!g_router->Put(seq, 0, &task)) {
+            g_failures.AddAndFetch(1);
+        }
+
+        delete task;
+    }
+
+    return NULL;
+}
+
+TEST(AsyncRouterTest, TestConcurrent)
+{
+    Handler h;
+    Router r(&h);
+    r.Add("a");
+    r.Add("b");
+    g_router = &r;
+
+    pthread_t threads[4];
+    for (intptr_t i = 0; i < 4; ++i) {
+        pthread_create(&threads[i], NULL, Worker, reinterpret_cast<void *>(i));
+    }
+
+    // Hosts change underneath.
+    for (int i = 0; i < 100; ++i) {
+        r.Add("c");
+        r.Del("c");
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    EXPECT_EQ(0, g_failures.Get());
+    EXPECT_EQ(0u, r.pending());
+    EXPECT_EQ(100, h._destroyed.Get());
+}
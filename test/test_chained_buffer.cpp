@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <flinter/types/chained_buffer.h>
+#include <flinter/utility.h>
+
+static std::string Drain(flinter::ChainedBuffer *b)
+{
+    std::string result;
+    while (!b->empty()) {
+        const void *p;
+        size_t length;
+        b->Peek(&p, &length);
+        EXPECT_TRUE(p);
+        EXPECT_LT(0u, length);
+        result.append(reinterpret_cast<const char *>(p), length);
+        b->Consume(length);
+    }
+
+    return result;
+}
+
+TEST(ChainedBufferTest, TestEmpty)
+{
+    flinter::ChainedBuffer b;
+    const void *p;
+    size_t length;
+    b.Peek(&p, &length);
+    EXPECT_FALSE(p);
+    EXPECT_EQ(0u, length);
+    EXPECT_TRUE(b.Append("", 0));
+    EXPECT_TRUE(b.empty());
+}
+
+TEST(ChainedBufferTest, TestContiguous)
+{
+    flinter::ChainedBuffer b(16);
+    std::string s(100, 'x');
+    ASSERT_TRUE(b.Append(s.data(), s.length()));
+
+    const void *p;
+    size_t length;
+    b.Peek(&p, &length);
+    EXPECT_EQ(100u, length);
+
+    ASSERT_TRUE(b.Append("0123456789", 10));
+    EXPECT_EQ(110u, b.size());
+    b.Consume(99);
+    b.Peek(&p, &length);
+    EXPECT_EQ(1u, length);
+    EXPECT_EQ(s.substr(99) + "0123456789", Drain(&b));
+}
+
+TEST(ChainedBufferTest, TestRandom)
+{
+    flinter::ChainedBuffer b(64);
+    std::string expected;
+    std::string actual;
+    unsigned int seed = 1;
+    for (int i = 0; i < 10000; ++i) {
+        size_t length = static_cast<size_t>(rand_r(&seed)) % 200;
+        std::string s;
+        for (size_t j = 0; j < length; ++j) {
+            s.push_back(static_cast<char>('a' + (i + j) % 26));
+        }
+
+        ASSERT_TRUE(b.Append(s.data(), s.length()));
+        expected.append(s);
+
+        size_t consume = static_cast<size_t>(rand_r(&seed)) % 150;
+        while (consume && !b.empty()) {
+            const void *p;
+            size_t length;
+            b.Peek(&p, &length);
+            if (length > consume) {
+                length = consume;
+            }
+
+            actual.append(reinterpret_cast<const char *>(p), length);
+            b.Consume(length);
+            consume -= length;
+        }
+
+        ASSERT_EQ(expected.length() - actual.length(), b.size());
+    }
+
+    actual.append(Drain(&b));
+    EXPECT_EQ(expected, actual);
+}
+
+TEST(ChainedBufferTest, TestAdoptAndGather)
+{
+    flinter::ChainedBuffer b(16);
+    ASSERT_TRUE(b.Append("hello ", 6));
+
+    char *block = reinterpret_cast<char *>(malloc(32));
+    memcpy(block, "xxworld", 7);
+    b.Adopt(block, block + 2, 5);
+    ASSERT_TRUE(b.Append("!", 1));
+    EXPECT_EQ(12u, b.size());
+
+    struct iovec iov[8];
+    size_t length;
+    EXPECT_EQ(3u, b.Peek(iov, 8, 0, &length));
+    EXPECT_EQ(12u, length);
+    EXPECT_EQ(block + 2, iov[1].iov_base);
+
+    EXPECT_EQ(2u, b.Peek(iov, 8, 8, &length));
+    EXPECT_EQ(8u, length);
+    EXPECT_EQ(2u, iov[1].iov_len);
+
+    EXPECT_EQ(1u, b.Peek(iov, 1, 0, &length));
+    EXPECT_EQ(6u, length);
+
+    b.Consume(8);
+    EXPECT_EQ("rld!", Drain(&b));
+}
+
+// Enqueue a backlog, then drain it in small writes as a slow reader would.
+static double ChainedCost(size_t backlog, size_t chunk)
+{
+    std::vector<unsigned char> data(chunk, 'x');
+    flinter::ChainedBuffer b;
+    for (size_t i = 0; i < backlog; i += chunk) {
+        b.Append(&data[0], chunk);
+    }
+
+    int64_t start = get_monotonic_timestamp();
+    while (!b.empty()) {
+        const void *p;
+        size_t length;
+        b.Peek(&p, &length);
+        b.Consume(length < chunk ? length : chunk);
+    }
+
+    return static_cast<double>(get_monotonic_timestamp() - start) /
+           static_cast<double>(backlog);
+}
+
+static double VectorCost(size_t backlog, size_t chunk)
+{
+    std::vector<unsigned char> b(backlog, 'x');
+    int64_t start = get_monotonic_timestamp();
+    while (!b.empty()) {
+        std::vector<unsigned char>::iterator p = b.begin();
+        std::advance(p, static_cast<ssize_t>(chunk < b.size() ? chunk : b.size()));
+        b.erase(b.begin(), p);
+    }
+
+    return static_cast<double>(get_monotonic_timestamp() - start) /
+           static_cast<double>(backlog);
+}
+
+// Run with --gtest_also_run_disabled_tests.
+TEST(ChainedBufferTest, DISABLED_BenchmarkConsume)
+{
+    static const size_t kChunk = 1024;
+    for (size_t backlog = 65536; backlog <= 64 * 1024 * 1024; backlog *= 4) {
+        double chained = ChainedCost(backlog, kChunk);
+        if (backlog <= 4 * 1024 * 1024) {
+            double vector = VectorCost(backlog, kChunk);
+            printf("backlog %9lu: chained %.3f ns/byte, vector %.3f ns/byte\n",
+                   backlog, chained, vector);
+        } else {
+            printf("backlog %9lu: chained %.3f ns/byte\n", backlog, chained);
+        }
+    }
+}
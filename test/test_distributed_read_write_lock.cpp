@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <flinter/thread/distributed_read_write_lock.h>
+#include <flinter/thread/read_locker.h>
+#include <flinter/thread/read_write_lock.h>
+#include <flinter/thread/write_locker.h>
+#include <flinter/types/atomic.h>
+#include <flinter/utility.h>
+
+template <class T>
+struct Shared {
+    Shared() : rounds(0), writes(0), first(0), second(0), broken(0) {}
+    T lock;
+    size_t rounds;
+    size_t writes;
+    size_t first;
+    size_t second;
+    flinter::Atomic<size_t> broken;
+}; // struct Shared
+
+// Writers keep both the same, readers must never see them differ.
+template <class T>
+static void *Access(void *parameter)
+{
+    Shared<T> *s = reinterpret_cast<Shared<T> *>(parameter);
+    for (size_t i = 0; i < s->rounds; ++i) {
+        if (s->writes && i % s->writes == 0) {
+            flinter::BasicWriteLocker<T> locker(&s->lock);
+            ++s->first;
+            ++s->second;
+        } else {
+            flinter::BasicReadLocker<T> locker(&s->lock);
+            if (s->first != s->second) {
+                s->broken.AddAndFetch(1);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// @return nanoseconds per locking.
+template <class T>
+static double Spawn(Shared<T> *s, size_t threads)
+{
+    std::vector<pthread_t> tids(threads);
+    int64_t start = get_monotonic_timestamp();
+    for (size_t i = 0; i < threads; ++i) {
+        EXPECT_EQ(0, pthread_create(&tids[i], NULL, Access<T>, s));
+    }
+
+    for (size_t i = 0; i < threads; ++i) {
+        pthread_join(tids[i], NULL);
+    }
+
+    return static_cast<double>(get_monotonic_timestamp() - start) /
+           static_cast<double>(threads * s->rounds);
+}
+
+template <class T>
+static double Benchmark(size_t threads, size_t rounds)
+{
+    Shared<T> s;
+    s.rounds = rounds;
+    return Spawn(&s, threads);
+}
+
+TEST(DistributedReadWriteLockTest, TestTryLock)
+{
+    flinter::DistributedReadWriteLock lock;
+    EXPECT_TRUE(lock.TryReaderLock());
+    EXPECT_TRUE(lock.TryReaderLock());
+    EXPECT_FALSE(lock.TryWriterLock());
+    lock.Unlock();
+    EXPECT_FALSE(lock.TryWriterLock());
+    lock.Unlock();
+
+    EXPECT_TRUE(lock.TryWriterLock());
+    EXPECT_FALSE(lock.TryReaderLock());
+    EXPECT_FALSE(lock.TryWriterLock());
+    lock.Unlock();
+
+    lock.ReaderLock();
+    lock.Unlock();
+    lock.WriterLock();
+    lock.Unlock();
+    EXPECT_TRUE(lock.TryReaderLock());
+    lock.Unlock();
+}
+
+TEST(DistributedReadWriteLockTest, TestExclusive)
+{
+    Shared<flinter::DistributedReadWriteLock> s;
+    s.rounds = 100000;
+    s.writes = 100;
+    Spawn(&s, 8);
+
+    EXPECT_EQ(0u, s.broken.Get());
+    EXPECT_EQ(8 * s.rounds / s.writes, s.first);
+    EXPECT_EQ(s.first, s.second);
+}
+
+// Run with --gtest_also_run_disabled_tests.
+TEST(DistributedReadWriteLockTest, DISABLED_Benchmark)
+{
+    static const size_t kRounds = 1000000;
+    size_t cpus = static_cast<size_t>(sysconf(_SC_NPROCESSORS_ONLN));
+
+    // Readers only, up to all cores.
+    for (size_t threads = 1; ; threads *= 2) {
+        threads = threads < cpus ? threads : cpus;
+        printf("%3zu readers  pthread %7.1f ns, distributed %7.1f ns\n",
+               threads,
+               Benchmark<flinter::ReadWriteLock>(threads, kRounds / threads),
+               Benchmark<flinter::DistributedReadWriteLock>(threads, kRounds / threads));
+
+        if (threads == cpus) {
+            break;
+        }
+    }
+}
@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include <flinter/linkage/easy_server.h>
+#include <flinter/thread/condition.h>
+#include <flinter/thread/mutex.h>
+#include <flinter/thread/mutex_locker.h>
+#include <flinter/types/atomic.h>
+#include <flinter/logger.h>
+#include <flinter/runnable.h>
+#include <flinter/utility.h>
+
+// Counts runs, the last one expected wakes up the waiter.
+class Latch {
+public:
+    explicit Latch(int64_t expected) : _expected(expected), _done(false) {}
+
+    void CountDown()
+    {
+        if (_count.AddAndFetch(1) != _expected) {
+            return;
+        }
+
+        flinter::MutexLocker locker(&_mutex);
+        _done = true;
+        _condition.WakeAll();
+    }
+
+    void Wait()
+    {
+        flinter::MutexLocker locker(&_mutex);
+        while (!_done) {
+            _condition.Wait(&_mutex);
+        }
+    }
+
+    int64_t count() const
+    {
+        return _count.Get();
+    }
+
+private:
+    flinter::atomic64_t _count;
+    const int64_t _expected;
+    flinter::Condition _condition;
+    flinter::Mutex _mutex;
+    bool _done;
+
+}; // class Latch
+
+class Job : public flinter::Runnable {
+public:
+    // @param last if not NULL, sequence of the last job of the same hash.
+    Job(Latch *latch, int64_t *last, int64_t sequence, flinter::atomic_t *errors)
+            : _latch(latch), _last(last), _sequence(sequence), _errors(errors) {}
+
+    virtual ~Job() {}
+    virtual bool Run()
+    {
+        // Only the worker owning this hash ever gets here.
+        if (_last) {
+            if (*_last >= _sequence) {
+                _errors->AddAndFetch(1);
+            }
+
+            *_last = _sequence;
+        }
+
+        _latch->CountDown();
+        return true;
+    }
+
+private:
+    Latch *const _latch;
+    int64_t *const _last;
+    const int64_t _sequence;
+    flinter::atomic_t *const _errors;
+
+}; // class Job
+
+struct Producer {
+    flinter::EasyServer *server;
+    Latch *latch;
+    std::vector<int64_t> *lasts; // NULL for jobs without hash.
+    flinter::atomic_t *errors;
+    int hash;
+    int64_t jobs;
+}; // struct Producer
+
+static void *Produce(void *parameter)
+{
+    Producer *p = reinterpret_cast<Producer *>(parameter);
+    for (int64_t i = 0; i < p->jobs; ++i) {
+        int64_t *last = p->lasts ? &(*p->lasts)[static_cast<size_t>(p->hash)] : NULL;
+        Job *job = new Job(p->latch, last, i, p->errors);
+        p->server->QueueOrExecuteJob(job, p->lasts ? p->hash : -1);
+    }
+
+    return NULL;
+}
+
+// Runs producers appending jobs at the same time.
+// @return nanoseconds taken until all jobs are run.
+static int64_t Run(flinter::EasyServer *server,
+                   size_t unhashed, size_t hashed, int64_t jobs,
+                   flinter::atomic_t *errors)
+{
+    size_t count = unhashed + hashed;
+    Latch latch(static_cast<int64_t>(count) * jobs);
+    std::vector<int64_t> lasts(hashed, -1);
+    std::vector<Producer> producers(count);
+    std::vector<pthread_t> threads(count);
+
+    int64_t start = get_monotonic_timestamp();
+    for (size_t i = 0; i < count; ++i) {
+        Producer *p = &producers[i];
+        p->server = server;
+        p->latch = &latch;
+        p->lasts = i < unhashed ? NULL : &lasts;
+        p->errors = errors;
+        p->hash = static_cast<int>(i - unhashed);
+        p->jobs = jobs;
+        EXPECT_EQ(0, pthread_create(&threads[i], NULL, Produce, p));
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    latch.Wait();
+    int64_t taken = get_monotonic_timestamp() - start;
+    EXPECT_EQ(static_cast<int64_t>(count) * jobs, latch.count());
+    return taken;
+}
+
+// Every job is run exactly once, hashed ones in order.
+TEST(EasyServerJobsTest, TestAllRun)
+{
+    flinter::Logger::SetFilter(flinter::Logger::kLevelError);
+    flinter::EasyServer server;
+    ASSERT_TRUE(server.Initialize(1, 4));
+
+    flinter::atomic_t errors;
+    ::Run(&server, 4, 4, 20000, &errors);
+    EXPECT_EQ(0, errors.Get());
+    ASSERT_TRUE(server.Shutdown());
+}
+
+// Run with --gtest_also_run_disabled_tests.
+TEST(EasyServerJobsTest, DISABLED_BenchmarkUnhashed)
+{
+    flinter::Logger::SetFilter(flinter::Logger::kLevelError);
+
+    static const size_t kProducers = 4;
+    static const int64_t kJobs = 1 << 17;
+    for (size_t workers = 1; workers <= 16; workers <<= 1) {
+        flinter::EasyServer server;
+        ASSERT_TRUE(server.Initialize(1, workers));
+
+        flinter::atomic_t errors;
+        int64_t taken = ::Run(&server, kProducers, 0, kJobs, &errors);
+        double total = static_cast<double>(kProducers * kJobs);
+        printf("%2lu workers %8.1f ns/job %10.0f jobs/s\n",
+               static_cast<unsigned long>(workers),
+               static_cast<double>(taken) / total,
+               total * 1000000000.0 / static_cast<double>(taken));
+
+        ASSERT_TRUE(server.Shutdown());
+    }
+}
@@ -0,0 +1,305 @@
+#include <gtest/gtest.h>
+
+#include <sys/socket.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <flinter/linkage/easy_context.h>
+#include <flinter/linkage/easy_handler.h>
+#include <flinter/linkage/easy_server.h>
+#include <flinter/linkage/easy_upstream.h>
+#include <flinter/linkage/linkage_peer.h>
+#include <flinter/thread/mutex.h>
+#include <flinter/thread/mutex_locker.h>
+#include <flinter/logger.h>
+#include <flinter/msleep.h>
+
+#include "loopback.h"
+
+using flinter::EasyServer;
+using flinter::EasyUpstream;
+
+// Counts connections and messages by listening port.
+class Backend : public flinter::EasyHandler {
+public:
+    virtual ssize_t GetMessageLength(const flinter::EasyContext &,
+                                     const void *, size_t length)
+    {
+        return length >= 4 ? 4 : 0;
+    }
+
+    virtual int OnMessage(const flinter::EasyContext &context,
+                          const void *, size_t)
+    {
+        flinter::MutexLocker locker(&_mutex);
+        ++_messages[context.me().port()];
+        return 1;
+    }
+
+    virtual bool OnConnected(const flinter::EasyContext &context)
+    {
+        flinter::MutexLocker locker(&_mutex);
+        ++_connections[context.me().port()];
+        return true;
+    }
+
+    int connections(uint16_t port)
+    {
+        flinter::MutexLocker locker(&_mutex);
+        return _connections[port];
+    }
+
+    int messages(uint16_t port)
+    {
+        flinter::MutexLocker locker(&_mutex);
+        return _messages[port];
+    }
+
+private:
+    flinter::Mutex _mutex;
+    std::map<uint16_t, int> _connections;
+    std::map<uint16_t, int> _messages;
+
+}; // class Backend
+
+class Client : public flinter::EasyHandler {
+public:
+    virtual ssize_t GetMessageLength(const flinter::EasyContext &,
+                                     const void *, size_t length)
+    {
+        return length >= 4 ? 4 : 0;
+    }
+
+    virtual int OnMessage(const flinter::EasyContext &, const void *, size_t)
+    {
+        return 1;
+    }
+
+}; // class Client
+
+class EasyUpstreamTest : public ::testing::Test {
+protected:
+    EasyUpstreamTest() : _port(GetLoopbackPort()), _upstream(NULL)
+    {
+        // Intended left blank.
+    }
+
+    virtual void SetUp()
+    {
+        flinter::Logger::SetFilter(flinter::Logger::kLevelError);
+        ASSERT_TRUE(_server.Listen(_port, &_backend));
+        ASSERT_TRUE(_server.Listen(static_cast<uint16_t>(_port + 1), &_backend));
+        ASSERT_TRUE(_server.Initialize(1, 0));
+        ASSERT_TRUE(_client.Initialize(2, 0));
+    }
+
+    virtual void TearDown()
+    {
+        _client.Shutdown();
+        delete _upstream;
+        _server.Shutdown();
+    }
+
+    void Create(const EasyUpstream::Option &option)
+    {
+        _upstream = new EasyUpstream(&_client, option);
+    }
+
+    static std::string Name(uint16_t port)
+    {
+        char name[32];
+        sprintf(name, "127.0.0.1:%u", port);
+        return name;
+    }
+
+    bool Add(uint16_t port)
+    {
+        EasyServer::ConnectOption o;
+        o.connect_socket.domain = AF_INET;
+        o.connect_socket.socket_hostname = "127.0.0.1";
+        o.connect_socket.socket_port = port;
+        o.easy_handler = &_handler;
+        return _upstream->Add(Name(port), o);
+    }
+
+    uint16_t _port;
+    Backend _backend;
+    Client _handler;
+    EasyServer _server;
+    EasyServer _client;
+    EasyUpstream *_upstream;
+
+}; // class EasyUpstreamTest
+
+TEST_F(EasyUpstreamTest, TestConnections)
+{
+    EasyUpstream::Option option;
+    option.connections = 2;
+    option.standby_connections = 1;
+    Create(option);
+
+    EasyUpstream::Connection *c;
+    EXPECT_EQ(EasyServer::kInvalidChannel, _upstream->Get(&c));
+    EXPECT_EQ(NULL, c);
+
+    ASSERT_TRUE(Add(_port));
+    ASSERT_TRUE(Add(static_cast<uint16_t>(_port + 1)));
+    ASSERT_FALSE(Add(_port));
+    EXPECT_EQ(2u, _upstream->backends());
+
+    // Connected in advance, standby ones as well.
+    msleep(300);
+    EXPECT_EQ(3, _backend.connections(_port));
+    EXPECT_EQ(3, _backend.connections(static_cast<uint16_t>(_port + 1)));
+
+    // Standby connections are not used if regular ones are up.
+    std::vector<EasyUpstream::Connection *> connections;
+    std::set<EasyServer::channel_t> channels;
+    for (int i = 0; i < 100; ++i) {
+        EasyServer::channel_t channel = _upstream->Get(&c);
+        ASSERT_TRUE(EasyServer::IsValidChannel(channel));
+        ASSERT_TRUE(_client.Send(channel, "ping", 4));
+        connections.push_back(c);
+        channels.insert(channel);
+    }
+
+    EXPECT_EQ(4u, channels.size());
+    msleep(300);
+    int a = _backend.messages(_port);
+    int b = _backend.messages(static_cast<uint16_t>(_port + 1));
+    EXPECT_EQ(100, a + b);
+    EXPECT_LE(abs(a - b), 2);
+
+    for (size_t i = 0; i < connections.size(); ++i) {
+        _upstream->Put(connections[i], true);
+    }
+
+    EXPECT_TRUE(_upstream->Remove(Name(_port)));
+    EXPECT_FALSE(_upstream->Remove(Name(_port)));
+    EXPECT_EQ(1u, _upstream->backends());
+}
+
+TEST_F(EasyUpstreamTest, TestLeastPending)
+{
+    EasyUpstream::Option option;
+    option.connections = 3;
+    option.balance = EasyUpstream::kBalanceLeastPending;
+    Create(option);
+    ASSERT_TRUE(Add(_port));
+    ASSERT_TRUE(Add(static_cast<uint16_t>(_port + 1)));
+    msleep(300);
+
+    // Pending requests are spread evenly over backends and connections.
+    std::vector<EasyUpstream::Connection *> connections;
+    std::map<EasyServer::channel_t, int> channels;
+    for (int i = 0; i < 60; ++i) {
+        EasyUpstream::Connection *c;
+        ++channels[_upstream->Get(&c)];
+        connections.push_back(c);
+    }
+
+    EXPECT_EQ(6u, channels.size());
+    for (std::map<EasyServer::channel_t, int>::const_iterator p = channels.begin();
+         p != channels.end(); ++p) {
+
+        EXPECT_EQ(10, p->second);
+    }
+
+    for (size_t i = 0; i < connections.size(); ++i) {
+        _upstream->Put(connections[i], true);
+    }
+}
+
+TEST_F(EasyUpstreamTest, TestEjection)
+{
+    EasyUpstream::Option option;
+    option.ejection_threshold = 3;
+    option.maximum_ejection_percent = 100;
+    Create(option);
+
+    // Nobody listens, connecting fails and it's ejected.
+    ASSERT_TRUE(Add(static_cast<uint16_t>(_port + 2)));
+    ASSERT_TRUE(Add(_port));
+    for (int i = 0; i < 10 && !_upstream->ejected_backends(); ++i) {
+        msleep(300);
+    }
+
+    EXPECT_EQ(1u, _upstream->ejected_backends());
+    for (int i = 0; i < 50; ++i) {
+        EasyUpstream::Connection *c;
+        EasyServer::channel_t channel = _upstream->Get(&c);
+        ASSERT_TRUE(_client.Send(channel, "ping", 4));
+        _upstream->Put(c, true);
+    }
+
+    msleep(300);
+    EXPECT_EQ(50, _backend.messages(_port));
+
+    // Timeouts and errors reported by the caller count as well.
+    for (int i = 0; i < 3; ++i) {
+        EasyUpstream::Connection *c;
+        _upstream->Get(&c);
+        _upstream->Put(c, false);
+    }
+
+    EXPECT_EQ(2u, _upstream->ejected_backends());
+
+    // All ejected, still picked rather than failing everything.
+    EasyUpstream::Connection *c;
+    EXPECT_TRUE(EasyServer::IsValidChannel(_upstream->Get(&c)));
+    _upstream->Put(c, true);
+}
+
+TEST_F(EasyUpstreamTest, TestMaximumEjectionPercent)
+{
+    EasyUpstream::Option option;
+    option.ejection_threshold = 1;
+    option.maximum_ejection_percent = 50;
+    option.balance = EasyUpstream::kBalanceLeastPending;
+    Create(option);
+    ASSERT_TRUE(Add(_port));
+    ASSERT_TRUE(Add(static_cast<uint16_t>(_port + 1)));
+    msleep(300);
+
+    for (int i = 0; i < 10; ++i) {
+        EasyUpstream::Connection *c;
+        _upstream->Get(&c);
+        _upstream->Put(c, false);
+    }
+
+    EXPECT_EQ(1u, _upstream->ejected_backends());
+}
+
+TEST_F(EasyUpstreamTest, TestReclaim)
+{
+    EasyUpstream::Option option;
+    option.reconnect_interval = 100000000LL;
+    Create(option);
+    ASSERT_TRUE(Add(_port));
+    msleep(300);
+
+    EasyUpstream::Connection *c;
+    EasyServer::channel_t channel = _upstream->Get(&c);
+    ASSERT_TRUE(_client.Send(channel, "ping", 4));
+    ASSERT_TRUE(_upstream->Remove(Name(_port)));
+    EXPECT_EQ(0u, _upstream->backends());
+
+    // Still pending.
+    msleep(300);
+    EXPECT_EQ(1, _backend.messages(_port));
+    EXPECT_EQ(1u, _upstream->retired_backends());
+
+    _upstream->Put(c, true);
+    for (int i = 0; i < 30 && _upstream->retired_backends(); ++i) {
+        msleep(100);
+    }
+
+    EXPECT_EQ(0u, _upstream->retired_backends());
+}
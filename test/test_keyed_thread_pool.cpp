@@ -1,10 +1,16 @@
 #include <gtest/gtest.h>
 
+#include <pthread.h>
+#include <stdio.h>
+
+#include <vector>
+
 #include <flinter/thread/keyed_thread_pool.h>
 #include <flinter/types/atomic.h>
 #include <flinter/logger.h>
 #include <flinter/msleep.h>
 #include <flinter/runnable.h>
+#include <flinter/utility.h>
 
 typedef flinter::atomic64_t count_t;
 
@@ -50,3 +56,185 @@ TEST(FixedThreadPoolTest, TestKeyed)
     ASSERT_EQ(a.Get(), 5);
     ASSERT_EQ(b.Get(), 5);
 }
+
+static const size_t kKeys = 64;
+
+// Checks jobs of the same key run one by one, in the order they're appended.
+struct KeyState {
+    flinter::atomic_t running;
+    flinter::atomic64_t last;
+}; // struct KeyState
+
+class Ordered : public flinter::Runnable {
+public:
+    Ordered(KeyState *state, int64_t sequence, count_t *errors, count_t *done, int spin)
+            : _state(state), _sequence(sequence), _errors(errors), _done(done), _spin(spin) {}
+
+    virtual ~Ordered() {}
+    virtual bool Run()
+    {
+        if (_state->running.CompareAndSwap(0, 1) != 0) {
+            _errors->AddAndFetch(1);
+        }
+
+        if (_state->last.Get() + 1 != _sequence) {
+            _errors->AddAndFetch(1);
+        }
+
+        _state->last.Set(_sequence);
+        for (volatile int i = 0; i < _spin; ++i);
+
+        _state->running.BarrierSet(0);
+        _done->AddAndFetch(1);
+        return true;
+    }
+
+private:
+    KeyState *const _state;
+    const int64_t _sequence;
+    count_t *const _errors;
+    count_t *const _done;
+    const int _spin;
+
+}; // class Ordered
+
+// One hot key gets half of the jobs, the others share the rest.
+static int64_t RunSkewed(flinter::KeyedThreadPool *pool, int jobs, count_t *errors)
+{
+    std::vector<KeyState> states(kKeys);
+    std::vector<int64_t> sequences(kKeys, 0);
+    count_t done;
+
+    int64_t start = get_monotonic_timestamp();
+    for (int i = 0; i < jobs; ++i) {
+        size_t key = i % 2 ? 0 : static_cast<size_t>(i / 2) % (kKeys - 1) + 1;
+        int64_t sequence = ++sequences[key];
+        Ordered *job = new Ordered(&states[key], sequence, errors, &done, 2000);
+        EXPECT_TRUE(pool->AppendJobWithKey(key * 4, job, true));
+    }
+
+    while (done.BarrierGet() < jobs) {
+        msleep(1);
+    }
+
+    return get_monotonic_timestamp() - start;
+}
+
+TEST(KeyedThreadPoolTest, TestOrdered)
+{
+    flinter::Logger::SetFilter(flinter::Logger::kLevelError);
+    flinter::KeyedThreadPool pool;
+    ASSERT_TRUE(pool.Initialize(4));
+
+    count_t errors;
+    RunSkewed(&pool, 20000, &errors);
+    EXPECT_EQ(0, errors.Get());
+    EXPECT_EQ(0, pool.migrations());
+
+    // Keys are multiples of 4, all on one thread.
+    EXPECT_LT(0u, pool.GetMaximumQueueDepth(0, true));
+    for (size_t i = 1; i < pool.size(); ++i) {
+        EXPECT_EQ(0u, pool.GetMaximumQueueDepth(i));
+    }
+
+    EXPECT_EQ(0u, pool.GetQueueDepth(0));
+    ASSERT_TRUE(pool.Shutdown(true));
+}
+
+TEST(KeyedThreadPoolTest, TestMigration)
+{
+    flinter::Logger::SetFilter(flinter::Logger::kLevelError);
+    flinter::KeyedThreadPool pool;
+    pool.set_migration(1000000LL); // 1ms
+    ASSERT_TRUE(pool.Initialize(4));
+
+    count_t errors;
+    RunSkewed(&pool, 20000, &errors);
+    EXPECT_EQ(0, errors.Get());
+    EXPECT_LT(0, pool.migrations());
+    ASSERT_TRUE(pool.Shutdown(true));
+}
+
+class Counter : public flinter::Runnable {
+public:
+    explicit Counter(count_t *done) : _done(done) {}
+    virtual ~Counter() {}
+    virtual bool Run()
+    {
+        _done->AddAndFetch(1);
+        return true;
+    }
+
+private:
+    count_t *const _done;
+
+}; // class Counter
+
+struct Appender {
+    flinter::KeyedThreadPool *pool;
+    flinter::atomic_t quit;
+    count_t appended;
+    count_t done;
+}; // struct Appender
+
+static void *Append(void *parameter)
+{
+    Appender *a = reinterpret_cast<Appender *>(parameter);
+    for (size_t key = 0; !a->quit.BarrierGet(); ++key) {
+        if (a->pool->AppendJobWithKey(key, new Counter(&a->done), true)) {
+            a->appended.AddAndFetch(1);
+        }
+    }
+
+    return NULL;
+}
+
+// Appending while the pool is (re)initialized never sees half built threads.
+TEST(KeyedThreadPoolTest, TestAppendWhileInitializing)
+{
+    flinter::Logger::SetFilter(flinter::Logger::kLevelError);
+    flinter::KeyedThreadPool pool;
+    pool.set_migration(1000000LL); // 1ms
+
+    Appender a;
+    a.pool = &pool;
+    pthread_t tid;
+    ASSERT_EQ(0, pthread_create(&tid, NULL, Append, &a));
+    for (int i = 0; i < 50; ++i) {
+        ASSERT_TRUE(pool.Initialize(4));
+        msleep(1);
+        ASSERT_TRUE(pool.Shutdown(true));
+    }
+
+    a.quit.BarrierSet(1);
+    pthread_join(tid, NULL);
+    // Jobs not taken yet are purged by Shutdown().
+    EXPECT_LT(0, a.appended.Get());
+    EXPECT_GE(a.appended.Get(), a.done.Get());
+}
+
+// Run with --gtest_also_run_disabled_tests.
+TEST(KeyedThreadPoolTest, DISABLED_BenchmarkSkewed)
+{
+    flinter::Logger::SetFilter(flinter::Logger::kLevelError);
+    for (int migration = 0; migration < 2; ++migration) {
+        flinter::KeyedThreadPool pool;
+        pool.set_migration(migration ? 1000000LL : 0);
+        ASSERT_TRUE(pool.Initialize(4));
+
+        count_t errors;
+        int64_t cost = RunSkewed(&pool, 100000, &errors);
+        printf("migration %-3s %8.1f ms, %ld migrations, maximum depths",
+               migration ? "on" : "off",
+               static_cast<double>(cost) / 1000000.0,
+               pool.migrations());
+
+        for (size_t i = 0; i < pool.size(); ++i) {
+            printf(" %lu", pool.GetMaximumQueueDepth(i));
+        }
+
+        printf("\n");
+        EXPECT_EQ(0, errors.Get());
+        ASSERT_TRUE(pool.Shutdown(true));
+    }
+}
@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+
+#include <flinter/types/latency_histogram.h>
+
+TEST(LatencyHistogramTest, TestEmpty)
+{
+    flinter::LatencyHistogram histogram;
+    EXPECT_EQ(0u, histogram.count());
+    EXPECT_EQ(0, histogram.GetPercentile(99));
+}
+
+TEST(LatencyHistogramTest, TestPercentile)
+{
+    flinter::LatencyHistogram histogram;
+    for (int i = 0; i < 990; ++i) {
+        histogram.Record(2500); // 2us
+    }
+
+    for (int i = 0; i < 10; ++i) {
+        histogram.Record(1000000); // 1ms
+    }
+
+    EXPECT_EQ(1000u, histogram.count());
+    EXPECT_EQ(3000, histogram.GetPercentile(50));
+    EXPECT_EQ(3000, histogram.GetPercentile(99));
+
+    // Within a quarter of the true value, never below it.
+    int64_t p = histogram.GetPercentile(99.9);
+    EXPECT_GT(p, 1000000);
+    EXPECT_LE(p, 1250000);
+    EXPECT_EQ(p, histogram.GetPercentile(100));
+
+    histogram.Reset();
+    EXPECT_EQ(0u, histogram.count());
+}
+
+TEST(LatencyHistogramTest, TestRange)
+{
+    flinter::LatencyHistogram histogram;
+    histogram.Record(-1);
+    EXPECT_EQ(1000, histogram.GetPercentile(100));
+
+    // Clamped rather than lost.
+    histogram.Record(INT64_MAX);
+    EXPECT_EQ(2u, histogram.count());
+    EXPECT_GT(histogram.GetPercentile(100), 3600LL * 1000000000LL);
+}
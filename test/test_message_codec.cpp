@@ -0,0 +1,199 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <flinter/linkage/message_codec.h>
+
+// Feed the message byte by byte as if it trickles in.
+static ssize_t Trickle(flinter::MessageCodec *codec, const std::string &message)
+{
+    for (size_t i = 1; i <= message.length(); ++i) {
+        ssize_t ret = codec->GetMessageLength(message.data(), i);
+        if (ret) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+TEST(MessageCodecTest, TestLengthFieldBigEndian)
+{
+    // 2 bytes magic, 4 bytes length of the whole message.
+    flinter::LengthFieldCodec codec(2, 4, true, 0, 1024);
+    std::string m("\xAB\xCD\x00\x00\x00\x0A" "abcd", 10);
+    EXPECT_EQ(0, codec.GetMessageLength(m.data(), 5));
+    EXPECT_EQ(10, codec.GetMessageLength(m.data(), 6));
+    EXPECT_EQ(10, Trickle(&codec, m));
+
+    std::string small("\xAB\xCD\x00\x00\x00\x05", 6);
+    EXPECT_GT(0, codec.GetMessageLength(small.data(), small.length()));
+
+    std::string large("\xAB\xCD\x00\x00\x04\x01", 6);
+    EXPECT_GT(0, codec.GetMessageLength(large.data(), large.length()));
+
+    std::string huge("\xAB\xCD\xFF\xFF\xFF\xFF", 6);
+    EXPECT_GT(0, codec.GetMessageLength(huge.data(), huge.length()));
+}
+
+TEST(MessageCodecTest, TestLengthFieldLittleEndian)
+{
+    // 2 bytes length of the body only.
+    flinter::LengthFieldCodec codec(0, 2, false, 2, 1024);
+    std::string m("\x03\x00" "abc", 5);
+    EXPECT_EQ(0, codec.GetMessageLength(m.data(), 1));
+    EXPECT_EQ(5, codec.GetMessageLength(m.data(), 2));
+
+    std::string empty("\x00\x00", 2);
+    EXPECT_EQ(2, codec.GetMessageLength(empty.data(), empty.length()));
+
+    flinter::LengthFieldCodec wide(0, 8, false, 8, 1ull << 40);
+    std::string w("\x00\x00\x00\x00\x01\x00\x00\x00", 8);
+    EXPECT_EQ((1ll << 32) + 8, wide.GetMessageLength(w.data(), w.length()));
+}
+
+TEST(MessageCodecTest, TestVarint)
+{
+    flinter::VarintCodec codec(1024);
+    std::string m("\x03" "abc");
+    EXPECT_EQ(4, codec.GetMessageLength(m.data(), 1));
+
+    // 300 = 0xAC 0x02
+    std::string w("\xAC\x02", 2);
+    EXPECT_EQ(0, codec.GetMessageLength(w.data(), 1));
+    EXPECT_EQ(302, codec.GetMessageLength(w.data(), 2));
+
+    std::string empty("\x00", 1);
+    EXPECT_EQ(1, codec.GetMessageLength(empty.data(), empty.length()));
+
+    // 1024 plus the prefix.
+    std::string large("\x80\x08", 2);
+    EXPECT_GT(0, codec.GetMessageLength(large.data(), large.length()));
+
+    std::string invalid(11, '\xFF');
+    EXPECT_EQ(0, codec.GetMessageLength(invalid.data(), 9));
+    EXPECT_GT(0, codec.GetMessageLength(invalid.data(), 10));
+}
+
+TEST(MessageCodecTest, TestDelimiter)
+{
+    flinter::DelimiterCodec line("\n", 16);
+    EXPECT_EQ(6, Trickle(&line, "hello\nworld\n"));
+    EXPECT_EQ(6, Trickle(&line, "world\n"));
+    EXPECT_EQ(1, line.GetMessageLength("\n", 1));
+    EXPECT_EQ(0, line.GetMessageLength("0123456789abcde", 15));
+    EXPECT_GT(0, line.GetMessageLength("0123456789abcdef", 16));
+
+    line.Reset();
+    EXPECT_EQ(16, line.GetMessageLength("0123456789abcde\n", 16));
+
+    flinter::DelimiterCodec crlf("\r\n", 1024);
+    EXPECT_EQ(0, crlf.GetMessageLength("GET\r", 4));
+    EXPECT_EQ(5, crlf.GetMessageLength("GET\r\n", 5));
+    EXPECT_EQ(7, Trickle(&crlf, "a\rb\nc\r\n"));
+}
+
+TEST(MessageCodecTest, TestHttpContentLength)
+{
+    flinter::HttpCodec codec(true, 1024, 4096);
+    std::string m("POST / HTTP/1.1\r\n"
+                  "Host: example.com\r\n"
+                  "content-length:  5 \r\n"
+                  "\r\n"
+                  "hello");
+
+    EXPECT_EQ(static_cast<ssize_t>(m.length()), Trickle(&codec, m));
+    EXPECT_EQ(static_cast<ssize_t>(m.length()),
+              codec.GetMessageLength(m.data(), m.length()));
+
+    std::string get("GET / HTTP/1.1\r\nHost: example.com\r\n\r\n");
+    EXPECT_EQ(static_cast<ssize_t>(get.length()), Trickle(&codec, get));
+
+    std::string conflict("POST / HTTP/1.1\r\n"
+                         "Content-Length: 5\r\n"
+                         "Content-Length: 6\r\n"
+                         "\r\n");
+
+    EXPECT_GT(0, codec.GetMessageLength(conflict.data(), conflict.length()));
+    codec.Reset();
+
+    std::string large("POST / HTTP/1.1\r\nContent-Length: 5000\r\n\r\n");
+    EXPECT_GT(0, codec.GetMessageLength(large.data(), large.length()));
+    codec.Reset();
+
+    std::string header(1024, 'a');
+    EXPECT_GT(0, codec.GetMessageLength(header.data(), header.length()));
+}
+
+TEST(MessageCodecTest, TestHttpChunked)
+{
+    flinter::HttpCodec codec(false, 1024, 4096);
+    std::string m("HTTP/1.1 200 OK\r\n"
+                  "Transfer-Encoding: gzip, Chunked\r\n"
+                  "Content-Length: 100\r\n"
+                  "\r\n"
+                  "5;name=value\r\n"
+                  "hello\r\n"
+                  "A\r\n"
+                  "0123456789\r\n"
+                  "0\r\n"
+                  "Trailer: yes\r\n"
+                  "\r\n");
+
+    EXPECT_EQ(static_cast<ssize_t>(m.length()), Trickle(&codec, m));
+    EXPECT_EQ(static_cast<ssize_t>(m.length()),
+              codec.GetMessageLength(m.data(), m.length()));
+
+    // Pipelined, only the first one counts.
+    std::string twice = m + m;
+    EXPECT_EQ(static_cast<ssize_t>(m.length()),
+              codec.GetMessageLength(twice.data(), twice.length()));
+
+    std::string bad("HTTP/1.1 200 OK\r\n"
+                    "Transfer-Encoding: chunked\r\n"
+                    "\r\n"
+                    "5\r\n"
+                    "hello!\r\n"
+                    "0\r\n"
+                    "\r\n");
+
+    EXPECT_GT(0, codec.GetMessageLength(bad.data(), bad.length()));
+    codec.Reset();
+
+    std::string size("HTTP/1.1 200 OK\r\n"
+                     "Transfer-Encoding: chunked\r\n"
+                     "\r\n"
+                     "x\r\n");
+
+    EXPECT_GT(0, codec.GetMessageLength(size.data(), size.length()));
+    codec.Reset();
+
+    std::string large("HTTP/1.1 200 OK\r\n"
+                      "Transfer-Encoding: chunked\r\n"
+                      "\r\n"
+                      "FFFFFFFFFFFFFFFFFFFF\r\n");
+
+    EXPECT_GT(0, codec.GetMessageLength(large.data(), large.length()));
+}
+
+TEST(MessageCodecTest, TestHttpResponse)
+{
+    flinter::HttpCodec codec(false, 1024, 4096);
+    std::string no_content("HTTP/1.1 204 No Content\r\n"
+                           "Content-Length: 10\r\n"
+                           "\r\n");
+
+    EXPECT_EQ(static_cast<ssize_t>(no_content.length()),
+              codec.GetMessageLength(no_content.data(), no_content.length()));
+
+    std::string close("HTTP/1.1 200 OK\r\nConnection: close\r\n\r\n");
+    EXPECT_GT(0, codec.GetMessageLength(close.data(), close.length()));
+    codec.Reset();
+
+    std::string gzip("HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip\r\n\r\n");
+    EXPECT_GT(0, codec.GetMessageLength(gzip.data(), gzip.length()));
+    codec.Reset();
+
+    std::string request("GET / HTTP/1.1\r\nContent-Length: 0\r\n\r\n");
+    EXPECT_GT(0, codec.GetMessageLength(request.data(), request.length()));
+}
@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+
+#include <vector>
+
+#include <flinter/types/mpsc_queue.h>
+
+static const int kProducers = 8;
+static const int kItems = 100000;
+
+static void *Produce(void *arg)
+{
+    std::pair<flinter::MpscQueue<int> *, int> *p =
+            reinterpret_cast<std::pair<flinter::MpscQueue<int> *, int> *>(arg);
+
+    for (int i = 0; i < kItems; ++i) {
+        p->first->Push(p->second * kItems + i);
+    }
+
+    return NULL;
+}
+
+TEST(MpscQueueTest, TestFifo)
+{
+    flinter::MpscQueue<int> q;
+    int value;
+    EXPECT_TRUE(q.empty());
+    EXPECT_FALSE(q.Pop(&value));
+
+    for (int i = 0; i < 100; ++i) {
+        q.Push(i);
+    }
+
+    EXPECT_FALSE(q.empty());
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_TRUE(q.Pop(&value));
+        EXPECT_EQ(i, value);
+    }
+
+    EXPECT_FALSE(q.Pop(&value));
+    q.Push(1);
+    q.Push(2);
+}
+
+TEST(MpscQueueTest, TestProducers)
+{
+    flinter::MpscQueue<int> q;
+    pthread_t threads[kProducers];
+    std::pair<flinter::MpscQueue<int> *, int> args[kProducers];
+    for (int i = 0; i < kProducers; ++i) {
+        args[i] = std::make_pair(&q, i);
+        ASSERT_EQ(0, pthread_create(&threads[i], NULL, Produce, &args[i]));
+    }
+
+    // Every producer's items must come out in the order they're pushed.
+    std::vector<int> next(kProducers, 0);
+    int total = 0;
+    while (total < kProducers * kItems) {
+        int value;
+        if (!q.Pop(&value)) {
+            continue;
+        }
+
+        int producer = value / kItems;
+        ASSERT_EQ(next[static_cast<size_t>(producer)], value % kItems);
+        ++next[static_cast<size_t>(producer)];
+        ++total;
+    }
+
+    for (int i = 0; i < kProducers; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    EXPECT_TRUE(q.empty());
+}
+
+struct Node {
+    Node() : value(0), next(NULL) {}
+    int value;
+    flinter::Atomic<Node *> next;
+};
+
+static void *ProduceNodes(void *arg)
+{
+    std::pair<flinter::IntrusiveMpscQueue<Node> *, Node *> *p =
+            reinterpret_cast<std::pair<flinter::IntrusiveMpscQueue<Node> *, Node *> *>(arg);
+
+    for (int i = 0; i < kItems; ++i) {
+        p->first->Push(&p->second[i]);
+    }
+
+    return NULL;
+}
+
+TEST(MpscQueueTest, TestIntrusive)
+{
+    flinter::IntrusiveMpscQueue<Node> q;
+    std::vector<Node> nodes(static_cast<size_t>(kProducers * kItems));
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        nodes[i].value = static_cast<int>(i);
+    }
+
+    EXPECT_FALSE(q.Pop());
+    q.Push(&nodes[0]);
+    EXPECT_EQ(&nodes[0], q.Pop());
+    EXPECT_FALSE(q.Pop());
+
+    pthread_t threads[kProducers];
+    std::pair<flinter::IntrusiveMpscQueue<Node> *, Node *> args[kProducers];
+    for (int i = 0; i < kProducers; ++i) {
+        args[i] = std::make_pair(&q, &nodes[static_cast<size_t>(i * kItems)]);
+        ASSERT_EQ(0, pthread_create(&threads[i], NULL, ProduceNodes, &args[i]));
+    }
+
+    std::vector<int> next(kProducers, 0);
+    int total = 0;
+    while (total < kProducers * kItems) {
+        Node *node = q.Pop();
+        if (!node) {
+            continue;
+        }
+
+        int producer = node->value / kItems;
+        ASSERT_EQ(next[static_cast<size_t>(producer)], node->value % kItems);
+        ++next[static_cast<size_t>(producer)];
+        ++total;
+    }
+
+    for (int i = 0; i < kProducers; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    EXPECT_FALSE(q.Pop());
+}
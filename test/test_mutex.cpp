@@ -0,0 +1,289 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <flinter/thread/condition.h>
+#include <flinter/thread/lock_statistics.h>
+#include <flinter/thread/mutex.h>
+#include <flinter/thread/semaphore.h>
+#include <flinter/utility.h>
+
+// What Mutex, Condition and Semaphore used to be, for comparison.
+class PosixMutex {
+public:
+    PosixMutex() : _mutex(new pthread_mutex_t) { pthread_mutex_init(_mutex, NULL); }
+    ~PosixMutex() { pthread_mutex_destroy(_mutex); delete _mutex; }
+    void Lock() { pthread_mutex_lock(_mutex); }
+    void Unlock() { pthread_mutex_unlock(_mutex); }
+    pthread_mutex_t *_mutex;
+}; // class PosixMutex
+
+class PosixCondition {
+public:
+    PosixCondition() : _cond(new pthread_cond_t) { pthread_cond_init(_cond, NULL); }
+    ~PosixCondition() { pthread_cond_destroy(_cond); delete _cond; }
+    void WakeOne() { pthread_cond_signal(_cond); }
+    bool Wait(PosixMutex *mutex) { return !pthread_cond_wait(_cond, mutex->_mutex); }
+    pthread_cond_t *_cond;
+}; // class PosixCondition
+
+class PosixSemaphore {
+public:
+    explicit PosixSemaphore(int count) : _sem(new sem_t) { sem_init(_sem, 0, static_cast<unsigned int>(count)); }
+    ~PosixSemaphore() { sem_destroy(_sem); delete _sem; }
+    void Acquire() { while (sem_wait(_sem)); }
+    void Release() { sem_post(_sem); }
+    sem_t *_sem;
+}; // class PosixSemaphore
+
+template <class M>
+struct Counter {
+    Counter() : rounds(0), counter(0) {}
+    M mutex;
+    size_t rounds;
+    size_t counter;
+}; // struct Counter
+
+template <class M>
+static void *Count(void *parameter)
+{
+    Counter<M> *c = reinterpret_cast<Counter<M> *>(parameter);
+    for (size_t i = 0; i < c->rounds; ++i) {
+        c->mutex.Lock();
+        ++c->counter;
+        c->mutex.Unlock();
+    }
+
+    return NULL;
+}
+
+// @return nanoseconds per locking.
+template <class M>
+static double Contend(size_t threads, size_t rounds)
+{
+    Counter<M> c;
+    c.rounds = rounds;
+
+    std::vector<pthread_t> tids(threads);
+    int64_t start = get_monotonic_timestamp();
+    for (size_t i = 0; i < threads; ++i) {
+        EXPECT_EQ(0, pthread_create(&tids[i], NULL, Count<M>, &c));
+    }
+
+    for (size_t i = 0; i < threads; ++i) {
+        pthread_join(tids[i], NULL);
+    }
+
+    EXPECT_EQ(threads * rounds, c.counter);
+    return static_cast<double>(get_monotonic_timestamp() - start) /
+           static_cast<double>(threads * rounds);
+}
+
+template <class M, class C>
+struct PingPong {
+    PingPong() : rounds(0), turn(0) {}
+    M mutex;
+    C condition[2];
+    size_t rounds;
+    size_t turn;
+}; // struct PingPong
+
+template <class M, class C>
+static void *Pong(void *parameter)
+{
+    PingPong<M, C> *p = reinterpret_cast<PingPong<M, C> *>(parameter);
+    p->mutex.Lock();
+    for (size_t i = 0; i < p->rounds; ++i) {
+        while (p->turn % 2 == 0) {
+            p->condition[1].Wait(&p->mutex);
+        }
+
+        ++p->turn;
+        p->condition[0].WakeOne();
+    }
+
+    p->mutex.Unlock();
+    return NULL;
+}
+
+// @return nanoseconds per round trip.
+template <class M, class C>
+static double Ping(size_t rounds)
+{
+    PingPong<M, C> p;
+    p.rounds = rounds;
+
+    pthread_t tid;
+    int64_t start = get_monotonic_timestamp();
+    EXPECT_EQ(0, pthread_create(&tid, NULL, Pong<M, C>, &p));
+
+    p.mutex.Lock();
+    for (size_t i = 0; i < rounds; ++i) {
+        ++p.turn;
+        p.condition[1].WakeOne();
+        while (p.turn % 2 == 1) {
+            p.condition[0].Wait(&p.mutex);
+        }
+    }
+
+    p.mutex.Unlock();
+    pthread_join(tid, NULL);
+    EXPECT_EQ(rounds * 2, p.turn);
+    return static_cast<double>(get_monotonic_timestamp() - start) /
+           static_cast<double>(rounds);
+}
+
+template <class S>
+struct Relay {
+    Relay() : rounds(0), ping(0), pong(0) {}
+    size_t rounds;
+    S ping;
+    S pong;
+}; // struct Relay
+
+template <class S>
+static void *Bounce(void *parameter)
+{
+    Relay<S> *r = reinterpret_cast<Relay<S> *>(parameter);
+    for (size_t i = 0; i < r->rounds; ++i) {
+        r->ping.Acquire();
+        r->pong.Release();
+    }
+
+    return NULL;
+}
+
+// @return nanoseconds per round trip.
+template <class S>
+static double Serve(size_t rounds)
+{
+    Relay<S> r;
+    r.rounds = rounds;
+
+    pthread_t tid;
+    int64_t start = get_monotonic_timestamp();
+    EXPECT_EQ(0, pthread_create(&tid, NULL, Bounce<S>, &r));
+    for (size_t i = 0; i < rounds; ++i) {
+        r.ping.Release();
+        r.pong.Acquire();
+    }
+
+    pthread_join(tid, NULL);
+    return static_cast<double>(get_monotonic_timestamp() - start) /
+           static_cast<double>(rounds);
+}
+
+static void *Acquire(void *parameter)
+{
+    reinterpret_cast<flinter::Semaphore *>(parameter)->Acquire();
+    return NULL;
+}
+
+TEST(MutexTest, TestMutex)
+{
+    flinter::Mutex mutex;
+    EXPECT_TRUE(mutex.TryLock());
+    EXPECT_FALSE(mutex.TryLock());
+    mutex.Unlock();
+
+    mutex.Lock();
+    EXPECT_FALSE(mutex.TryLock());
+    mutex.Unlock();
+    EXPECT_TRUE(mutex.TryLock());
+    mutex.Unlock();
+
+    Contend<flinter::Mutex>(8, 100000);
+}
+
+TEST(MutexTest, TestCondition)
+{
+    flinter::Mutex mutex;
+    flinter::Condition condition;
+
+    mutex.Lock();
+    int64_t start = get_monotonic_timestamp();
+    EXPECT_FALSE(condition.Wait(&mutex, 20000000LL));
+    EXPECT_LE(20000000LL, get_monotonic_timestamp() - start);
+    EXPECT_FALSE(mutex.TryLock());
+    mutex.Unlock();
+
+    // Nobody's waiting.
+    condition.WakeOne();
+    condition.WakeAll();
+
+    Ping<flinter::Mutex, flinter::Condition>(10000);
+}
+
+TEST(MutexTest, TestSemaphore)
+{
+    flinter::Semaphore semaphore(2);
+    EXPECT_TRUE(semaphore.TryAcquire());
+    semaphore.Acquire();
+    EXPECT_FALSE(semaphore.TryAcquire());
+
+    pthread_t tids[3];
+    for (size_t i = 0; i < 3; ++i) {
+        ASSERT_EQ(0, pthread_create(&tids[i], NULL, Acquire, &semaphore));
+    }
+
+    semaphore.Release(4);
+    for (size_t i = 0; i < 3; ++i) {
+        pthread_join(tids[i], NULL);
+    }
+
+    EXPECT_TRUE(semaphore.TryAcquire());
+    EXPECT_FALSE(semaphore.TryAcquire());
+
+    Serve<flinter::Semaphore>(10000);
+}
+
+TEST(MutexTest, TestLockStatistics)
+{
+    flinter::LockStatistics statistics;
+    if (!flinter::GetLockStatistics(&statistics, true)) {
+        EXPECT_EQ(0, statistics.contended);
+        return;
+    }
+
+    Contend<flinter::Mutex>(4, 100000);
+    ASSERT_TRUE(flinter::GetLockStatistics(&statistics));
+    printf("contended %lld, spun %lld, slept %lld, woken %lld\n",
+           static_cast<long long>(statistics.contended),
+           static_cast<long long>(statistics.spun),
+           static_cast<long long>(statistics.slept),
+           static_cast<long long>(statistics.woken));
+}
+
+// Run with --gtest_also_run_disabled_tests.
+TEST(MutexTest, DISABLED_Benchmark)
+{
+    static const size_t kRounds = 1000000;
+    size_t cpus = static_cast<size_t>(sysconf(_SC_NPROCESSORS_ONLN));
+    size_t oversubscribed = cpus * 4;
+
+    printf("mutex uncontended      posix %7.1f ns, futex %7.1f ns\n",
+           Contend<PosixMutex>(1, kRounds),
+           Contend<flinter::Mutex>(1, kRounds));
+
+    printf("mutex contended (4)    posix %7.1f ns, futex %7.1f ns\n",
+           Contend<PosixMutex>(4, kRounds / 4),
+           Contend<flinter::Mutex>(4, kRounds / 4));
+
+    printf("mutex oversubscribed   posix %7.1f ns, futex %7.1f ns (%zu threads)\n",
+           Contend<PosixMutex>(oversubscribed, kRounds / oversubscribed),
+           Contend<flinter::Mutex>(oversubscribed, kRounds / oversubscribed),
+           oversubscribed);
+
+    printf("condition ping-pong    posix %7.1f ns, futex %7.1f ns\n",
+           Ping<PosixMutex, PosixCondition>(kRounds / 20),
+           Ping<flinter::Mutex, flinter::Condition>(kRounds / 20));
+
+    printf("semaphore ping-pong    posix %7.1f ns, futex %7.1f ns\n",
+           Serve<PosixSemaphore>(kRounds / 20),
+           Serve<flinter::Semaphore>(kRounds / 20));
+}
@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <flinter/linkage/easy_context.h>
+#include <flinter/linkage/easy_handler.h>
+#include <flinter/linkage/easy_server.h>
+#include <flinter/types/atomic.h>
+#include <flinter/logger.h>
+#include <flinter/msleep.h>
+
+#include "loopback.h"
+
+// Counts Cleanup() calls, like handlers sending heartbeats would.
+class HeartbeatHandler : public flinter::EasyHandler {
+public:
+    HeartbeatHandler() : _cleanups(0) {}
+
+    virtual ssize_t GetMessageLength(const flinter::EasyContext &,
+                                     const void *, size_t length)
+    {
+        return static_cast<ssize_t>(length);
+    }
+
+    virtual int OnMessage(const flinter::EasyContext &, const void *, size_t)
+    {
+        return 1;
+    }
+
+    virtual bool Cleanup(const flinter::EasyContext &, int64_t)
+    {
+        _cleanups.AddAndFetch(1);
+        return true;
+    }
+
+    int cleanups() const
+    {
+        return _cleanups.Get();
+    }
+
+private:
+    flinter::atomic_t _cleanups;
+
+}; // class HeartbeatHandler
+
+TEST(PeriodicCleanupTest, TestEverySecond)
+{
+    flinter::Logger::SetFilter(flinter::Logger::kLevelError);
+
+    // The default idle timeout is minutes away.
+    uint16_t port = GetLoopbackPort();
+    HeartbeatHandler handler;
+    flinter::EasyServer server;
+    server.configure()->periodic_cleanup = true;
+    ASSERT_TRUE(server.Listen(port, &handler));
+    ASSERT_TRUE(server.Initialize(1, 0));
+
+    int fd = ConnectLoopback(port);
+    ASSERT_LE(0, fd);
+    msleep(3500);
+    EXPECT_LE(3, handler.cleanups());
+
+    close(fd);
+    server.Shutdown();
+}
+
+TEST(PeriodicCleanupTest, TestOffByDefault)
+{
+    flinter::Logger::SetFilter(flinter::Logger::kLevelError);
+
+    // Only called once timeouts might be due.
+    uint16_t port = GetLoopbackPort();
+    HeartbeatHandler handler;
+    flinter::EasyServer server;
+    ASSERT_TRUE(server.Listen(port, &handler));
+    ASSERT_TRUE(server.Initialize(1, 0));
+
+    int fd = ConnectLoopback(port);
+    ASSERT_LE(0, fd);
+    ASSERT_EQ(4, write(fd, "ping", 4));
+    msleep(2500);
+    EXPECT_EQ(0, handler.cleanups());
+
+    close(fd);
+    server.Shutdown();
+}
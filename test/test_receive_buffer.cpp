@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <flinter/linkage/receive_buffer.h>
+
+TEST(ReceiveBufferTest, TestRefCount)
+{
+    flinter::ReceiveBuffer *b = flinter::ReceiveBuffer::Create();
+    ASSERT_TRUE(b);
+    EXPECT_EQ(flinter::ReceiveBuffer::kDefaultCapacity, b->capacity());
+    EXPECT_FALSE(b->shared());
+
+    memset(b->data(), 'x', b->capacity());
+    b->Ref();
+    EXPECT_TRUE(b->shared());
+    b->Release();
+    EXPECT_FALSE(b->shared());
+    b->Release();
+}
+
+TEST(ReceiveBufferTest, TestRecycle)
+{
+    flinter::ReceiveBuffer *b = flinter::ReceiveBuffer::Create();
+    ASSERT_TRUE(b);
+    b->Release();
+
+    flinter::ReceiveBuffer *c = flinter::ReceiveBuffer::Create();
+    ASSERT_TRUE(c);
+    EXPECT_EQ(b, c);
+    EXPECT_FALSE(c->shared());
+    c->Release();
+}
+
+TEST(ReceiveBufferTest, TestLarge)
+{
+    flinter::ReceiveBuffer *b = flinter::ReceiveBuffer::Create(1048576);
+    ASSERT_TRUE(b);
+    EXPECT_EQ(1048576u, b->capacity());
+    memset(b->data(), 'x', b->capacity());
+    b->Release();
+
+    EXPECT_FALSE(flinter::ReceiveBuffer::Create(0));
+}
+
+TEST(ReceiveBufferTest, TestSizeClass)
+{
+    EXPECT_EQ(4096u, flinter::ReceiveBuffer::GetCapacity(1));
+    EXPECT_EQ(4096u, flinter::ReceiveBuffer::GetCapacity(4096));
+    EXPECT_EQ(8192u, flinter::ReceiveBuffer::GetCapacity(4097));
+    EXPECT_EQ(262144u, flinter::ReceiveBuffer::GetCapacity(200000));
+    EXPECT_EQ(262145u, flinter::ReceiveBuffer::GetCapacity(262145));
+
+    flinter::ReceiveBuffer *b = flinter::ReceiveBuffer::Create(5000);
+    ASSERT_TRUE(b);
+    EXPECT_EQ(8192u, b->capacity());
+    b->Release();
+}
+
+TEST(ReceiveBufferTest, TestPool)
+{
+    flinter::ReceiveBufferPool *pool = flinter::ReceiveBufferPool::Create(2);
+    ASSERT_TRUE(pool);
+
+    flinter::ReceiveBuffer *a = pool->Get(100);
+    flinter::ReceiveBuffer *b = pool->Get(100);
+    flinter::ReceiveBuffer *c = pool->Get(100);
+    flinter::ReceiveBuffer *d = pool->Get(10000);
+    ASSERT_TRUE(a && b && c && d);
+    EXPECT_EQ(4096u, a->capacity());
+    EXPECT_EQ(16384u, d->capacity());
+    EXPECT_EQ(0u, pool->cached());
+
+    a->Release();
+    b->Release();
+    c->Release();
+    d->Release();
+    EXPECT_EQ(3u, pool->cached()); // 2 of 4KiB and 1 of 16KiB.
+
+    flinter::ReceiveBuffer *e = pool->Get(4096);
+    EXPECT_TRUE(e == a || e == b);
+    EXPECT_FALSE(e->shared());
+
+    flinter::ReceiveBuffer *large = pool->Get(1048576);
+    ASSERT_TRUE(large);
+    EXPECT_EQ(1048576u, large->capacity());
+    large->Release();
+    EXPECT_EQ(2u, pool->cached());
+
+    // Slabs outlive the pool.
+    pool->Release();
+    memset(e->data(), 'x', e->capacity());
+    e->Release();
+}
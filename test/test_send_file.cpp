@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <flinter/linkage/easy_context.h>
+#include <flinter/linkage/easy_handler.h>
+#include <flinter/linkage/easy_server.h>
+#include <flinter/logger.h>
+
+#include "loopback.h"
+
+// "file" is answered with a header, bytes of the file and a trailer, "pipe"
+// with "nope" since only regular files are taken.
+class FileHandler : public flinter::EasyHandler {
+public:
+    explicit FileHandler(const std::string &filename) : _filename(filename) {}
+
+    virtual ssize_t GetMessageLength(const flinter::EasyContext &,
+                                     const void *, size_t length)
+    {
+        return length >= 4 ? 4 : 0;
+    }
+
+    virtual int OnMessage(const flinter::EasyContext &context,
+                          const void *buffer, size_t)
+    {
+        flinter::EasyServer *server = context.easy_server();
+        if (memcmp(buffer, "pipe", 4) == 0) {
+            int fds[2];
+            if (pipe(fds) || write(fds[1], "piped", 5) != 5) {
+                return -1;
+            }
+
+            close(fds[1]);
+            if (server->SendFile(context, fds[0], 0, 5)) {
+                return -1;
+            }
+
+            return server->Send(context, "nope", 4) ? 1 : -1;
+        }
+
+        int fd = open(_filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return -1;
+        }
+
+        if (!server->Send(context, "head", 4) ||
+            !server->SendFile(context, fd, 10, 1048576 - 20) ||
+            !server->Send(context, "tail", 4)) {
+
+            return -1;
+        }
+
+        return 1;
+    }
+
+private:
+    const std::string _filename;
+
+}; // class FileHandler
+
+class SendFileTest : public ::testing::TestWithParam<size_t> {
+protected:
+    SendFileTest() : _handler(NULL), _port(GetLoopbackPort())
+    {
+        // Intended left blank.
+    }
+
+    virtual void SetUp()
+    {
+        flinter::Logger::SetFilter(flinter::Logger::kLevelError);
+
+        char filename[] = "/tmp/test_send_file.XXXXXX";
+        int fd = mkstemp(filename);
+        ASSERT_LE(0, fd);
+        _filename = filename;
+
+        _content.resize(1048576);
+        for (size_t i = 0; i < _content.size(); ++i) {
+            _content[i] = static_cast<char>('a' + i % 26);
+        }
+
+        ASSERT_EQ(static_cast<ssize_t>(_content.size()),
+                  write(fd, _content.data(), _content.size()));
+
+        close(fd);
+
+        _handler = new FileHandler(_filename);
+        ASSERT_TRUE(_server.Listen(_port, _handler));
+        ASSERT_TRUE(_server.Initialize(1, GetParam()));
+    }
+
+    virtual void TearDown()
+    {
+        _server.Shutdown();
+        delete _handler;
+        unlink(_filename.c_str());
+    }
+
+    flinter::EasyServer _server;
+    FileHandler *_handler;
+    std::string _filename;
+    std::string _content;
+    uint16_t _port;
+
+}; // class SendFileTest
+
+TEST_P(SendFileTest, TestInOrder)
+{
+    int fd = ConnectLoopback(_port);
+    ASSERT_LE(0, fd);
+
+    // Twice to interleave with what's still queued.
+    ASSERT_EQ(8, write(fd, "filefile", 8));
+
+    std::string expected = "head" + _content.substr(10, 1048576 - 20) + "tail";
+    std::string received = ReceiveLoopback(fd, expected.length() * 2);
+    close(fd);
+
+    ASSERT_EQ(expected.length() * 2, received.length());
+    EXPECT_TRUE(received == expected + expected);
+}
+
+TEST_P(SendFileTest, TestPipe)
+{
+    int fd = ConnectLoopback(_port);
+    ASSERT_LE(0, fd);
+
+    ASSERT_EQ(4, write(fd, "pipe", 4));
+    EXPECT_EQ("nope", ReceiveLoopback(fd, 4));
+    close(fd);
+}
+
+// In the I/O thread, or from a job thread.
+INSTANTIATE_TEST_CASE_P(Workers, SendFileTest, ::testing::Values(0u, 1u));
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <flinter/linkage/local_ssl_session_cache.h>
+#include <flinter/linkage/shared_ssl_session_cache.h>
+
+static void TestBasic(flinter::SslSessionCache *cache)
+{
+    std::string session;
+    EXPECT_FALSE(cache->Find("id1", 100, &session));
+
+    cache->Insert("id1", "session1", 200);
+    cache->Insert("id2", "session2", 300);
+    EXPECT_TRUE(cache->Find("id1", 100, &session));
+    EXPECT_EQ("session1", session);
+
+    // Replaced.
+    cache->Insert("id1", "session3", 200);
+    EXPECT_TRUE(cache->Find("id1", 100, &session));
+    EXPECT_EQ("session3", session);
+
+    // Expired.
+    EXPECT_FALSE(cache->Find("id1", 200, &session));
+    EXPECT_FALSE(cache->Find("id1", 100, &session));
+
+    cache->Erase("id2");
+    EXPECT_FALSE(cache->Find("id2", 100, &session));
+}
+
+TEST(SessionCacheTest, TestLocal)
+{
+    flinter::LocalSslSessionCache cache(100, 4);
+    TestBasic(&cache);
+}
+
+TEST(SessionCacheTest, TestLocalEviction)
+{
+    flinter::LocalSslSessionCache cache(2, 1);
+    cache.Insert("id1", "session1", 100);
+    cache.Insert("id2", "session2", 100);
+    cache.Insert("id3", "session3", 100);
+
+    std::string session;
+    EXPECT_FALSE(cache.Find("id1", 0, &session));
+    EXPECT_TRUE(cache.Find("id2", 0, &session));
+    EXPECT_TRUE(cache.Find("id3", 0, &session));
+}
+
+TEST(SessionCacheTest, TestShared)
+{
+    flinter::SharedSslSessionCache cache(100, 64);
+    TestBasic(&cache);
+
+    // Too long to cache.
+    std::string session;
+    cache.Insert("id4", std::string(65, 'x'), 1000);
+    EXPECT_FALSE(cache.Find("id4", 0, &session));
+    cache.Insert(std::string(33, 'x'), "session", 1000);
+    EXPECT_FALSE(cache.Find(std::string(33, 'x'), 0, &session));
+}
+
+TEST(SessionCacheTest, TestSharedEviction)
+{
+    // Only one set, the entry expiring first goes away.
+    flinter::SharedSslSessionCache cache(1, 64);
+    cache.Insert("id1", "session1", 500);
+    cache.Insert("id2", "session2", 100);
+    cache.Insert("id3", "session3", 300);
+    cache.Insert("id4", "session4", 400);
+    cache.Insert("id5", "session5", 200);
+
+    std::string session;
+    EXPECT_FALSE(cache.Find("id2", 0, &session));
+    EXPECT_TRUE(cache.Find("id1", 0, &session));
+    EXPECT_TRUE(cache.Find("id5", 0, &session));
+    EXPECT_EQ("session5", session);
+}
+
+TEST(SessionCacheTest, TestSharedFork)
+{
+    flinter::SharedSslSessionCache cache(100);
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        cache.Insert("child", "session", 1000);
+        _exit(0);
+    }
+
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+
+    std::string session;
+    EXPECT_TRUE(cache.Find("child", 0, &session));
+    EXPECT_EQ("session", session);
+}
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include <flinter/types/slot_table.h>
+
+TEST(SlotTableTest, TestAllocate)
+{
+    flinter::SlotTable<int> t;
+    int a = 1;
+    int b = 2;
+    uint32_t ia, ga, ib, gb;
+    ASSERT_TRUE(t.Allocate(&a, &ia, &ga));
+    ASSERT_TRUE(t.Allocate(&b, &ib, &gb));
+    EXPECT_NE(ia, ib);
+    EXPECT_NE(0u, ga);
+    EXPECT_EQ(2u, t.size());
+
+    EXPECT_TRUE(t.IsValid(ia, ga));
+    EXPECT_EQ(&a, t.Get(ia, ga));
+    EXPECT_EQ(&b, t.Get(ib, gb));
+    EXPECT_FALSE(t.IsValid(ia, ga + 1));
+    EXPECT_EQ(NULL, t.Get(ia, ga + 1));
+    EXPECT_FALSE(t.IsValid(12345, 1));
+    EXPECT_FALSE(t.IsValid(flinter::SlotTable<int>::kMaximumSlots, 1));
+
+    EXPECT_TRUE(t.Set(ia, ga, &b));
+    EXPECT_EQ(&b, t.Get(ia, ga));
+    EXPECT_FALSE(t.Set(ia, ga + 1, &a));
+}
+
+TEST(SlotTableTest, TestStale)
+{
+    flinter::SlotTable<int> t;
+    int a = 1;
+    uint32_t index, generation;
+    ASSERT_TRUE(t.Allocate(&a, &index, &generation));
+    t.Release(index);
+    EXPECT_FALSE(t.IsValid(index, generation));
+    EXPECT_EQ(0u, t.size());
+
+    // Reused slot, but the old handle still misses.
+    uint32_t i2, g2;
+    ASSERT_TRUE(t.Allocate(NULL, &i2, &g2));
+    EXPECT_EQ(index, i2);
+    EXPECT_NE(generation, g2);
+    EXPECT_FALSE(t.IsValid(index, generation));
+    EXPECT_TRUE(t.IsValid(i2, g2));
+    EXPECT_EQ(NULL, t.Get(i2, g2));
+}
+
+TEST(SlotTableTest, TestFifoReuse)
+{
+    flinter::SlotTable<int> t;
+    uint32_t index[3], generation[3];
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_TRUE(t.Allocate(NULL, &index[i], &generation[i]));
+    }
+
+    t.Release(index[1]);
+    t.Release(index[0]);
+
+    uint32_t i, g;
+    ASSERT_TRUE(t.Allocate(NULL, &i, &g));
+    EXPECT_EQ(index[1], i);
+    ASSERT_TRUE(t.Allocate(NULL, &i, &g));
+    EXPECT_EQ(index[0], i);
+    ASSERT_TRUE(t.Allocate(NULL, &i, &g));
+    EXPECT_EQ(3u, i);
+}
+
+TEST(SlotTableTest, TestChunks)
+{
+    flinter::SlotTable<int> t;
+    const uint32_t count = flinter::SlotTable<int>::kChunkSize * 3 + 7;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t index, generation;
+        ASSERT_TRUE(t.Allocate(NULL, &index, &generation));
+        ASSERT_EQ(i, index);
+        ASSERT_TRUE(t.IsValid(index, generation));
+    }
+
+    EXPECT_EQ(count, t.size());
+}
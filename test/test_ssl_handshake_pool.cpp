@@ -0,0 +1,203 @@
+#include <gtest/gtest.h>
+
+#include <signal.h>
+#include <string.h>
+
+#include <string>
+
+#include <flinter/linkage/easy_context.h>
+#include <flinter/linkage/easy_handler.h>
+#include <flinter/linkage/easy_server.h>
+#include <flinter/linkage/ssl_context.h>
+#include <flinter/thread/fixed_thread_pool.h>
+#include <flinter/thread/mutex.h>
+#include <flinter/thread/mutex_locker.h>
+#include <flinter/thread/semaphore.h>
+#include <flinter/types/atomic.h>
+#include <flinter/logger.h>
+#include <flinter/msleep.h>
+#include <flinter/openssl.h>
+#include <flinter/runnable.h>
+#include <flinter/signals.h>
+
+#include "loopback.h"
+
+// Echoes 4 bytes messages on the server, records them on the client.
+class EchoHandler : public flinter::EasyHandler {
+public:
+    EchoHandler() : _connected(0), _disconnected(0) {}
+
+    virtual ssize_t GetMessageLength(const flinter::EasyContext &,
+                                     const void *, size_t length)
+    {
+        return length >= 4 ? 4 : 0;
+    }
+
+    virtual int OnMessage(const flinter::EasyContext &context,
+                          const void *buffer, size_t length)
+    {
+        if (!flinter::EasyServer::IsOutgoingChannel(context.channel())) {
+            return context.easy_server()->Send(context, buffer, length) ? 1 : -1;
+        }
+
+        flinter::MutexLocker locker(&_mutex);
+        _received.append(reinterpret_cast<const char *>(buffer), length);
+        return 1;
+    }
+
+    virtual bool OnConnected(const flinter::EasyContext &)
+    {
+        _connected.AddAndFetch(1);
+        return true;
+    }
+
+    virtual void OnDisconnected(const flinter::EasyContext &)
+    {
+        _disconnected.AddAndFetch(1);
+    }
+
+    std::string received()
+    {
+        flinter::MutexLocker locker(&_mutex);
+        return _received;
+    }
+
+    int connected() const
+    {
+        return _connected.Get();
+    }
+
+    int disconnected() const
+    {
+        return _disconnected.Get();
+    }
+
+private:
+    flinter::Mutex _mutex;
+    std::string _received;
+    flinter::atomic_t _connected;
+    flinter::atomic_t _disconnected;
+
+}; // class EchoHandler
+
+// Keeps a pool thread busy until released.
+class Gate : public flinter::Runnable {
+public:
+    explicit Gate(flinter::Semaphore *semaphore) : _semaphore(semaphore) {}
+
+    virtual bool Run()
+    {
+        _semaphore->Acquire();
+        return true;
+    }
+
+private:
+    flinter::Semaphore *const _semaphore;
+
+}; // class Gate
+
+class SslHandshakePoolTest : public ::testing::Test {
+protected:
+    SslHandshakePoolTest()
+            : _server_ssl(false)
+            , _client_ssl(false)
+            , _gate(0)
+            , _port(GetLoopbackPort())
+    {
+        // Intended left blank.
+    }
+
+    virtual void SetUp()
+    {
+        flinter::Logger::SetFilter(flinter::Logger::kLevelError);
+        signals_ignore(SIGPIPE);
+
+        ASSERT_TRUE(_server_ssl.LoadCertificate("ssl.pem"));
+        ASSERT_TRUE(_server_ssl.LoadPrivateKey("ssl.key", "1234"));
+        ASSERT_TRUE(_server_ssl.VerifyPrivateKey());
+
+        ASSERT_TRUE(_server_pool.Initialize(1));
+        ASSERT_TRUE(_client_pool.Initialize(1));
+        _server_ssl.SetHandshakePool(&_server_pool);
+        _client_ssl.SetHandshakePool(&_client_pool);
+
+        _server.configure()->incoming_connect_timeout = 500000000LL;
+        ASSERT_TRUE(_server.SslListen(_port, &_server_ssl, &_server_handler));
+        ASSERT_TRUE(_server.Initialize(1, 0));
+    }
+
+    virtual void TearDown()
+    {
+        _server.Shutdown();
+        _gate.Release();
+        _server_pool.Shutdown();
+        _client_pool.Shutdown();
+    }
+
+    // @return what's echoed within 5s.
+    std::string Echo(const std::string &message)
+    {
+        flinter::EasyServer::channel_t channel = _server.SslConnectTcp4(
+                "127.0.0.1", _port, &_client_ssl, &_client_handler);
+
+        EXPECT_TRUE(flinter::EasyServer::IsValidChannel(channel));
+        size_t before = _client_handler.received().length();
+        EXPECT_TRUE(_server.Send(channel, message.data(), message.length()));
+        for (int i = 0; i < 500; ++i) {
+            if (_client_handler.received().length() >= before + message.length()) {
+                break;
+            }
+
+            msleep(10);
+        }
+
+        _server.Disconnect(channel);
+        _server.Forget(channel);
+        return _client_handler.received().substr(before);
+    }
+
+    flinter::OpenSSLInitializer _openssl;
+    flinter::SslContext _server_ssl;
+    flinter::SslContext _client_ssl;
+    flinter::FixedThreadPool _server_pool;
+    flinter::FixedThreadPool _client_pool;
+    flinter::Semaphore _gate;
+    EchoHandler _server_handler;
+    EchoHandler _client_handler;
+    flinter::EasyServer _server;
+    uint16_t _port;
+
+}; // class SslHandshakePoolTest
+
+TEST_F(SslHandshakePoolTest, TestHandshake)
+{
+    EXPECT_EQ("ping", Echo("ping"));
+    EXPECT_EQ(1, _server_handler.connected());
+    EXPECT_EQ(1, _client_handler.connected());
+}
+
+TEST_F(SslHandshakePoolTest, TestClosedWhileHandshaking)
+{
+    // The server can't finish the handshake, it times out and closes while
+    // the job is still queued.
+    ASSERT_TRUE(_server_pool.AppendJob(new Gate(&_gate), true));
+    flinter::EasyServer::channel_t channel = _server.SslConnectTcp4(
+            "127.0.0.1", _port, &_client_ssl, &_client_handler);
+
+    ASSERT_TRUE(_server.Send(channel, "ping", 4));
+    msleep(1500);
+
+    // The job might finish the handshake, but closes the socket right away
+    // for the linkage that's gone.
+    _gate.Release();
+    for (int i = 0; i < 300 && !_client_handler.disconnected(); ++i) {
+        msleep(10);
+    }
+
+    EXPECT_EQ(1, _client_handler.disconnected());
+    EXPECT_EQ(0, _server_handler.connected());
+    _server.Forget(channel);
+
+    EXPECT_EQ("pong", Echo("pong"));
+    EXPECT_EQ(1, _server_handler.connected());
+}
@@ -0,0 +1,308 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <new>
+#include <vector>
+
+#include <flinter/thread/condition.h>
+#include <flinter/thread/fixed_thread_pool.h>
+#include <flinter/thread/keyed_thread_pool.h>
+#include <flinter/thread/mutex.h>
+#include <flinter/thread/mutex_locker.h>
+#include <flinter/thread/thread_job.h>
+#include <flinter/thread/work_stealing_thread_pool.h>
+#include <flinter/types/atomic.h>
+#include <flinter/logger.h>
+#include <flinter/runnable.h>
+#include <flinter/utility.h>
+
+// Count every allocation in the process, including those in the library.
+// All forms are replaced so that every new is paired with its own delete.
+static flinter::atomic64_t g_allocations;
+
+static void *Allocate(size_t size)
+{
+    g_allocations.AddAndFetch(1);
+    return malloc(size ? size : 1);
+}
+
+static void *AllocateOrThrow(size_t size)
+{
+    void *p = Allocate(size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+
+    return p;
+}
+
+static void Deallocate(void *p)
+{
+    free(p);
+}
+
+void *operator new(size_t size) { return AllocateOrThrow(size); }
+void *operator new[](size_t size) { return AllocateOrThrow(size); }
+void *operator new(size_t size, const std::nothrow_t &) throw() { return Allocate(size); }
+void *operator new[](size_t size, const std::nothrow_t &) throw() { return Allocate(size); }
+
+void operator delete(void *p) throw() { Deallocate(p); }
+void operator delete[](void *p) throw() { Deallocate(p); }
+void operator delete(void *p, const std::nothrow_t &) throw() { Deallocate(p); }
+void operator delete[](void *p, const std::nothrow_t &) throw() { Deallocate(p); }
+
+#if __cpp_sized_deallocation
+void operator delete(void *p, size_t) throw() { Deallocate(p); }
+void operator delete[](void *p, size_t) throw() { Deallocate(p); }
+#endif
+
+using flinter::internal::ThreadJob;
+using flinter::internal::ThreadJobList;
+
+static void *Release(void *arg)
+{
+    std::vector<ThreadJob *> *jobs = reinterpret_cast<std::vector<ThreadJob *> *>(arg);
+    for (size_t i = 0; i < jobs->size(); ++i) {
+        ThreadJob::Release((*jobs)[i]);
+    }
+
+    return NULL;
+}
+
+TEST(ThreadJobTest, TestList)
+{
+    ThreadJob a, b, c;
+    ThreadJobList list;
+    EXPECT_TRUE(list.empty());
+
+    list.push_back(&a);
+    list.push_back(&b);
+    EXPECT_EQ(2u, list.size());
+    EXPECT_EQ(&a, list.front());
+    list.pop_front();
+    list.push_back(&c);
+    EXPECT_EQ(&b, list.front());
+    list.pop_front();
+    EXPECT_EQ(&c, list.front());
+    list.pop_front();
+    EXPECT_TRUE(list.empty());
+    EXPECT_EQ(0u, list.size());
+}
+
+TEST(ThreadJobTest, TestRecycle)
+{
+    std::vector<ThreadJob *> jobs;
+    for (int i = 0; i < 100; ++i) {
+        jobs.push_back(ThreadJob::Allocate(NULL, i % 2 == 0));
+        EXPECT_EQ(i % 2 == 0, jobs.back()->auto_release());
+    }
+
+    // Given back by another thread.
+    pthread_t thread;
+    ASSERT_EQ(0, pthread_create(&thread, NULL, Release, &jobs));
+    ASSERT_EQ(0, pthread_join(thread, NULL));
+
+    int64_t before = g_allocations.BarrierGet();
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        jobs[i] = ThreadJob::Allocate(NULL, false);
+    }
+
+    EXPECT_EQ(before, g_allocations.BarrierGet());
+
+    // And by ourselves.
+    Release(&jobs);
+    before = g_allocations.BarrierGet();
+    ThreadJob::Release(ThreadJob::Allocate(NULL, false));
+    EXPECT_EQ(before, g_allocations.BarrierGet());
+}
+
+// Counts down, wakes up the waiter when it reaches zero.
+class Latch {
+public:
+    Latch() : _count(0) {}
+
+    void Reset(int64_t count)
+    {
+        _count.BarrierSet(count);
+    }
+
+    void CountDown()
+    {
+        if (_count.SubAndFetch(1) == 0) {
+            flinter::MutexLocker locker(&_mutex);
+            _condition.WakeAll();
+        }
+    }
+
+    void Wait()
+    {
+        flinter::MutexLocker locker(&_mutex);
+        while (_count.BarrierGet() > 0) {
+            _condition.Wait(&_mutex);
+        }
+    }
+
+private:
+    flinter::atomic64_t _count;
+    flinter::Condition _condition;
+    flinter::Mutex _mutex;
+
+}; // class Latch
+
+class Counter : public flinter::Runnable {
+public:
+    explicit Counter(Latch *latch) : _latch(latch) {}
+    virtual ~Counter() {}
+    virtual bool Run()
+    {
+        _latch->CountDown();
+        return true;
+    }
+
+private:
+    Latch *const _latch;
+
+}; // class Counter
+
+class IntrusiveCounter : public flinter::IntrusiveRunnable {
+public:
+    IntrusiveCounter() : _latch(NULL) {}
+    explicit IntrusiveCounter(Latch *latch) : _latch(latch) {}
+    virtual ~IntrusiveCounter() {}
+    virtual bool Run()
+    {
+        _latch->CountDown();
+        return true;
+    }
+
+    void set_latch(Latch *latch)
+    {
+        _latch = latch;
+    }
+
+private:
+    Latch *_latch;
+
+}; // class IntrusiveCounter
+
+enum Mode {
+    kModeHeap,      // Runnables allocated and auto released.
+    kModeShared,    // Runnable shared by all jobs.
+    kModeIntrusive, // Runnables with headers inside, allocated beforehand.
+};
+
+static const char *const kModes[] = { "heap", "shared", "intrusive" };
+
+static bool Submit(flinter::AbstractThreadPool *pool,
+                   Mode mode,
+                   Latch *latch,
+                   Counter *shared,
+                   IntrusiveCounter *intrusive,
+                   size_t i)
+{
+    flinter::KeyedThreadPool *keyed = dynamic_cast<flinter::KeyedThreadPool *>(pool);
+    switch (mode) {
+    case kModeHeap:
+        return keyed ? keyed->AppendJobWithKey(i, new Counter(latch), true)
+                     : pool->AppendJob(new Counter(latch), true);
+
+    case kModeShared:
+        return keyed ? keyed->AppendJobWithKey(i, shared)
+                     : pool->AppendJob(shared);
+
+    case kModeIntrusive:
+        return keyed ? keyed->AppendJobWithKey(i, &intrusive[i])
+                     : pool->AppendJob(&intrusive[i]);
+    };
+
+    return false;
+}
+
+// @return allocations per job.
+static double Run(flinter::AbstractThreadPool *pool,
+                  Mode mode,
+                  size_t count,
+                  double *cost)
+{
+    Latch latch;
+    Counter shared(&latch);
+    std::vector<IntrusiveCounter> intrusive(count);
+    for (size_t i = 0; i < count; ++i) {
+        intrusive[i].set_latch(&latch);
+    }
+
+    // Warm up caches with as many jobs.
+    for (int round = 0; round < 3; ++round) {
+        latch.Reset(static_cast<int64_t>(count));
+        int64_t allocations = g_allocations.BarrierGet();
+        int64_t start = get_monotonic_timestamp();
+        for (size_t i = 0; i < count; ++i) {
+            EXPECT_TRUE(Submit(pool, mode, &latch, &shared, &intrusive[0], i));
+        }
+
+        latch.Wait();
+        if (round == 2) {
+            *cost = static_cast<double>(get_monotonic_timestamp() - start) /
+                    static_cast<double>(count);
+
+            return static_cast<double>(g_allocations.BarrierGet() - allocations) /
+                   static_cast<double>(count);
+        }
+    }
+
+    return 0;
+}
+
+static void Benchmark(const char *name, flinter::AbstractThreadPool *pool)
+{
+    static const size_t kCount = 1 << 15;
+    ASSERT_TRUE(pool->Initialize(4));
+    for (int m = kModeHeap; m <= kModeIntrusive; ++m) {
+        double cost;
+        Mode mode = static_cast<Mode>(m);
+        double allocations = Run(pool, mode, kCount, &cost);
+        printf("%-13s %-9s %5.2f allocations/job, %8.1f ns/job\n",
+               name, kModes[m], allocations, cost);
+
+        // Others depend on how many jobs are queued at most.
+        if (mode == kModeIntrusive) {
+            EXPECT_EQ(0.0, allocations);
+        }
+    }
+
+    ASSERT_TRUE(pool->Shutdown(true));
+}
+
+TEST(ThreadJobTest, TestIntrusive)
+{
+    flinter::Logger::SetFilter(flinter::Logger::kLevelError);
+
+    flinter::FixedThreadPool fixed;
+    flinter::KeyedThreadPool keyed;
+    flinter::WorkStealingThreadPool stealing;
+    flinter::AbstractThreadPool *pools[] = { &fixed, &keyed, &stealing };
+    for (size_t i = 0; i < 3; ++i) {
+        double cost;
+        ASSERT_TRUE(pools[i]->Initialize(4));
+        EXPECT_EQ(0.0, ::Run(pools[i], kModeIntrusive, 1024, &cost));
+        ASSERT_TRUE(pools[i]->Shutdown(true));
+    }
+}
+
+// Run with --gtest_also_run_disabled_tests.
+TEST(ThreadJobTest, DISABLED_BenchmarkAllocations)
+{
+    flinter::Logger::SetFilter(flinter::Logger::kLevelError);
+
+    flinter::FixedThreadPool fixed;
+    Benchmark("fixed", &fixed);
+
+    flinter::KeyedThreadPool keyed;
+    Benchmark("keyed", &keyed);
+
+    flinter::WorkStealingThreadPool stealing;
+    Benchmark("work stealing", &stealing);
+}
@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+
+#include <flinter/linkage/timer_wheel.h>
+
+static size_t Drain(flinter::TimerWheel *wheel)
+{
+    size_t count = 0;
+    while (wheel->PopExpired()) {
+        ++count;
+    }
+
+    return count;
+}
+
+TEST(TimerWheelTest, TestExpire)
+{
+    flinter::TimerWheel wheel(10, 8, 0);
+    flinter::TimerWheel::node_t a;
+    flinter::TimerWheel::node_t b;
+    flinter::TimerWheel::Initialize(&a);
+    flinter::TimerWheel::Initialize(&b);
+    EXPECT_FALSE(flinter::TimerWheel::IsScheduled(&a));
+
+    wheel.Schedule(&a, 25);
+    wheel.Schedule(&b, 40);
+    EXPECT_TRUE(flinter::TimerWheel::IsScheduled(&a));
+
+    // Rounded up, never early.
+    wheel.Advance(29);
+    EXPECT_EQ(0u, Drain(&wheel));
+
+    wheel.Advance(30);
+    EXPECT_EQ(&a, wheel.PopExpired());
+    EXPECT_EQ(NULL, wheel.PopExpired());
+    EXPECT_FALSE(flinter::TimerWheel::IsScheduled(&a));
+
+    wheel.Advance(40);
+    EXPECT_EQ(&b, wheel.PopExpired());
+    EXPECT_EQ(NULL, wheel.PopExpired());
+}
+
+TEST(TimerWheelTest, TestCancel)
+{
+    flinter::TimerWheel wheel(10, 8, 0);
+    flinter::TimerWheel::node_t a;
+    flinter::TimerWheel::node_t b;
+    flinter::TimerWheel::Initialize(&a);
+    flinter::TimerWheel::Initialize(&b);
+
+    wheel.Schedule(&a, 10);
+    wheel.Schedule(&b, 10);
+    flinter::TimerWheel::Cancel(&a);
+    flinter::TimerWheel::Cancel(&a);
+
+    wheel.Advance(10);
+    EXPECT_EQ(&b, wheel.PopExpired());
+    EXPECT_EQ(NULL, wheel.PopExpired());
+
+    // Cancelled after expired but before popped.
+    wheel.Schedule(&a, 20);
+    wheel.Schedule(&b, 20);
+    wheel.Advance(20);
+    flinter::TimerWheel::Cancel(&b);
+    EXPECT_EQ(&a, wheel.PopExpired());
+    EXPECT_EQ(NULL, wheel.PopExpired());
+}
+
+TEST(TimerWheelTest, TestReschedule)
+{
+    flinter::TimerWheel wheel(10, 8, 0);
+    flinter::TimerWheel::node_t a;
+    flinter::TimerWheel::Initialize(&a);
+
+    wheel.Schedule(&a, 20);
+    wheel.Schedule(&a, 50);
+    wheel.Advance(40);
+    EXPECT_EQ(0u, Drain(&wheel));
+    wheel.Advance(50);
+    EXPECT_EQ(&a, wheel.PopExpired());
+
+    // Already due, fires on the next tick.
+    wheel.Schedule(&a, 0);
+    wheel.Advance(59);
+    EXPECT_EQ(0u, Drain(&wheel));
+    wheel.Advance(60);
+    EXPECT_EQ(&a, wheel.PopExpired());
+}
+
+TEST(TimerWheelTest, TestRounds)
+{
+    flinter::TimerWheel wheel(10, 8, 0);
+    flinter::TimerWheel::node_t a;
+    flinter::TimerWheel::node_t b;
+    flinter::TimerWheel::Initialize(&a);
+    flinter::TimerWheel::Initialize(&b);
+
+    // Same slot, different rounds.
+    wheel.Schedule(&a, 10);
+    wheel.Schedule(&b, 90);
+    wheel.Advance(10);
+    EXPECT_EQ(&a, wheel.PopExpired());
+    EXPECT_EQ(NULL, wheel.PopExpired());
+
+    for (int64_t now = 20; now < 90; now += 10) {
+        wheel.Advance(now);
+        EXPECT_EQ(0u, Drain(&wheel));
+    }
+
+    wheel.Advance(90);
+    EXPECT_EQ(&b, wheel.PopExpired());
+}
+
+TEST(TimerWheelTest, TestJump)
+{
+    flinter::TimerWheel wheel(10, 8, 0);
+    flinter::TimerWheel::node_t nodes[32];
+    for (size_t i = 0; i < 32; ++i) {
+        flinter::TimerWheel::Initialize(&nodes[i]);
+        wheel.Schedule(&nodes[i], static_cast<int64_t>(i + 1) * 10);
+    }
+
+    // Far beyond a whole round, everything due at once.
+    wheel.Advance(160);
+    EXPECT_EQ(16u, Drain(&wheel));
+    wheel.Advance(10000);
+    EXPECT_EQ(16u, Drain(&wheel));
+}
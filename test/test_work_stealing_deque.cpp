@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+
+#include <vector>
+
+#include <flinter/types/atomic.h>
+#include <flinter/types/work_stealing_deque.h>
+
+static const int kThieves = 4;
+static const int kItems = 200000;
+
+struct Shared {
+    flinter::WorkStealingDeque<int> deque;
+    flinter::atomic_t done;
+    std::vector<int> taken[kThieves + 1];
+}; // struct Shared
+
+static Shared *g_shared;
+
+static void *Steal(void *arg)
+{
+    std::vector<int> *taken = reinterpret_cast<std::vector<int> *>(arg);
+    while (true) {
+        bool done = !!g_shared->done.BarrierGet();
+        int value;
+        if (g_shared->deque.Steal(&value)) {
+            taken->push_back(value);
+        } else if (done && g_shared->deque.empty()) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+TEST(WorkStealingDequeTest, TestOwner)
+{
+    flinter::WorkStealingDeque<int> d(2);
+    int value;
+    EXPECT_TRUE(d.empty());
+    EXPECT_FALSE(d.Pop(&value));
+    EXPECT_FALSE(d.Steal(&value));
+
+    // Grows.
+    for (int i = 0; i < 100; ++i) {
+        d.Push(i);
+    }
+
+    EXPECT_EQ(100u, d.size());
+    ASSERT_TRUE(d.Steal(&value));
+    EXPECT_EQ(0, value);
+    ASSERT_TRUE(d.Pop(&value));
+    EXPECT_EQ(99, value);
+
+    for (int i = 98; i > 0; --i) {
+        ASSERT_TRUE(d.Pop(&value));
+        EXPECT_EQ(i, value);
+    }
+
+    EXPECT_FALSE(d.Pop(&value));
+    EXPECT_FALSE(d.Steal(&value));
+    EXPECT_TRUE(d.empty());
+}
+
+TEST(WorkStealingDequeTest, TestThieves)
+{
+    Shared shared;
+    g_shared = &shared;
+
+    pthread_t threads[kThieves];
+    for (int i = 0; i < kThieves; ++i) {
+        ASSERT_EQ(0, pthread_create(&threads[i], NULL, Steal, &shared.taken[i]));
+    }
+
+    // Push a few and pop one, so both ends are raced for.
+    std::vector<int> *mine = &shared.taken[kThieves];
+    for (int i = 0; i < kItems; ++i) {
+        shared.deque.Push(i);
+        if (i % 3 == 0) {
+            int value;
+            if (shared.deque.Pop(&value)) {
+                mine->push_back(value);
+            }
+        }
+    }
+
+    int value;
+    while (shared.deque.Pop(&value)) {
+        mine->push_back(value);
+    }
+
+    shared.done.BarrierSet(1);
+    for (int i = 0; i < kThieves; ++i) {
+        ASSERT_EQ(0, pthread_join(threads[i], NULL));
+    }
+
+    // Every item must be taken exactly once.
+    std::vector<int> count(kItems, 0);
+    for (int i = 0; i <= kThieves; ++i) {
+        for (size_t j = 0; j < shared.taken[i].size(); ++j) {
+            ++count[static_cast<size_t>(shared.taken[i][j])];
+        }
+    }
+
+    for (int i = 0; i < kItems; ++i) {
+        ASSERT_EQ(1, count[static_cast<size_t>(i)]) << i;
+    }
+}
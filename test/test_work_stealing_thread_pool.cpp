@@ -0,0 +1,226 @@
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+
+#include <flinter/thread/condition.h>
+#include <flinter/thread/fixed_thread_pool.h>
+#include <flinter/thread/growable_thread_pool.h>
+#include <flinter/thread/keyed_thread_pool.h>
+#include <flinter/thread/mutex.h>
+#include <flinter/thread/mutex_locker.h>
+#include <flinter/thread/work_stealing_thread_pool.h>
+#include <flinter/types/atomic.h>
+#include <flinter/logger.h>
+#include <flinter/msleep.h>
+#include <flinter/runnable.h>
+#include <flinter/utility.h>
+
+typedef flinter::atomic64_t count_t;
+
+class Sleeper : public flinter::Runnable {
+public:
+    Sleeper(count_t *b, count_t *a) : _b(b), _a(a) {}
+    virtual ~Sleeper() {}
+    virtual bool Run()
+    {
+        _b->AddAndFetch(1);
+        msleep(500);
+        _a->AddAndFetch(1);
+        return true;
+    }
+
+private:
+    count_t *_b;
+    count_t *_a;
+
+}; // class Sleeper
+
+// Counts down, wakes up the waiter when it reaches zero.
+class Latch {
+public:
+    explicit Latch(int64_t count) : _count(count) {}
+
+    void CountDown()
+    {
+        if (_count.SubAndFetch(1) == 0) {
+            flinter::MutexLocker locker(&_mutex);
+            _condition.WakeAll();
+        }
+    }
+
+    void Wait()
+    {
+        flinter::MutexLocker locker(&_mutex);
+        while (_count.BarrierGet() > 0) {
+            _condition.Wait(&_mutex);
+        }
+    }
+
+private:
+    count_t _count;
+    flinter::Condition _condition;
+    flinter::Mutex _mutex;
+
+}; // class Latch
+
+// Keyed pools run everything appended without keys in one thread.
+static bool Submit(flinter::AbstractThreadPool *pool, flinter::Runnable *runnable)
+{
+    static count_t key;
+    flinter::KeyedThreadPool *keyed = dynamic_cast<flinter::KeyedThreadPool *>(pool);
+    if (keyed) {
+        size_t k = static_cast<size_t>(key.AddAndFetch(1));
+        return keyed->AppendJobWithKey(k, runnable, true);
+    }
+
+    return pool->AppendJob(runnable, true);
+}
+
+// Spawns two children until the leaves, which count down.
+class Spawner : public flinter::Runnable {
+public:
+    Spawner(flinter::AbstractThreadPool *pool, int depth, Latch *latch)
+            : _pool(pool), _depth(depth), _latch(latch) {}
+
+    virtual ~Spawner() {}
+    virtual bool Run()
+    {
+        if (!_depth) {
+            _latch->CountDown();
+            return true;
+        }
+
+        Submit(_pool, new Spawner(_pool, _depth - 1, _latch));
+        Submit(_pool, new Spawner(_pool, _depth - 1, _latch));
+        return true;
+    }
+
+private:
+    flinter::AbstractThreadPool *const _pool;
+    const int _depth;
+    Latch *const _latch;
+
+}; // class Spawner
+
+class Tiny : public flinter::Runnable {
+public:
+    explicit Tiny(Latch *latch) : _latch(latch) {}
+    virtual ~Tiny() {}
+    virtual bool Run()
+    {
+        _latch->CountDown();
+        return true;
+    }
+
+private:
+    Latch *const _latch;
+
+}; // class Tiny
+
+TEST(WorkStealingThreadPoolTest, TestWait)
+{
+    count_t a, b;
+    flinter::Logger::SetFilter(flinter::Logger::kLevelError);
+    flinter::WorkStealingThreadPool pool;
+    ASSERT_TRUE(pool.Initialize(5));
+    for (size_t i = 0; i < 3; ++i) {
+        ASSERT_TRUE(pool.AppendJob(new Sleeper(&b, &a), true));
+    }
+
+    msleep(200);
+    ASSERT_TRUE(pool.Shutdown(true));
+
+    ASSERT_EQ(a.Get(), 3);
+    ASSERT_EQ(b.Get(), 3);
+}
+
+TEST(WorkStealingThreadPoolTest, TestNoWait)
+{
+    count_t a, b;
+    flinter::Logger::SetFilter(flinter::Logger::kLevelError);
+    flinter::WorkStealingThreadPool pool;
+    ASSERT_TRUE(pool.Initialize(5));
+    for (size_t i = 0; i < 3; ++i) {
+        ASSERT_TRUE(pool.AppendJob(new Sleeper(&b, &a), true));
+    }
+
+    msleep(200);
+    ASSERT_TRUE(pool.Shutdown(false));
+
+    ASSERT_EQ(a.Get(), 0);
+    ASSERT_EQ(b.Get(), 3);
+}
+
+TEST(WorkStealingThreadPoolTest, TestFanOut)
+{
+    flinter::Logger::SetFilter(flinter::Logger::kLevelError);
+    flinter::WorkStealingThreadPool pool;
+    ASSERT_TRUE(pool.Initialize(4));
+
+    // Again after restarting.
+    for (int i = 0; i < 2; ++i) {
+        Latch latch(1 << 12);
+        ASSERT_TRUE(pool.AppendJob(new Spawner(&pool, 12, &latch), true));
+        latch.Wait();
+        ASSERT_TRUE(pool.Shutdown(true));
+        ASSERT_TRUE(pool.Initialize(4));
+    }
+}
+
+static double FanOut(flinter::AbstractThreadPool *pool, int depth)
+{
+    Latch latch(1 << depth);
+    int64_t start = get_monotonic_timestamp();
+    Submit(pool, new Spawner(pool, depth, &latch));
+    latch.Wait();
+
+    // Jobs in total.
+    return static_cast<double>(get_monotonic_timestamp() - start) /
+           static_cast<double>((2 << depth) - 1);
+}
+
+static double ManyTiny(flinter::AbstractThreadPool *pool, int count)
+{
+    Latch latch(count);
+    int64_t start = get_monotonic_timestamp();
+    for (int i = 0; i < count; ++i) {
+        Submit(pool, new Tiny(&latch));
+    }
+
+    latch.Wait();
+    return static_cast<double>(get_monotonic_timestamp() - start) /
+           static_cast<double>(count);
+}
+
+static void Benchmark(const char *name, flinter::AbstractThreadPool *pool)
+{
+    static const size_t kThreads = 4;
+    ASSERT_TRUE(pool->Initialize(kThreads));
+
+    // Warm up.
+    FanOut(pool, 8);
+    double fan_out = FanOut(pool, 14);
+    double many_tiny = ManyTiny(pool, 1 << 15);
+    printf("%-13s fan-out %8.1f ns/job, many tiny %8.1f ns/job\n",
+           name, fan_out, many_tiny);
+
+    ASSERT_TRUE(pool->Shutdown(true));
+}
+
+// Run with --gtest_also_run_disabled_tests.
+TEST(WorkStealingThreadPoolTest, DISABLED_Benchmark)
+{
+    flinter::Logger::SetFilter(flinter::Logger::kLevelError);
+
+    flinter::FixedThreadPool fixed;
+    Benchmark("fixed", &fixed);
+
+    flinter::GrowableThreadPool growable;
+    Benchmark("growable", &growable);
+
+    flinter::KeyedThreadPool keyed;
+    Benchmark("keyed", &keyed);
+
+    flinter::WorkStealingThreadPool stealing;
+    Benchmark("work stealing", &stealing);
+}
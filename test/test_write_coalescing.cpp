@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <flinter/linkage/easy_context.h>
+#include <flinter/linkage/easy_handler.h>
+#include <flinter/linkage/easy_server.h>
+#include <flinter/logger.h>
+
+#include "loopback.h"
+
+// Every "ping" is answered with a header, a body and a trailer, "last" with
+// the same but flushed explicitly, the trailer after the flush.
+class PieceHandler : public flinter::EasyHandler {
+public:
+    virtual bool OnConnected(const flinter::EasyContext &context)
+    {
+        return context.easy_server()->SetWriteCoalescing(context, true, true);
+    }
+
+    virtual ssize_t GetMessageLength(const flinter::EasyContext &,
+                                     const void *, size_t length)
+    {
+        return length >= 4 ? 4 : 0;
+    }
+
+    virtual int OnMessage(const flinter::EasyContext &context,
+                          const void *buffer, size_t)
+    {
+        flinter::EasyServer *server = context.easy_server();
+        if (!server->Send(context, "<", 1) ||
+            !server->Send(context, buffer, 4) ||
+            !server->Send(context, ">", 1)) {
+
+            return -1;
+        }
+
+        if (memcmp(buffer, "last", 4) == 0) {
+            if (!server->Flush(context) ||
+                !server->Send(context, "!", 1)) {
+
+                return -1;
+            }
+        }
+
+        return 1;
+    }
+
+}; // class PieceHandler
+
+class WriteCoalescingTest : public ::testing::TestWithParam<size_t> {
+protected:
+    WriteCoalescingTest() : _port(GetLoopbackPort())
+    {
+        // Intended left blank.
+    }
+
+    virtual void SetUp()
+    {
+        flinter::Logger::SetFilter(flinter::Logger::kLevelError);
+        ASSERT_TRUE(_server.Listen(_port, &_handler));
+        ASSERT_TRUE(_server.Initialize(1, GetParam()));
+    }
+
+    virtual void TearDown()
+    {
+        _server.Shutdown();
+    }
+
+    flinter::EasyServer _server;
+    PieceHandler _handler;
+    uint16_t _port;
+
+}; // class WriteCoalescingTest
+
+TEST_P(WriteCoalescingTest, TestInOrder)
+{
+    int fd = ConnectLoopback(_port);
+    ASSERT_LE(0, fd);
+
+    std::string request;
+    std::string expected;
+    for (int i = 0; i < 100; ++i) {
+        request += "ping";
+        expected += "<ping>";
+    }
+
+    ASSERT_EQ(static_cast<ssize_t>(request.length()),
+              write(fd, request.data(), request.length()));
+
+    EXPECT_EQ(expected, ReceiveLoopback(fd, expected.length()));
+
+    ASSERT_EQ(4, write(fd, "last", 4));
+    EXPECT_EQ("<last>!", ReceiveLoopback(fd, 7));
+    close(fd);
+}
+
+// In the I/O thread, or from a job thread.
+INSTANTIATE_TEST_CASE_P(Workers, WriteCoalescingTest, ::testing::Values(0u, 1u));